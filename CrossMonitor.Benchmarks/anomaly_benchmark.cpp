@@ -0,0 +1,209 @@
+#include "benchmark.hpp"
+
+#include <anomaly.hpp>
+#include <data.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace crossover::monitor;
+
+/**
+ * Replays recorded samples through the anomaly detector and reports
+ * how fast labelled incidents are detected and how often it raises
+ * events outside of them.
+ *
+ * Input (optional): a CSV recording, one sample per line:
+ *   time_ms,cpu_percent,memory_percent,process_count,incident
+ * where incident is 1 for the samples of a labelled incident.
+ * Without one, two weeks of one minute samples with a daily cpu pattern
+ * and injected spike, step, leak and fork storm incidents are generated.
+ */
+
+struct recorded_sample {
+	int64_t time_ms;
+	float cpu_percent;
+	float memory_percent;
+	unsigned process_count;
+	bool incident;
+};
+
+static vector<recorded_sample> generate(unsigned seed) {
+	const double pi = 3.14159265358979323846;
+	const unsigned minutes = 14 * 24 * 60;
+
+	mt19937 random(seed);
+	normal_distribution<float> noise(0.f, 1.f);
+	uniform_int_distribution<unsigned> gap(12 * 60, 36 * 60);
+
+	vector<recorded_sample> res;
+	res.reserve(minutes);
+	// start after a day so that the baselines are warm for the first incident
+	unsigned next_incident = 24 * 60 + gap(random);
+	unsigned incident_kind = 0;
+	unsigned incident_left = 0;
+	unsigned incident_age = 0;
+
+	for (unsigned minute = 0; minute < minutes; ++minute) {
+		const double day = (minute % (24 * 60)) / (24.0 * 60);
+		float cpu = static_cast<float>(40 + 25 * sin(2 * pi * (day - 0.25))) + 3 * noise(random);
+		float memory = 55 + noise(random);
+		float processes = 200 + 2 * noise(random);
+
+		if (minute == next_incident) {
+			incident_kind = (incident_kind + 1) % 4;
+			incident_left = incident_kind == 0 ? 1 : incident_kind == 1 ? 60 : incident_kind == 2 ? 40 : 10;
+			incident_age = 0;
+			next_incident += gap(random);
+		}
+
+		const bool incident = incident_left > 0;
+		if (incident) {
+			switch (incident_kind) {
+			case 0: // spike
+				cpu += 40;
+				break;
+			case 1: // step
+				cpu += 20;
+				break;
+			case 2: // memory leak
+				memory += 0.5f * incident_age;
+				break;
+			case 3: // fork storm
+				processes += 80;
+				break;
+			}
+			--incident_left;
+			++incident_age;
+		}
+
+		recorded_sample sample;
+		sample.time_ms = (16801LL * 24 * 60 + minute) * 60 * 1000;
+		sample.cpu_percent = min(100.f, max(0.f, cpu));
+		sample.memory_percent = min(100.f, max(0.f, memory));
+		sample.process_count = static_cast<unsigned>(max(1.f, processes));
+		sample.incident = incident;
+		res.push_back(sample);
+	}
+	return res;
+}
+
+static vector<recorded_sample> load(const string& path) {
+	ifstream in(path);
+	if (!in) {
+		throw runtime_error("cannot open " + path);
+	}
+
+	vector<recorded_sample> res;
+	string line;
+	while (getline(in, line)) {
+		replace(line.begin(), line.end(), ',', ' ');
+		istringstream fields(line);
+		recorded_sample sample;
+		int incident = 0;
+		if (fields >> sample.time_ms >> sample.cpu_percent >> sample.memory_percent
+			>> sample.process_count >> incident) {
+			sample.incident = incident != 0;
+			res.push_back(sample);
+		}
+	}
+	return res;
+}
+
+static void replay(const string& name, const vector<recorded_sample>& samples, const anomaly_options& options) {
+	// events this many samples after an incident still belong to it
+	const size_t grace = 10;
+
+	anomaly_detector detector(options);
+	data sample;
+
+	vector<size_t> event_indices;
+	chrono::nanoseconds check_time(0);
+	for (size_t i = 0; i < samples.size(); ++i) {
+		sample.set_cpu_percent(samples[i].cpu_percent);
+		sample.set_memory_percent(samples[i].memory_percent);
+		sample.set_process_count(samples[i].process_count);
+		const sample_history::clock::time_point time{ chrono::milliseconds(samples[i].time_ms) };
+
+		const auto start = chrono::steady_clock::now();
+		const bool raised = !detector.check(sample, time).empty();
+		check_time += chrono::steady_clock::now() - start;
+
+		if (raised) {
+			event_indices.push_back(i);
+		}
+	}
+
+	size_t incidents = 0;
+	size_t normal_samples = 0;
+	size_t false_positives = 0;
+	vector<size_t> delays;
+	vector<bool> explained(event_indices.size(), false);
+
+	for (size_t i = 0; i < samples.size();) {
+		if (!samples[i].incident) {
+			++normal_samples;
+			++i;
+			continue;
+		}
+
+		size_t end = i;
+		while (end < samples.size() && samples[end].incident) {
+			++end;
+		}
+		++incidents;
+
+		bool detected = false;
+		for (size_t e = 0; e < event_indices.size(); ++e) {
+			if (event_indices[e] >= i && event_indices[e] < end + grace) {
+				if (!detected) {
+					delays.push_back(event_indices[e] - i);
+					detected = true;
+				}
+				explained[e] = true;
+			}
+		}
+		i = end;
+	}
+	false_positives = count(explained.begin(), explained.end(), false);
+	sort(delays.begin(), delays.end());
+
+	cout << "anomaly/" << name
+		<< " samples=" << samples.size()
+		<< " incidents=" << incidents
+		<< " detected=" << delays.size()
+		<< " delay_p50_samples=" << (delays.empty() ? 0 : delays[delays.size() / 2])
+		<< " delay_max_samples=" << (delays.empty() ? 0 : delays.back())
+		<< " false_positives_per_1k=" << (normal_samples ? 1000.0 * false_positives / normal_samples : 0)
+		<< " check_ns=" << (samples.empty() ? 0 : check_time.count() / static_cast<long long>(samples.size()))
+		<< endl;
+}
+
+static int run_benchmark(int argc, char* argv[]) {
+	try {
+		const vector<recorded_sample> samples = argc > 1 ? load(argv[1]) : generate(42);
+
+		anomaly_options flat;
+		replay("flat", samples, flat);
+
+		anomaly_options seasonal;
+		seasonal.season_buckets = 24;
+		replay("seasonal", samples, seasonal);
+	} catch (const exception& e) {
+		cerr << e.what() << endl;
+		return 1;
+	}
+
+	return 0;
+}
+
+static benchmark::registration registered("anomaly", "[recording.csv]", &run_benchmark);
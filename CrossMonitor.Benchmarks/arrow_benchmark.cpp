@@ -0,0 +1,131 @@
+#include "benchmark.hpp"
+
+#include <arrow_ipc.hpp>
+#include <data.hpp>
+
+#include <cpprest/json.h>
+
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <streambuf>
+#include <string>
+
+using namespace std;
+using namespace crossover::monitor;
+
+/**
+ * Cost of exporting samples for analysis: appending a sample to the
+ * Arrow columns and writing them as record batches, against serializing
+ * it into the JSON line the logs hold. The fixture is a sample of a host
+ * with four volumes, changing every time.
+ *
+ * With a directory, the samples are written there as samples.arrow and
+ * samples.jsonl, for arrow_load_benchmark.py to time loading them into a
+ * dataframe; without one they are counted and dropped.
+ *
+ * Usage: arrow_benchmark [samples] [directory]
+ */
+
+namespace {
+
+	/**
+	 * Counts what is written to it and drops it.
+	 */
+	class counting_buffer final : public streambuf {
+	public:
+		counting_buffer()
+			: count_(0) {
+		}
+
+		uint64_t count() const noexcept {
+			return count_;
+		}
+
+	protected:
+		int_type overflow(int_type c) override {
+			++count_;
+			return traits_type::not_eof(c);
+		}
+
+		streamsize xsputn(const char*, streamsize n) override {
+			count_ += static_cast<uint64_t>(n);
+			return n;
+		}
+
+	private:
+		uint64_t count_;
+	}; //class counting_buffer
+
+	void next_sample(data& sample, unsigned n) {
+		sample.set_cpu_percent(static_cast<float>(n % 1000) / 10.f);
+		sample.set_memory_percent(static_cast<float>(n % 97));
+		sample.set_process_count(200 + n % 50);
+		IO_stats& io_stats = sample.get_io_stats_for_edit();
+		for (size_t i = 0; i < io_stats.size(); ++i) {
+			io_stats[i].bytes_read = (n * 4096 + static_cast<unsigned>(i)) % 4000000000u;
+			io_stats[i].bytes_written = (n * 512 + static_cast<unsigned>(i)) % 4000000000u;
+		}
+	}
+
+} //namespace
+
+static int run_benchmark(int argc, char* argv[]) {
+	const size_t samples = argc > 1 ? stoul(argv[1]) : 200000;
+	const string directory = argc > 2 ? argv[2] : string();
+
+	counting_buffer arrow_count;
+	counting_buffer json_count;
+	filebuf arrow_file;
+	filebuf json_file;
+	if (!directory.empty()) {
+		if (!arrow_file.open(directory + "/samples.arrow", ios::out | ios::binary) ||
+			!json_file.open(directory + "/samples.jsonl", ios::out | ios::binary)) {
+			cerr << "arrow_benchmark: cannot write to " << directory << endl;
+			return EXIT_FAILURE;
+		}
+	}
+	ostream arrow_out(directory.empty() ? static_cast<streambuf*>(&arrow_count) : &arrow_file);
+	ostream json_out(directory.empty() ? static_cast<streambuf*>(&json_count) : &json_file);
+
+	data sample(0.f, 0.f, 1, { { 0, 0, L'C' }, { 0, 0, L'D' }, { 0, 0, L'E' }, { 0, 0, L'F' } });
+	const int64_t start_ms = 1700000000000;
+
+	uint64_t arrow_rows = 0;
+	{
+		arrow_writer writer(arrow_out);
+		benchmark::measure("arrow/append", samples, 64, [&]() {
+			next_sample(sample, static_cast<unsigned>(arrow_rows));
+			writer.append(sample, start_ms + static_cast<int64_t>(arrow_rows) * 1000);
+			++arrow_rows;
+		});
+		writer.close();
+	}
+
+	uint64_t json_rows = 0;
+	benchmark::measure("arrow/json_line", samples, 64, [&]() {
+		next_sample(sample, static_cast<unsigned>(json_rows));
+		json_out << utility::conversions::to_utf8string(sample.to_json().serialize()) << '\n';
+		++json_rows;
+	});
+	json_out.flush();
+
+	const uint64_t arrow_bytes = directory.empty() ? arrow_count.count() :
+		static_cast<uint64_t>(arrow_file.pubseekoff(0, ios::cur, ios::out));
+	const uint64_t json_bytes = directory.empty() ? json_count.count() :
+		static_cast<uint64_t>(json_file.pubseekoff(0, ios::cur, ios::out));
+	cout << "arrow/size"
+		<< " samples=" << arrow_rows
+		<< " arrow_bytes_per_sample=" << static_cast<double>(arrow_bytes) / arrow_rows
+		<< " json_bytes_per_sample=" << static_cast<double>(json_bytes) / json_rows
+		<< endl;
+
+	if (arrow_rows == 0 || arrow_bytes == 0 || json_bytes == 0) {
+		cerr << "arrow_benchmark: unexpected results" << endl;
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
+
+static benchmark::registration registered("arrow", "[samples] [directory]", &run_benchmark);
@@ -0,0 +1,90 @@
+#!/usr/bin/env python3
+"""Times loading the sample history into a dataframe, Arrow against JSON.
+
+Runs the arrow benchmark of CrossMonitor.Benchmarks to write --samples
+samples to the work directory as samples.arrow and samples.jsonl, then
+loads each into a table:
+  arrow  pyarrow.feather.read_table() of samples.arrow
+  json   json.loads() of every line of samples.jsonl, then a table of the
+         records, as a script reading the logs does
+
+Prints one line per load in the format of the benchmark target, e.g.
+  arrow_load/arrow samples=10000000 load_ms=850 per_sample_ns=85
+
+Usage:
+  arrow_load_benchmark.py [--build _build] [--samples 10000000]
+                          [--work arrow_load] [--keep]
+
+Needs pyarrow (pip install pyarrow), and is skipped with exit code 0 when
+it is not installed. 10 million samples take about 3 GB in samples.jsonl
+and several GB of memory for the JSON load.
+"""
+
+import argparse
+import json
+import os
+import shutil
+import subprocess
+import sys
+import time
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+sys.path.insert(0, HERE)
+from pgo_build import executable, run  # noqa: E402
+
+try:
+    import pyarrow
+    import pyarrow.feather
+except ImportError:
+    pyarrow = None
+
+
+def load_arrow(path):
+    return pyarrow.feather.read_table(path)
+
+
+def load_json(path):
+    with open(path) as f:
+        records = [json.loads(line) for line in f]
+    return pyarrow.Table.from_pylist(records)
+
+
+def report(name, samples, seconds):
+    print('arrow_load/%s samples=%d load_ms=%.0f per_sample_ns=%.1f' % (
+        name, samples, seconds * 1e3, seconds * 1e9 / samples), flush=True)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('--build', default='_build', help='build directory of CrossMonitor.Benchmarks')
+    parser.add_argument('--samples', type=int, default=10000000, help='samples written (default 10000000)')
+    parser.add_argument('--work', default='arrow_load', help='directory of the files (default arrow_load)')
+    parser.add_argument('--keep', action='store_true', help='keep the files')
+    args = parser.parse_args()
+
+    if pyarrow is None:
+        print('arrow_load: skipped, pyarrow is not installed (pip install pyarrow)')
+        return 0
+
+    work = os.path.abspath(args.work)
+    os.makedirs(work, exist_ok=True)
+    try:
+        run([executable(os.path.abspath(args.build), 'CrossMonitor.Benchmarks'),
+             'arrow', str(args.samples), work])
+
+        start = time.perf_counter()
+        table = load_arrow(os.path.join(work, 'samples.arrow'))
+        report('arrow', table.num_rows, time.perf_counter() - start)
+        del table
+
+        start = time.perf_counter()
+        table = load_json(os.path.join(work, 'samples.jsonl'))
+        report('json', table.num_rows, time.perf_counter() - start)
+    finally:
+        if not args.keep:
+            shutil.rmtree(work, ignore_errors=True)
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,200 @@
+#include "benchmark.hpp"
+
+#if defined(__linux__)
+
+#include <file_batch_reader.hpp>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace crossover::monitor;
+
+/**
+ * Cost of reading many small files on every sample, as a per process
+ * collector reads /proc/<pid>/stat of every process: opening, reading and
+ * closing each file, then file_batch_reader with pread and with io_uring.
+ * Runs on files of a temporary directory, which compare across hosts, then
+ * on /proc/<pid>/stat of the processes of this host. Besides the time of
+ * one read of all files, reports the system calls per 1000 files read.
+ *
+ * Usage: batch_read_benchmark [files] [calls]
+ */
+
+namespace {
+
+	/**
+	 * Temporary directory of files holding a /proc/<pid>/stat like line,
+	 * removed with the object.
+	 */
+	class fixture final {
+	public:
+		explicit fixture(size_t files) {
+			char directory[] = "/tmp/crossmonitor_batch_read_XXXXXX";
+			if (!mkdtemp(directory)) {
+				throw runtime_error("Failed to create a temporary directory");
+			}
+			directory_ = directory;
+			for (size_t i = 0; i < files; ++i) {
+				const string path = directory_ + "/" + to_string(i);
+				const string line = to_string(i + 1000) + " (worker) S 1 " + to_string(i + 1000)
+					+ " 0 -1 4194560 1829 0 12 0 1823 912 0 0 20 0 4 0 1928371 182736128 4821"
+					" 18446744073709551615 1 1 0 0 0 0 0 4096 17638 0 0 0 17 3 0 0 0 0 0\n";
+				FILE* out = fopen(path.c_str(), "w");
+				if (!out) {
+					throw runtime_error("Failed to create " + path);
+				}
+				fwrite(line.data(), 1, line.size(), out);
+				fclose(out);
+				paths_.push_back(path);
+			}
+		}
+
+		~fixture() {
+			for (const auto& path : paths_) {
+				unlink(path.c_str());
+			}
+			rmdir(directory_.c_str());
+		}
+
+		const vector<string>& paths() const {
+			return paths_;
+		}
+
+	private:
+		string directory_;
+		vector<string> paths_;
+	}; //class fixture
+
+	vector<string> process_stat_paths() {
+		vector<string> res;
+		DIR* proc = opendir("/proc");
+		if (!proc) {
+			return res;
+		}
+		while (const dirent* entry = readdir(proc)) {
+			if (isdigit(static_cast<unsigned char>(entry->d_name[0]))) {
+				res.push_back(string("/proc/") + entry->d_name + "/stat");
+			}
+		}
+		closedir(proc);
+		return res;
+	}
+
+	/**
+	 * Raises the open file limit to hold the given number of files,
+	 * as far as the hard limit allows.
+	 */
+	size_t open_file_limit(size_t files) {
+		rlimit limit;
+		if (getrlimit(RLIMIT_NOFILE, &limit) != 0) {
+			return files;
+		}
+		// the standard streams and whatever else the process holds
+		const rlim_t wanted = files + 64;
+		if (limit.rlim_cur < wanted) {
+			limit.rlim_cur = limit.rlim_max == RLIM_INFINITY ? wanted : min<rlim_t>(wanted, limit.rlim_max);
+			setrlimit(RLIMIT_NOFILE, &limit);
+			getrlimit(RLIMIT_NOFILE, &limit);
+		}
+		return limit.rlim_cur < wanted ? static_cast<size_t>(limit.rlim_cur > 64 ? limit.rlim_cur - 64 : 0) : files;
+	}
+
+	void report_system_calls(const string& name, uint64_t system_calls, size_t files, size_t reads) {
+		cout << name << "/syscalls"
+			<< " syscalls_per_1k=" << (files > 0 && reads > 0 ? 1000.0 * system_calls / files / reads : 0)
+			<< endl;
+	}
+
+	/**
+	 * Measures every way of reading the files.
+	 * @return false if a way read nothing.
+	 */
+	bool run_files(const string& name, const vector<string>& paths, size_t calls) {
+		const string suffix = name + "/" + to_string(paths.size());
+		char buffer[4096];
+		uint64_t plain_bytes = 0;
+		benchmark::measure("batch_read/open_read_close/" + suffix, calls, 1, [&]() {
+			for (const auto& path : paths) {
+				const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+				if (fd >= 0) {
+					const ssize_t res = read(fd, buffer, sizeof(buffer));
+					plain_bytes += res > 0 ? res : 0;
+					close(fd);
+				}
+			}
+		});
+		report_system_calls("batch_read/open_read_close/" + suffix, 3 * paths.size() * calls, paths.size(), calls);
+
+		bool res = true;
+		for (const bool use_io_uring : { false, true }) {
+			client::os::file_batch_reader reader(use_io_uring);
+			for (const auto& path : paths) {
+				try {
+					reader.add(path, 512);
+				} catch (const exception&) {
+					// a process that exited
+				}
+			}
+			reader.read();
+			if (use_io_uring && !reader.uses_io_uring()) {
+				cout << "# batch_read: io_uring not available, skipped" << endl;
+				break;
+			}
+
+			const string way = use_io_uring ? "io_uring/" : "pread/";
+			const uint64_t before = reader.system_calls();
+			size_t files_read = 0;
+			benchmark::measure("batch_read/" + way + suffix, calls, 1, [&]() {
+				files_read += reader.read();
+			});
+			report_system_calls("batch_read/" + way + suffix, reader.system_calls() - before, reader.size(), calls);
+			res = res && files_read > 0;
+		}
+		return res && plain_bytes > 0;
+	}
+
+} //namespace
+
+static int run_benchmark(int argc, char* argv[]) {
+	size_t files = argc > 1 ? stoul(argv[1]) : 10000;
+	const size_t calls = argc > 2 ? stoul(argv[2]) : 20;
+
+	const size_t limit = open_file_limit(files);
+	if (limit < files) {
+		cout << "# batch_read: open file limit allows " << limit << " of " << files << " files" << endl;
+		files = limit;
+	}
+
+	bool res;
+	{
+		const fixture f(files);
+		res = run_files("tmp", f.paths(), calls);
+	}
+	vector<string> processes = process_stat_paths();
+	if (processes.size() > files) {
+		processes.resize(files);
+	}
+	res = run_files("proc_stat", processes, calls) && res;
+
+	if (!res) {
+		cerr << "batch_read_benchmark: nothing read" << endl;
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
+
+static benchmark::registration registered("batch_read", "[files] [calls]", &run_benchmark);
+
+#endif
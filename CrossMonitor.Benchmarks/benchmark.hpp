@@ -0,0 +1,129 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+/**
+ * Every benchmark prints its results to stdout, one line per measurement:
+ * a name followed by space separated key=value pairs. Keys ending in _ns
+ * or _samples are costs, keys ending in _per_s are rates; see
+ * compare_benchmarks.py. Anything else a benchmark wants to say goes to
+ * stderr or to a line starting with '#'.
+ */
+
+namespace crossover {
+namespace monitor {
+namespace benchmark {
+
+	/**
+	 * Entry point of one benchmark, called with its own arguments
+	 * (argv[0] is the benchmark name).
+	 */
+	typedef int (*entry_point)(int argc, char* argv[]);
+
+	struct entry {
+		const char* name;
+		const char* usage;
+		entry_point run;
+	};
+
+	/**
+	 * Benchmarks linked into the executable, see registration.
+	 */
+	inline std::vector<entry>& registry() {
+		static std::vector<entry> entries;
+		return entries;
+	}
+
+	/**
+	 * Adds a benchmark to the registry, define one per benchmark at namespace scope:
+	 *   static benchmark::registration reg("log", "[calls] [pause_us]", &run_benchmark);
+	 */
+	class registration final {
+	public:
+		registration(const char* name, const char* usage, entry_point run) {
+			registry().push_back(entry{ name, usage, run });
+		}
+	}; //class registration
+
+	/**
+	 * Collects per-call latencies and reports their distribution.
+	 * Storage is reserved up front so that recording does not
+	 * disturb the measured code.
+	 */
+	class latency_recorder final {
+	public:
+		explicit latency_recorder(std::size_t expected_samples) {
+			samples_.reserve(expected_samples);
+		}
+
+		void add(const std::chrono::nanoseconds& latency) {
+			samples_.push_back(latency.count());
+		}
+
+		/**
+		 * Adds the latencies recorded by another thread.
+		 */
+		void add(const latency_recorder& other) {
+			samples_.insert(samples_.end(), other.samples_.begin(), other.samples_.end());
+		}
+
+		/**
+		 * Gets the latency below which the given fraction of calls fell.
+		 * @param fraction 0 to 1, e.g. 0.99 for p99.
+		 */
+		std::int64_t percentile(double fraction) {
+			if (samples_.empty()) {
+				return 0;
+			}
+			const std::size_t index = std::min(samples_.size() - 1,
+				static_cast<std::size_t>(fraction * samples_.size()));
+			std::nth_element(samples_.begin(), samples_.begin() + index, samples_.end());
+			return samples_[index];
+		}
+
+		/**
+		 * Prints one result line: name, call count, p50, p99, p99.9 and max in ns.
+		 */
+		void report(const std::string& name, std::ostream& out = std::cout) {
+			out << name
+				<< " calls=" << samples_.size()
+				<< " p50_ns=" << percentile(0.5)
+				<< " p99_ns=" << percentile(0.99)
+				<< " p999_ns=" << percentile(0.999)
+				<< " max_ns=" << percentile(1.0)
+				<< std::endl;
+		}
+
+	private:
+		std::vector<std::int64_t> samples_;
+	}; //class latency_recorder
+
+	/**
+	 * Calls f calls times and reports the latency per call as name.
+	 * The clock is read once per batch of calls and the batch mean is
+	 * recorded, so that calls cheaper than the clock itself still
+	 * measure (calls= in the report then counts batches); use a batch
+	 * of 1 for calls that block.
+	 */
+	template <class F>
+	void measure(const std::string& name, std::size_t calls, std::size_t batch, F f) {
+		latency_recorder recorder(calls / batch + 1);
+		for (std::size_t done = 0; done < calls; done += batch) {
+			const auto start = std::chrono::steady_clock::now();
+			for (std::size_t i = 0; i < batch; ++i) {
+				f();
+			}
+			recorder.add((std::chrono::steady_clock::now() - start) / batch);
+		}
+		recorder.report(name);
+	}
+
+} //namespace benchmark
+} //namespace monitor
+} //namespace crossover
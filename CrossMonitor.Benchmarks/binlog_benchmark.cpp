@@ -0,0 +1,68 @@
+#include "benchmark.hpp"
+
+#include <log.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+using namespace std;
+using namespace crossover::monitor;
+
+#define LOG CROSSOVER_MONITOR_LOG
+#define LOGF CROSSOVER_MONITOR_LOGF
+
+/**
+ * Size and throughput of the text and the binary file log for the same
+ * stream of records: a sample-shaped structured record followed by a
+ * plain message, like the sampler and the os layer produce.
+ * Throughput is measured from the first LOG call until log::shutdown()
+ * returns, so it includes draining the queue and writing the file.
+ */
+static void run(const string& name, bool binary, size_t calls) {
+	const string file = "binlog_benchmark_" + name + ".log";
+
+	log::options opts;
+	opts.asynchronous = true;
+	opts.console = false;
+	opts.overflow = log::overflow_policy::block;
+	log::init(opts);
+	if (binary) {
+		log::set_binary_file(file);
+	} else {
+		log::set_file(file);
+	}
+
+	const auto start = chrono::steady_clock::now();
+	for (size_t i = 0; i < calls / 2; ++i) {
+		LOGF(info, "cpu_percent=%1% memory_percent=%2% process_count=%3% volume=%4% bytes_read=%5% bytes_written=%6%",
+			 12.5f + (i % 50), 55.1f, 312 + (i % 7), "C", 1123 * i, 3321 * i);
+		LOG(info) << "Data sent successfully to http://localhost:8080/ #" << i;
+	}
+	log::shutdown();
+	const chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+
+	ifstream in(file, ios::binary | ios::ate);
+	const double bytes = static_cast<double>(in.tellg());
+	in.close();
+	remove(file.c_str());
+
+	cout << "log_file/" << name
+		 << " records=" << calls
+		 << " bytes_per_record=" << bytes / calls
+		 << " records_per_s=" << static_cast<uint64_t>(calls / elapsed.count())
+		 << endl;
+}
+
+static int run_benchmark(int argc, char* argv[]) {
+	const size_t calls = argc > 1 ? stoul(argv[1]) : 200000;
+
+	run("text", false, calls);
+	run("binary", true, calls);
+
+	return 0;
+}
+
+static benchmark::registration registered("binlog", "[calls]", &run_benchmark);
@@ -0,0 +1,135 @@
+#include "benchmark.hpp"
+
+#include <procfs.hpp>
+#include <snapshot.hpp>
+#include <data.hpp>
+#include <os.hpp>
+
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+using namespace std;
+using namespace crossover::monitor;
+
+/**
+ * Cost of one sample of the collector on this host, read like the
+ * application does, then of the procfs parsers and the snapshot decoder on
+ * fixture text from a 64 CPU host with a dozen disks, which compares across
+ * hosts.
+ *
+ * Usage: collect_benchmark [calls]
+ */
+
+namespace {
+
+	string fixture_stat() {
+		ostringstream out;
+		out << "cpu  48391220 12410 9182733 981723123 1823411 0 382711 0 0 0\n";
+		for (int i = 0; i < 64; ++i) {
+			out << "cpu" << i << " 756112 193 143480 15339423 28490 0 5979 0 0 0\n";
+		}
+		out << "intr 3829182733 21 9 0 0 0 0 0 0 1 0 0 0 144 0 0 0 0 0 0 0 0 0 0 0\n"
+			<< "ctxt 8817263123\n"
+			<< "btime 1451606400\n"
+			<< "processes 18273612\n"
+			<< "procs_running 3\n"
+			<< "procs_blocked 0\n"
+			<< "softirq 1928371623 0 381723 9812 192837 0 0 2837 918273 0 19283\n";
+		return out.str();
+	}
+
+	string fixture_meminfo() {
+		static const char* const names[] = {
+			"MemTotal", "MemFree", "MemAvailable", "Buffers", "Cached", "SwapCached",
+			"Active", "Inactive", "Active(anon)", "Inactive(anon)", "Active(file)",
+			"Inactive(file)", "Unevictable", "Mlocked", "SwapTotal", "SwapFree",
+			"Dirty", "Writeback", "AnonPages", "Mapped", "Shmem", "KReclaimable",
+			"Slab", "SReclaimable", "SUnreclaim", "KernelStack", "PageTables",
+			"NFS_Unstable", "Bounce", "WritebackTmp", "CommitLimit", "Committed_AS",
+			"VmallocTotal", "VmallocUsed", "VmallocChunk", "Percpu", "HardwareCorrupted",
+			"AnonHugePages", "ShmemHugePages", "ShmemPmdMapped", "FileHugePages",
+			"FilePmdMapped", "HugePages_Total", "HugePages_Free", "HugePages_Rsvd",
+			"HugePages_Surp", "Hugepagesize", "Hugetlb", "DirectMap4k", "DirectMap2M"
+		};
+		ostringstream out;
+		unsigned long long value = 263842112;
+		for (const char* name : names) {
+			const size_t length = string(name).size();
+			out << name << ":" << string(length < 16 ? 16 - length : 1, ' ') << value << " kB\n";
+			value = value * 7 / 11 + 1;
+		}
+		return out.str();
+	}
+
+	string fixture_diskstats() {
+		ostringstream out;
+		for (int i = 0; i < 8; ++i) {
+			out << "   7       " << i << " loop" << i << " 44 0 2110 12 0 0 0 0 0 24 12 0 0 0 0 0 0\n";
+		}
+		for (int disk = 0; disk < 12; ++disk) {
+			const string name = disk < 4 ? "nvme" + to_string(disk) + "n1" : string("sd") + static_cast<char>('a' + disk - 4);
+			const string part = disk < 4 ? name + "p" : name;
+			out << " 259       " << disk * 8 << " " << name
+				<< " 9182731 182 981723123 1827361 19283712 9182 1928371623 8172631 0 2837162 9283712 0 0 0 0 0 0\n";
+			for (int p = 1; p <= 3; ++p) {
+				out << " 259       " << disk * 8 + p << " " << part << p
+					<< " 3060910 60 327241041 609120 6427904 3060 642790541 2724210 0 945720 3094570 0 0 0 0 0 0\n";
+			}
+		}
+		out << " 253       0 dm-0 9182731 0 981723123 1827361 19283712 0 1928371623 8172631 0 2837162 9283712 0 0 0 0 0 0\n";
+		return out.str();
+	}
+
+} //namespace
+
+static int run_benchmark(int argc, char* argv[]) {
+	const size_t calls = argc > 1 ? stoul(argv[1]) : 2000;
+
+	counter_snapshot snapshot;
+	unsigned processes = 0;
+
+	client::os::collector collector;
+	data collected;
+	// the first sample waits out the bootstrap interval
+	collector.collect(collected);
+	benchmark::measure("collect/sample", calls, 1, [&]() {
+		collector.collect(collected);
+		processes += collected.get_process_count();
+	});
+
+	const string stat = fixture_stat();
+	const string meminfo = fixture_meminfo();
+	const string diskstats = fixture_diskstats();
+	benchmark::measure("collect/parse_stat", calls * 10, 16, [&]() {
+		procfs::parse_stat(stat, snapshot);
+	});
+	benchmark::measure("collect/parse_meminfo", calls * 10, 16, [&]() {
+		procfs::parse_meminfo(meminfo, snapshot);
+	});
+	benchmark::measure("collect/parse_diskstats", calls * 10, 16, [&]() {
+		procfs::parse_diskstats(diskstats, snapshot);
+	});
+
+	snapshot.process_count = 312;
+	counter_snapshot later = snapshot;
+	snapshot_decoder decoder;
+	data sample;
+	decoder.decode(snapshot, sample);
+	benchmark::measure("collect/decode", calls * 10, 16, [&]() {
+		later.time_ms += 1000;
+		later.cpu_total += 6400;
+		later.cpu_busy += 1600;
+		later.volumes[0].bytes_read += 4096;
+		decoder.decode(later, sample);
+	});
+
+	if (processes == 0 || snapshot.volumes.size() != 12) {
+		cerr << "collect_benchmark: unexpected results" << endl;
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
+
+static benchmark::registration registered("collect", "[calls]", &run_benchmark);
@@ -0,0 +1,109 @@
+#!/usr/bin/env python3
+"""Compares CrossMonitor.Benchmarks results against a stored baseline.
+
+Both files hold the benchmark output: one line per measurement, a name
+followed by key=value pairs; lines starting with '#' and lines without
+any pair (log records) are ignored.
+Keys ending in _ns, _samples, _per_record or _per_1k are costs (lower is
+better), keys ending in _per_s are rates (higher is better); other keys
+are not compared. p999_ns and max_ns are skipped by default as they are
+mostly scheduler noise.
+
+Usage:
+  compare_benchmarks.py baseline.txt results.txt [--threshold 10]
+  compare_benchmarks.py baseline.txt results.txt --update
+
+Exits with 1 if any compared value regressed by more than the threshold
+(percent), with 2 if the baseline is missing.
+"""
+
+import argparse
+import re
+import shutil
+import sys
+
+COST = re.compile(r'(_ns|_samples|_per_record|_per_1k)$')
+RATE = re.compile(r'_per_s$')
+
+
+def load(path):
+    results = {}
+    with open(path) as f:
+        for line in f:
+            fields = line.split()
+            if not fields or fields[0].startswith('#'):
+                continue
+            values = {}
+            for field in fields[1:]:
+                key, sep, value = field.partition('=')
+                if not sep:
+                    continue
+                try:
+                    values[key] = float(value)
+                except ValueError:
+                    pass
+            if values:
+                results[fields[0]] = values
+    return results
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('baseline')
+    parser.add_argument('results')
+    parser.add_argument('--threshold', type=float, default=10.0,
+                        help='regression in percent that fails the comparison (default 10)')
+    parser.add_argument('--noise-ns', type=float, default=20.0,
+                        help='cost differences below this many ns never fail (default 20)')
+    parser.add_argument('--skip', default=r'^(p999_ns|max_ns)$',
+                        help='regex of keys not to compare')
+    parser.add_argument('--update', action='store_true',
+                        help='store the results as the new baseline')
+    args = parser.parse_args()
+
+    if args.update:
+        shutil.copyfile(args.results, args.baseline)
+        print('baseline updated: ' + args.baseline)
+        return 0
+
+    try:
+        baseline = load(args.baseline)
+    except IOError:
+        print('no baseline at %s, store one with --update' % args.baseline)
+        return 2
+    results = load(args.results)
+    skip = re.compile(args.skip)
+
+    regressions = 0
+    print('%-40s %-24s %14s %14s %8s' % ('benchmark', 'key', 'baseline', 'current', 'change'))
+    for name in sorted(results):
+        if name not in baseline:
+            print('%-40s new' % name)
+            continue
+        for key, current in sorted(results[name].items()):
+            cost = COST.search(key)
+            if not (cost or RATE.search(key)) or skip.search(key) or key not in baseline[name]:
+                continue
+            before = baseline[name][key]
+            if before == 0:
+                change = 0.0 if current == 0 else float('inf')
+            else:
+                change = 100.0 * (current - before) / before
+            worse = change if cost else -change
+            regressed = worse > args.threshold
+            if regressed and cost and key.endswith('_ns') and current - before < args.noise_ns:
+                regressed = False
+            mark = '  REGRESSION' if regressed else ''
+            regressions += regressed
+            print('%-40s %-24s %14.1f %14.1f %+7.1f%%%s' % (name, key, before, current, change, mark))
+    for name in sorted(set(baseline) - set(results)):
+        print('%-40s missing' % name)
+
+    if regressions:
+        print('%d regression(s) beyond %.1f%%' % (regressions, args.threshold))
+        return 1
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,95 @@
+#include "benchmark.hpp"
+
+#include <data.hpp>
+#include <log.hpp>
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+using namespace std;
+using namespace crossover::monitor;
+
+#define LOG CROSSOVER_MONITOR_LOG
+
+/**
+ * Cost of what happens to every sample once it is collected: the
+ * validating setters, to_json, serialize and the log record the default
+ * handler writes. The fixture is a sample of a host with four volumes.
+ *
+ * Usage: data_benchmark [calls]
+ */
+
+namespace {
+
+	data fixture() {
+		return data(37.5f, 61.25f, 312, {
+			{ 1123456, 3321987, L'C' },
+			{ 0, 409600, L'D' },
+			{ 88888, 0, L'E' },
+			{ 4000000000u, 4000000000u, L'F' } });
+	}
+
+} //namespace
+
+static int run_benchmark(int argc, char* argv[]) {
+	const size_t calls = argc > 1 ? stoul(argv[1]) : 200000;
+
+	data sample = fixture();
+	const IO_stats io_stats = sample.get_io_stats();
+	unsigned n = 0;
+
+	benchmark::measure("data/set_scalars", calls, 64, [&]() {
+		++n;
+		sample.set_cpu_percent(static_cast<float>(n % 100));
+		sample.set_memory_percent(static_cast<float>(n % 97));
+		sample.set_process_count(200 + n % 50);
+	});
+
+	benchmark::measure("data/set_io_stats", calls, 64, [&]() {
+		sample.set_io_stats(io_stats);
+	});
+
+	size_t rejected = 0;
+	benchmark::measure("data/set_rejected", calls / 10, 16, [&]() {
+		try {
+			sample.set_cpu_percent(150.f);
+		} catch (const invalid_argument&) {
+			++rejected;
+		}
+	});
+
+	sample = fixture();
+	size_t fields = 0;
+	benchmark::measure("data/to_json", calls, 16, [&]() {
+		fields += sample.to_json().size();
+	});
+
+	const web::json::value json = sample.to_json();
+	size_t chars = 0;
+	benchmark::measure("data/serialize", calls, 16, [&]() {
+		chars += json.serialize().size();
+	});
+
+	// what application::collectedDataDefaultHandler does, into a file
+	const string file = "data_benchmark.log";
+	log::options opts;
+	opts.console = false;
+	log::init(opts);
+	log::set_file(file);
+	benchmark::measure("data/log_record", calls / 10, 1, [&]() {
+		LOG(info) << sample.to_json().serialize();
+	});
+	log::shutdown();
+	remove(file.c_str());
+
+	if (rejected == 0 || fields == 0 || chars == 0) {
+		cerr << "data_benchmark: unexpected results" << endl;
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
+
+static benchmark::registration registered("data", "[calls]", &run_benchmark);
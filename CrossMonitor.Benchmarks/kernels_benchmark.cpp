@@ -0,0 +1,75 @@
+#include "benchmark.hpp"
+
+#include <counter_kernels.hpp>
+
+#include <cstdint>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace crossover::monitor;
+
+/**
+ * Cost of one call of each counter kernel with every instruction set the
+ * CPU supports, from a handful of counters (the volumes of a host) to
+ * thousands (per process counters). Calls are repeated so that every
+ * width does about the same work.
+ *
+ * Usage: kernels_benchmark [counters_per_width]
+ */
+
+static int run_benchmark(int argc, char* argv[]) {
+	const size_t work = argc > 1 ? stoul(argv[1]) : 4000000;
+	const size_t widths[] = { 4, 16, 64, 256, 1024, 4096 };
+	const kernels::isa sets[] = { kernels::isa::scalar, kernels::isa::sse2, kernels::isa::avx2 };
+
+	const size_t largest = widths[sizeof(widths) / sizeof(widths[0]) - 1];
+	mt19937_64 random(42);
+	vector<uint64_t> before(largest), after(largest), moved(largest);
+	for (size_t i = 0; i < largest; ++i) {
+		before[i] = random() >> 8;
+		// a few counters reset
+		after[i] = i % 97 ? before[i] + (random() >> 40) : before[i] / 2;
+	}
+	vector<double> per_second(largest);
+	vector<float> percent(largest);
+	vector<unsigned> narrowed(largest);
+
+	const kernels::isa initial = kernels::active();
+	for (kernels::isa set : sets) {
+		if (!kernels::supported(set)) {
+			continue;
+		}
+		kernels::select(set);
+		const string prefix = string("kernels/") + kernels::name(set) + "/";
+
+		for (size_t width : widths) {
+			const size_t calls = work / width;
+			const size_t batch = width < 256 ? 16 : 1;
+			const string suffix = "/" + to_string(width);
+
+			benchmark::measure(prefix + "deltas" + suffix, calls, batch, [&]() {
+				kernels::deltas(before.data(), after.data(), moved.data(), width);
+			});
+			benchmark::measure(prefix + "deltas32" + suffix, calls, batch, [&]() {
+				kernels::deltas(before.data(), after.data(), moved.data(), width, 32);
+			});
+			benchmark::measure(prefix + "rates" + suffix, calls, batch, [&]() {
+				kernels::rates(moved.data(), 60.0, per_second.data(), width);
+			});
+			benchmark::measure(prefix + "percentages" + suffix, calls, batch, [&]() {
+				kernels::percentages(moved.data(), after.data(), percent.data(), width);
+			});
+			benchmark::measure(prefix + "saturate" + suffix, calls, batch, [&]() {
+				kernels::saturate(after.data(), narrowed.data(), width);
+			});
+		}
+	}
+	kernels::select(initial);
+
+	return EXIT_SUCCESS;
+}
+
+static benchmark::registration registered("kernels", "[counters_per_width]", &run_benchmark);
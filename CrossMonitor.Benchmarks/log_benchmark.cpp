@@ -0,0 +1,79 @@
+#include "benchmark.hpp"
+
+#include <log.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+
+using namespace std;
+using namespace crossover::monitor;
+
+#define LOG CROSSOVER_MONITOR_LOG
+
+/**
+ * Latency of a single LOG call on the calling (sampling) thread,
+ * with the synchronous sinks and with the asynchronous drain thread.
+ * The call pattern mimics the sampler: one JSON-sized record per
+ * iteration, with a short pause so that the drain thread gets to run
+ * between records like it does between real samples.
+ */
+static void run(const string& name, const log::options& opts, size_t calls,
+				const chrono::microseconds& pause) {
+	const string file = "log_benchmark_" + name + ".log";
+
+	log::init(opts);
+	log::set_file(file);
+
+	const string payload = "{\"cpu_percent\":12.5,\"memory_percent\":55.1,"
+		"\"process_count\":312,\"volumme_io\":[{\"C\":{\"bytes_read\":1123,"
+		"\"bytes_written\":3321}}]}";
+
+	benchmark::latency_recorder recorder(calls);
+	for (size_t i = 0; i < calls; ++i) {
+		const auto start = chrono::steady_clock::now();
+		LOG(info) << payload << " #" << i;
+		recorder.add(chrono::steady_clock::now() - start);
+
+		this_thread::sleep_for(pause);
+	}
+
+	log::shutdown();
+	remove(file.c_str());
+
+	recorder.report("log_call/" + name);
+}
+
+static int run_benchmark(int argc, char* argv[]) {
+	const size_t calls = argc > 1 ? stoul(argv[1]) : 20000;
+	const chrono::microseconds pause(argc > 2 ? stoul(argv[2]) : 50);
+
+	// keep the console sink but send it somewhere cheap and quiet,
+	// results go to stdout
+	ofstream null_console("log_benchmark_console.log");
+	auto console = clog.rdbuf(null_console.rdbuf());
+
+	log::options sync_opts;
+	run("sync", sync_opts, calls, pause);
+
+	log::options async_drop;
+	async_drop.asynchronous = true;
+	async_drop.flush_interval = chrono::milliseconds(1000);
+	async_drop.overflow = log::overflow_policy::drop;
+	run("async_drop", async_drop, calls, pause);
+
+	log::options async_block = async_drop;
+	async_block.overflow = log::overflow_policy::block;
+	run("async_block", async_block, calls, pause);
+
+	clog.rdbuf(console);
+	null_console.close();
+	remove("log_benchmark_console.log");
+
+	return 0;
+}
+
+static benchmark::registration registered("log", "[calls] [pause_us]", &run_benchmark);
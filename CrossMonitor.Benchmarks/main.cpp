@@ -0,0 +1,84 @@
+#include "benchmark.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace crossover::monitor;
+
+/**
+ * Runs the benchmarks linked in.
+ *
+ * Usage: CrossMonitor.Benchmarks                    every benchmark with its defaults
+ *        CrossMonitor.Benchmarks <name> [arguments] one benchmark
+ *        CrossMonitor.Benchmarks --list
+ */
+
+namespace {
+
+	void print_usage(const vector<benchmark::entry>& entries) {
+		cerr << "Usage: CrossMonitor.Benchmarks [--list | <name> [arguments]]" << endl;
+		for (const auto& e : entries) {
+			cerr << "  " << e.name << " " << e.usage << endl;
+		}
+	}
+
+	int run(const benchmark::entry& e, int argc, char* argv[]) {
+		cout << "# benchmark " << e.name << endl;
+		try {
+			const int res = e.run(argc, argv);
+			if (res != EXIT_SUCCESS) {
+				cerr << e.name << " failed with " << res << endl;
+			}
+			return res;
+		} catch (const exception& ex) {
+			cerr << e.name << " failed: " << ex.what() << endl;
+			return EXIT_FAILURE;
+		}
+	}
+
+} //namespace
+
+int main(int argc, char* argv[]) {
+	vector<benchmark::entry> entries = benchmark::registry();
+	sort(entries.begin(), entries.end(), [](const benchmark::entry& a, const benchmark::entry& b) {
+		return strcmp(a.name, b.name) < 0;
+	});
+
+	if (argc > 1 && strcmp(argv[1], "--list") == 0) {
+		for (const auto& e : entries) {
+			cout << e.name << endl;
+		}
+		return EXIT_SUCCESS;
+	}
+	if (argc > 1 && strcmp(argv[1], "--help") == 0) {
+		print_usage(entries);
+		return EXIT_SUCCESS;
+	}
+
+	if (argc > 1) {
+		const auto it = find_if(entries.begin(), entries.end(), [&](const benchmark::entry& e) {
+			return argv[1] == string(e.name);
+		});
+		if (it == entries.end()) {
+			cerr << "Unknown benchmark " << argv[1] << endl;
+			print_usage(entries);
+			return EXIT_FAILURE;
+		}
+		return run(*it, argc - 1, argv + 1);
+	}
+
+	int res = EXIT_SUCCESS;
+	for (const auto& e : entries) {
+		char* args[] = { const_cast<char*>(e.name), nullptr };
+		if (run(e, 1, args) != EXIT_SUCCESS) {
+			res = EXIT_FAILURE;
+		}
+	}
+	return res;
+}
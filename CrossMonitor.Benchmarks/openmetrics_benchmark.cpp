@@ -0,0 +1,155 @@
+#include "benchmark.hpp"
+
+#include <openmetrics.hpp>
+#include <query_server.hpp>
+#include <sample_ring.hpp>
+#include <data.hpp>
+
+#include <boost/asio.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+using namespace crossover::monitor;
+
+/**
+ * Load test of the OpenMetrics endpoint: a collector thread updates the
+ * exposition every 10 ms while scrapers hit /metrics back to back over
+ * loopback. Reports the cost of an update and the scrape latency.
+ *
+ * Usage: openmetrics_benchmark [scrapers] [seconds] [partitions]
+ */
+
+namespace {
+
+	const chrono::milliseconds sample_period(10);
+
+	bool scrape(unsigned short port, string& response) {
+		using boost::asio::ip::tcp;
+
+		boost::asio::io_service io_service;
+		tcp::socket socket(io_service);
+		boost::system::error_code error;
+		socket.connect(tcp::endpoint(boost::asio::ip::address_v4::loopback(), port), error);
+		if (error) {
+			return false;
+		}
+
+		boost::asio::write(socket, boost::asio::buffer(string("GET /metrics HTTP/1.0\r\n\r\n")), error);
+
+		response.clear();
+		char buffer[16 * 1024];
+		while (size_t read = socket.read_some(boost::asio::buffer(buffer), error)) {
+			response.append(buffer, read);
+		}
+		return response.size() > 6 && response.compare(response.size() - 6, 6, "# EOF\n") == 0;
+	}
+
+} //namespace
+
+static int run_benchmark(int argc, char* argv[]) {
+	try {
+		const unsigned scrapers = argc > 1 ? static_cast<unsigned>(atoi(argv[1])) : 16;
+		const chrono::seconds duration(argc > 2 ? atoi(argv[2]) : 10);
+		const unsigned partitions = argc > 3 ? static_cast<unsigned>(atoi(argv[3])) : 8;
+
+		utils::sample_ring samples(64 * 1024, 16);
+		utils::sample_ring aggregates(64 * 1024, 16);
+		utils::sample_ring metrics(256 * 1024, 64);
+		query_options options;
+		options.port = 0;
+		query_server server(options, samples, aggregates, metrics);
+
+		data sample;
+		IO_stats io_stats;
+		for (unsigned i = 0; i < partitions; ++i) {
+			io_stats.push_back(IO_stat<unsigned>{ 0, 0, static_cast<wchar_t>(L'C' + i) });
+		}
+
+		openmetrics_exporter exporter;
+		atomic<bool> stop(false);
+		atomic<uint64_t> failed(0);
+		vector<benchmark::latency_recorder> latencies;
+		vector<thread> threads;
+		for (unsigned i = 0; i < scrapers; ++i) {
+			latencies.emplace_back(1024 * 1024);
+		}
+
+		// publish one exposition before the scrapers start
+		sample.set_process_count(1);
+		exporter.update(sample);
+		metrics.publish(0, 0, exporter.text());
+
+		for (unsigned i = 0; i < scrapers; ++i) {
+			threads.emplace_back([&, i]() {
+				string response;
+				while (!stop) {
+					const auto start = chrono::steady_clock::now();
+					if (!scrape(server.port(), response)) {
+						++failed;
+					}
+					latencies[i].add(chrono::steady_clock::now() - start);
+				}
+			});
+		}
+
+		benchmark::latency_recorder update(static_cast<size_t>(duration / sample_period) + 1);
+		const auto start = chrono::steady_clock::now();
+		auto next = start;
+		for (unsigned n = 0; next - start < duration; ++n) {
+			next += sample_period;
+			this_thread::sleep_until(next);
+
+			sample.set_cpu_percent(static_cast<float>(n % 1000) / 10);
+			sample.set_memory_percent(static_cast<float>(n % 100));
+			sample.set_process_count(200 + n % 50);
+			for (auto& io_stat : sample.get_io_stats_for_edit()) {
+				io_stat.bytes_read = n * 4096;
+				io_stat.bytes_written = n * 512;
+			}
+			if (n == 0) {
+				sample.set_io_stats(io_stats);
+			}
+
+			const auto before = chrono::steady_clock::now();
+			exporter.update(sample);
+			metrics.publish(n, 0, exporter.text());
+			update.add(chrono::steady_clock::now() - before);
+		}
+
+		stop = true;
+		for (auto& t : threads) {
+			t.join();
+		}
+
+		benchmark::latency_recorder scrape_latency(0);
+		for (const auto& l : latencies) {
+			scrape_latency.add(l);
+		}
+
+		update.report("openmetrics/update");
+		scrape_latency.report("openmetrics/scrape");
+		cout << "openmetrics"
+			<< " scrapers=" << scrapers
+			<< " scrapes_per_s=" << server.served() / static_cast<double>(duration.count())
+			<< " bytes=" << exporter.text().size()
+			<< " renders=" << exporter.renders()
+			<< " failed=" << failed
+			<< " torn=" << server.torn_responses()
+			<< endl;
+	} catch (const exception& e) {
+		cerr << e.what() << endl;
+		return 1;
+	}
+
+	return 0;
+}
+
+static benchmark::registration registered("openmetrics", "[scrapers] [seconds] [partitions]", &run_benchmark);
@@ -0,0 +1,152 @@
+#!/usr/bin/env python3
+"""Builds the PGO and LTO release profile of the agent and measures it.
+
+Three builds under the work directory, all Release:
+  baseline   no LTO, no PGO
+  generate   LTO, CROSSMONITOR_PGO=GENERATE; the pgo_train target replays
+             the training trace through the collect, serialize and log
+             pipeline and writes the profiles
+  optimized  LTO, CROSSMONITOR_PGO=USE with those profiles
+
+Then the baseline and the optimized build take turns to replay the
+evaluation trace and run every benchmark, --rounds times, so that a change
+of the machine load hits both alike; every value reported is the median of
+the rounds. The report shows the binary sizes, the replay cost per sample,
+and the benchmarks compared with compare_benchmarks.py. The medians are kept
+as <work>/<build>/benchmark_results.txt, in the format of the benchmark
+target.
+
+Usage:
+  pgo_build.py [--work pgo] [--training "--journal day1.journal"]
+               [--evaluation "--journal day2.journal"] [--rounds 3]
+               [--measure-only] [-- cmake arguments]
+
+Use different traces for training and evaluation, recorded with
+capture_procfs.sh or CrossMonitor.Replay --write-journal, so that the gain
+is not measured on the very input the profile was trained on.
+"""
+
+import argparse
+import os
+import shlex
+import shutil
+import subprocess
+import sys
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+SOURCE = os.path.dirname(HERE)
+TARGETS = ['CrossMonitor.Client', 'CrossMonitor.Replay', 'CrossMonitor.Benchmarks']
+
+sys.path.insert(0, HERE)
+import compare_benchmarks  # noqa: E402
+
+
+def run(command, **kwargs):
+    print('+ ' + ' '.join(shlex.quote(c) for c in command), flush=True)
+    subprocess.check_call(command, **kwargs)
+
+
+def build(directory, options, targets):
+    run(['cmake', '-S', SOURCE, '-B', directory, '-DCMAKE_BUILD_TYPE=Release'] + options)
+    run(['cmake', '--build', directory, '--config', 'Release', '--parallel', '--target'] + targets)
+
+
+def executable(directory, target):
+    name = target + ('.exe' if os.name == 'nt' else '')
+    for path in (os.path.join(directory, target, name),
+                 os.path.join(directory, target, 'Release', name)):
+        if os.path.exists(path):
+            return path
+    raise IOError('%s not built in %s' % (target, directory))
+
+
+def measure(directory, evaluation, round_number):
+    """Runs the replay and the benchmarks once, returns the results."""
+    results = os.path.join(directory, 'benchmark_results.%d.txt' % round_number)
+    with open(results, 'w') as out:
+        run([executable(directory, 'CrossMonitor.Replay')] + evaluation + ['--send', 'both'],
+            stdout=out, cwd=directory)
+        run([executable(directory, 'CrossMonitor.Benchmarks')], stdout=out, cwd=directory)
+    return compare_benchmarks.load(results)
+
+
+def median(rounds, directory):
+    """Writes the median of every value to <directory>/benchmark_results.txt."""
+    results = os.path.join(directory, 'benchmark_results.txt')
+    with open(results, 'w') as out:
+        for name in sorted(rounds[0]):
+            values = []
+            for key in sorted(rounds[0][name]):
+                samples = sorted(r[name][key] for r in rounds if key in r.get(name, {}))
+                values.append('%s=%g' % (key, samples[len(samples) // 2]))
+            out.write('%s %s\n' % (name, ' '.join(values)))
+    return results
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('--work', default='pgo', help='directory of the three builds (default pgo)')
+    parser.add_argument('--training', default='--synthetic 200000',
+                        help='CrossMonitor.Replay arguments selecting the training trace')
+    parser.add_argument('--evaluation', default='--synthetic 200000',
+                        help='CrossMonitor.Replay arguments selecting the evaluation trace')
+    parser.add_argument('--rounds', type=int, default=3,
+                        help='measurements of each build, interleaved (default 3)')
+    parser.add_argument('--measure-only', action='store_true',
+                        help='measure the builds of an earlier run again')
+    parser.add_argument('--threshold', type=float, default=10.0,
+                        help='regression in percent reported by the comparison (default 10)')
+    parser.add_argument('cmake_args', nargs='*', help='passed on to every configuration')
+    args = parser.parse_args()
+
+    work = os.path.abspath(args.work)
+    profile = os.path.join(work, 'profile')
+    baseline = os.path.join(work, 'baseline')
+    generate = os.path.join(work, 'generate')
+    optimized = os.path.join(work, 'optimized')
+    evaluation = [os.path.abspath(a) if os.path.exists(a) else a for a in shlex.split(args.evaluation)]
+
+    if not args.measure_only:
+        # counters of an earlier training run would be merged into the new ones
+        shutil.rmtree(profile, ignore_errors=True)
+
+        build(baseline, args.cmake_args + ['-DCROSSMONITOR_LTO=OFF', '-DCROSSMONITOR_PGO=OFF'], TARGETS)
+        build(generate, args.cmake_args + [
+            '-DCROSSMONITOR_LTO=ON', '-DCROSSMONITOR_PGO=GENERATE', '-DCROSSMONITOR_PGO_DIR=' + profile,
+            '-DCROSSMONITOR_PGO_TRAINING=' + ' '.join(
+                shlex.quote(os.path.abspath(a) if os.path.exists(a) else a) for a in shlex.split(args.training))],
+            ['pgo_train'])
+        build(optimized, args.cmake_args + [
+            '-DCROSSMONITOR_LTO=ON', '-DCROSSMONITOR_PGO=USE', '-DCROSSMONITOR_PGO_DIR=' + profile], TARGETS)
+
+    rounds_before = []
+    rounds_after = []
+    for round_number in range(args.rounds):
+        rounds_before.append(measure(baseline, evaluation, round_number))
+        rounds_after.append(measure(optimized, evaluation, round_number))
+    before = median(rounds_before, baseline)
+    after = median(rounds_after, optimized)
+
+    print()
+    print('%-40s %14s %14s %8s' % ('binary', 'baseline', 'optimized', 'change'))
+    for target in TARGETS:
+        size_before = os.path.getsize(executable(baseline, target))
+        size_after = os.path.getsize(executable(optimized, target))
+        print('%-40s %14d %14d %+7.1f%%' % (
+            target, size_before, size_after, 100.0 * (size_after - size_before) / size_before))
+
+    replay_before = compare_benchmarks.load(before)['replay']['per_sample_ns']
+    replay_after = compare_benchmarks.load(after)['replay']['per_sample_ns']
+    print()
+    print('replay per sample: %.1f ns -> %.1f ns (%+.1f%%)' % (
+        replay_before, replay_after, 100.0 * (replay_after - replay_before) / replay_before))
+    print()
+
+    # informational: the optimized build is the "results", regressions are flagged
+    subprocess.call([sys.executable, os.path.join(HERE, 'compare_benchmarks.py'),
+                     before, after, '--threshold', str(args.threshold)])
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,137 @@
+#include "benchmark.hpp"
+
+#include <query_server.hpp>
+#include <sample_ring.hpp>
+
+#include <boost/asio.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+using namespace crossover::monitor;
+
+/**
+ * Measures what serving the local query endpoint costs the collector.
+ * A collector thread publishes a sample every period and records how late
+ * it woke up and how long publishing took, first alone, then while
+ * pollers hit /latest and /history at the given total rate.
+ *
+ * Usage: query_benchmark [polls per second] [seconds]
+ */
+
+namespace {
+
+	const chrono::milliseconds sample_period(10);
+
+	// about the size of a rendered sample of a machine with two volumes
+	string make_sample(int64_t time_ms) {
+		return "{\"time_ms\":" + to_string(time_ms) + ",\"data\":{\"cpu_percent\":12.5,"
+			"\"memory_percent\":41.25,\"process_count\":213,\"io_stats\":["
+			"{\"partition_name\":\"C\",\"bytes_read\":123456789,\"bytes_written\":987654321},"
+			"{\"partition_name\":\"D\",\"bytes_read\":23456789,\"bytes_written\":87654321}]}}";
+	}
+
+	bool poll(unsigned short port, const string& target) {
+		using boost::asio::ip::tcp;
+
+		boost::asio::io_service io_service;
+		tcp::socket socket(io_service);
+		boost::system::error_code error;
+		socket.connect(tcp::endpoint(boost::asio::ip::address_v4::loopback(), port), error);
+		if (error) {
+			return false;
+		}
+
+		const string request = "GET " + target + " HTTP/1.0\r\n\r\n";
+		boost::asio::write(socket, boost::asio::buffer(request), error);
+
+		char buffer[64 * 1024];
+		size_t total = 0;
+		while (size_t read = socket.read_some(boost::asio::buffer(buffer), error)) {
+			total += read;
+		}
+		return total > 0;
+	}
+
+	void run(const string& name, unsigned polls_per_second, chrono::seconds duration) {
+		utils::sample_ring samples(4 * 1024 * 1024, 16 * 1024);
+		utils::sample_ring aggregates(64 * 1024, 16);
+		utils::sample_ring metrics(64 * 1024, 16);
+		query_options options;
+		options.port = 0;
+		query_server server(options, samples, aggregates, metrics);
+
+		atomic<bool> stop(false);
+		atomic<uint64_t> polls(0);
+		vector<thread> pollers;
+		const unsigned poller_count = polls_per_second ? 4 : 0;
+		for (unsigned i = 0; i < poller_count; ++i) {
+			pollers.emplace_back([&, i]() {
+				const chrono::nanoseconds interval(1000000000LL * poller_count / polls_per_second);
+				auto next = chrono::steady_clock::now();
+				for (unsigned n = 0; !stop; ++n) {
+					poll(server.port(), (n + i) % 10 == 0 ? "/history?minutes=1" : "/latest");
+					++polls;
+					next += interval;
+					this_thread::sleep_until(next);
+				}
+			});
+		}
+
+		const size_t expected = static_cast<size_t>(duration / sample_period) + 1;
+		benchmark::latency_recorder publish(expected);
+		benchmark::latency_recorder lateness(expected);
+
+		const auto start = chrono::steady_clock::now();
+		auto next = start;
+		while (next - start < duration) {
+			next += sample_period;
+			this_thread::sleep_until(next);
+			const auto woke = chrono::steady_clock::now();
+			lateness.add(woke - next);
+
+			const int64_t time_ms = chrono::duration_cast<chrono::milliseconds>(woke - start).count();
+			const string sample = make_sample(time_ms);
+			const auto before = chrono::steady_clock::now();
+			samples.publish(time_ms, 0, sample);
+			publish.add(chrono::steady_clock::now() - before);
+		}
+
+		stop = true;
+		for (auto& poller : pollers) {
+			poller.join();
+		}
+
+		publish.report("query/" + name + "/publish");
+		lateness.report("query/" + name + "/wakeup_lateness");
+		cout << "query/" << name
+			<< " polls_per_s=" << polls / static_cast<double>(duration.count())
+			<< " torn=" << server.torn_responses()
+			<< endl;
+	}
+
+} //namespace
+
+static int run_benchmark(int argc, char* argv[]) {
+	try {
+		const unsigned polls_per_second = argc > 1 ? static_cast<unsigned>(atoi(argv[1])) : 400;
+		const chrono::seconds duration(argc > 2 ? atoi(argv[2]) : 10);
+
+		run("idle", 0, duration);
+		run("polled", polls_per_second, duration);
+	} catch (const exception& e) {
+		cerr << e.what() << endl;
+		return 1;
+	}
+
+	return 0;
+}
+
+static benchmark::registration registered("query", "[polls_per_second] [seconds]", &run_benchmark);
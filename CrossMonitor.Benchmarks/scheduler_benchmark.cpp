@@ -0,0 +1,75 @@
+#include "benchmark.hpp"
+
+#include <utils.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+
+using namespace std;
+using namespace crossover::monitor;
+
+/**
+ * Timing of the sampling loop: how late utils::interruptible_sleep wakes
+ * up after a period, how long stop() takes to end a sleep, and how far
+ * a loop that sleeps a period after each sample drifts from the schedule.
+ * The periods are scaled down from the real minutes so a run takes seconds;
+ * the check period keeps the ratio the application uses.
+ *
+ * Usage: scheduler_benchmark [cycles] [period_ms]
+ */
+
+static int run_benchmark(int argc, char* argv[]) {
+	const size_t cycles = argc > 1 ? stoul(argv[1]) : 100;
+	const chrono::milliseconds period(argc > 2 ? stoul(argv[2]) : 20);
+	const chrono::milliseconds resolution(max<chrono::milliseconds::rep>(1, period.count() / 10));
+
+	const atomic<bool> never(false);
+	benchmark::latency_recorder lateness(cycles);
+	for (size_t i = 0; i < cycles; ++i) {
+		const auto start = chrono::steady_clock::now();
+		utils::interruptible_sleep(period, resolution, never);
+		lateness.add(chrono::steady_clock::now() - start - period);
+	}
+	lateness.report("scheduler/sleep_lateness");
+
+	mt19937 random(42);
+	uniform_int_distribution<long long> stop_after(0, period.count() * 1000);
+	benchmark::latency_recorder stop_latency(cycles);
+	for (size_t i = 0; i < cycles; ++i) {
+		atomic<bool> stop(false);
+		atomic<long long> stopped_at(0);
+		thread stopper([&]() {
+			this_thread::sleep_for(chrono::microseconds(stop_after(random)));
+			stopped_at = chrono::steady_clock::now().time_since_epoch().count();
+			stop = true;
+		});
+		utils::interruptible_sleep(period * 2, resolution, stop);
+		const auto returned = chrono::steady_clock::now();
+		stopper.join();
+		stop_latency.add(returned - chrono::steady_clock::time_point(chrono::steady_clock::duration(stopped_at)));
+	}
+	stop_latency.report("scheduler/stop_latency");
+
+	// a sample costs a little, like collect_data, and the loop sleeps a full period after it
+	const auto start = chrono::steady_clock::now();
+	for (size_t i = 0; i < cycles; ++i) {
+		const auto busy_until = chrono::steady_clock::now() + chrono::microseconds(200);
+		while (chrono::steady_clock::now() < busy_until) {
+		}
+		utils::interruptible_sleep(period, resolution, never);
+	}
+	const chrono::nanoseconds drift = chrono::steady_clock::now() - start - period * cycles;
+	cout << "scheduler/drift"
+		<< " cycles=" << cycles
+		<< " drift_per_cycle_ns=" << drift.count() / static_cast<long long>(cycles)
+		<< endl;
+
+	return EXIT_SUCCESS;
+}
+
+static benchmark::registration registered("scheduler", "[cycles] [period_ms]", &run_benchmark);
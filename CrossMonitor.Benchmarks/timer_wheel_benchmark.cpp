@@ -0,0 +1,99 @@
+#include "benchmark.hpp"
+
+#include <timer_wheel.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace crossover::monitor;
+
+/**
+ * Cost of driving many periodic sources from one timer_wheel on virtual
+ * time: a 1 ms tick of the clock, most of which find nothing due, the
+ * timers firing on the way, and rescheduling every timer as on a switch to
+ * the high rate. A scan of the next due time of every timer on each tick,
+ * what a loop without the wheel does, runs alongside for comparison.
+ * The periods run from 1 s to 5 min like the sources of an agent.
+ *
+ * Usage: timer_wheel_benchmark [timers] [ticks]
+ */
+
+namespace {
+
+	struct source {
+		int64_t period;
+		int64_t phase;
+	};
+
+	vector<source> random_sources(size_t count) {
+		mt19937 random(42);
+		uniform_int_distribution<int64_t> period(1000, 300000);
+		vector<source> res;
+		for (size_t i = 0; i < count; ++i) {
+			const int64_t p = period(random);
+			res.push_back(source{ p, uniform_int_distribution<int64_t>(0, p - 1)(random) });
+		}
+		return res;
+	}
+
+} //namespace
+
+static int run_benchmark(int argc, char* argv[]) {
+	const size_t timers = argc > 1 ? stoul(argv[1]) : 10000;
+	const size_t ticks = argc > 2 ? stoul(argv[2]) : 600000;
+	const vector<source> sources = random_sources(timers);
+	const string suffix = "/" + to_string(timers);
+
+	timer_wheel wheel;
+	vector<timer_wheel::timer_id> ids;
+	for (const auto& s : sources) {
+		ids.push_back(wheel.add(chrono::milliseconds(s.period), chrono::milliseconds(s.phase)));
+	}
+	vector<timer_wheel::timer_id> due;
+	int64_t now = 0;
+	uint64_t fired = 0;
+	benchmark::measure("timer_wheel/tick" + suffix, ticks, 1000, [&]() {
+		due.clear();
+		fired += wheel.advance(chrono::milliseconds(++now), due);
+	});
+
+	// the same firings by scanning every timer
+	vector<int64_t> next;
+	for (const auto& s : sources) {
+		next.push_back(s.phase > 0 ? s.phase : s.period);
+	}
+	int64_t scan_now = 0;
+	uint64_t scan_fired = 0;
+	benchmark::measure("timer_wheel/scan_tick" + suffix, ticks, 1000, [&]() {
+		++scan_now;
+		for (size_t i = 0; i < next.size(); ++i) {
+			if (next[i] <= scan_now) {
+				next[i] += sources[i].period;
+				++scan_fired;
+			}
+		}
+	});
+
+	benchmark::measure("timer_wheel/reschedule" + suffix, 100, 1, [&]() {
+		for (size_t i = 0; i < ids.size(); ++i) {
+			wheel.reschedule(ids[i], chrono::milliseconds(sources[i].period), chrono::milliseconds(sources[i].phase));
+		}
+	});
+
+	cout << "# timer_wheel: " << fired << " firings over " << ticks << " ms, "
+		<< wheel.missed() << " missed" << endl;
+	if (fired != scan_fired || wheel.missed() != 0) {
+		cerr << "timer_wheel_benchmark: the wheel fired " << fired << " times, the scan " << scan_fired << endl;
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
+
+static benchmark::registration registered("timer_wheel", "[timers] [ticks]", &run_benchmark);
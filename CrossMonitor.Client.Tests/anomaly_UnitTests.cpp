@@ -0,0 +1,177 @@
+#include "CppUnitTest.h"
+
+#include <anomaly.hpp>
+
+#include <chrono>
+#include <random>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace CrossMonitorClientTests
+{
+	TEST_CLASS(anomaly_UnitTests)
+	{
+		typedef crossover::monitor::sample_history::clock clock;
+
+		/**
+		 * one sample per minute from 2016-01-01 00:00 UTC
+		 */
+		static clock::time_point getTime(unsigned minute) {
+			return clock::time_point(std::chrono::hours(24 * 16801) + std::chrono::minutes(minute));
+		}
+
+		static const crossover::monitor::data &getSample(float cpu_percent) {
+			static crossover::monitor::data res;
+			res.set_cpu_percent(cpu_percent);
+			res.set_memory_percent(40.f);
+			res.set_process_count(100);
+			return res;
+		}
+
+	public:
+
+		/**
+		 * check that a jump far outside the baseline raises a z-score event
+		 * on the very sample where it happens
+		 */
+		TEST_METHOD(Spike_ShouldBeDetectedOnFirstSample)
+		{
+			using namespace crossover::monitor;
+
+			anomaly_options options;
+			anomaly_detector detector(options);
+			std::mt19937 random(1);
+			std::normal_distribution<float> noise(50.f, 2.f);
+
+			unsigned minute = 0;
+			for (; minute < 200; ++minute) {
+				Assert::IsTrue(detector.check(getSample(noise(random)), getTime(minute)).empty(),
+					L"event raised on normal samples");
+			}
+
+			const auto &events = detector.check(getSample(90.f), getTime(minute));
+			Assert::IsTrue(events.size() == 1, L"events.size() != 1");
+			Assert::IsTrue(*events[0].metric == U("cpu_percent"), L"metric != cpu_percent");
+			Assert::IsTrue(events[0].kind == anomaly_kind::zscore, L"kind != zscore");
+			Assert::IsTrue(events[0].value == 90., L"value != 90");
+		}
+
+		/**
+		 * check that stationary noise does not raise events
+		 */
+		TEST_METHOD(StationaryNoise_ShouldNotRaiseEvents)
+		{
+			using namespace crossover::monitor;
+
+			anomaly_options options;
+			anomaly_detector detector(options);
+			std::mt19937 random(2);
+			std::normal_distribution<float> noise(30.f, 3.f);
+
+			for (unsigned minute = 0; minute < 5000; ++minute) {
+				Assert::IsTrue(detector.check(getSample(noise(random)), getTime(minute)).empty(),
+					L"event raised on stationary noise");
+			}
+		}
+
+		/**
+		 * check that a shift too small for the z-score is caught by CUSUM
+		 * within a few samples
+		 */
+		TEST_METHOD(SmallShift_ShouldBeDetectedByCusum)
+		{
+			using namespace crossover::monitor;
+
+			anomaly_options options;
+			options.min_stddev = 0.1;
+			anomaly_detector detector(options);
+			std::mt19937 random(3);
+			std::normal_distribution<float> noise(0.f, 2.f);
+
+			unsigned minute = 0;
+			for (; minute < 300; ++minute) {
+				detector.check(getSample(50.f + noise(random)), getTime(minute));
+			}
+
+			unsigned delay = 0;
+			for (; delay < 30; ++delay) {
+				const auto &events = detector.check(getSample(56.f + noise(random)), getTime(minute + delay));
+				if (!events.empty()) {
+					Assert::IsTrue(events[0].kind == anomaly_kind::cusum_up, L"kind != cusum_up");
+					break;
+				}
+			}
+			Assert::IsTrue(delay < 15, L"shift not detected within 15 samples");
+		}
+
+		/**
+		 * check that with time-of-day buckets a daily pattern is not an anomaly
+		 *
+		 * 1. train on 5 days of 10% cpu at night and 80% cpu during the day
+		 * 2. the morning switch raises an event without seasonality only
+		 */
+		TEST_METHOD(DailyPattern_ShouldNotRaiseEventsWithSeasons)
+		{
+			using namespace crossover::monitor;
+
+			anomaly_options options;
+			anomaly_detector flat(options);
+			options.season_buckets = 24;
+			anomaly_detector seasonal(options);
+
+			bool flat_raised = false;
+			for (unsigned minute = 0; minute < 6 * 24 * 60; ++minute) {
+				const unsigned hour = minute / 60 % 24;
+				const data &sample = getSample(hour >= 8 && hour < 20 ? 80.f : 10.f);
+
+				const bool trained = minute >= 5 * 24 * 60;
+				flat_raised |= trained && !flat.check(sample, getTime(minute)).empty();
+				Assert::IsTrue(!trained || seasonal.check(sample, getTime(minute)).empty(),
+					L"seasonal baseline raised an event");
+			}
+			Assert::IsTrue(flat_raised, L"flat baseline did not raise an event");
+		}
+
+		/**
+		 * check that sample_history keeps the last samples, oldest first
+		 */
+		TEST_METHOD(SampleHistory_ShouldKeepLastSamples)
+		{
+			using namespace crossover::monitor;
+
+			sample_history history(3);
+			data sample = getSample(1.f);
+			for (unsigned i = 1; i <= 5; ++i) {
+				sample.set_process_count(i);
+				history.push(sample, getTime(i));
+			}
+
+			Assert::IsTrue(history.size() == 3, L"history.size() != 3");
+			for (unsigned i = 0; i < 3; ++i) {
+				Assert::IsTrue(history.sample(i).get_process_count() == i + 3, L"unexpected sample order");
+				Assert::IsTrue(history.time(i) == getTime(i + 3), L"unexpected sample time");
+			}
+			Assert::IsTrue(history.to_json().size() == 3, L"history.to_json().size() != 3");
+		}
+
+		/**
+		 * check anomaly_detector rejects out of range options
+		 */
+		TEST_METHOD(InvalidOptions_ShouldThrow)
+		{
+			using namespace crossover::monitor;
+
+			Assert::ExpectException<std::invalid_argument>([]() {
+				anomaly_options options;
+				options.season_buckets = 25;
+				anomaly_detector detector(options);
+			});
+			Assert::ExpectException<std::invalid_argument>([]() {
+				anomaly_options options;
+				options.alpha = 0;
+				anomaly_detector detector(options);
+			});
+		}
+
+	};
+}
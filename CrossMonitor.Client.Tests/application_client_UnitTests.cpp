@@ -3,8 +3,12 @@
 #include <data.hpp>
 #include <os_mock.hpp>
 #include <application.hpp>
+#include <rollup.hpp>
 
+#include <atomic>
+#include <memory>
 #include <thread>
+#include <vector>
 #include <iostream>
 
 using namespace Microsoft::VisualStudio::CppUnitTestFramework;
@@ -50,19 +54,19 @@ namespace CrossMonitorClientTests
 
 			// keys should be in alphabetical order
 			auto iter = obj.cbegin();
-			Assert::AreEqual(iter->first.c_str(), L"cpu_percent", L"iter->first != cpu_percent");
+			Assert::AreEqual(iter->first.c_str(), U("cpu_percent"), L"iter->first != cpu_percent");
 			Assert::IsTrue(iter->second.as_double() == original_data.get_cpu_percent(),
 				L"iter->second.as_double() != original_data.get_cpu_percent()");
 			++iter;
-			Assert::AreEqual(iter->first.c_str(), L"memory_percent", L"iter->first != memory_percent");
+			Assert::AreEqual(iter->first.c_str(), U("memory_percent"), L"iter->first != memory_percent");
 			Assert::IsTrue(iter->second.as_double() == original_data.get_memory_percent(),
 				L"iter->second.as_double() != original_data.get_memory_percent()");
 			++iter;
-			Assert::AreEqual(iter->first.c_str(), L"process_count", L"iter->first != process_count");
+			Assert::AreEqual(iter->first.c_str(), U("process_count"), L"iter->first != process_count");
 			Assert::IsTrue(iter->second.as_integer() == original_data.get_process_count(),
 				L"iter->second.as_integer() != original_data.get_process_count()");
 			++iter;
-			Assert::AreEqual(iter->first.c_str(), L"volumme_io", L"(iter->first != volumme_io");
+			Assert::AreEqual(iter->first.c_str(), U("volumme_io"), L"(iter->first != volumme_io");
 			Assert::IsTrue(iter->second.is_array(), L"iter->second is not array");
 
 			// now check the conversion of volume IO statistics in details
@@ -76,16 +80,16 @@ namespace CrossMonitorClientTests
 				const web::json::object &obj1 = arr_conv[i].as_object();
 				Assert::IsTrue(obj1.size() == 1, L"obj1.size() != 1");
 				auto iter1 = obj1.cbegin();
-				Assert::AreEqual(std::wstring(&arr_orig[i].partition_name, 1), iter1->first,
+				Assert::AreEqual(utility::string_t(1, static_cast<utility::char_t>(arr_orig[i].partition_name)), iter1->first,
 					L"arr_orig[i].partition_name != iter1->first");
 				Assert::IsTrue(iter1->second.is_object(), L"iter1->second is not object");
 				const web::json::object &obj2 = iter1->second.as_object();
 				Assert::IsTrue(obj2.size() == 2, L"obj2.size() != 2");
 				auto iter2 = obj2.cbegin();
-				Assert::AreEqual(iter2->first.c_str(), L"bytes_read", L"iter2->first != bytes_read");
+				Assert::AreEqual(iter2->first.c_str(), U("bytes_read"), L"iter2->first != bytes_read");
 				Assert::IsTrue(iter2->second.as_integer() == arr_orig[i].bytes_read);
 				++iter2;
-				Assert::AreEqual(iter2->first.c_str(), L"bytes_written", L"bytes_read", L"iter2->first != bytes_written");
+				Assert::AreEqual(iter2->first.c_str(), U("bytes_written"), L"bytes_read", L"iter2->first != bytes_written");
 				Assert::IsTrue(iter2->second.as_integer() == arr_orig[i].bytes_written,
 					L"(iter2->second.as_integer() != arr_orig[i].bytes_written");
 			}
@@ -135,11 +139,8 @@ namespace CrossMonitorClientTests
 
 				auto collected_str = collected_data.serialize();
 				auto expected_str = expected_data.to_json().serialize();
-				wchar_t str[1024];
-				swprintf_s(str, L"collected_data = %s", collected_str.c_str());
-				Logger::WriteMessage(str);
-				swprintf_s(str, L"expected_data = %s", expected_str.c_str());
-				Logger::WriteMessage(str);
+				Logger::WriteMessage(("collected_data = " + utility::conversions::to_utf8string(collected_str)).c_str());
+				Logger::WriteMessage(("expected_data = " + utility::conversions::to_utf8string(expected_str)).c_str());
 
 				Assert::AreEqual(collected_str, expected_str, L"collected_str != expected_str");
 
@@ -165,5 +166,130 @@ namespace CrossMonitorClientTests
 			Logger::WriteMessage("thread joined. end of unit test");
 		}
 
+		/**
+		 * check several applications collecting side by side
+		 *
+		 * 1. run four applications, each in its own thread
+		 * 2. wait until every one has collected its first sample
+		 * 3. stop them all and check each sample against the mock values
+		 */
+		TEST_METHOD(CheckParallelApplications)
+		{
+			using namespace crossover::monitor;
+			using namespace crossover::monitor::client;
+
+			const data &mock_data = getData();
+			os::set_process_count(mock_data.get_process_count());
+			os::set_cpu_use_percent(mock_data.get_cpu_percent());
+			os::set_memory_use_percent(mock_data.get_memory_percent());
+			os::set_disk_io_stats(mock_data.get_io_stats());
+
+			// a fresh data, set in the order the collector sets it
+			data expected_data;
+			expected_data.set_cpu_percent(mock_data.get_cpu_percent());
+			expected_data.set_process_count(mock_data.get_process_count());
+			expected_data.set_memory_percent(mock_data.get_memory_percent());
+			expected_data.set_io_stats(mock_data.get_io_stats());
+			const auto expected_str = expected_data.to_json().serialize();
+
+			const size_t count = 4;
+			std::vector<utility::string_t> collected(count);
+			std::unique_ptr<std::atomic<bool>[]> received(new std::atomic<bool>[count]);
+			std::vector<std::unique_ptr<application>> apps;
+			for (size_t i = 0; i < count; ++i) {
+				received[i] = false;
+				apps.emplace_back(new application(std::chrono::minutes(1), [&, i](const web::json::value &collected_data) {
+					if (!received[i]) {
+						collected[i] = collected_data.serialize();
+						received[i] = true;
+					}
+				}));
+			}
+
+			std::vector<std::thread> threads;
+			for (auto &app : apps) {
+				threads.emplace_back([&app]() {
+					app->run();
+				});
+			}
+
+			for (size_t i = 0; i < count; ++i) {
+				while (!received[i]) {
+					std::this_thread::sleep_for(std::chrono::milliseconds(10));
+				}
+			}
+			for (auto &app : apps) {
+				app->stop();
+			}
+			for (auto &thr : threads) {
+				thr.join();
+			}
+
+			for (size_t i = 0; i < count; ++i) {
+				Assert::AreEqual(expected_str, collected[i], L"collected_str != expected_str");
+			}
+		}
+
+		/**
+		 * check application::run() in send_mode::both
+		 *
+		 * 1. run in different thread, wait for the first raw sample
+		 * 2. request application::stop()
+		 * 3. check that stopping sent the open rollups of every width
+		 *    and that each width counts every raw sample once
+		 */
+		TEST_METHOD(CheckRollupMode)
+		{
+			using namespace crossover::monitor;
+			using namespace crossover::monitor::client;
+
+			const data &expected_data = getData();
+			os::set_process_count(expected_data.get_process_count());
+			os::set_cpu_use_percent(expected_data.get_cpu_percent());
+			os::set_memory_use_percent(expected_data.get_memory_percent());
+			os::set_disk_io_stats(expected_data.get_io_stats());
+
+			std::atomic<unsigned> raw_count(0);
+			std::vector<rollup> rollups;
+
+			application app {std::chrono::minutes(1), [&](const web::json::value &collected_data) {
+				if (collected_data.has_field(U("rollup"))) {
+					rollups.push_back(rollup::from_json(collected_data));
+				} else {
+					++raw_count;
+				}
+			}, send_mode::both};
+
+			std::thread thr([&]() {
+				app.run();
+			});
+
+			while (raw_count == 0) {
+				std::this_thread::sleep_for(std::chrono::milliseconds(10));
+			}
+			app.stop();
+			thr.join();
+
+			for (const auto &width : rollup_builder::widths) {
+				std::uint64_t count = 0;
+				for (const auto &r : rollups) {
+					if (r.width() != width) {
+						continue;
+					}
+
+					const auto &metrics = r.metrics();
+					Assert::IsTrue(metrics.size() == 3 + 2 * expected_data.get_io_stats().size(),
+						L"unexpected metric count");
+
+					const aggregate &process_count = metrics.at(U("process_count"));
+					Assert::IsTrue(process_count.min == expected_data.get_process_count() &&
+						process_count.max == expected_data.get_process_count(),
+						L"process_count != expected");
+					count += process_count.count;
+				}
+				Assert::IsTrue(count == raw_count, L"rollup count != raw sample count");
+			}
+		}
+
 	};
 }
\ No newline at end of file
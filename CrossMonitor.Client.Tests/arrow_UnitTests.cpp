@@ -0,0 +1,489 @@
+#include "CppUnitTest.h"
+
+#include <anomaly.hpp>
+#include <arrow_ipc.hpp>
+#include <data.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace CrossMonitorClientTests
+{
+	TEST_CLASS(arrow_UnitTests)
+	{
+		static crossover::monitor::data getSample(unsigned n) {
+			return crossover::monitor::data(static_cast<float>(n), 50.f, 100 + n,
+				{ { 1000 * n, 2000 * n, L'C' }, { 3000 * n, 4000 * n, L'D' } });
+		}
+
+		template <typename T>
+		static T read(const std::string& bytes, std::size_t offset) {
+			Assert::IsTrue(offset + sizeof(T) <= bytes.size(), L"read past the end");
+			T value;
+			std::memcpy(&value, bytes.data() + offset, sizeof(value));
+			return value;
+		}
+
+		/**
+		 * Table of a FlatBuffer, read through its vtable as Arrow readers do
+		 */
+		class table {
+		public:
+
+			table(const std::string& bytes, std::size_t position)
+				: bytes_(bytes)
+				, position_(position)
+				, vtable_(position - read<std::int32_t>(bytes, position)) {
+			}
+
+			/**
+			 * table at offset 0 of the buffer starting at start
+			 */
+			static table root(const std::string& bytes, std::size_t start) {
+				return table(bytes, start + read<std::uint32_t>(bytes, start));
+			}
+
+			template <typename T>
+			T scalar(unsigned id, T missing = T()) const {
+				const std::size_t at = field(id);
+				return at == 0 ? missing : read<T>(bytes_, at);
+			}
+
+			table child(unsigned id) const {
+				const std::size_t at = reference(id);
+				return table(bytes_, at);
+			}
+
+			std::string text(unsigned id) const {
+				const std::size_t at = reference(id);
+				return bytes_.substr(at + 4, read<std::uint32_t>(bytes_, at));
+			}
+
+			std::vector<table> tables(unsigned id) const {
+				const std::size_t at = reference(id);
+				std::vector<table> out;
+				for (std::uint32_t i = 0; i < read<std::uint32_t>(bytes_, at); ++i) {
+					const std::size_t slot = at + 4 + 4 * i;
+					out.push_back(table(bytes_, slot + read<std::uint32_t>(bytes_, slot)));
+				}
+				return out;
+			}
+
+			/**
+			 * offset of the first of the structs of a vector, and their count
+			 */
+			std::pair<std::size_t, std::uint32_t> structs(unsigned id) const {
+				const std::size_t at = reference(id);
+				Assert::IsTrue((at + 4) % 8 == 0, L"structs not aligned");
+				return std::make_pair(at + 4, read<std::uint32_t>(bytes_, at));
+			}
+
+			const std::string& bytes() const noexcept {
+				return bytes_;
+			}
+
+		private:
+			std::size_t field(unsigned id) const {
+				if (4 + 2 * id >= read<std::uint16_t>(bytes_, vtable_)) {
+					return 0;
+				}
+				const std::uint16_t offset = read<std::uint16_t>(bytes_, vtable_ + 4 + 2 * id);
+				Assert::IsTrue(offset < read<std::uint16_t>(bytes_, vtable_ + 2), L"field past the table");
+				return offset == 0 ? 0 : position_ + offset;
+			}
+
+			std::size_t reference(unsigned id) const {
+				const std::size_t at = field(id);
+				Assert::IsTrue(at != 0, L"missing table, string or vector");
+				return at + read<std::uint32_t>(bytes_, at);
+			}
+
+			const std::string& bytes_;
+			std::size_t position_;
+			std::size_t vtable_;
+		};
+
+		/**
+		 * check the fields of a Schema table: names, types, their
+		 * parameters and children
+		 */
+		static void checkSchema(const table& schema) {
+			// name, Type union member, bit width or precision, signed, children
+			struct expected_field {
+				const char* name;
+				std::uint8_t type;
+				int width;
+				std::size_t children;
+			};
+			const expected_field columns[] = {
+				{ "time", 10, 0, 0 },
+				{ "fresh", 2, 8, 0 },
+				{ "cpu_percent", 3, 1, 0 },
+				{ "memory_percent", 3, 1, 0 },
+				{ "process_count", 2, 32, 0 },
+				{ "run_queue_delay_us", 3, 1, 0 },
+				{ "run_queue_wait_ratio", 3, 1, 0 },
+				{ "io_stats", 12, 0, 1 }
+			};
+			const expected_field io_stat[] = {
+				{ "partition_name", 5, 0, 0 },
+				{ "bytes_read", 2, 32, 0 },
+				{ "bytes_written", 2, 32, 0 }
+			};
+
+			Assert::IsTrue(schema.scalar<std::int16_t>(0) == 0, L"schema not little-endian");
+			const std::vector<table> fields = schema.tables(1);
+			Assert::IsTrue(fields.size() == 8, L"schema columns");
+			for (std::size_t i = 0; i < fields.size(); ++i) {
+				checkField(fields[i], columns[i]);
+			}
+
+			const std::vector<table> item = fields[7].tables(5);
+			Assert::IsTrue(item[0].text(0) == "item" && item[0].scalar<std::uint8_t>(2) == 13, L"io_stats item not a struct");
+			Assert::IsTrue(!item[0].scalar<bool>(1, true), L"io_stats item nullable");
+			const std::vector<table> members = item[0].tables(5);
+			Assert::IsTrue(members.size() == 3, L"io_stats struct members");
+			for (std::size_t i = 0; i < members.size(); ++i) {
+				checkField(members[i], io_stat[i]);
+			}
+			Assert::IsTrue(fields[0].child(3).scalar<std::int16_t>(0) == 1, L"time not in milliseconds");
+			Assert::IsTrue(fields[0].child(3).text(1) == "UTC", L"time not in UTC");
+		}
+
+		template <typename T>
+		static void checkField(const table& field, const T& expected) {
+			const std::wstring name(expected.name, expected.name + std::strlen(expected.name));
+			Assert::IsTrue(field.text(0) == expected.name, (L"field name " + name).c_str());
+			Assert::IsTrue(!field.scalar<bool>(1, true), (L"nullable " + name).c_str());
+			Assert::IsTrue(field.scalar<std::uint8_t>(2) == expected.type, (L"type of " + name).c_str());
+			Assert::IsTrue(field.tables(5).size() == expected.children, (L"children of " + name).c_str());
+			const table type = field.child(3);
+			if (expected.type == 2) {
+				Assert::IsTrue(type.scalar<std::int32_t>(0) == expected.width, (L"bit width of " + name).c_str());
+				Assert::IsTrue(!type.scalar<bool>(1), (L"signed " + name).c_str());
+			} else if (expected.type == 3) {
+				Assert::IsTrue(type.scalar<std::int16_t>(0) == expected.width, (L"precision of " + name).c_str());
+			}
+		}
+
+		/**
+		 * Columns of record batches, decoded from their buffers
+		 */
+		struct columns {
+			std::vector<std::int64_t> time_ms;
+			std::vector<std::uint8_t> fresh;
+			std::vector<float> cpu_percent;
+			std::vector<float> memory_percent;
+			std::vector<std::uint32_t> process_count;
+			std::vector<float> run_queue_delay_us;
+			std::vector<float> run_queue_wait_ratio;
+			// one entry per sample: names, bytes read and written of its volumes
+			std::vector<std::vector<std::string>> names;
+			std::vector<std::vector<std::uint32_t>> bytes_read;
+			std::vector<std::vector<std::uint32_t>> bytes_written;
+		};
+
+		template <typename T>
+		static void appendValues(const std::string& body, std::uint64_t offset, std::uint64_t length,
+								 std::uint64_t count, std::vector<T>& out) {
+			Assert::IsTrue(offset % 8 == 0, L"buffer not aligned");
+			Assert::IsTrue(length >= count * sizeof(T) && offset + length <= body.size(), L"buffer too short");
+			for (std::uint64_t i = 0; i < count; ++i) {
+				out.push_back(read<T>(body, static_cast<std::size_t>(offset + i * sizeof(T))));
+			}
+		}
+
+		/**
+		 * decode the RecordBatch of a message, its body following it
+		 */
+		static void decodeBatch(const table& message, const std::string& body, columns& out) {
+			Assert::IsTrue(message.scalar<std::int16_t>(0) == 4, L"metadata not V5");
+			Assert::IsTrue(message.scalar<std::uint8_t>(1) == 3, L"message not a record batch");
+			Assert::IsTrue(message.scalar<std::int64_t>(3) == static_cast<std::int64_t>(body.size()), L"body length");
+			const table batch = message.child(2);
+			const std::uint64_t rows = static_cast<std::uint64_t>(batch.scalar<std::int64_t>(0));
+
+			const std::string& meta = message.bytes();
+			const auto nodes = batch.structs(1);
+			const auto buffers = batch.structs(2);
+			Assert::IsTrue(nodes.second == 12 && buffers.second == 24, L"nodes and buffers");
+			std::uint64_t length[12];
+			for (std::uint32_t i = 0; i < nodes.second; ++i) {
+				length[i] = read<std::uint64_t>(meta, nodes.first + 16 * i);
+				Assert::IsTrue(read<std::int64_t>(meta, nodes.first + 16 * i + 8) == 0, L"null count");
+			}
+			std::uint64_t offset[24];
+			std::uint64_t size[24];
+			for (std::uint32_t i = 0; i < buffers.second; ++i) {
+				offset[i] = read<std::uint64_t>(meta, buffers.first + 16 * i);
+				size[i] = read<std::uint64_t>(meta, buffers.first + 16 * i + 8);
+			}
+			// no nulls, so no validity bitmaps: buffers 0, 2, ..., 16, 17, 20, 22
+			const int validity[] = { 0, 2, 4, 6, 8, 10, 12, 14, 16, 17, 20, 22 };
+			for (const int v : validity) {
+				Assert::IsTrue(size[v] == 0, L"validity bitmap written");
+			}
+			for (int i = 0; i < 8; ++i) {
+				Assert::IsTrue(length[i] == rows, L"column length != batch length");
+			}
+
+			appendValues(body, offset[1], size[1], rows, out.time_ms);
+			appendValues(body, offset[3], size[3], rows, out.fresh);
+			appendValues(body, offset[5], size[5], rows, out.cpu_percent);
+			appendValues(body, offset[7], size[7], rows, out.memory_percent);
+			appendValues(body, offset[9], size[9], rows, out.process_count);
+			appendValues(body, offset[11], size[11], rows, out.run_queue_delay_us);
+			appendValues(body, offset[13], size[13], rows, out.run_queue_wait_ratio);
+
+			const std::uint64_t volumes = length[8];
+			Assert::IsTrue(length[9] == volumes && length[10] == volumes && length[11] == volumes, L"struct member lengths");
+			std::vector<std::int32_t> io_offsets;
+			std::vector<std::int32_t> name_offsets;
+			std::vector<std::uint32_t> bytes_read;
+			std::vector<std::uint32_t> bytes_written;
+			appendValues(body, offset[15], size[15], rows + 1, io_offsets);
+			appendValues(body, offset[18], size[18], volumes + 1, name_offsets);
+			appendValues(body, offset[21], size[21], volumes, bytes_read);
+			appendValues(body, offset[23], size[23], volumes, bytes_written);
+			Assert::IsTrue(io_offsets.front() == 0 && static_cast<std::uint64_t>(io_offsets.back()) == volumes, L"list offsets");
+			Assert::IsTrue(name_offsets.front() == 0 && static_cast<std::uint64_t>(name_offsets.back()) <= size[19], L"string offsets");
+
+			for (std::uint64_t row = 0; row < rows; ++row) {
+				out.names.emplace_back();
+				out.bytes_read.emplace_back();
+				out.bytes_written.emplace_back();
+				Assert::IsTrue(io_offsets[row] <= io_offsets[row + 1], L"list offsets decrease");
+				for (std::int32_t v = io_offsets[row]; v < io_offsets[row + 1]; ++v) {
+					out.names.back().push_back(body.substr(static_cast<std::size_t>(offset[19] + name_offsets[v]),
+						static_cast<std::size_t>(name_offsets[v + 1] - name_offsets[v])));
+					out.bytes_read.back().push_back(bytes_read[v]);
+					out.bytes_written.back().push_back(bytes_written[v]);
+				}
+			}
+		}
+
+		/**
+		 * decode a whole file: the schema of its first message and of the
+		 * footer, and every batch the footer lists
+		 * @return batches of the file.
+		 */
+		static std::size_t decodeFile(const std::string& file, columns& out) {
+			const std::string magic("ARROW1\0\0", 8);
+			Assert::IsTrue(file.compare(0, 8, magic) == 0, L"no magic at the start");
+			Assert::IsTrue(file.compare(file.size() - 6, 6, magic, 0, 6) == 0, L"no magic at the end");
+
+			Assert::IsTrue(read<std::int32_t>(file, 8) == -1, L"no continuation marker");
+			const table first = table::root(file, 16);
+			Assert::IsTrue(first.scalar<std::uint8_t>(1) == 1, L"first message not the schema");
+			checkSchema(first.child(2));
+
+			const std::size_t footer_size = read<std::uint32_t>(file, file.size() - 10);
+			const std::size_t footer_start = file.size() - 10 - footer_size;
+			Assert::IsTrue(footer_start % 8 == 0, L"footer not aligned");
+			Assert::IsTrue(read<std::int32_t>(file, footer_start - 8) == -1 && read<std::int32_t>(file, footer_start - 4) == 0,
+				L"no end of stream before the footer");
+			const table footer = table::root(file, footer_start);
+			Assert::IsTrue(footer.scalar<std::int16_t>(0) == 4, L"footer not V5");
+			checkSchema(footer.child(1));
+
+			const auto blocks = footer.structs(3);
+			for (std::uint32_t i = 0; i < blocks.second; ++i) {
+				const std::size_t block = blocks.first + 24 * i;
+				const std::size_t offset = static_cast<std::size_t>(read<std::int64_t>(file, block));
+				const std::size_t metadata = static_cast<std::size_t>(read<std::int32_t>(file, block + 8));
+				const std::size_t body = static_cast<std::size_t>(read<std::int64_t>(file, block + 16));
+				Assert::IsTrue(offset % 8 == 0 && metadata % 8 == 0, L"block not aligned");
+				Assert::IsTrue(read<std::int32_t>(file, offset) == -1, L"block not at a message");
+				Assert::IsTrue(static_cast<std::size_t>(read<std::int32_t>(file, offset + 4)) + 8 == metadata, L"block metadata length");
+				decodeBatch(table::root(file, offset + 8), file.substr(offset + metadata, body), out);
+			}
+			return blocks.second;
+		}
+
+		/**
+		 * sample n of a host whose volumes come and go, none every fourth
+		 */
+		static crossover::monitor::data getRingSample(unsigned n) {
+			using namespace crossover::monitor;
+			IO_stats io_stats;
+			for (unsigned v = 0; v < n % 4; ++v) {
+				io_stats.push_back({ 100 * n + v, 4000000000u - n - v, v == 2 ? L'\u00c9' : static_cast<wchar_t>(L'C' + v) });
+			}
+			data sample(static_cast<float>(n) + 0.25f, 100.f - static_cast<float>(n), 300 + n, io_stats);
+			sample.set_run_queues(run_queue_stats(), 10.f * n, 0.01f * n);
+			sample.set_fresh(n % 2 == 0 ? all_parts : static_cast<unsigned>(cpu_part));
+			return sample;
+		}
+
+		static std::string toUtf8(wchar_t c) {
+			return c == L'\u00c9' ? std::string("\xc3\x89") : std::string(1, static_cast<char>(c));
+		}
+
+		/**
+		 * check decoded columns against the samples of the history, the
+		 * oldest first
+		 */
+		static void checkColumns(const columns& decoded, const crossover::monitor::sample_history& history) {
+			using namespace std::chrono;
+			Assert::IsTrue(decoded.time_ms.size() == history.size() && decoded.names.size() == history.size(),
+				L"rows != samples");
+			for (std::size_t i = 0; i < history.size(); ++i) {
+				const crossover::monitor::data& sample = history.sample(i);
+				Assert::IsTrue(decoded.time_ms[i] == duration_cast<milliseconds>(history.time(i).time_since_epoch()).count(),
+					L"time mismatch");
+				Assert::IsTrue(decoded.fresh[i] == sample.get_fresh(), L"fresh mismatch");
+				Assert::IsTrue(decoded.cpu_percent[i] == sample.get_cpu_percent(), L"cpu_percent mismatch");
+				Assert::IsTrue(decoded.memory_percent[i] == sample.get_memory_percent(), L"memory_percent mismatch");
+				Assert::IsTrue(decoded.process_count[i] == sample.get_process_count(), L"process_count mismatch");
+				Assert::IsTrue(decoded.run_queue_delay_us[i] == sample.get_run_queue_delay_us(), L"run_queue_delay_us mismatch");
+				Assert::IsTrue(decoded.run_queue_wait_ratio[i] == sample.get_run_queue_wait_ratio(), L"run_queue_wait_ratio mismatch");
+
+				const crossover::monitor::IO_stats& io_stats = sample.get_io_stats();
+				Assert::IsTrue(decoded.names[i].size() == io_stats.size(), L"io_stats length mismatch");
+				for (std::size_t v = 0; v < io_stats.size(); ++v) {
+					Assert::IsTrue(decoded.names[i][v] == toUtf8(io_stats[v].partition_name), L"partition_name mismatch");
+					Assert::IsTrue(decoded.bytes_read[i][v] == io_stats[v].bytes_read, L"bytes_read mismatch");
+					Assert::IsTrue(decoded.bytes_written[i][v] == io_stats[v].bytes_written, L"bytes_written mismatch");
+				}
+			}
+		}
+
+		static std::string writeHistory(const crossover::monitor::sample_history& history, std::size_t batch_rows) {
+			using namespace std::chrono;
+			std::ostringstream out;
+			crossover::monitor::arrow_writer writer(out, crossover::monitor::arrow_writer::format::file, batch_rows);
+			for (std::size_t i = 0; i < history.size(); ++i) {
+				writer.append(history.sample(i), duration_cast<milliseconds>(history.time(i).time_since_epoch()).count());
+			}
+			writer.close();
+			return out.str();
+		}
+
+	public:
+
+		/**
+		 * check every column of the file against the samples it was
+		 * written from, decoding it as a reader does
+		 *
+		 * 1. fill a history ring of 10 samples with 13, so that it wraps
+		 * 2. write it in batches of 4: three full batches and one of 1
+		 * 3. decode the schema of the first message and of the footer:
+		 *    names, types, widths, nullability and children
+		 * 4. decode every batch the footer lists, through the nodes and
+		 *    buffers of its metadata, and compare with the ring's samples
+		 * 5. the same history in one batch decodes to the same columns
+		 */
+		TEST_METHOD(File_ShouldDecodeToSamples)
+		{
+			using namespace crossover::monitor;
+
+			sample_history history(10);
+			for (unsigned n = 0; n < 13; ++n) {
+				history.push(getRingSample(n), sample_history::clock::time_point(std::chrono::seconds(1700000000 + n)));
+			}
+
+			columns decoded;
+			Assert::IsTrue(decodeFile(writeHistory(history, 4), decoded) == 3, L"batches of 4");
+			checkColumns(decoded, history);
+
+			columns single;
+			Assert::IsTrue(decodeFile(writeHistory(history, arrow_writer::default_batch_rows), single) == 1, L"one batch");
+			checkColumns(single, history);
+		}
+
+		/**
+		 * check that an empty history writes a file of the schema and no
+		 * batch
+		 */
+		TEST_METHOD(EmptyHistory_ShouldDecode)
+		{
+			using namespace crossover::monitor;
+
+			const sample_history history(10);
+			columns decoded;
+			Assert::IsTrue(decodeFile(writeHistory(history, 4), decoded) == 0, L"batch written for no sample");
+			checkColumns(decoded, history);
+		}
+
+		/**
+		 * check the file format
+		 *
+		 * 1. write 7 samples in batches of 3
+		 * 2. the file starts and ends with the magic, and the footer size
+		 *    before the last magic stays within the file
+		 * 3. three batches, the last one of the sample left for close()
+		 * 4. the times of a batch are one buffer of int64 values
+		 */
+		TEST_METHOD(File_ShouldHoldBatches)
+		{
+			using namespace crossover::monitor;
+
+			std::ostringstream out;
+			arrow_writer writer(out, arrow_writer::format::file, 3);
+			for (unsigned i = 0; i < 7; ++i) {
+				writer.append(getSample(i), 1700000000000 + 1000 * i);
+			}
+			Assert::IsTrue(writer.batches() == 2, L"batches not written at batch_rows");
+			writer.close();
+			Assert::IsTrue(writer.batches() == 3, L"last batch not written by close()");
+
+			const std::string file = out.str();
+			const std::string magic("ARROW1", 6);
+			Assert::IsTrue(file.size() > 16, L"file too small");
+			Assert::IsTrue(file.compare(0, 6, magic) == 0, L"no magic at the start");
+			Assert::IsTrue(file.compare(file.size() - 6, 6, magic) == 0, L"no magic at the end");
+			const std::int32_t footer = read<std::int32_t>(file, file.size() - 10);
+			Assert::IsTrue(footer > 0 && static_cast<std::size_t>(footer) < file.size() - 18, L"bad footer size");
+
+			const std::int64_t times[3] = { 1700000000000, 1700000001000, 1700000002000 };
+			Assert::IsTrue(file.find(std::string(reinterpret_cast<const char*>(times), sizeof(times))) != std::string::npos,
+				L"times not written as a column");
+		}
+
+		/**
+		 * check the stream format
+		 *
+		 * 1. nothing but the schema before the first batch
+		 * 2. flush() writes a batch, a second flush() none
+		 * 3. close() ends the stream, and nothing is written after it
+		 * 4. a batch of 0 samples is refused
+		 */
+		TEST_METHOD(Stream_ShouldEndWithEos)
+		{
+			using namespace crossover::monitor;
+
+			std::ostringstream out;
+			arrow_writer writer(out, arrow_writer::format::stream);
+			const std::size_t schema = out.str().size();
+			Assert::IsTrue(schema > 0 && schema % 8 == 0, L"schema not written or not aligned");
+			Assert::IsTrue(read<std::int32_t>(out.str(), 0) == -1, L"no continuation marker");
+
+			writer.append(getSample(1), 1000);
+			Assert::IsTrue(out.str().size() == schema, L"batch written before batch_rows");
+			writer.flush();
+			const std::size_t batch = out.str().size();
+			Assert::IsTrue(writer.batches() == 1 && batch > schema, L"flush() did not write the batch");
+			writer.flush();
+			Assert::IsTrue(out.str().size() == batch, L"empty batch written");
+
+			writer.close();
+			const std::string stream = out.str();
+			Assert::IsTrue(stream.size() == batch + 8, L"no end of stream");
+			Assert::IsTrue(read<std::int32_t>(stream, batch) == -1 && read<std::int32_t>(stream, batch + 4) == 0, L"bad end of stream");
+			writer.close();
+			Assert::IsTrue(out.str().size() == stream.size(), L"written after close()");
+
+			Assert::ExpectException<std::invalid_argument>([&]() {
+				std::ostringstream ignored;
+				arrow_writer empty(ignored, arrow_writer::format::stream, 0);
+			}, L"batch of 0 samples accepted");
+		}
+	};
+}
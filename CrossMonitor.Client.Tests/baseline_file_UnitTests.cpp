@@ -0,0 +1,157 @@
+#include "CppUnitTest.h"
+
+#include <baseline_file.hpp>
+#include <snapshot.hpp>
+#include <temporary_directory.hpp>
+
+#include <boost/filesystem.hpp>
+
+#include <chrono>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace CrossMonitorClientTests
+{
+	TEST_CLASS(baseline_file_UnitTests)
+	{
+		/**
+		 * State file and boot id
+		 */
+		class state_dir {
+		public:
+			state_dir() {
+				set_boot_id("0b1f6c52-4c1e-4d8b-9a43-2f7e8c1d5a60");
+			}
+
+			void set_boot_id(const std::string& id) {
+				std::ofstream((root_.path / "boot_id").string()) << id << "\n";
+			}
+
+			std::string state() const {
+				return (root_.path / "state").string();
+			}
+
+			std::string boot_id() const {
+				return (root_.path / "boot_id").string();
+			}
+
+		private:
+			const temporary_directory root_;
+		};
+
+		static crossover::monitor::counter_snapshot getSnapshot(std::size_t volumes) {
+			crossover::monitor::counter_snapshot snapshot;
+			snapshot.time_ms = 1700000000000;
+			snapshot.cpu_total = 123456789;
+			snapshot.cpu_busy = 23456789;
+			snapshot.memory_total = 16ull << 30;
+			snapshot.memory_available = 9ull << 30;
+			snapshot.process_count = 312;
+			for (std::size_t i = 0; i < volumes; ++i) {
+				snapshot.volumes.push_back({ L'C', "sd" + std::to_string(i), 1000 * i, 2000 * i });
+			}
+			snapshot.run_queues.cpus = { 0 };
+			snapshot.run_queues.run_ns = { 5000000 };
+			snapshot.run_queues.wait_ns = { 100000 };
+			snapshot.run_queues.timeslices = { 42 };
+			snapshot.has_net = true;
+			snapshot.net.tcp_retransmits = 460;
+			snapshot.net.sockets = 18;
+			return snapshot;
+		}
+
+	public:
+
+		/**
+		 * check that a saved reading loads in the next run of the same boot,
+		 * and that the file grows for a reading larger than it
+		 */
+		TEST_METHOD(Reading_ShouldSurviveRestart)
+		{
+			using namespace crossover::monitor;
+
+			state_dir dir;
+			const std::chrono::minutes max_age(10);
+			counter_snapshot loaded;
+			{
+				client::os::baseline_file file(dir.state(), max_age, dir.boot_id());
+				Assert::IsFalse(file.load(loaded), L"new file loaded");
+				file.save(getSnapshot(2));
+				file.save(getSnapshot(3));
+			}
+			{
+				client::os::baseline_file file(dir.state(), max_age, dir.boot_id());
+				Assert::IsTrue(file.load(loaded), L"saved reading not loaded");
+				Assert::IsTrue(loaded == getSnapshot(3), L"loaded reading mismatch");
+
+				const std::size_t capacity = file.capacity();
+				file.save(getSnapshot(1000));
+				Assert::IsTrue(file.capacity() > capacity, L"file did not grow");
+			}
+			client::os::baseline_file file(dir.state(), max_age, dir.boot_id());
+			Assert::IsTrue(file.load(loaded) && loaded == getSnapshot(1000), L"large reading mismatch");
+		}
+
+		/**
+		 * check that the boot id of the machine, the boot time on Windows,
+		 * is the same for the next run
+		 */
+		TEST_METHOD(DefaultBootId_ShouldLoadInTheSameBoot)
+		{
+			using namespace crossover::monitor;
+
+			state_dir dir;
+			const std::chrono::minutes max_age(10);
+			{
+				client::os::baseline_file file(dir.state(), max_age);
+				file.save(getSnapshot(2));
+			}
+			client::os::baseline_file file(dir.state(), max_age);
+			counter_snapshot loaded;
+			Assert::IsTrue(file.load(loaded) && loaded == getSnapshot(2), L"reading of this boot not loaded");
+		}
+
+		/**
+		 * check that a reading of another boot, too old or not a reading at
+		 * all is not loaded, and that bad arguments are refused
+		 */
+		TEST_METHOD(StaleReading_ShouldNotLoad)
+		{
+			using namespace crossover::monitor;
+
+			state_dir dir;
+			counter_snapshot loaded;
+			{
+				client::os::baseline_file file(dir.state(), std::chrono::minutes(10), dir.boot_id());
+				file.save(getSnapshot(2));
+			}
+			{
+				client::os::baseline_file file(dir.state(), std::chrono::milliseconds(1), dir.boot_id());
+				// the Windows clock of the age ticks every 16 ms
+				std::this_thread::sleep_for(std::chrono::milliseconds(50));
+				Assert::IsFalse(file.load(loaded), L"old reading loaded");
+			}
+			dir.set_boot_id("7d2e9a10-3b5f-4c6d-8e7f-1a2b3c4d5e6f");
+			{
+				client::os::baseline_file file(dir.state(), std::chrono::minutes(10), dir.boot_id());
+				Assert::IsFalse(file.load(loaded), L"reading of another boot loaded");
+			}
+
+			std::ofstream(dir.state(), std::ios::trunc) << "not a baseline";
+			client::os::baseline_file file(dir.state(), std::chrono::minutes(10), dir.boot_id());
+			Assert::IsFalse(file.load(loaded), L"other file loaded");
+
+			Assert::ExpectException<std::invalid_argument>([&]() {
+				client::os::baseline_file negative(dir.state(), std::chrono::milliseconds(-1), dir.boot_id());
+			}, L"negative max age accepted");
+			Assert::ExpectException<std::system_error>([&]() {
+				client::os::baseline_file missing(dir.state(), std::chrono::minutes(10), dir.state() + ".none");
+			}, L"missing boot id accepted");
+		}
+	};
+}
@@ -0,0 +1,154 @@
+#include "CppUnitTest.h"
+
+#include <binlog.hpp>
+
+#include <cstring>
+#include <sstream>
+#include <string>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace CrossMonitorClientTests
+{
+	TEST_CLASS(binlog_UnitTests)
+	{
+		/**
+		 * write three blocks: info records at t=1000..1002, a warning at t=2000
+		 * and an error at t=3000
+		 */
+		static std::string getLog() {
+			using namespace crossover::monitor::log;
+			namespace trivial = boost::log::trivial;
+
+			std::ostringstream out;
+			binary::writer writer(out);
+			for (unsigned i = 0; i < 3; ++i) {
+				writer.append(1000 + i, trivial::info, 42,
+					arguments("cpu %1% memory %2% count %3% name %4%", 12.5, -3, 7u + i, "C"));
+			}
+			writer.write_block();
+			writer.append(2000, trivial::warning, 43, std::string("plain message"));
+			writer.write_block();
+			writer.append(3000, trivial::error, 42, arguments("code %1%", 5));
+			writer.write_block();
+			return out.str();
+		}
+
+	public:
+
+		/**
+		 * check binary::writer / binary::reader round trip
+		 *
+		 * 1. read back every record of getLog()
+		 * 2. compare timestamps, severities, threads and rendered messages
+		 */
+		TEST_METHOD(BinaryLogRoundTrip)
+		{
+			using namespace crossover::monitor::log;
+			namespace trivial = boost::log::trivial;
+
+			std::istringstream in(getLog());
+			binary::reader reader(in);
+			binary::record rec;
+
+			for (unsigned i = 0; i < 3; ++i) {
+				Assert::IsTrue(reader.next(rec), L"info record missing");
+				Assert::IsTrue(rec.timestamp == 1000 + i, L"rec.timestamp != 1000 + i");
+				Assert::IsTrue(rec.severity == trivial::info, L"rec.severity != info");
+				Assert::IsTrue(rec.thread_id == 42, L"rec.thread_id != 42");
+				Assert::AreEqual(std::string("cpu 12.5 memory -3 count ") + std::to_string(7 + i) + " name C",
+					rec.args.render(), L"unexpected info message");
+			}
+
+			Assert::IsTrue(reader.next(rec), L"warning record missing");
+			Assert::IsTrue(rec.timestamp == 2000 && rec.thread_id == 43, L"unexpected warning record");
+			Assert::AreEqual(std::string("plain message"), rec.args.render(), L"unexpected warning message");
+
+			Assert::IsTrue(reader.next(rec), L"error record missing");
+			Assert::AreEqual(std::string("code 5"), rec.args.render(), L"unexpected error message");
+
+			Assert::IsFalse(reader.next(rec), L"unexpected record after the last one");
+		}
+
+		/**
+		 * check that filtered out blocks are skipped without reading their records
+		 */
+		TEST_METHOD(BinaryLogFilterSkipsBlocks)
+		{
+			using namespace crossover::monitor::log;
+			namespace trivial = boost::log::trivial;
+
+			std::istringstream in(getLog());
+			binary::reader reader(in);
+			binary::record rec;
+			binary::filter filter;
+			filter.from = 1500;
+			filter.min_severity = trivial::error;
+
+			Assert::IsTrue(reader.next(rec, filter), L"error record missing");
+			Assert::IsTrue(rec.timestamp == 3000, L"rec.timestamp != 3000");
+			Assert::IsFalse(reader.next(rec, filter), L"unexpected record after the error");
+
+			Assert::IsTrue(reader.blocks_skipped() == 2, L"blocks_skipped() != 2");
+			Assert::IsTrue(reader.records_skipped() == 0, L"records_skipped() != 0");
+		}
+
+		/**
+		 * check that formats are told apart by content, not address
+		 *
+		 * 1. one buffer holding two formats in turn gives two formats
+		 * 2. two buffers holding the same format define it once
+		 * 3. records read back from a log encode again as they were
+		 */
+		TEST_METHOD(BinaryLogFormatsByContent)
+		{
+			using namespace crossover::monitor::log;
+			namespace trivial = boost::log::trivial;
+
+			std::ostringstream out;
+			{
+				binary::writer writer(out);
+				char format[32];
+				std::strcpy(format, "free %1%");
+				writer.append(1000, trivial::info, 42, arguments(format, 1));
+				std::strcpy(format, "used %1%");
+				writer.append(1001, trivial::info, 42, arguments(format, 2));
+				writer.write_block();
+
+				char first[] = "disk %1%";
+				char second[] = "disk %1%";
+				writer.append(1002, trivial::info, 42, arguments(first, 3));
+				const std::size_t one = writer.pending();
+				writer.append(1003, trivial::info, 42, arguments(second, 4));
+				const std::size_t two = writer.pending();
+				writer.append(1004, trivial::info, 42, arguments(first, 5));
+				Assert::IsTrue(two - one == writer.pending() - two, L"same format defined again");
+				writer.write_block();
+			}
+
+			const char* const expected[] = { "free 1", "used 2", "disk 3", "disk 4", "disk 5" };
+			std::istringstream in(out.str());
+			binary::reader reader(in);
+			binary::record rec;
+			std::ostringstream again;
+			{
+				binary::writer writer(again);
+				for (const char* message : expected) {
+					Assert::IsTrue(reader.next(rec), L"record missing");
+					Assert::AreEqual(std::string(message), rec.args.render(), L"unexpected message");
+					writer.append(rec.timestamp, rec.severity, rec.thread_id, rec.args);
+				}
+				Assert::IsFalse(reader.next(rec), L"unexpected record after the last one");
+				writer.write_block();
+			}
+
+			std::istringstream in_again(again.str());
+			binary::reader reread(in_again);
+			for (const char* message : expected) {
+				Assert::IsTrue(reread.next(rec), L"encoded again record missing");
+				Assert::AreEqual(std::string(message), rec.args.render(), L"unexpected message encoded again");
+			}
+		}
+
+	};
+}
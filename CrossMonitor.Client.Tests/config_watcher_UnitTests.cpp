@@ -0,0 +1,200 @@
+#include "CppUnitTest.h"
+
+#include <application.hpp>
+#include <config_watcher.hpp>
+#include <os_mock.hpp>
+#include <settings_file.hpp>
+#include <temporary_directory.hpp>
+
+#include <boost/filesystem.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace CrossMonitorClientTests
+{
+	TEST_CLASS(config_watcher_UnitTests)
+	{
+		/**
+		 * writes next to the file and renames it over, like deployment tools do
+		 */
+		static void replace(const boost::filesystem::path &file, const std::string &text) {
+			const boost::filesystem::path next = file.string() + ".next";
+			{
+				std::ofstream out(next.string());
+				out << text;
+			}
+			boost::filesystem::rename(next, file);
+		}
+
+		static bool waitFor(const std::atomic<unsigned> &value, unsigned expected) {
+			for (int i = 0; i < 300 && value < expected; ++i) {
+				std::this_thread::sleep_for(std::chrono::milliseconds(10));
+			}
+			return value >= expected;
+		}
+
+	public:
+
+		/**
+		 * check that writing the file in place, replacing it and creating it
+		 * are each seen, and that other files in the directory are not
+		 */
+		TEST_METHOD(FileChanges_ShouldCallHandler)
+		{
+			using namespace crossover::monitor::client;
+
+			temporary_directory directory;
+			const boost::filesystem::path file = directory.path / "agent.conf";
+
+			std::atomic<unsigned> changes(0);
+			os::config_watcher watcher(file.string(), [&]() {
+				++changes;
+			});
+
+			replace(file, "minutes=1\n");
+			Assert::IsTrue(waitFor(changes, 1), L"creation by rename not seen");
+
+			{
+				std::ofstream out(file.string(), std::ios::app);
+				out << "anomaly-high-rate-ms=500\n";
+			}
+			Assert::IsTrue(waitFor(changes, 2), L"write in place not seen");
+
+			{
+				std::ofstream out((directory.path / "other.conf").string());
+				out << "minutes=2\n";
+			}
+			std::this_thread::sleep_for(std::chrono::milliseconds(300));
+			Assert::AreEqual(2u, changes.load(), L"change of another file seen");
+		}
+
+		/**
+		 * check that a configuration file sets the settings it names, keeps
+		 * the others and is refused if it names anything else
+		 */
+		TEST_METHOD(LoadSettings_ShouldKeepDefaults)
+		{
+			using namespace crossover::monitor::client;
+
+			temporary_directory directory;
+			const boost::filesystem::path file = directory.path / "agent.conf";
+
+			runtime_settings defaults;
+			defaults.period = std::chrono::minutes(2);
+			defaults.high_rate_period = std::chrono::milliseconds(250);
+			defaults.net.period = std::chrono::seconds(30);
+
+			replace(file, "# sampling\nminutes=3\nrun-queue-top=5\ncpu-period-ms=500\n");
+			const runtime_settings loaded = load_settings(file.string(), defaults);
+			Assert::IsTrue(loaded.period == std::chrono::minutes(3), L"minutes not read");
+			Assert::AreEqual(std::size_t(5), loaded.run_queue_processes, L"run-queue-top not read");
+			Assert::IsTrue(loaded.cpu.period == std::chrono::milliseconds(500), L"cpu-period-ms not read");
+			Assert::IsTrue(loaded.high_rate_period == std::chrono::milliseconds(250), L"default not kept");
+			Assert::IsTrue(loaded.net.period == std::chrono::seconds(30), L"default source period not kept");
+			Assert::IsTrue(loaded.memory.period == std::chrono::milliseconds::zero(), L"unset source period changed");
+
+			replace(file, "minutes=3\nsend=both\n");
+			bool thrown = false;
+			try {
+				load_settings(file.string(), defaults);
+			} catch (const std::exception &) {
+				thrown = true;
+			}
+			Assert::IsTrue(thrown, L"setting that cannot change loaded");
+
+			thrown = false;
+			try {
+				load_settings((directory.path / "missing.conf").string(), defaults);
+			} catch (const std::exception &) {
+				thrown = true;
+			}
+			Assert::IsTrue(thrown, L"missing file loaded");
+		}
+
+		/**
+		 * check reloading the configuration of an application sampling at 10 Hz
+		 *
+		 * 1. run an application with a 100 ms period
+		 * 2. rewrite its configuration file every 150 ms, switching the CPU
+		 *    between 50 ms and 100 ms periods, load_settings() and
+		 *    reconfigure() from the watcher
+		 * 3. check that every reload was applied, that every sample collected
+		 *    was passed on, that the samples never paused and that the
+		 *    collector and its baseline were kept throughout
+		 */
+		TEST_METHOD(ReloadAt10Hz_ShouldNotLoseSamples)
+		{
+			using namespace crossover::monitor;
+			using namespace crossover::monitor::client;
+			typedef std::chrono::steady_clock clock;
+
+			os::set_process_count(34);
+			os::set_cpu_use_percent(1.f);
+			os::set_memory_use_percent(55.f);
+			os::set_disk_io_stats({ { 1123, 3321, L'C' } });
+
+			temporary_directory directory;
+			const boost::filesystem::path file = directory.path / "agent.conf";
+
+			const std::uint64_t collectors_before = os::collector_count();
+			std::vector<clock::time_point> samples;
+			application app{ std::chrono::minutes(1), [&](const web::json::value &) {
+				samples.push_back(clock::now());
+			} };
+			Assert::IsTrue(os::collector_count() == collectors_before + 1, L"application without a collector");
+
+			runtime_settings defaults;
+			defaults.period = std::chrono::milliseconds(100);
+			app.reconfigure(defaults);
+
+			std::atomic<unsigned> reloads(0);
+			std::atomic<long long> cpu_period_ms(0);
+			os::config_watcher watcher(file.string(), [&]() {
+				const runtime_settings settings = load_settings(file.string(), defaults);
+				app.reconfigure(settings);
+				cpu_period_ms = settings.cpu.period.count();
+				++reloads;
+			});
+
+			const std::uint64_t collected_before = os::collect_count();
+			const std::uint64_t fresh_before = os::fresh_baseline_count();
+			std::thread thr([&]() {
+				app.run();
+			});
+
+			const unsigned writes = 12;
+			for (unsigned i = 0; i < writes; ++i) {
+				std::this_thread::sleep_for(std::chrono::milliseconds(150));
+				const unsigned period_ms = i % 2 ? 100 : 50;
+				replace(file, "# written by the test\ncpu-period-ms=" + std::to_string(period_ms) + "\n");
+				Assert::IsTrue(waitFor(reloads, i + 1), L"reload not seen");
+				Assert::IsTrue(cpu_period_ms == period_ms, L"reload not read from the file");
+			}
+
+			app.stop();
+			thr.join();
+			const std::uint64_t collected = os::collect_count() - collected_before;
+
+			Logger::WriteMessage(("samples: " + std::to_string(samples.size())).c_str());
+			Assert::IsTrue(collected == samples.size(), L"collected sample not passed on");
+			Assert::IsTrue(os::collector_count() == collectors_before + 1, L"collector replaced on a reload");
+			Assert::IsTrue(os::fresh_baseline_count() == fresh_before + 1, L"baseline dropped on a reload");
+			// 1.8 s at 10 to 20 Hz, far below on a loaded machine still
+			Assert::IsTrue(samples.size() >= 9, L"too few samples");
+			for (size_t i = 1; i < samples.size(); ++i) {
+				Assert::IsTrue(samples[i] - samples[i - 1] < std::chrono::milliseconds(600),
+					L"sampling paused during a reload");
+			}
+		}
+	};
+}
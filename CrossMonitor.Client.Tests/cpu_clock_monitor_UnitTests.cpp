@@ -0,0 +1,231 @@
+#include "CppUnitTest.h"
+
+#if defined(__linux__)
+
+#include <cpu_clock_monitor.hpp>
+#include <snapshot.hpp>
+#include <temporary_directory.hpp>
+
+#include <boost/filesystem.hpp>
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <system_error>
+#include <vector>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace CrossMonitorClientTests
+{
+	TEST_CLASS(cpu_clock_monitor_UnitTests)
+	{
+		/**
+		 * sysfs CPU tree and msr devices
+		 */
+		class cpu_tree {
+		public:
+			cpu_tree() {
+				boost::filesystem::create_directories(root_.path / "cpu");
+				boost::filesystem::create_directories(root_.path / "msr");
+			}
+
+			void write_cpu_file(unsigned cpu, const std::string& file, std::uint64_t value) {
+				const boost::filesystem::path path = root_.path / "cpu" / ("cpu" + std::to_string(cpu)) / file;
+				boost::filesystem::create_directories(path.parent_path());
+				// in place, as sysfs files change under their open handles
+				std::ofstream out(path.string(), std::ios::in | std::ios::out | std::ios::trunc);
+				out << value << "\n";
+			}
+
+			void write_online(const std::string& list) {
+				std::ofstream out((root_.path / "cpu" / "online").string());
+				out << list << "\n";
+			}
+
+			/**
+			 * Writes the bytes at the MPERF and APERF addresses of a file.
+			 * The device reads every MSR at its number, but in a file APERF
+			 * overlaps MPERF but for its last byte.
+			 * @return APERF as read back.
+			 */
+			std::uint64_t write_msr(unsigned cpu, std::uint64_t mperf, std::uint8_t last) {
+				const boost::filesystem::path path = root_.path / "msr" / std::to_string(cpu) / "msr";
+				boost::filesystem::create_directories(path.parent_path());
+				if (!boost::filesystem::exists(path)) {
+					std::ofstream create(path.string());
+				}
+				std::fstream out(path.string(), std::ios::in | std::ios::out | std::ios::binary);
+				out.seekp(0xe7);
+				out.write(reinterpret_cast<const char*>(&mperf), sizeof(mperf));
+				out.write(reinterpret_cast<const char*>(&last), sizeof(last));
+				return (mperf >> 8) | static_cast<std::uint64_t>(last) << 56;
+			}
+
+			std::string cpu_root() const {
+				return (root_.path / "cpu").string();
+			}
+
+			std::string msr_root() const {
+				return (root_.path / "msr").string();
+			}
+
+			void remove_msr() {
+				boost::filesystem::remove_all(root_.path / "msr");
+			}
+
+		private:
+			const temporary_directory root_;
+		};
+
+	public:
+
+		/**
+		 * check that every source of every CPU is read, from the handles
+		 * opened at first, and that two readings give the effective clock
+		 * and the throttles in between
+		 */
+		TEST_METHOD(FullTree_ShouldReadEveryCpu)
+		{
+			using namespace crossover::monitor;
+
+			cpu_tree tree;
+			tree.write_online("0-3");
+			std::uint64_t aperf[4];
+			for (unsigned c = 0; c < 4; ++c) {
+				tree.write_cpu_file(c, "cpufreq/scaling_cur_freq", 1200000 + c * 100000);
+				tree.write_cpu_file(c, "cpufreq/base_frequency", 2000000);
+				tree.write_cpu_file(c, "thermal_throttle/core_throttle_count", c);
+				tree.write_cpu_file(c, "thermal_throttle/package_throttle_count", 10);
+				aperf[c] = tree.write_msr(c, 0x0123456789abcd00ull + c, 0x10);
+			}
+
+			client::os::cpu_clock_monitor monitor(tree.cpu_root(), tree.msr_root());
+			Assert::IsTrue(monitor.cpu_count() == 4, L"cpu count mismatch");
+			Assert::IsTrue(monitor.has_frequency() && monitor.has_throttles() && monitor.has_aperf_mperf(),
+				L"source missing");
+
+			cpu_core_counters before;
+			monitor.read(before);
+			Assert::IsTrue(before.size() == 4, L"cores read mismatch");
+			for (unsigned c = 0; c < 4; ++c) {
+				Assert::IsTrue(before.cpus[c] == c && before.frequency_khz[c] == 1200000 + c * 100000 &&
+					before.base_frequency_khz[c] == 2000000, L"clock mismatch");
+				Assert::IsTrue(before.core_throttles[c] == c && before.package_throttles[c] == 10, L"throttles mismatch");
+				Assert::IsTrue(before.mperf[c] == 0x0123456789abcd00ull + c && before.aperf[c] == aperf[c],
+					L"APERF/MPERF mismatch");
+			}
+
+			// CPU 3 was throttled twice
+			for (unsigned c = 0; c < 4; ++c) {
+				tree.write_cpu_file(c, "cpufreq/scaling_cur_freq", 3000000);
+				tree.write_cpu_file(c, "thermal_throttle/package_throttle_count", 11);
+				aperf[c] = tree.write_msr(c, 0x0123456789abce00ull, 0x20);
+			}
+			tree.write_cpu_file(3, "thermal_throttle/core_throttle_count", 5);
+			// the devices stay open
+			tree.remove_msr();
+
+			cpu_core_counters after;
+			monitor.read(after);
+			cpu_core_stats cores;
+			delta_buffers buffers;
+			snapshot_decoder::core_deltas(before, after, cores, buffers);
+			Assert::IsTrue(cores.size() == 4, L"core stats size mismatch");
+			for (unsigned c = 0; c < 4; ++c) {
+				Assert::IsTrue(after.mperf[c] == 0x0123456789abce00ull && after.aperf[c] == aperf[c], L"MSRs not read again");
+				Assert::IsTrue(cores.frequency_khz[c] == 3000000, L"frequency not read again");
+				Assert::IsTrue(cores.package_throttles[c] == 1, L"package throttles mismatch");
+			}
+			Assert::IsTrue(cores.core_throttles[0] == 0 && cores.core_throttles[3] == 2, L"core throttles mismatch");
+		}
+
+		/**
+		 * check the effective clock of CPUs that ran at (1 + c / 4) times
+		 * their base clock, of one whose counters did not move, and that
+		 * the deltas follow CPUs by number when they go offline or online
+		 */
+		TEST_METHOD(AperfMperf_ShouldGiveEffectiveFrequency)
+		{
+			using namespace crossover::monitor;
+
+			cpu_core_counters before;
+			cpu_core_counters after;
+			before.resize(5);
+			after.resize(5);
+			for (unsigned c = 0; c < 5; ++c) {
+				before.cpus[c] = after.cpus[c] = c;
+				before.base_frequency_khz[c] = after.base_frequency_khz[c] = 2000000;
+				before.aperf[c] = before.mperf[c] = 1000;
+				// CPU 4 did not run
+				after.aperf[c] = c < 4 ? 1000 + 400 + c * 100 : 1000;
+				after.mperf[c] = c < 4 ? 1400 : 1000;
+			}
+
+			cpu_core_stats cores;
+			delta_buffers buffers;
+			snapshot_decoder::core_deltas(before, after, cores, buffers);
+			for (unsigned c = 0; c < 4; ++c) {
+				Assert::IsTrue(cores.effective_frequency_khz[c] == 2000000 + c * 500000, L"effective frequency mismatch");
+			}
+			Assert::IsTrue(cores.effective_frequency_khz[4] == 0, L"idle CPU has an effective frequency");
+
+			// CPU 1 went offline, CPU 4 moved first and CPU 7 came online
+			cpu_core_counters moved;
+			moved.resize(3);
+			const unsigned cpus[3] = { 4, 0, 7 };
+			for (unsigned i = 0; i < 3; ++i) {
+				moved.cpus[i] = cpus[i];
+				moved.base_frequency_khz[i] = 2000000;
+				moved.aperf[i] = 1000 + 800;
+				moved.mperf[i] = 1000 + 400;
+				moved.core_throttles[i] = 3;
+			}
+			snapshot_decoder::core_deltas(before, moved, cores, buffers);
+			Assert::IsTrue(cores.cpus == std::vector<unsigned>({ 4, 0, 7 }), L"CPU order mismatch");
+			Assert::IsTrue(cores.effective_frequency_khz[0] == 4000000 && cores.effective_frequency_khz[1] == 4000000,
+				L"moved CPU effective frequency mismatch");
+			Assert::IsTrue(cores.core_throttles[0] == 3 && cores.core_throttles[1] == 3, L"moved CPU throttles mismatch");
+			// the new CPU is its own base, it moved nothing
+			Assert::IsTrue(cores.effective_frequency_khz[2] == 0 && cores.core_throttles[2] == 0, L"new CPU moved");
+		}
+
+		/**
+		 * check that missing sources read as 0: no online list, no
+		 * thermal_throttle, no msr devices and cpufreq for one CPU only
+		 */
+		TEST_METHOD(MissingSources_ShouldReadAsZero)
+		{
+			using namespace crossover::monitor;
+
+			cpu_tree tree;
+			tree.write_cpu_file(0, "cpufreq/scaling_cur_freq", 2400000);
+			tree.write_cpu_file(1, "topology/core_id", 1);
+			tree.remove_msr();
+
+			client::os::cpu_clock_monitor monitor(tree.cpu_root(), tree.msr_root());
+			Assert::IsTrue(monitor.cpu_count() == 2, L"CPU directories not listed");
+			Assert::IsTrue(monitor.has_frequency(), L"frequency missing");
+			Assert::IsFalse(monitor.has_throttles() || monitor.has_aperf_mperf(), L"missing source found");
+
+			cpu_core_counters before;
+			cpu_core_counters after;
+			monitor.read(before);
+			monitor.read(after);
+			Assert::IsTrue(after.frequency_khz[0] == 2400000 && after.frequency_khz[1] == 0, L"frequency mismatch");
+			Assert::IsTrue(after.core_throttles[1] == 0 && after.aperf[1] == 0, L"missing source not 0");
+
+			cpu_core_stats cores;
+			delta_buffers buffers;
+			snapshot_decoder::core_deltas(before, after, cores, buffers);
+			Assert::IsTrue(cores.effective_frequency_khz[0] == 0 && cores.effective_frequency_khz[1] == 0,
+				L"effective frequency without APERF/MPERF");
+
+			Assert::ExpectException<std::system_error>([&]() {
+				client::os::cpu_clock_monitor none(tree.msr_root(), tree.msr_root());
+			}, L"no CPU accepted");
+		}
+	};
+}
+
+#endif
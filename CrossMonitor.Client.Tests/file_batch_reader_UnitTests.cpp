@@ -0,0 +1,111 @@
+#include "CppUnitTest.h"
+
+#if defined(__linux__)
+
+#include <file_batch_reader.hpp>
+#include <temporary_directory.hpp>
+
+#include <boost/filesystem.hpp>
+
+#include <fstream>
+#include <string>
+#include <system_error>
+#include <vector>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace CrossMonitorClientTests
+{
+	TEST_CLASS(file_batch_reader_UnitTests)
+	{
+		/**
+		 * rewrites the file in place, the reader keeps it open
+		 */
+		static void write(const boost::filesystem::path &file, const std::string &text) {
+			std::ofstream out(file.string(), std::ios::binary | std::ios::trunc);
+			out << text;
+		}
+
+		static std::string contents(const crossover::monitor::client::os::file_batch_reader &reader, std::size_t index) {
+			return std::string(reader.data(index), reader.length(index));
+		}
+
+	public:
+
+		/**
+		 * check that io_uring and pread read the same contents of many
+		 * files, some larger than their buffer
+		 *
+		 * 1. write 600 files of 0 to 300 bytes
+		 * 2. read them with both readers, 64 bytes of buffer each
+		 * 3. every file must read as written, twice in a row
+		 */
+		TEST_METHOD(ManyFiles_ShouldReadTheSameWithAndWithoutIoUring)
+		{
+			using crossover::monitor::client::os::file_batch_reader;
+
+			const temporary_directory directory;
+			std::vector<std::string> expected;
+			for (unsigned i = 0; i < 600; ++i) {
+				expected.push_back(std::string(i % 301, static_cast<char>('a' + i % 26)));
+				write(directory.path / std::to_string(i), expected.back());
+			}
+
+			for (const bool use_io_uring : { true, false }) {
+				file_batch_reader reader(use_io_uring);
+				for (unsigned i = 0; i < expected.size(); ++i) {
+					Assert::IsTrue(reader.add((directory.path / std::to_string(i)).string(), 64) == i, L"index mismatch");
+				}
+				Assert::IsTrue(use_io_uring || !reader.uses_io_uring(), L"io_uring used when not asked to");
+				if (use_io_uring && !reader.uses_io_uring()) {
+					Logger::WriteMessage("io_uring not available, reading with pread");
+				}
+
+				for (int pass = 0; pass < 2; ++pass) {
+					Assert::IsTrue(reader.read() == expected.size(), L"file not read");
+					for (unsigned i = 0; i < expected.size(); ++i) {
+						Assert::IsTrue(reader.error(i) == 0, L"read failed");
+						Assert::IsTrue(contents(reader, i) == expected[i], L"contents mismatch");
+					}
+				}
+			}
+		}
+
+		/**
+		 * check that the reader follows a file rewritten between reads,
+		 * grown past its buffer and shrunk again, and that a file which
+		 * cannot be opened throws
+		 */
+		TEST_METHOD(RewrittenFile_ShouldBeReadWhole)
+		{
+			using crossover::monitor::client::os::file_batch_reader;
+
+			const temporary_directory directory;
+			const boost::filesystem::path file = directory.path / "counters";
+			const std::string large(10000, 'x');
+
+			for (const bool use_io_uring : { true, false }) {
+				file_batch_reader reader(use_io_uring);
+				write(file, "cpu 1 2 3\n");
+				reader.add(file.string(), 16);
+				Assert::IsTrue(reader.size() == 1, L"size() != 1");
+
+				Assert::IsTrue(reader.read() == 1 && contents(reader, 0) == "cpu 1 2 3\n", L"first contents mismatch");
+				write(file, large);
+				Assert::IsTrue(reader.read() == 1 && contents(reader, 0) == large, L"grown contents cut");
+				// laid out again with the larger buffer
+				Assert::IsTrue(reader.read() == 1 && contents(reader, 0) == large, L"grown contents cut on the next read");
+				write(file, "cpu 4\n");
+				Assert::IsTrue(reader.read() == 1 && contents(reader, 0) == "cpu 4\n", L"shrunk contents mismatch");
+
+				Assert::ExpectException<std::system_error>([&]() {
+					reader.add((directory.path / "missing").string());
+				});
+				reader.clear();
+				Assert::IsTrue(reader.size() == 0 && reader.read() == 0, L"files not cleared");
+			}
+		}
+	};
+}
+
+#endif
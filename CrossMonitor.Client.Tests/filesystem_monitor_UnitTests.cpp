@@ -0,0 +1,148 @@
+#include "CppUnitTest.h"
+
+#if defined(__linux__)
+
+#include <filesystem_monitor.hpp>
+#include <procfs.hpp>
+
+#include <boost/filesystem.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace CrossMonitorClientTests
+{
+	TEST_CLASS(filesystem_monitor_UnitTests)
+	{
+		static bool has_mount(const crossover::monitor::fs_stats &filesystems, const std::string &mount_point) {
+			return std::any_of(filesystems.begin(), filesystems.end(), [&](const crossover::monitor::fs_stat &fs) {
+				return fs.mount_point == mount_point;
+			});
+		}
+
+	public:
+
+		/**
+		 * check that mountinfo lines are unescaped, pseudo filesystems
+		 * skipped and stacked mounts reduced to the visible one
+		 */
+		TEST_METHOD(MountInfo_ShouldListFilesystems)
+		{
+			using namespace crossover::monitor;
+
+			const std::string text =
+				"22 1 0:21 / /proc rw,nosuid shared:12 - proc proc rw\n"
+				"25 1 8:1 / / rw,relatime shared:1 - ext4 /dev/sda1 rw\n"
+				"26 25 0:23 / /sys/fs/cgroup ro shared:9 - cgroup2 cgroup2 rw\n"
+				"31 25 0:45 / /mnt/my\\040disk rw master:3 - xfs /dev/sdb1 rw\n"
+				"32 25 0:46 / /data rw - nfs4 server:/export rw\n"
+				"33 25 0:47 / /data rw - ext4 /dev/sdc1 rw";
+			std::vector<procfs::mount_entry> mounts;
+			procfs::parse_mountinfo(text, mounts);
+
+			Assert::IsTrue(mounts.size() == 3, L"mounts.size() != 3");
+			Assert::IsTrue(mounts[0].mount_point == "/" && mounts[0].fs_type == "ext4" && mounts[0].source == "/dev/sda1",
+				L"root mount mismatch");
+			Assert::IsTrue(mounts[1].mount_point == "/mnt/my disk" && mounts[1].fs_type == "xfs", L"escaped mount point mismatch");
+			Assert::IsTrue(mounts[2].mount_point == "/data" && mounts[2].fs_type == "ext4", L"stacked mount not replaced");
+		}
+
+		/**
+		 * check that the mount table of this process is parsed once while
+		 * nothing is mounted, and that the root filesystem is read
+		 */
+		TEST_METHOD(MountTable_ShouldBeParsedOnlyOnChange)
+		{
+			using namespace crossover::monitor;
+
+			client::os::filesystem_monitor monitor;
+			fs_stats filesystems;
+			for (int i = 0; i < 5; ++i) {
+				monitor.read(filesystems);
+			}
+			Assert::IsTrue(monitor.mount_table_reads() == 1, L"mount table parsed again without a change");
+			Assert::IsTrue(has_mount(filesystems, "/"), L"root filesystem missing");
+			for (const auto &fs : filesystems) {
+				Assert::IsTrue(fs.used_bytes <= fs.size_bytes && fs.inodes_used <= fs.inodes, L"capacity out of range");
+			}
+		}
+
+		/**
+		 * check that a mount whose statfs hangs is skipped without stalling
+		 * the readings and read again once its call returns
+		 *
+		 * 1. read a mount table of three mounts, the second one hanging
+		 * 2. the read must return the other two within a few timeouts and
+		 *    count one hung mount; the next read must not call it again
+		 * 3. release the hanging call, the mount must come back
+		 */
+		TEST_METHOD(HungMount_ShouldBeSkipped)
+		{
+			using namespace crossover::monitor;
+
+			const boost::filesystem::path table = boost::filesystem::temp_directory_path() /
+				boost::filesystem::unique_path("crossmonitor-mountinfo-%%%%-%%%%");
+			{
+				std::ofstream out(table.string());
+				out << "25 1 8:1 / /a rw - ext4 /dev/sda1 rw\n"
+					"26 25 0:40 / /hang rw - nfs4 server:/export rw\n"
+					"27 25 8:17 / /c rw - ext4 /dev/sdb1 rw\n";
+			}
+
+			std::mutex lock;
+			std::condition_variable released_changed;
+			bool released = false;
+			std::atomic<int> hang_calls(0);
+			const auto stat = [&](const std::string &path, fs_stat &fs) {
+				if (path == "/hang") {
+					++hang_calls;
+					std::unique_lock<std::mutex> guard(lock);
+					released_changed.wait(guard, [&]() { return released; });
+				}
+				fs = fs_stat{ path, 1000, 400, 500, 100, 10 };
+				return true;
+			};
+
+			const std::chrono::milliseconds timeout(50);
+			{
+				client::os::filesystem_monitor monitor(timeout, stat, table.string());
+				fs_stats filesystems;
+
+				const auto start = std::chrono::steady_clock::now();
+				monitor.read(filesystems);
+				Assert::IsTrue(std::chrono::steady_clock::now() - start < 20 * timeout, L"read stalled on the hung mount");
+				Assert::IsTrue(filesystems.size() == 2 && has_mount(filesystems, "/a") && has_mount(filesystems, "/c"),
+					L"answering mounts missing");
+				Assert::IsTrue(monitor.hung_mounts() == 1, L"hung mount not counted");
+
+				monitor.read(filesystems);
+				Assert::IsTrue(filesystems.size() == 2 && monitor.hung_mounts() == 1, L"hung mount not skipped");
+				Assert::IsTrue(hang_calls == 1, L"hung mount called again");
+
+				{
+					std::lock_guard<std::mutex> guard(lock);
+					released = true;
+				}
+				released_changed.notify_all();
+				for (int i = 0; i < 200 && !has_mount(filesystems, "/hang"); ++i) {
+					std::this_thread::sleep_for(std::chrono::milliseconds(5));
+					monitor.read(filesystems);
+				}
+				Assert::IsTrue(filesystems.size() == 3 && filesystems[1].mount_point == "/hang", L"released mount not back");
+				Assert::IsTrue(monitor.hung_mounts() == 0, L"released mount still counted as hung");
+			}
+			boost::filesystem::remove(table);
+		}
+	};
+}
+
+#endif
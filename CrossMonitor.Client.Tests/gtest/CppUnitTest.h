@@ -0,0 +1,217 @@
+#pragma once
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstring>
+#include <exception>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * The part of Microsoft's CppUnitTest framework the tests use, on top of
+ * Google Test, so that the same test sources build and run where Visual
+ * Studio does not. Every TEST_METHOD becomes the Google Test test
+ * Class.Method; Assert throws like it does in Visual Studio and the
+ * failure is reported when the method returns.
+ */
+
+namespace Microsoft {
+namespace VisualStudio {
+namespace CppUnitTestFramework {
+
+	namespace details {
+
+		/**
+		 * Thrown by a failed Assert, deliberately not a std::exception
+		 * so that the code under test cannot swallow it.
+		 */
+		struct failure {
+			std::string message;
+		};
+
+		inline std::string narrow(const wchar_t* text) {
+			std::string res;
+			for (; text && *text; ++text) {
+				res += *text < 0x80 ? static_cast<char>(*text) : '?';
+			}
+			return res;
+		}
+
+		inline std::string narrow(const char* text) {
+			return text ? text : "";
+		}
+
+		template <class T>
+		class test_class {
+		public:
+			typedef T self_type;
+			typedef void (T::*method)();
+
+			static std::vector<std::pair<const char*, method>>& methods() {
+				static std::vector<std::pair<const char*, method>> res;
+				return res;
+			}
+
+			/**
+			 * Set while the one instance made to list the methods exists.
+			 */
+			static bool& discovering() {
+				static bool res = false;
+				return res;
+			}
+
+			struct method_entry {
+				method_entry(const char* name, method m) {
+					if (discovering()) {
+						methods().emplace_back(name, m);
+					}
+				}
+			};
+		};
+
+		template <class T>
+		class test final : public ::testing::Test {
+		public:
+			explicit test(typename test_class<T>::method m)
+				: method_(m) {
+			}
+
+			void TestBody() override {
+				try {
+					T instance;
+					(instance.*method_)();
+				} catch (const failure& f) {
+					ADD_FAILURE() << f.message;
+				} catch (const std::exception& e) {
+					ADD_FAILURE() << "Unexpected exception: " << e.what();
+				} catch (...) {
+					ADD_FAILURE() << "Unexpected exception";
+				}
+			}
+
+		private:
+			typename test_class<T>::method method_;
+		};
+
+		/**
+		 * Registers the methods of a TEST_CLASS with Google Test.
+		 */
+		template <class T>
+		class class_registration final {
+		public:
+			class_registration(const char* name, const char* file, int line) {
+				test_class<T>::discovering() = true;
+				{
+					T instance;
+				}
+				test_class<T>::discovering() = false;
+
+				// in the order Visual Studio runs them, some tests share static data
+				auto& methods = test_class<T>::methods();
+				std::sort(methods.begin(), methods.end(),
+					[](const std::pair<const char*, typename test_class<T>::method>& a,
+						const std::pair<const char*, typename test_class<T>::method>& b) {
+						return std::strcmp(a.first, b.first) < 0;
+					});
+				for (const auto& m : test_class<T>::methods()) {
+					const auto method = m.second;
+					::testing::RegisterTest(name, m.first, nullptr, nullptr, file, line,
+						[method]() -> ::testing::Test* { return new test<T>(method); });
+				}
+			}
+		};
+
+	} //namespace details
+
+	class Assert final {
+	public:
+		template <class M>
+		static void Fail(const M* message) {
+			throw details::failure{ details::narrow(message) };
+		}
+		static void Fail() {
+			throw details::failure{ "Assert failed" };
+		}
+
+		static void IsTrue(bool condition, const wchar_t* message = nullptr) {
+			if (!condition) {
+				Fail(message ? message : L"Assert::IsTrue failed");
+			}
+		}
+
+		static void IsFalse(bool condition, const wchar_t* message = nullptr) {
+			if (condition) {
+				Fail(message ? message : L"Assert::IsFalse failed");
+			}
+		}
+
+		template <class T>
+		static void AreEqual(const T& expected, const T& actual, const wchar_t* message = nullptr) {
+			if (!(expected == actual)) {
+				Fail(message ? message : L"Assert::AreEqual failed");
+			}
+		}
+
+		static void AreEqual(const char* expected, const char* actual, const wchar_t* message = nullptr) {
+			if (std::strcmp(expected, actual) != 0) {
+				Fail(message ? message : L"Assert::AreEqual failed");
+			}
+		}
+
+		static void AreEqual(const wchar_t* expected, const wchar_t* actual, const wchar_t* message = nullptr) {
+			if (std::wcscmp(expected, actual) != 0) {
+				Fail(message ? message : L"Assert::AreEqual failed");
+			}
+		}
+
+		/**
+		 * The Visual Studio overload with ignoreCase, which the literal
+		 * passed for it turns into true.
+		 */
+		template <class C>
+		static void AreEqual(const C* expected, const C* actual, const wchar_t*, const wchar_t* message) {
+			AreEqual(expected, actual, message);
+		}
+
+		template <class E, class F>
+		static void ExpectException(F f, const wchar_t* message = nullptr) {
+			try {
+				f();
+			} catch (const E&) {
+				return;
+			} catch (const details::failure&) {
+				throw;
+			} catch (...) {
+				Fail(message ? message : L"Assert::ExpectException: unexpected exception type");
+			}
+			Fail(message ? message : L"Assert::ExpectException: no exception");
+		}
+	}; //class Assert
+
+	class Logger final {
+	public:
+		static void WriteMessage(const char* message) {
+			std::cout << message << std::endl;
+		}
+		static void WriteMessage(const wchar_t* message) {
+			std::cout << details::narrow(message) << std::endl;
+		}
+	}; //class Logger
+
+} //namespace CppUnitTestFramework
+} //namespace VisualStudio
+} //namespace Microsoft
+
+#define TEST_CLASS(className) \
+	class className; \
+	static ::Microsoft::VisualStudio::CppUnitTestFramework::details::class_registration<className> \
+		className##_registration(#className, __FILE__, __LINE__); \
+	class className : public ::Microsoft::VisualStudio::CppUnitTestFramework::details::test_class<className>
+
+#define TEST_METHOD(methodName) \
+	method_entry methodName##_entry{ #methodName, &self_type::methodName }; \
+	public: \
+	void methodName()
@@ -0,0 +1,198 @@
+#include "CppUnitTest.h"
+
+#include <counter_kernels.hpp>
+
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace CrossMonitorClientTests
+{
+	TEST_CLASS(kernels_UnitTests)
+	{
+		/**
+		 * counters with the cases the SIMD versions must get right: equal,
+		 * backwards, past 2^32, past 2^53 (not exact as double) and the
+		 * extremes of 64 bits
+		 */
+		static void fill(std::mt19937_64& random, std::vector<std::uint64_t>& before, std::vector<std::uint64_t>& after) {
+			for (std::size_t i = 0; i < before.size(); ++i) {
+				switch (random() % 8) {
+				case 0:
+					before[i] = after[i] = random();
+					break;
+				case 1:
+					before[i] = random();
+					after[i] = before[i] / 3;
+					break;
+				case 2:
+					before[i] = random() % 0x100000000ULL;
+					after[i] = random() % 0x100000000ULL;
+					break;
+				case 3:
+					before[i] = 0;
+					after[i] = UINT64_MAX - random() % 4;
+					break;
+				case 4:
+					before[i] = (1ULL << 53) + random() % 1000;
+					after[i] = before[i] + random() % 1000;
+					break;
+				default:
+					before[i] = random() >> (random() % 64);
+					after[i] = before[i] + (random() >> (random() % 64));
+					break;
+				}
+			}
+		}
+
+		static bool same(const void* a, const void* b, std::size_t size) {
+			return size == 0 || std::memcmp(a, b, size) == 0;
+		}
+
+		/**
+		 * runs every kernel with the scalar and with the given instruction set
+		 * over lengths 0 to 67, which covers every tail, and compares the bits
+		 */
+		static void checkSameAsScalar(crossover::monitor::kernels::isa set) {
+			using namespace crossover::monitor;
+
+			std::mt19937_64 random(7);
+			const kernels::isa initial = kernels::active();
+			for (std::size_t count = 0; count < 68; ++count) {
+				std::vector<std::uint64_t> before(count), after(count);
+				fill(random, before, after);
+				const double seconds = 0.5 + (random() % 100);
+
+				std::vector<std::uint64_t> expectedDeltas(count), actualDeltas(count);
+				std::vector<std::uint64_t> expectedWrapped(count), actualWrapped(count);
+				std::vector<double> expectedRates(count), actualRates(count);
+				std::vector<float> expectedPercent(count), actualPercent(count);
+				std::vector<unsigned> expectedNarrow(count), actualNarrow(count);
+
+				kernels::select(kernels::isa::scalar);
+				kernels::deltas(before.data(), after.data(), expectedDeltas.data(), count);
+				kernels::deltas(before.data(), after.data(), expectedWrapped.data(), count, 32);
+				kernels::rates(after.data(), seconds, expectedRates.data(), count);
+				kernels::percentages(before.data(), after.data(), expectedPercent.data(), count);
+				kernels::saturate(after.data(), expectedNarrow.data(), count);
+
+				kernels::select(set);
+				kernels::deltas(before.data(), after.data(), actualDeltas.data(), count);
+				kernels::deltas(before.data(), after.data(), actualWrapped.data(), count, 32);
+				kernels::rates(after.data(), seconds, actualRates.data(), count);
+				kernels::percentages(before.data(), after.data(), actualPercent.data(), count);
+				kernels::saturate(after.data(), actualNarrow.data(), count);
+
+				Assert::IsTrue(same(expectedDeltas.data(), actualDeltas.data(), count * sizeof(std::uint64_t)), L"deltas");
+				Assert::IsTrue(same(expectedWrapped.data(), actualWrapped.data(), count * sizeof(std::uint64_t)), L"deltas 32 bits");
+				Assert::IsTrue(same(expectedRates.data(), actualRates.data(), count * sizeof(double)), L"rates");
+				Assert::IsTrue(same(expectedPercent.data(), actualPercent.data(), count * sizeof(float)), L"percentages");
+				Assert::IsTrue(same(expectedNarrow.data(), actualNarrow.data(), count * sizeof(unsigned)), L"saturate");
+
+				// in place, as the collectors call it
+				kernels::deltas(before.data(), after.data(), after.data(), count);
+				Assert::IsTrue(same(expectedDeltas.data(), after.data(), count * sizeof(std::uint64_t)), L"deltas in place");
+			}
+			kernels::select(initial);
+		}
+
+	public:
+
+		/**
+		 * check the scalar kernels against known values
+		 */
+		TEST_METHOD(CheckScalar)
+		{
+			using namespace crossover::monitor;
+
+			const kernels::isa initial = kernels::active();
+			kernels::select(kernels::isa::scalar);
+
+			const std::uint64_t before[] = { 10, 50, 0xFFFFFFF0ULL, 7 };
+			const std::uint64_t after[] = { 25, 40, 0x10ULL, 7 };
+			std::uint64_t moved[4];
+			kernels::deltas(before, after, moved, 4);
+			Assert::AreEqual<std::uint64_t>(15, moved[0]);
+			Assert::AreEqual<std::uint64_t>(0, moved[1], L"reset counter");
+			Assert::AreEqual<std::uint64_t>(0, moved[2], L"reset counter");
+			Assert::AreEqual<std::uint64_t>(0, moved[3]);
+
+			kernels::deltas(before, after, moved, 4, 32);
+			Assert::AreEqual<std::uint64_t>(15, moved[0]);
+			Assert::AreEqual<std::uint64_t>(0xFFFFFFF6ULL, moved[1], L"wrapped 32 bit counter");
+			Assert::AreEqual<std::uint64_t>(0x20, moved[2], L"wrapped 32 bit counter");
+
+			double perSecond[2];
+			const std::uint64_t counts[] = { 60, 90 };
+			kernels::rates(counts, 30.0, perSecond, 2);
+			Assert::AreEqual(2.0, perSecond[0]);
+			Assert::AreEqual(3.0, perSecond[1]);
+			kernels::rates(counts, 0.0, perSecond, 2);
+			Assert::AreEqual(0.0, perSecond[0]);
+
+			const std::uint64_t part[] = { 1, 5, 3 };
+			const std::uint64_t whole[] = { 4, 0, 2 };
+			float percent[3];
+			kernels::percentages(part, whole, percent, 3);
+			Assert::AreEqual(25.0f, percent[0]);
+			Assert::AreEqual(0.0f, percent[1], L"nothing to divide");
+			Assert::AreEqual(100.0f, percent[2], L"part clamped to whole");
+
+			const std::uint64_t wide[] = { 12, UINT_MAX, 1ULL << 32 };
+			unsigned narrow[3];
+			kernels::saturate(wide, narrow, 3);
+			Assert::AreEqual(12u, narrow[0]);
+			Assert::AreEqual(static_cast<unsigned>(UINT_MAX), narrow[1]);
+			Assert::AreEqual(static_cast<unsigned>(UINT_MAX), narrow[2]);
+
+			kernels::select(initial);
+		}
+
+		/**
+		 * check the SSE2 kernels give exactly the scalar results
+		 */
+		TEST_METHOD(CheckSse2)
+		{
+			using namespace crossover::monitor;
+			if (!kernels::supported(kernels::isa::sse2)) {
+				Logger::WriteMessage("SSE2 not supported, skipped");
+				return;
+			}
+			checkSameAsScalar(kernels::isa::sse2);
+		}
+
+		/**
+		 * check the AVX2 kernels give exactly the scalar results
+		 */
+		TEST_METHOD(CheckAvx2)
+		{
+			using namespace crossover::monitor;
+			if (!kernels::supported(kernels::isa::avx2)) {
+				Logger::WriteMessage("AVX2 not supported, skipped");
+				return;
+			}
+			checkSameAsScalar(kernels::isa::avx2);
+		}
+
+		/**
+		 * check selecting an instruction set the CPU lacks is refused
+		 */
+		TEST_METHOD(CheckSelect)
+		{
+			using namespace crossover::monitor;
+			Assert::IsTrue(kernels::supported(kernels::isa::scalar));
+			Assert::IsTrue(kernels::supported(kernels::active()));
+			for (kernels::isa set : { kernels::isa::sse2, kernels::isa::avx2 }) {
+				if (!kernels::supported(set)) {
+					Assert::ExpectException<std::invalid_argument>([set]() { kernels::select(set); });
+				}
+			}
+			Assert::AreEqual("avx2", kernels::name(kernels::isa::avx2));
+		}
+	};
+}
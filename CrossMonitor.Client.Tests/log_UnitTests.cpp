@@ -0,0 +1,212 @@
+#include "CppUnitTest.h"
+
+#include <bounded_queue.hpp>
+#include <log.hpp>
+#include <temporary_directory.hpp>
+
+#include <boost/filesystem.hpp>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define LOG CROSSOVER_MONITOR_LOG
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace CrossMonitorClientTests
+{
+	TEST_CLASS(log_UnitTests)
+	{
+		/**
+		 * asynchronous logging to a file only, a flush every hour at most
+		 */
+		static crossover::monitor::log::options getOptions(std::size_t capacity,
+			crossover::monitor::log::overflow_policy overflow) {
+			crossover::monitor::log::options options;
+			options.asynchronous = true;
+			options.queue_capacity = capacity;
+			options.flush_interval = std::chrono::hours(1);
+			options.overflow = overflow;
+			options.console = false;
+			return options;
+		}
+
+		/**
+		 * the numbers of the "record <thread> <number>" lines of a log file,
+		 * per thread in the order written
+		 */
+		static std::vector<std::vector<unsigned>> getRecords(const boost::filesystem::path &file, unsigned threads) {
+			std::vector<std::vector<unsigned>> res(threads);
+			std::ifstream in(file.string());
+			std::string line;
+			while (std::getline(in, line)) {
+				const std::size_t pos = line.find("record ");
+				if (pos == std::string::npos) {
+					continue;
+				}
+				std::size_t end = 0;
+				const unsigned thread = std::stoul(line.substr(pos + 7), &end);
+				const unsigned number = std::stoul(line.substr(pos + 7 + end));
+				Assert::IsTrue(thread < threads, L"record of an unknown thread");
+				res[thread].push_back(number);
+			}
+			return res;
+		}
+
+	public:
+
+		/**
+		 * check that a queue fed by several producers passes every element
+		 * to its consumer exactly once, in the order of each producer
+		 */
+		TEST_METHOD(BoundedQueue_ShouldPassEveryElementOnce)
+		{
+			using crossover::monitor::utils::bounded_queue;
+
+			Assert::ExpectException<std::invalid_argument>([]() {
+				bounded_queue<int> queue(48);
+			}, L"capacity not a power of two accepted");
+			Assert::ExpectException<std::invalid_argument>([]() {
+				bounded_queue<int> queue(1);
+			}, L"capacity of one accepted");
+
+			const unsigned producers = 4;
+			const std::uint64_t per_producer = 100000;
+			bounded_queue<std::uint64_t> queue(64);
+			Assert::IsTrue(queue.capacity() == 64, L"capacity != 64");
+
+			std::vector<std::thread> threads;
+			for (unsigned p = 0; p < producers; ++p) {
+				threads.emplace_back([&queue, p, per_producer]() {
+					for (std::uint64_t i = 0; i < per_producer; ++i) {
+						while (!queue.try_push(p * per_producer + i)) {
+							std::this_thread::yield();
+						}
+					}
+				});
+			}
+
+			std::vector<std::uint64_t> next(producers, 0);
+			std::uint64_t value = 0;
+			for (std::uint64_t popped = 0; popped < producers * per_producer;) {
+				if (!queue.try_pop(value)) {
+					std::this_thread::yield();
+					continue;
+				}
+				const std::uint64_t p = value / per_producer;
+				Assert::IsTrue(p < producers, L"element never pushed");
+				Assert::IsTrue(value % per_producer == next[p], L"element lost, duplicated or out of order");
+				++next[p];
+				++popped;
+			}
+			for (auto &thr : threads) {
+				thr.join();
+			}
+			Assert::IsFalse(queue.try_pop(value), L"element left over");
+		}
+
+		/**
+		 * check that records logged faster than the drain thread writes them
+		 * to a full queue are dropped and counted, and the others written in
+		 * order
+		 */
+		TEST_METHOD(DropPolicy_ShouldCountDroppedRecords)
+		{
+			namespace log = crossover::monitor::log;
+
+			const temporary_directory directory;
+			const boost::filesystem::path file = directory.path / "agent.log";
+			log::init(getOptions(2, log::overflow_policy::drop));
+			log::set_file(file.string());
+
+			const unsigned count = 20000;
+			for (unsigned i = 0; i < count; ++i) {
+				LOG(info) << "record 0 " << i;
+			}
+			log::flush();
+			const std::uint64_t dropped = log::dropped_records();
+			const std::vector<unsigned> written = getRecords(file, 1)[0];
+			log::shutdown();
+
+			Logger::WriteMessage(("dropped: " + std::to_string(dropped)).c_str());
+			Assert::IsTrue(written.size() < count, L"nothing dropped");
+			Assert::IsTrue(written.size() + dropped >= count, L"dropped record not counted");
+			for (std::size_t i = 1; i < written.size(); ++i) {
+				Assert::IsTrue(written[i - 1] < written[i], L"records out of order");
+			}
+		}
+
+		/**
+		 * check that threads logging to a full queue wait for it, so that
+		 * every record is written once and in the order of its thread
+		 */
+		TEST_METHOD(BlockPolicy_ShouldKeepEveryRecord)
+		{
+			namespace log = crossover::monitor::log;
+
+			const temporary_directory directory;
+			const boost::filesystem::path file = directory.path / "agent.log";
+			log::init(getOptions(16, log::overflow_policy::block));
+			log::set_file(file.string());
+
+			const unsigned threads = 4;
+			const unsigned count = 500;
+			std::vector<std::thread> loggers;
+			for (unsigned t = 0; t < threads; ++t) {
+				loggers.emplace_back([t, count]() {
+					for (unsigned i = 0; i < count; ++i) {
+						LOG(info) << "record " << t << " " << i;
+					}
+				});
+			}
+			for (auto &thr : loggers) {
+				thr.join();
+			}
+			log::flush();
+			const std::uint64_t dropped = log::dropped_records();
+			const std::vector<std::vector<unsigned>> written = getRecords(file, threads);
+			log::shutdown();
+
+			Assert::IsTrue(dropped == 0, L"records dropped");
+			for (unsigned t = 0; t < threads; ++t) {
+				Assert::IsTrue(written[t].size() == count, L"record lost or duplicated");
+				for (unsigned i = 0; i < count; ++i) {
+					Assert::IsTrue(written[t][i] == i, L"records out of order");
+				}
+			}
+		}
+
+		/**
+		 * check that flush() writes out every record still queued or
+		 * buffered before it returns, as the termination handler expects
+		 */
+		TEST_METHOD(Flush_ShouldWriteEveryQueuedRecord)
+		{
+			namespace log = crossover::monitor::log;
+
+			const temporary_directory directory;
+			const boost::filesystem::path file = directory.path / "agent.log";
+			log::init(getOptions(8192, log::overflow_policy::block));
+			log::set_file(file.string());
+
+			const unsigned count = 5000;
+			for (unsigned i = 0; i < count; ++i) {
+				LOG(info) << "record 0 " << i;
+			}
+			log::flush();
+			const std::vector<unsigned> written = getRecords(file, 1)[0];
+			log::shutdown();
+
+			Assert::IsTrue(written.size() == count, L"queued record not written by flush()");
+			for (unsigned i = 0; i < count; ++i) {
+				Assert::IsTrue(written[i] == i, L"records out of order");
+			}
+		}
+	};
+}
@@ -0,0 +1,163 @@
+#include "CppUnitTest.h"
+
+#if defined(__linux__)
+
+#include <net_monitor.hpp>
+#include <procfs.hpp>
+#include <snapshot.hpp>
+#include <temporary_directory.hpp>
+
+#include <boost/filesystem.hpp>
+
+#include <unistd.h>
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <system_error>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace CrossMonitorClientTests
+{
+	TEST_CLASS(net_monitor_UnitTests)
+	{
+		/**
+		 * /proc/net with the files net_monitor reads
+		 */
+		class net_tree {
+		public:
+			net_tree() {
+				boost::filesystem::create_directories(root_.path / "net");
+			}
+
+			void write(const std::string& file, const std::string& text) {
+				const std::string path = (root_.path / "net" / file).string();
+				// in place, as procfs files change under their open handles
+				std::ofstream out(path, std::ios::in | std::ios::out | std::ios::trunc);
+				if (!out) {
+					out.open(path);
+				}
+				out << text;
+			}
+
+			/**
+			 * Writes snmp, netstat and sockstat as a 5.x kernel does, with
+			 * the counters given.
+			 */
+			void write_all(std::uint64_t retransmits, std::uint64_t overflows, std::uint64_t tcp_sockets) {
+				write("snmp",
+					"Ip: Forwarding DefaultTTL InReceives\n"
+					"Ip: 1 64 123456\n"
+					"Tcp: RtoAlgorithm RtoMin RtoMax MaxConn ActiveOpens PassiveOpens AttemptFails EstabResets CurrEstab InSegs OutSegs RetransSegs InErrs OutRsts InCsumErrors\n"
+					"Tcp: 1 200 120000 -1 500 400 3 7 12 90000 80000 " + std::to_string(retransmits) + " 0 21 0\n"
+					"Udp: InDatagrams NoPorts InErrors OutDatagrams RcvbufErrors SndbufErrors InCsumErrors IgnoredMulti\n"
+					"Udp: 1000 5 2 900 4 0 0 0\n");
+				write("netstat",
+					"TcpExt: SyncookiesSent SyncookiesRecv ListenOverflows ListenDrops TCPTimeouts\n"
+					"TcpExt: 0 0 " + std::to_string(overflows) + " " + std::to_string(overflows + 1) + " 42\n"
+					"IpExt: InNoRoutes InTruncatedPkts\n"
+					"IpExt: 0 0\n");
+				write("sockstat",
+					"sockets: used 321\n"
+					"TCP: inuse " + std::to_string(tcp_sockets) + " orphan 2 tw 9 alloc 20 mem 3\n"
+					"UDP: inuse 6 mem 1\n"
+					"UDPLITE: inuse 0\n"
+					"RAW: inuse 0\n"
+					"FRAG: inuse 0 memory 0\n");
+			}
+
+			std::string root() const {
+				return root_.path.string();
+			}
+
+		private:
+			const temporary_directory root_;
+		};
+
+	public:
+
+		/**
+		 * check that every field is read, the columns looked up only once,
+		 * and the deltas between two readings
+		 */
+		TEST_METHOD(Files_ShouldBeReadByColumn)
+		{
+			using namespace crossover::monitor;
+
+			net_tree tree;
+			tree.write_all(100, 5, 10);
+			client::os::net_monitor monitor(tree.root());
+
+			net_stats before;
+			monitor.read(before);
+			const std::uint64_t page = static_cast<std::uint64_t>(sysconf(_SC_PAGESIZE));
+			Assert::IsTrue(before.tcp_retransmits == 100 && before.tcp_resets_sent == 21 &&
+				before.tcp_established_resets == 7 && before.udp_receive_buffer_errors == 4, L"snmp mismatch");
+			Assert::IsTrue(before.listen_overflows == 5 && before.listen_drops == 6, L"netstat mismatch");
+			Assert::IsTrue(before.sockets == 321 && before.tcp_sockets == 10 && before.tcp_orphans == 2 &&
+				before.tcp_time_wait == 9 && before.udp_sockets == 6, L"sockets mismatch");
+			Assert::IsTrue(before.tcp_memory_bytes == 3 * page && before.udp_memory_bytes == page, L"socket memory mismatch");
+
+			tree.write_all(130, 8, 12);
+			net_stats after;
+			monitor.read(after);
+			Assert::IsTrue(monitor.column_lookups() == 2, L"columns looked up again");
+
+			net_stats net;
+			snapshot_decoder::net_deltas(before, after, net);
+			Assert::IsTrue(net.tcp_retransmits == 30 && net.listen_overflows == 3 && net.listen_drops == 3,
+				L"deltas mismatch");
+			Assert::IsTrue(net.tcp_resets_sent == 0 && net.tcp_sockets == 12, L"gauges or idle counters mismatch");
+
+			// counters that went back, as in a new network namespace, moved nothing
+			snapshot_decoder::net_deltas(after, before, net);
+			Assert::IsTrue(net.tcp_retransmits == 0 && net.tcp_sockets == 10, L"counters went back");
+		}
+
+		/**
+		 * check that a kernel listing other columns has them looked up again,
+		 * that missing and negative fields read as 0, and that a missing file
+		 * is refused
+		 */
+		TEST_METHOD(ColumnChange_ShouldLookUpAgain)
+		{
+			using namespace crossover::monitor;
+
+			procfs::net_table_columns columns({ "Tcp:RetransSegs", "Tcp:MaxConn", "Udp:RcvbufErrors", "Tcp:Missing" });
+			const std::string first =
+				"Tcp: MaxConn RetransSegs\n"
+				"Tcp: -1 5\n"
+				"Udp: RcvbufErrors\n"
+				"Udp: 7\n";
+			std::uint64_t values[4];
+			Assert::IsTrue(columns.parse(first.data(), first.size(), values) == 2, L"found fields mismatch");
+			Assert::IsTrue(values[0] == 5 && values[1] == 0 && values[2] == 7 && values[3] == 0, L"values mismatch");
+			const std::string same =
+				"Tcp: MaxConn RetransSegs\n"
+				"Tcp: -1 6\n"
+				"Udp: RcvbufErrors\n"
+				"Udp: 8\n";
+			columns.parse(same.data(), same.size(), values);
+			Assert::IsTrue(columns.lookups() == 1 && values[0] == 6 && values[2] == 8, L"same columns looked up again");
+
+			const std::string moved =
+				"Tcp: RetransSegs NewField MaxConn\n"
+				"Tcp: 9 1 -1\n";
+			Assert::IsTrue(columns.parse(moved.data(), moved.size(), values) == 1, L"found fields mismatch");
+			Assert::IsTrue(columns.lookups() == 2 && values[0] == 9 && values[2] == 0, L"moved columns not looked up");
+
+			Assert::ExpectException<std::invalid_argument>([]() {
+				procfs::net_table_columns bad({ "RetransSegs" });
+			}, L"field without a table accepted");
+
+			net_tree tree;
+			tree.write("snmp", first);
+			Assert::ExpectException<std::system_error>([&]() {
+				client::os::net_monitor none(tree.root());
+			}, L"missing files accepted");
+		}
+	};
+}
+
+#endif
@@ -0,0 +1,265 @@
+#include "CppUnitTest.h"
+
+#if defined(__linux__)
+
+#include <numa_monitor.hpp>
+#include <procfs.hpp>
+#include <snapshot.hpp>
+#include <temporary_directory.hpp>
+
+#include <boost/filesystem.hpp>
+
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace CrossMonitorClientTests
+{
+	TEST_CLASS(numa_monitor_UnitTests)
+	{
+		static const unsigned cpus_per_node = 4;
+
+		/**
+		 * sysfs node tree of the numa_monitor
+		 */
+		class node_tree {
+		public:
+			/**
+			 * Writes node n with CPUs 4n to 4n+3, (n + 1) GiB of which
+			 * n * 128 MiB free and n * 64 MiB of file pages, and miss
+			 * pages counted from miss.
+			 */
+			void write_node(unsigned n, std::uint64_t miss) {
+				const boost::filesystem::path node = root_.path / ("node" + std::to_string(n));
+				boost::filesystem::create_directories(node);
+				const std::string id = "Node " + std::to_string(n) + " ";
+				write(node / "cpulist", std::to_string(cpus_per_node * n) + "-" + std::to_string(cpus_per_node * n + 3) + "\n");
+				write(node / "meminfo",
+					id + "MemTotal:       " + std::to_string((n + 1) * 1024 * 1024) + " kB\n" +
+					id + "MemFree:        " + std::to_string(n * 128 * 1024) + " kB\n" +
+					id + "MemUsed:        0 kB\n" +
+					id + "Active(file):   " + std::to_string(n * 32 * 1024) + " kB\n" +
+					id + "Inactive(file): " + std::to_string(n * 32 * 1024) + " kB\n");
+				write(node / "numastat",
+					"numa_hit 1000\nnuma_miss " + std::to_string(miss) + "\nnuma_foreign " + std::to_string(2 * miss) +
+					"\ninterleave_hit 0\nlocal_node 1000\nother_node " + std::to_string(miss) + "\n");
+			}
+
+			std::string path() const {
+				return root_.path.string();
+			}
+
+		private:
+			static void write(const boost::filesystem::path& path, const std::string& text) {
+				std::ofstream out(path.string());
+				out << text;
+			}
+
+			const temporary_directory root_;
+		};
+
+		/**
+		 * /proc/stat where CPU c spent 100 units, c % 4 * 10 of them busy
+		 */
+		static std::string stat_text(unsigned cpus) {
+			std::string text = "cpu  0 0 0 0 0 0 0 0 0 0\n";
+			for (unsigned c = 0; c < cpus; ++c) {
+				const unsigned busy = c % cpus_per_node * 10;
+				text += "cpu" + std::to_string(c) + " " + std::to_string(busy) + " 0 0 " +
+					std::to_string(100 - busy) + " 0 0 0 0 0 0\n";
+			}
+			return text + "intr 0\nctxt 0\n";
+		}
+
+	public:
+
+		/**
+		 * check the parsers of the node files, CPU lists and uevents
+		 */
+		TEST_METHOD(NodeFiles_ShouldBeParsed)
+		{
+			using namespace crossover::monitor;
+
+			std::uint64_t memory_total = 0;
+			std::uint64_t memory_available = 0;
+			Assert::IsTrue(procfs::parse_node_meminfo(
+				"Node 1 MemTotal:       8388608 kB\n"
+				"Node 1 MemFree:        1048576 kB\n"
+				"Node 1 MemUsed:        7340032 kB\n"
+				"Node 1 Active(file):    524288 kB\n"
+				"Node 1 Inactive(file):  524288 kB\n"
+				"Node 1 SReclaimable:    262144 kB\n", memory_total, memory_available), L"node meminfo not parsed");
+			Assert::IsTrue(memory_total == 8ull << 30, L"memory_total mismatch");
+			Assert::IsTrue(memory_available == (2ull << 30) + (256ull << 20), L"memory_available mismatch");
+			Assert::IsFalse(procfs::parse_node_meminfo("Node 0 MemTotal: 1 kB\n", memory_total, memory_available),
+				L"meminfo without MemFree parsed");
+
+			std::uint64_t numa_miss = 0;
+			std::uint64_t numa_foreign = 0;
+			Assert::IsTrue(procfs::parse_numastat("numa_hit 5\nnuma_miss 7\nnuma_foreign 9\n", numa_miss, numa_foreign),
+				L"numastat not parsed");
+			Assert::IsTrue(numa_miss == 7 && numa_foreign == 9, L"numastat mismatch");
+
+			std::vector<unsigned> cpus;
+			procfs::parse_cpulist("0-2,8,10-11\n", cpus);
+			Assert::IsTrue(cpus == std::vector<unsigned>({ 0, 1, 2, 8, 10, 11 }), L"cpulist mismatch");
+			procfs::parse_cpulist("\n", cpus);
+			Assert::IsTrue(cpus.empty(), L"empty cpulist not empty");
+
+			const auto uevent = [](const char* header) {
+				const std::string message = std::string(header) + '\0' + "ACTION=x" + '\0';
+				return procfs::topology_uevent(message.data(), message.size());
+			};
+			Assert::IsTrue(uevent("online@/devices/system/cpu/cpu3"), L"CPU online missed");
+			Assert::IsTrue(uevent("offline@/devices/system/memory/memory40"), L"memory offline missed");
+			Assert::IsTrue(uevent("add@/devices/system/node/node2"), L"node add missed");
+			Assert::IsFalse(uevent("change@/devices/system/cpu/cpu3"), L"CPU change taken");
+			Assert::IsFalse(uevent("add@/devices/system/cpu/cpufreq"), L"cpufreq taken");
+			Assert::IsFalse(uevent("add@/devices/virtual/net/veth0"), L"network device taken");
+		}
+
+		/**
+		 * check the counters of every node of 1, 2 and 8 node trees, and
+		 * the use decoded from two readings of them
+		 */
+		TEST_METHOD(FixtureTrees_ShouldReadEveryNode)
+		{
+			using namespace crossover::monitor;
+
+			for (const unsigned count : { 1u, 2u, 8u }) {
+				node_tree tree;
+				for (unsigned n = 0; n < count; ++n) {
+					tree.write_node(n, 100);
+				}
+
+				client::os::numa_monitor monitor(tree.path(), false);
+				Assert::IsTrue(monitor.node_count() == count, L"node count mismatch");
+				Assert::IsTrue(monitor.node_of(cpus_per_node * count - 1) == static_cast<int>(count - 1), L"last CPU on the wrong node");
+				Assert::IsTrue(monitor.node_of(cpus_per_node * count) == -1, L"unknown CPU on a node");
+
+				numa_counters before;
+				monitor.read(stat_text(cpus_per_node * count), before);
+				Assert::IsTrue(before.size() == count, L"nodes read mismatch");
+				for (unsigned n = 0; n < count; ++n) {
+					Assert::IsTrue(before.nodes[n] == n, L"node number mismatch");
+					// 0 + 10 + 20 + 30 busy of 4 * 100
+					Assert::IsTrue(before.cpu_total[n] == 400 && before.cpu_busy[n] == 60, L"node CPU time mismatch");
+					Assert::IsTrue(before.memory_total[n] == (n + 1ull) << 30, L"node memory_total mismatch");
+					Assert::IsTrue(before.memory_available[n] == n * (192ull << 20), L"node memory_available mismatch");
+					Assert::IsTrue(before.numa_miss[n] == 100 && before.numa_foreign[n] == 200, L"node numastat mismatch");
+				}
+
+				for (unsigned n = 0; n < count; ++n) {
+					tree.write_node(n, 100 + n);
+				}
+				numa_counters after;
+				monitor.read(stat_text(cpus_per_node * count), after);
+				for (unsigned n = 0; n < count; ++n) {
+					after.cpu_total[n] *= 2;
+					after.cpu_busy[n] = after.cpu_busy[n] * 2 + 40;
+				}
+
+				numa_stats stats;
+				delta_buffers buffers;
+				snapshot_decoder::numa_deltas(before, after, stats, buffers);
+				Assert::IsTrue(stats.size() == count, L"stats size mismatch");
+				for (unsigned n = 0; n < count; ++n) {
+					Assert::IsTrue(stats[n].node == n && stats[n].numa_miss == n && stats[n].numa_foreign == 2 * n,
+						L"numa deltas mismatch");
+					// 100 busy of 400 moved
+					Assert::IsTrue(std::fabs(stats[n].cpu_percent - 25.f) < 0.01f, L"node cpu_percent mismatch");
+					const float memory = 100.f * ((n + 1) * 1024 - n * 192) / ((n + 1) * 1024);
+					Assert::IsTrue(std::fabs(stats[n].memory_percent - memory) < 0.01f, L"node memory_percent mismatch");
+				}
+			}
+		}
+
+		/**
+		 * check that the topology is read at startup only, and again
+		 * only when a hotplug event calls for it
+		 */
+		TEST_METHOD(Topology_ShouldBeReadOnlyOnHotplug)
+		{
+			using namespace crossover::monitor;
+
+			node_tree tree;
+			tree.write_node(0, 0);
+			tree.write_node(1, 0);
+			client::os::numa_monitor monitor(tree.path(), false);
+
+			// node 2 comes online, but no event says so
+			tree.write_node(2, 0);
+			numa_counters nodes;
+			for (int i = 0; i < 5; ++i) {
+				monitor.read(stat_text(3 * cpus_per_node), nodes);
+			}
+			Assert::IsTrue(monitor.topology_reads() == 1, L"topology read again without an event");
+			Assert::IsTrue(nodes.size() == 2 && monitor.node_of(8) == -1, L"topology changed without an event");
+
+			monitor.refresh();
+			monitor.read(stat_text(3 * cpus_per_node), nodes);
+			Assert::IsTrue(monitor.topology_reads() == 2, L"topology not read again");
+			Assert::IsTrue(nodes.size() == 3 && nodes.nodes[2] == 2 && nodes.cpu_total[2] == 400, L"new node missing");
+			Assert::IsTrue(monitor.node_of(8) == 2, L"CPU of the new node mismatch");
+		}
+
+		/**
+		 * check that the deltas follow every node by number when nodes
+		 * move, go offline or come online between two readings
+		 */
+		TEST_METHOD(Deltas_ShouldMatchNodesByNumber)
+		{
+			using namespace crossover::monitor;
+
+			numa_counters before;
+			before.resize(3);
+			for (unsigned n = 0; n < 3; ++n) {
+				before.nodes[n] = n;
+				before.cpu_total[n] = 1000 * (n + 1);
+				before.cpu_busy[n] = 100 * (n + 1);
+				before.memory_total[n] = 1000;
+				before.memory_available[n] = 500;
+				before.numa_miss[n] = 10 * (n + 1);
+				before.numa_foreign[n] = 20 * (n + 1);
+			}
+
+			// node 1 went offline, node 5 came online and node 2 moved first
+			numa_counters after;
+			after.resize(3);
+			const unsigned nodes[3] = { 2, 0, 5 };
+			for (unsigned i = 0; i < 3; ++i) {
+				const unsigned n = nodes[i];
+				after.nodes[i] = n;
+				after.cpu_total[i] = 1000 * (n + 1) + 400;
+				after.cpu_busy[i] = 100 * (n + 1) + 100;
+				after.memory_total[i] = 1000;
+				after.memory_available[i] = 250;
+				after.numa_miss[i] = 10 * (n + 1) + n;
+				after.numa_foreign[i] = 20 * (n + 1) + 2 * n;
+			}
+
+			numa_stats stats;
+			delta_buffers buffers;
+			snapshot_decoder::numa_deltas(before, after, stats, buffers);
+			Assert::IsTrue(stats.size() == 3, L"stats size mismatch");
+			for (unsigned i = 0; i < 2; ++i) {
+				Assert::IsTrue(stats[i].node == nodes[i], L"node order mismatch");
+				Assert::IsTrue(std::fabs(stats[i].cpu_percent - 25.f) < 0.01f, L"moved node cpu_percent mismatch");
+				Assert::IsTrue(stats[i].numa_miss == nodes[i] && stats[i].numa_foreign == 2 * nodes[i],
+					L"moved node deltas mismatch");
+			}
+			// the new node is its own base, it moved nothing
+			Assert::IsTrue(stats[2].node == 5 && stats[2].cpu_percent == 0.f &&
+				stats[2].numa_miss == 0 && stats[2].numa_foreign == 0, L"new node moved");
+			for (const auto& stat : stats) {
+				Assert::IsTrue(std::fabs(stat.memory_percent - 75.f) < 0.01f, L"memory_percent mismatch");
+			}
+		}
+	};
+}
+
+#endif
@@ -0,0 +1,189 @@
+#include "CppUnitTest.h"
+
+#include <openmetrics.hpp>
+
+#include <string>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace CrossMonitorClientTests
+{
+	TEST_CLASS(openmetrics_UnitTests)
+	{
+		static crossover::monitor::data getSample(float cpu_percent, const crossover::monitor::IO_stats &io_stats) {
+			crossover::monitor::data res;
+			res.set_cpu_percent(cpu_percent);
+			res.set_memory_percent(40.5f);
+			res.set_process_count(123);
+			res.set_io_stats(io_stats);
+			return res;
+		}
+
+		static bool contains(const std::string &text, const std::string &line) {
+			return text.find(line + "\n") != std::string::npos;
+		}
+
+	public:
+
+		/**
+		 * check every field is exported and later samples are patched in place
+		 */
+		TEST_METHOD(Exposition_ShouldCoverEveryField)
+		{
+			using namespace crossover::monitor;
+
+			openmetrics_exporter exporter;
+			exporter.update(getSample(12.5f, { { 100, 200, L'C' }, { 300, 400, L'D' } }));
+			const std::string &text = exporter.text();
+
+			Assert::IsTrue(contains(text, "# TYPE crossmonitor_cpu_percent gauge"), L"cpu_percent type missing");
+			Assert::IsTrue(contains(text, "crossmonitor_cpu_percent 012.500"), L"cpu_percent missing");
+			Assert::IsTrue(contains(text, "crossmonitor_memory_percent 040.500"), L"memory_percent missing");
+			Assert::IsTrue(contains(text, "crossmonitor_processes 0000000123"), L"processes missing");
+			Assert::IsTrue(contains(text, "# TYPE crossmonitor_disk_read_bytes counter"), L"read type missing");
+			Assert::IsTrue(contains(text, "crossmonitor_disk_read_bytes_total{partition_name=\"D\"} 00000000000000000300"),
+				L"bytes read missing");
+			Assert::IsTrue(text.size() > 6 && text.compare(text.size() - 6, 6, "# EOF\n") == 0, L"no # EOF");
+
+			const std::size_t size = text.size();
+			exporter.update(getSample(100.f, { { 1, 2, L'C' }, { 3, 4, L'D' } }));
+			Assert::IsTrue(exporter.renders() == 1, L"rendered again for the same partitions");
+			Assert::IsTrue(text.size() == size, L"text size changed");
+			Assert::IsTrue(contains(text, "crossmonitor_cpu_percent 100.000"), L"cpu_percent not patched");
+			Assert::IsTrue(contains(text, "crossmonitor_disk_written_bytes_total{partition_name=\"C\"} 00000000000000000202"),
+				L"bytes written not added up");
+
+			// the bytes of a sample carrying the volumes of the last one are not added again
+			data carried = getSample(50.f, { { 1, 2, L'C' }, { 3, 4, L'D' } });
+			carried.set_fresh(cpu_part);
+			exporter.update(carried);
+			Assert::IsTrue(contains(text, "crossmonitor_cpu_percent 050.000"), L"cpu_percent not patched");
+			Assert::IsTrue(contains(text, "crossmonitor_disk_written_bytes_total{partition_name=\"C\"} 00000000000000000202"),
+				L"carried bytes written added again");
+		}
+
+		/**
+		 * check a new partition set renders the text again and keeps the
+		 * totals of the partitions still there
+		 */
+		TEST_METHOD(PartitionChange_ShouldRenderAgain)
+		{
+			using namespace crossover::monitor;
+
+			openmetrics_exporter exporter;
+			exporter.update(getSample(1.f, { { 100, 200, L'C' } }));
+			exporter.update(getSample(1.f, { { 5, 5, L'E' }, { 10, 20, L'C' } }));
+
+			Assert::IsTrue(exporter.renders() == 2, L"renders != 2");
+			Assert::IsTrue(contains(exporter.text(), "crossmonitor_disk_read_bytes_total{partition_name=\"C\"} 00000000000000000110"),
+				L"total of C lost");
+			Assert::IsTrue(contains(exporter.text(), "crossmonitor_disk_read_bytes_total{partition_name=\"E\"} 00000000000000000005"),
+				L"total of E missing");
+		}
+
+		/**
+		 * check filesystems are exported as gauges with escaped mount
+		 * points, patched in place and rendered again on a mount change
+		 */
+		TEST_METHOD(Filesystems_ShouldBeGauges)
+		{
+			using namespace crossover::monitor;
+
+			openmetrics_exporter exporter;
+			data sample = getSample(1.f, {});
+			sample.set_fs_stats({ { "/", 1000, 400, 500, 100, 10 }, { "/mnt/a \"b\"", 2000, 0, 2000, 0, 0 } });
+			exporter.update(sample);
+			const std::string &text = exporter.text();
+
+			Assert::IsTrue(contains(text, "# TYPE crossmonitor_filesystem_available_bytes gauge"), L"available type missing");
+			Assert::IsTrue(contains(text, "crossmonitor_filesystem_size_bytes{mountpoint=\"/\"} 00000000000000001000"),
+				L"size missing");
+			Assert::IsTrue(contains(text, "crossmonitor_filesystem_inodes_used{mountpoint=\"/\"} 00000000000000000010"),
+				L"inodes used missing");
+			Assert::IsTrue(contains(text, "crossmonitor_filesystem_available_bytes{mountpoint=\"/mnt/a \\\"b\\\"\"} 00000000000000002000"),
+				L"mount point not escaped");
+
+			sample.set_fs_stats({ { "/", 1000, 600, 300, 100, 20 }, { "/mnt/a \"b\"", 2000, 0, 2000, 0, 0 } });
+			exporter.update(sample);
+			Assert::IsTrue(exporter.renders() == 1, L"rendered again for the same mounts");
+			Assert::IsTrue(contains(text, "crossmonitor_filesystem_used_bytes{mountpoint=\"/\"} 00000000000000000600"),
+				L"used not patched");
+
+			sample.set_fs_stats({ { "/", 1000, 600, 300, 100, 20 } });
+			exporter.update(sample);
+			Assert::IsTrue(exporter.renders() == 2 && text.find("/mnt/a") == std::string::npos, L"unmounted filesystem kept");
+		}
+
+		/**
+		 * check that the NUMA nodes are gauges and counters per node, whose
+		 * counters add up the fresh samples and survive a node going offline
+		 */
+		TEST_METHOD(NumaNodes_ShouldBeGaugesAndCounters)
+		{
+			using namespace crossover::monitor;
+
+			openmetrics_exporter exporter;
+			data sample = getSample(1.f, {});
+			sample.set_numa_stats({ { 0, 12.5f, 50.f, 10, 1 }, { 1, 100.f, 25.f, 20, 2 } });
+			exporter.update(sample);
+			const std::string &text = exporter.text();
+
+			Assert::IsTrue(contains(text, "# TYPE crossmonitor_numa_miss_pages counter"), L"miss type missing");
+			Assert::IsTrue(contains(text, "crossmonitor_numa_cpu_percent{node=\"0\"} 012.500"), L"node cpu missing");
+			Assert::IsTrue(contains(text, "crossmonitor_numa_memory_percent{node=\"1\"} 025.000"), L"node memory missing");
+
+			exporter.update(sample);
+			sample.set_fresh(cpu_part);
+			exporter.update(sample);
+			Assert::IsTrue(exporter.renders() == 1, L"rendered again for the same nodes");
+			Assert::IsTrue(contains(text, "crossmonitor_numa_miss_pages_total{node=\"1\"} 00000000000000000040"),
+				L"miss not added up");
+			Assert::IsTrue(contains(text, "crossmonitor_numa_foreign_pages_total{node=\"0\"} 00000000000000000002"),
+				L"foreign not added up");
+
+			sample.set_fresh(all_parts);
+			sample.set_numa_stats({ { 1, 50.f, 25.f, 5, 0 } });
+			exporter.update(sample);
+			Assert::IsTrue(exporter.renders() == 2 && text.find("node=\"0\"") == std::string::npos, L"offline node kept");
+			Assert::IsTrue(contains(text, "crossmonitor_numa_miss_pages_total{node=\"1\"} 00000000000000000045"),
+				L"miss total of the node lost");
+		}
+
+		/**
+		 * check that the run queues are left out until they are read, then
+		 * gauges of the machine and of every CPU, patched in place
+		 */
+		TEST_METHOD(RunQueues_ShouldBeGauges)
+		{
+			using namespace crossover::monitor;
+
+			openmetrics_exporter exporter;
+			data sample = getSample(1.f, {});
+			exporter.update(sample);
+			Assert::IsTrue(exporter.text().find("run_queue") == std::string::npos, L"run queues without schedstat");
+
+			run_queue_stats queues;
+			queues.resize(2);
+			queues.cpus = { 0, 1 };
+			queues.delay_us = { 12.5f, 1500.f };
+			queues.wait_ratio = { 0.25f, 0.5f };
+			sample.set_run_queues(queues, 756.25f, 0.375f);
+			exporter.update(sample);
+			const std::string &text = exporter.text();
+			Assert::IsTrue(exporter.renders() == 2, L"not rendered for the run queues");
+			Assert::IsTrue(contains(text, "crossmonitor_run_queue_delay_microseconds 0000000000000756.250"),
+				L"delay missing");
+			Assert::IsTrue(contains(text, "crossmonitor_run_queue_wait_percent 037.500"), L"wait missing");
+			Assert::IsTrue(contains(text, "crossmonitor_cpu_run_queue_wait_percent{cpu=\"1\"} 050.000"),
+				L"wait of the CPU missing");
+
+			queues.delay_us[0] = 20.f;
+			sample.set_run_queues(queues, 760.f, 0.375f);
+			exporter.update(sample);
+			Assert::IsTrue(exporter.renders() == 2, L"rendered again for the same CPUs");
+			Assert::IsTrue(contains(text, "crossmonitor_cpu_run_queue_delay_microseconds{cpu=\"0\"} 0000000000000020.000"),
+				L"delay of the CPU not patched");
+		}
+
+	};
+}
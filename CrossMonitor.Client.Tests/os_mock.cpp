@@ -1,5 +1,8 @@
 #include <os.hpp>
 
+#include <atomic>
+#include <cstdint>
+
 namespace crossover {
 namespace monitor {
 namespace client {
@@ -10,47 +13,85 @@ unsigned int _process_count = 0;
 float _cpu_use_percent = 0;
 float _memory_use_percent = 0;
 IO_stats _disk_io_stats;
+fs_stats _fs_stats;
+std::atomic<std::uint64_t> _collect_count(0);
+std::atomic<std::uint64_t> _collector_count(0);
+std::atomic<std::uint64_t> _fresh_baseline_count(0);
 
-bool init_cpu_use_percent() noexcept {
-	return true;
+void set_process_count(unsigned int n) {
+	_process_count = n;
 }
 
-void init_disk_io_stats() noexcept {
+void set_cpu_use_percent(float percent) {
+	_cpu_use_percent = percent;
 }
 
-void set_process_count(unsigned int n) {
-	_process_count = n;
+void set_memory_use_percent(float percent) {
+	_memory_use_percent = percent;
+}
+
+void set_disk_io_stats(const IO_stats &io_stats) {
+	_disk_io_stats = io_stats;
 }
 
-unsigned process_count() noexcept {
-	return _process_count;
+void set_fs_stats(const fs_stats &filesystems) {
+	_fs_stats = filesystems;
 }
 
-void set_cpu_use_percent(float percent) {
-	_cpu_use_percent = percent;
+std::uint64_t collect_count() {
+	return _collect_count;
 }
 
-float cpu_use_percent() noexcept {
-	return _cpu_use_percent;
+std::uint64_t collector_count() {
+	return _collector_count;
 }
 
-void set_memory_use_percent(float percent) {
-	_memory_use_percent = percent;
+std::uint64_t fresh_baseline_count() {
+	return _fresh_baseline_count;
 }
 
-float memory_use_percent() noexcept {
-	return _memory_use_percent;
+class collector::impl final {
+public:
+	bool has_baseline = false;
+};
+
+collector::collector()
+	: m_impl(new impl()) {
+	++_collector_count;
 }
 
-void set_disk_io_stats(const IO_stats &io_stats) {
-	_disk_io_stats = io_stats;
+collector::~collector() {
+}
+
+// the mock values are set before the collectors run and only read here
+void collector::collect(data& out, unsigned parts) {
+	if (parts & cpu_part) {
+		out.set_cpu_percent(_cpu_use_percent);
+	}
+	if (parts & process_part) {
+		out.set_process_count(_process_count);
+	}
+	if (parts & memory_part) {
+		out.set_memory_percent(_memory_use_percent);
+	}
+	if (parts & io_part) {
+		out.get_io_stats_for_edit() = _disk_io_stats;
+	}
+	if (parts & fs_part) {
+		out.set_fs_stats(_fs_stats);
+	}
+	out.set_fresh(parts);
+	++_collect_count;
+	if (!m_impl->has_baseline) {
+		m_impl->has_baseline = true;
+		++_fresh_baseline_count;
+	}
 }
 
-void disk_io_stats(IO_stats &io_stats) noexcept {
-	io_stats = _disk_io_stats;
+void collector::set_run_queue_processes(std::size_t) noexcept {
 }
 
-void uninit_cpu_use_percent() noexcept {
+void collector::keep_baseline(const std::string&, std::chrono::milliseconds) {
 }
 
 } //namespace os
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <cstdint>
+
 namespace crossover {
 namespace monitor {
 namespace client {
@@ -9,6 +11,20 @@ void set_process_count(unsigned int n);
 void set_cpu_use_percent(float percent);
 void set_memory_use_percent(float percent);
 void set_disk_io_stats(const IO_stats &io_stats);
+void set_fs_stats(const fs_stats &filesystems);
+/**
+ * Samples taken by all the collectors so far.
+ */
+std::uint64_t collect_count();
+/**
+ * Collectors constructed so far.
+ */
+std::uint64_t collector_count();
+/**
+ * Samples taken by all the collectors so far without a baseline, the first
+ * of each collector.
+ */
+std::uint64_t fresh_baseline_count();
 
 } //namespace os
 } //namespace client
@@ -0,0 +1,97 @@
+#include "CppUnitTest.h"
+
+#if defined(__linux__)
+
+#include <process_tracker.hpp>
+
+#include <spawn.h>
+#include <sys/wait.h>
+
+#include <chrono>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+extern char **environ;
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace CrossMonitorClientTests
+{
+	TEST_CLASS(process_tracker_UnitTests)
+	{
+		/**
+		 * waits until the tracker saw at least the given number of exits
+		 */
+		static bool waitForExits(const crossover::monitor::client::os::process_tracker &tracker, std::uint64_t exits) {
+			for (int i = 0; i < 200; ++i) {
+				if (tracker.stats().exits >= exits) {
+					return true;
+				}
+				std::this_thread::sleep_for(std::chrono::milliseconds(10));
+			}
+			return false;
+		}
+
+	public:
+
+		/**
+		 * spawn thousands of short lived processes and check the tracker
+		 * against a full scan of /proc
+		 */
+		TEST_METHOD(ShortLivedProcesses_ShouldBeCounted)
+		{
+			using namespace crossover::monitor::client::os;
+
+			const unsigned spawned = 2000;
+			const unsigned batch = 50;
+
+			std::unique_ptr<process_tracker> tracker;
+			try {
+				tracker.reset(new process_tracker(std::chrono::seconds(3600)));
+			} catch (const std::system_error &e) {
+				// the proc connector needs CAP_NET_ADMIN
+				Logger::WriteMessage((std::string("process events not available, skipped: ") + e.what()).c_str());
+				return;
+			}
+
+			const auto start = std::chrono::steady_clock::now();
+			const process_stats before = tracker->stats();
+			Assert::IsTrue(before.count == process_tracker::scan(), L"initial count differs from scan");
+
+			char *const argv[] = { const_cast<char *>("true"), nullptr };
+			for (unsigned i = 0; i < spawned; i += batch) {
+				std::vector<pid_t> children;
+				for (unsigned j = 0; j < batch; ++j) {
+					pid_t child;
+					Assert::IsTrue(posix_spawnp(&child, "true", nullptr, nullptr, argv, environ) == 0, L"spawn failed");
+					children.push_back(child);
+				}
+				for (pid_t child : children) {
+					waitpid(child, nullptr, 0);
+				}
+			}
+
+			Assert::IsTrue(waitForExits(*tracker, before.exits + spawned), L"exits not seen");
+			const auto elapsed = std::chrono::steady_clock::now() - start;
+			const process_stats after = tracker->stats();
+
+			// other processes of the machine may come and go meanwhile
+			const long long difference = static_cast<long long>(after.count) - process_tracker::scan();
+			Assert::IsTrue(difference >= -2 && difference <= 2, L"count differs from scan");
+			Assert::IsTrue(after.forks - before.forks >= spawned, L"forks missed");
+			Assert::IsTrue(after.execs - before.execs >= spawned, L"execs missed");
+			Assert::IsTrue(after.exits - before.exits >= spawned, L"exits missed");
+			Assert::IsTrue(after.resyncs == before.resyncs, L"events lost");
+
+			const process_rates rates = process_tracker::rates(before, after, elapsed);
+			const double seconds = std::chrono::duration<double>(elapsed).count();
+			Assert::IsTrue(rates.forks * seconds >= spawned - 0.5, L"fork rate too low");
+			Assert::IsTrue(rates.exits * seconds >= spawned - 0.5, L"exit rate too low");
+		}
+
+	};
+}
+
+#endif
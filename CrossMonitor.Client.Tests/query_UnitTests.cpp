@@ -0,0 +1,207 @@
+#include "CppUnitTest.h"
+
+#include <sample_ring.hpp>
+#include <query_server.hpp>
+#include <utils.hpp>
+
+#include <boost/asio.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace CrossMonitorClientTests
+{
+	TEST_CLASS(query_UnitTests)
+	{
+		/**
+		 * Sends a GET request to the query endpoint.
+		 * @return the whole response, headers included.
+		 */
+		static std::string get(unsigned short port, const std::string &target) {
+			using boost::asio::ip::tcp;
+
+			boost::asio::io_service io_service;
+			tcp::socket socket(io_service);
+			socket.connect(tcp::endpoint(boost::asio::ip::address_v4::loopback(), port));
+
+			const std::string request = "GET " + target + " HTTP/1.0\r\n\r\n";
+			boost::asio::write(socket, boost::asio::buffer(request));
+
+			std::string response;
+			char buffer[1024];
+			boost::system::error_code error;
+			while (size_t read = socket.read_some(boost::asio::buffer(buffer), error)) {
+				response.append(buffer, read);
+			}
+			return response;
+		}
+
+		static std::string body(const std::string &response) {
+			return response.substr(response.find("\r\n\r\n") + 4);
+		}
+
+	public:
+
+		/**
+		 * check that the ring keeps the newest records, including ones
+		 * wrapping around the end of the buffer, and invalidates the old ones
+		 */
+		TEST_METHOD(SampleRing_ShouldKeepNewestRecords)
+		{
+			using namespace crossover::monitor::utils;
+
+			sample_ring ring(50, 4);
+			sample_ring::view first;
+			Assert::IsTrue(ring.publish(1, 0, "record-1"), L"publish failed");
+			Assert::IsTrue(ring.read(0, first), L"first record not readable");
+
+			for (int i = 2; i <= 20; ++i) {
+				Assert::IsTrue(ring.publish(i, 0, "record-" + std::to_string(i)), L"publish failed");
+			}
+
+			Assert::IsTrue(ring.count() == 20, L"count != 20");
+			Assert::IsFalse(ring.valid(first), L"overwritten record still valid");
+
+			bool wrapped = false;
+			for (std::uint64_t index = ring.headroom(ring.count()); index < ring.count(); ++index) {
+				sample_ring::view v;
+				Assert::IsTrue(ring.read(index, v), L"recent record not readable");
+				Assert::IsTrue(v.to_string() == "record-" + std::to_string(index + 1), L"unexpected record bytes");
+				Assert::IsTrue(v.time_ms == static_cast<std::int64_t>(index + 1), L"unexpected record time");
+				wrapped |= v.second_size > 0;
+			}
+			Assert::IsTrue(wrapped, L"no record wrapped around the buffer");
+
+			Assert::IsFalse(ring.publish(21, 0, std::string(26, 'x')), L"record larger than half the ring published");
+			Assert::IsTrue(ring.count() == 20, L"rejected record counted");
+		}
+
+		/**
+		 * check that rings allocated on the heap keep their counters on
+		 * their own cache lines, and that a failed construction throws
+		 */
+		TEST_METHOD(SampleRing_ShouldBeAllocatedAligned)
+		{
+			using namespace crossover::monitor::utils;
+
+			std::vector<aligned_ptr<sample_ring>> rings;
+			for (int i = 0; i < 8; ++i) {
+				rings.push_back(make_aligned<sample_ring>(64 + i, 4));
+				const auto address = reinterpret_cast<std::uintptr_t>(rings.back().get());
+				Assert::IsTrue(address % alignof(sample_ring) == 0, L"ring not aligned");
+				Assert::IsTrue(rings.back()->publish(i, 0, "record"), L"publish failed");
+			}
+			Assert::IsTrue(alignof(sample_ring) == 64, L"ring alignment changed");
+
+			Assert::ExpectException<std::invalid_argument>([]() {
+				make_aligned<sample_ring>(0, 4);
+			}, L"empty ring accepted");
+		}
+
+		/**
+		 * check the endpoint routes
+		 */
+		TEST_METHOD(QueryServer_ShouldServeRecordsFromRings)
+		{
+			using namespace crossover::monitor;
+
+			utils::sample_ring samples(4096, 64);
+			utils::sample_ring aggregates(4096, 16);
+			utils::sample_ring metrics(4096, 16);
+
+			query_options options;
+			options.port = 0;
+			query_server server(options, samples, aggregates, metrics);
+			Assert::IsTrue(server.port() != 0, L"no port bound");
+
+			Assert::IsTrue(get(server.port(), "/latest").find("404") != std::string::npos, L"latest of empty ring not 404");
+
+			const std::int64_t minute = 60 * 1000;
+			for (std::int64_t i = 0; i < 10; ++i) {
+				samples.publish(i * minute, 0, "{\"n\":" + std::to_string(i) + "}");
+			}
+			aggregates.publish(0, 60, "{\"w\":60,\"n\":1}");
+			aggregates.publish(0, 10, "{\"w\":10,\"n\":1}");
+			aggregates.publish(10 * 1000, 10, "{\"w\":10,\"n\":2}");
+
+			Assert::IsTrue(body(get(server.port(), "/latest")) == "{\"n\":9}", L"unexpected latest");
+			Assert::IsTrue(body(get(server.port(), "/history?minutes=2")) == "[{\"n\":8},{\"n\":9}]",
+				L"unexpected history");
+			Assert::IsTrue(body(get(server.port(), "/aggregates")) == "[{\"w\":10,\"n\":2},{\"w\":60,\"n\":1}]",
+				L"unexpected aggregates");
+			metrics.publish(0, 0, "crossmonitor_processes 0000000001\n# EOF\n");
+			const std::string scrape = get(server.port(), "/metrics");
+			Assert::IsTrue(scrape.find("Content-Type: application/openmetrics-text") != std::string::npos,
+				L"unexpected metrics content type");
+			Assert::IsTrue(body(scrape) == "crossmonitor_processes 0000000001\n# EOF\n", L"unexpected metrics");
+			Assert::IsTrue(get(server.port(), "/other").find("404") != std::string::npos, L"unknown path not 404");
+			Assert::IsTrue(server.torn_responses() == 0, L"torn responses");
+		}
+
+		/**
+		 * check that a client stalling until the collector overwrote its
+		 * response gets an error rather than all of the response
+		 *
+		 * 1. request more history than the socket buffers hold
+		 * 2. publish a whole ring over it before reading
+		 * 3. check that less than the Content-Length arrives
+		 */
+		TEST_METHOD(QueryServer_ShouldResetTornResponses)
+		{
+			using namespace crossover::monitor;
+			using boost::asio::ip::tcp;
+
+			const std::size_t records = 16 * 1024;
+			utils::sample_ring samples(64 * 1024 * 1024, records);
+			utils::sample_ring aggregates(4096, 16);
+			utils::sample_ring metrics(4096, 16);
+
+			query_options options;
+			options.port = 0;
+			query_server server(options, samples, aggregates, metrics);
+
+			const std::string record(3000, 'x');
+			for (std::size_t i = 0; i < records; ++i) {
+				samples.publish(static_cast<std::int64_t>(i), 0, record);
+			}
+
+			boost::asio::io_service io_service;
+			tcp::socket socket(io_service);
+			socket.open(tcp::v4());
+			socket.set_option(tcp::socket::receive_buffer_size(64 * 1024));
+			socket.connect(tcp::endpoint(boost::asio::ip::address_v4::loopback(), server.port()));
+			const std::string request = "GET /history?minutes=60 HTTP/1.0\r\n\r\n";
+			boost::asio::write(socket, boost::asio::buffer(request));
+
+			// the response is some 36 MB, far beyond the socket buffers
+			std::this_thread::sleep_for(std::chrono::milliseconds(200));
+			for (std::size_t i = 0; i < records; ++i) {
+				samples.publish(static_cast<std::int64_t>(records + i), 0, record);
+			}
+
+			std::string response;
+			std::vector<char> buffer(64 * 1024);
+			boost::system::error_code error;
+			while (size_t read = socket.read_some(boost::asio::buffer(buffer), error)) {
+				response.append(buffer.data(), read);
+			}
+
+			const std::string length_header = "Content-Length: ";
+			const std::size_t length_pos = response.find(length_header);
+			Assert::IsTrue(length_pos != std::string::npos, L"no Content-Length");
+			const std::size_t length = std::stoul(response.substr(length_pos + length_header.size()));
+			Assert::IsTrue(length > 30 * 1024 * 1024, L"response fits the socket buffers");
+			Assert::IsTrue(body(response).size() < length, L"torn response received whole");
+			Assert::IsTrue(error == boost::asio::error::connection_reset, L"torn response not reset");
+			Assert::IsTrue(server.torn_responses() == 1, L"torn response not counted");
+			Assert::IsTrue(server.served() == 0, L"torn response counted as served");
+		}
+
+	};
+}
@@ -0,0 +1,233 @@
+#include "CppUnitTest.h"
+
+#include <relay_server.hpp>
+
+#include <boost/asio.hpp>
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace CrossMonitorClientTests
+{
+	TEST_CLASS(relay_UnitTests)
+	{
+		typedef crossover::monitor::rollup::clock clock;
+		// (rack, start) -> rollup
+		typedef std::map<std::pair<std::string, clock::time_point>, crossover::monitor::rollup> rack_rollups;
+
+		static void send(unsigned short port, const std::string &records) {
+			using boost::asio::ip::tcp;
+
+			boost::asio::io_service io_service;
+			tcp::socket socket(io_service);
+			socket.connect(tcp::endpoint(boost::asio::ip::address_v4::loopback(), port));
+			boost::asio::write(socket, boost::asio::buffer(records));
+		}
+
+		static std::string line(const web::json::value &record) {
+			return utility::conversions::to_utf8string(record.serialize()) + "\n";
+		}
+
+		static std::string sample(const std::string &host, const std::string &rack, std::int64_t time_ms,
+								  const crossover::monitor::data &d) {
+			web::json::value record;
+			record[U("host")] = web::json::value(utility::conversions::to_string_t(host));
+			record[U("rack")] = web::json::value(utility::conversions::to_string_t(rack));
+			record[U("time_ms")] = web::json::value(time_ms);
+			record[U("data")] = d.to_json();
+			return line(record);
+		}
+
+		/**
+		 * waits until the relay has taken in the given number of records
+		 */
+		static bool waitFor(const crossover::monitor::relay_server &relay, std::uint64_t records) {
+			for (int i = 0; i < 500; ++i) {
+				const auto stats = relay.stats();
+				if (stats.records + stats.rejected_records >= records) {
+					return true;
+				}
+				std::this_thread::sleep_for(std::chrono::milliseconds(10));
+			}
+			return false;
+		}
+
+		static void add(rack_rollups &into, const std::string &rack, const crossover::monitor::rollup &r) {
+			auto it = into.emplace(std::make_pair(rack, r.start()), r);
+			if (!it.second) {
+				it.first->second.merge(r);
+			}
+		}
+
+	public:
+
+		/**
+		 * check that the relay builds the rollup of every rack from the
+		 * records of all its hosts, whichever shard they came in on
+		 *
+		 * 1. send a minute of samples of 8 hosts in 3 racks over 4
+		 *    connections to a relay with 2 shards, and a rollup of a host
+		 * 2. flush the relay and decode the batches it forwarded
+		 * 3. compare with the rack rollups built directly from the records,
+		 *    every rack rollup must have been forwarded once
+		 */
+		TEST_METHOD(RackRollups_ShouldMatchDirectRollups)
+		{
+			using namespace crossover::monitor;
+
+			relay_options options;
+			options.address = "127.0.0.1";
+			options.port = 0;
+			options.shards = 2;
+			// nothing is due before the flush
+			options.lateness = std::chrono::hours(24);
+
+			std::mutex mutex;
+			std::vector<std::string> batches;
+			relay_server relay(options, [&](unsigned, const std::string &batch) {
+				std::lock_guard<std::mutex> lock(mutex);
+				batches.push_back(batch);
+			});
+
+			const char *racks[] = { "rack-a", "rack-b", "rack-c" };
+			const unsigned hosts = 8;
+			const unsigned connections = 4;
+			const std::int64_t start_ms = 16801LL * 24 * 60 * 60 * 1000;
+
+			rack_rollups expected;
+			std::vector<std::string> records(connections);
+			unsigned count = 0;
+			for (unsigned second = 0; second < 60; ++second) {
+				for (unsigned host = 0; host < hosts; ++host) {
+					const std::string rack = racks[host % 3];
+					const std::int64_t time_ms = start_ms + second * 1000 + host;
+					const data d((host * 7 + second) % 100 / 4.f, 50.f, 100 + host,
+						{ { second * 1000u, host * 10u, L'C' } });
+					records[host % connections] += sample("host-" + std::to_string(host), rack, time_ms, d);
+					++count;
+
+					const clock::time_point time{ std::chrono::milliseconds(time_ms) };
+					rollup r(options.width, time);
+					r.add(d, time);
+					add(expected, rack, r);
+				}
+			}
+
+			rollup host_rollup(std::chrono::seconds(10), clock::time_point(std::chrono::milliseconds(start_ms)));
+			host_rollup.add(U("cpu_percent"), 99, host_rollup.start());
+			web::json::value rollup_record = host_rollup.to_json();
+			rollup_record[U("host")] = web::json::value(U("host-1"));
+			rollup_record[U("rack")] = web::json::value(U("rack-b"));
+			records[0] += line(rollup_record);
+			++count;
+			add(expected, "rack-b", host_rollup);
+
+			std::vector<std::thread> agents;
+			for (const auto &r : records) {
+				agents.emplace_back([&relay, &r]() {
+					send(relay.port(), r);
+				});
+			}
+			for (auto &agent : agents) {
+				agent.join();
+			}
+
+			Assert::IsTrue(waitFor(relay, count), L"records not taken in");
+			relay.flush();
+
+			const auto stats = relay.stats();
+			Assert::IsTrue(stats.records == count, L"record lost");
+			Assert::IsTrue(stats.rejected_records == 0, L"record rejected");
+			Assert::IsTrue(stats.routed_records > 0, L"no record passed to another shard");
+			Assert::IsTrue(stats.connections == connections, L"connection not counted");
+
+			rack_rollups actual;
+			std::uint64_t forwarded_bytes = 0;
+			for (const auto &batch : batches) {
+				forwarded_bytes += batch.size();
+				std::vector<rack_rollup> decoded;
+				const char *position = batch.data();
+				Assert::IsFalse(relay_batch::decode(position, batch.data() + batch.size() - 1, decoded),
+					L"incomplete batch decoded");
+				Assert::IsTrue(relay_batch::decode(position, batch.data() + batch.size(), decoded), L"batch not decoded");
+				Assert::IsTrue(position == batch.data() + batch.size(), L"batch not read to its end");
+
+				for (const auto &r : decoded) {
+					Assert::IsTrue(actual.emplace(std::make_pair(r.rack, r.value.start()), r.value).second,
+						L"rack rollup forwarded twice");
+				}
+			}
+			Assert::IsTrue(forwarded_bytes == stats.forwarded_bytes, L"forwarded bytes miscounted");
+			Assert::IsTrue(actual.size() == stats.forwarded_rollups, L"forwarded rollups miscounted");
+
+			Assert::IsTrue(expected.size() == actual.size(), L"expected.size() != actual.size()");
+			for (auto e = expected.begin(), a = actual.begin(); e != expected.end(); ++e, ++a) {
+				Assert::IsTrue(e->first == a->first, L"rack rollup mismatch");
+
+				const auto &em = e->second.metrics();
+				const auto &am = a->second.metrics();
+				Assert::IsTrue(em.size() == am.size(), L"metric count mismatch");
+				for (auto ei = em.begin(), ai = am.begin(); ei != em.end(); ++ei, ++ai) {
+					Assert::IsTrue(ei->first == ai->first, L"metric name mismatch");
+					Assert::IsTrue(ei->second.count == ai->second.count, L"count mismatch");
+					Assert::IsTrue(ei->second.min == ai->second.min, L"min mismatch");
+					Assert::IsTrue(ei->second.max == ai->second.max, L"max mismatch");
+					Assert::IsTrue(ei->second.last == ai->second.last, L"last mismatch");
+					Assert::IsTrue(ei->second.sketch == ai->second.sketch, L"sketch mismatch");
+					Assert::IsTrue(std::fabs(ei->second.sum - ai->second.sum) <= 1e-9 * std::fabs(ei->second.sum),
+						L"sum mismatch");
+				}
+			}
+		}
+
+		/**
+		 * check that malformed records are counted and skipped, and the
+		 * records after them on the same connection still taken in
+		 */
+		TEST_METHOD(MalformedRecords_ShouldBeRejected)
+		{
+			using namespace crossover::monitor;
+
+			relay_options options;
+			options.address = "127.0.0.1";
+			options.port = 0;
+			options.shards = 1;
+
+			std::vector<std::string> batches;
+			relay_server relay(options, [&](unsigned, const std::string &batch) {
+				batches.push_back(batch);
+			});
+
+			const data d(10.f, 20.f, 30, {});
+			send(relay.port(),
+				"not json\n"
+				"{\"host\": \"h\", \"rack\": \"r\"}\n"
+				"{\"host\": \"h\", \"rack\": \"r\", \"time_ms\": 1000, "
+				"\"data\": {\"cpu_percent\": 500, \"memory_percent\": 1, \"process_count\": 1}}\n"
+				"\r\n" +
+				sample("h", "r", 1000, d));
+
+			Assert::IsTrue(waitFor(relay, 4), L"records not taken in");
+			const auto stats = relay.stats();
+			Assert::IsTrue(stats.rejected_records == 3, L"rejected_records != 3");
+			Assert::IsTrue(stats.records == 1, L"records != 1");
+
+			relay.flush();
+			Assert::IsTrue(batches.size() == 1, L"batches.size() != 1");
+			std::vector<rack_rollup> decoded;
+			const char *position = batches[0].data();
+			relay_batch::decode(position, batches[0].data() + batches[0].size(), decoded);
+			Assert::IsTrue(decoded.size() == 1 && decoded[0].rack == "r", L"rack rollup not forwarded");
+			Assert::IsTrue(decoded[0].value.metrics().at(U("cpu_percent")).last == 10, L"cpu_percent != 10");
+		}
+	};
+}
@@ -0,0 +1,413 @@
+#include "CppUnitTest.h"
+
+#include <application.hpp>
+#include <procfs.hpp>
+#include <rollup.hpp>
+#include <snapshot.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace CrossMonitorClientTests
+{
+	TEST_CLASS(replay_UnitTests)
+	{
+		class vector_source final : public crossover::monitor::snapshot_source {
+		public:
+			explicit vector_source(const std::vector<crossover::monitor::counter_snapshot>& snapshots)
+				: snapshots_(snapshots)
+				, index_(0) {
+			}
+
+			bool next(crossover::monitor::counter_snapshot& snapshot) override {
+				if (index_ == snapshots_.size()) {
+					return false;
+				}
+				snapshot = snapshots_[index_++];
+				return true;
+			}
+
+		private:
+			const std::vector<crossover::monitor::counter_snapshot>& snapshots_;
+			size_t index_;
+		};
+
+		/**
+		 * a quarter of an hour of 1 second snapshots of 4 CPUs and 2 NUMA
+		 * nodes, a volume and a filesystem appear half way and CPU 2 is
+		 * offline for 20 seconds, coming back with its counters reset
+		 */
+		static std::vector<crossover::monitor::counter_snapshot> getSnapshots(std::uint64_t seed = 7) {
+			using namespace crossover::monitor;
+
+			std::mt19937_64 random(seed);
+			std::uniform_int_distribution<std::uint64_t> busy(0, 100);
+			std::uniform_int_distribution<std::uint64_t> bytes(0, 1 << 20);
+
+			std::vector<counter_snapshot> res;
+			counter_snapshot snapshot;
+			snapshot.time_ms = 1451606400000LL;
+			snapshot.memory_total = 8ULL << 30;
+			snapshot.volumes.push_back(volume_counters{ L'C', "sda", 0, 0 });
+			cpu_core_counters& cores = snapshot.cores;
+			run_queue_counters& queues = snapshot.run_queues;
+			numa_counters& nodes = snapshot.numa_nodes;
+			cores.resize(4);
+			queues.resize(4);
+			for (unsigned c = 0; c < 4; ++c) {
+				cores.cpus[c] = queues.cpus[c] = c;
+				cores.base_frequency_khz[c] = 2000000;
+			}
+			nodes.resize(2);
+			for (unsigned n = 0; n < 2; ++n) {
+				nodes.nodes[n] = n;
+				nodes.memory_total[n] = 4ULL << 30;
+			}
+			snapshot.has_net = true;
+			for (int i = 0; i < 900; ++i) {
+				snapshot.time_ms += 1000;
+				snapshot.cpu_total += 100;
+				snapshot.cpu_busy += busy(random);
+				snapshot.memory_available = (4ULL << 30) + bytes(random);
+				snapshot.process_count = 100 + i % 7;
+				if (i == 450) {
+					snapshot.volumes.push_back(volume_counters{ L'D', "sdb", 0, 0 });
+					snapshot.filesystems.push_back(fs_stat{ "/mnt/my disk", 1ULL << 40, 0, 1ULL << 40, 1 << 20, 1 });
+				}
+				for (auto& fs : snapshot.filesystems) {
+					fs.used_bytes = std::min(fs.size_bytes, fs.used_bytes + bytes(random));
+					fs.available_bytes = fs.size_bytes - fs.used_bytes;
+				}
+				for (auto& volume : snapshot.volumes) {
+					volume.bytes_read += bytes(random);
+					volume.bytes_written += bytes(random);
+				}
+				if (i == 620) {
+					cores.aperf[2] = cores.mperf[2] = 0;
+					queues.run_ns[2] = queues.wait_ns[2] = queues.timeslices[2] = 0;
+				}
+				for (unsigned c = 0; c < 4; ++c) {
+					cores.frequency_khz[c] = static_cast<std::uint32_t>(1000000 + 10000 * busy(random));
+					cores.aperf[c] += 1000 + 20 * busy(random);
+					cores.mperf[c] += 1000;
+					cores.core_throttles[c] += busy(random) / 90;
+					cores.package_throttles[c] = cores.core_throttles[0];
+					queues.run_ns[c] += 10000 * busy(random);
+					queues.wait_ns[c] += 1000 * busy(random);
+					queues.timeslices[c] += 1 + busy(random);
+				}
+				for (unsigned n = 0; n < 2; ++n) {
+					nodes.cpu_total[n] += 50;
+					nodes.cpu_busy[n] += busy(random) / 2;
+					nodes.memory_available[n] = (2ULL << 30) + bytes(random);
+					nodes.numa_miss[n] += busy(random);
+					nodes.numa_foreign[n] += busy(random);
+				}
+				snapshot.net.tcp_retransmits += busy(random) / 10;
+				snapshot.net.listen_drops += busy(random) / 50;
+				snapshot.net.sockets = static_cast<std::uint32_t>(200 + i % 11);
+
+				res.push_back(snapshot);
+				if (i >= 600 && i < 620) {
+					// CPU 2 offline
+					counter_snapshot& offline = res.back();
+					for (auto* field : { &offline.cores.aperf, &offline.cores.mperf, &offline.cores.core_throttles,
+						&offline.cores.package_throttles, &offline.run_queues.run_ns, &offline.run_queues.wait_ns,
+						&offline.run_queues.timeslices }) {
+						field->erase(field->begin() + 2);
+					}
+					offline.cores.cpus.erase(offline.cores.cpus.begin() + 2);
+					offline.cores.frequency_khz.erase(offline.cores.frequency_khz.begin() + 2);
+					offline.cores.base_frequency_khz.erase(offline.cores.base_frequency_khz.begin() + 2);
+					offline.run_queues.cpus.erase(offline.run_queues.cpus.begin() + 2);
+				}
+			}
+			return res;
+		}
+
+		/**
+		 * every sample a decoder of its own makes of snapshots, as JSON
+		 */
+		static std::vector<utility::string_t> decodeAll(const std::vector<crossover::monitor::counter_snapshot>& snapshots) {
+			using namespace crossover::monitor;
+
+			snapshot_decoder decoder;
+			data sample;
+			std::vector<utility::string_t> res;
+			for (const auto& snapshot : snapshots) {
+				if (decoder.decode(snapshot, sample)) {
+					res.push_back(sample.to_json().serialize());
+				}
+			}
+			return res;
+		}
+
+		/**
+		 * every message an application replaying snapshots passes on
+		 */
+		static std::vector<utility::string_t> replayAll(const std::vector<crossover::monitor::counter_snapshot>& snapshots) {
+			using namespace crossover::monitor;
+			using namespace crossover::monitor::client;
+
+			std::vector<utility::string_t> messages;
+			application app {std::chrono::minutes(1), [&](const web::json::value &collected_data) {
+				messages.push_back(collected_data.serialize());
+			}, send_mode::both};
+			vector_source source(snapshots);
+			app.replay(source);
+			return messages;
+		}
+
+	public:
+		TEST_METHOD(JournalRoundTrip)
+		{
+			using namespace crossover::monitor;
+
+			const auto snapshots = getSnapshots();
+			std::stringstream stream;
+			{
+				journal::writer writer(stream);
+				for (const auto& s : snapshots) {
+					writer.append(s);
+				}
+			}
+
+			const std::string bytes = stream.str();
+			journal::reader reader(stream);
+			counter_snapshot snapshot;
+			for (const auto& s : snapshots) {
+				Assert::IsTrue(reader.next(snapshot), L"journal ended early");
+				Assert::IsTrue(snapshot == s, L"snapshot != written");
+			}
+			Assert::IsFalse(reader.next(snapshot), L"journal longer than written");
+
+			std::istringstream truncated(bytes.substr(0, bytes.size() - 3));
+			journal::reader truncatedReader(truncated);
+			Assert::ExpectException<std::runtime_error>([&]() {
+				while (truncatedReader.next(snapshot)) {
+				}
+			});
+
+			std::istringstream foreign("not a journal");
+			Assert::ExpectException<std::runtime_error>([&]() {
+				journal::reader foreignReader(foreign);
+			});
+		}
+
+		TEST_METHOD(DecoderDeltas)
+		{
+			using namespace crossover::monitor;
+
+			counter_snapshot first;
+			first.time_ms = 1000;
+			first.cpu_total = 1000;
+			first.cpu_busy = 400;
+			first.memory_total = 1000;
+			first.memory_available = 750;
+			first.process_count = 10;
+			first.volumes.push_back(volume_counters{ L'C', std::string(), 5000, 7000 });
+
+			counter_snapshot second = first;
+			second.time_ms = 2000;
+			second.cpu_total = 1200;
+			second.cpu_busy = 450;
+			second.memory_available = 250;
+			second.process_count = 12;
+			second.volumes[0].bytes_read = 6024;
+			second.volumes.push_back(volume_counters{ L'D', std::string(), 99, 99 });
+
+			// rebooted: every counter starts over
+			counter_snapshot third = second;
+			third.time_ms = 3000;
+			third.cpu_total = 100;
+			third.cpu_busy = 10;
+			third.volumes[0].bytes_read = 10;
+			third.volumes[1].bytes_written = 199;
+
+			snapshot_decoder decoder;
+			data sample;
+			Assert::IsFalse(decoder.decode(first, sample), L"first snapshot made a sample");
+
+			Assert::IsTrue(decoder.decode(second, sample), L"second snapshot made no sample");
+			Assert::AreEqual(sample.get_cpu_percent(), 25.f, L"cpu_percent != 25");
+			Assert::AreEqual(sample.get_memory_percent(), 75.f, L"memory_percent != 75");
+			Assert::AreEqual(sample.get_process_count(), 12u, L"process_count != 12");
+			Assert::IsTrue(sample.get_io_stats().size() == 2, L"unexpected volume count");
+			Assert::IsTrue(sample.get_io_stats()[0].bytes_read == 1024 &&
+				sample.get_io_stats()[0].bytes_written == 0, L"C delta wrong");
+			Assert::IsTrue(sample.get_io_stats()[1].bytes_read == 0 &&
+				sample.get_io_stats()[1].bytes_written == 0, L"new volume D not zero");
+
+			Assert::IsTrue(decoder.decode(third, sample), L"third snapshot made no sample");
+			Assert::AreEqual(sample.get_cpu_percent(), 0.f, L"cpu_percent after reset != 0");
+			Assert::IsTrue(sample.get_io_stats()[0].bytes_read == 0, L"C delta after reset != 0");
+			Assert::IsTrue(sample.get_io_stats()[1].bytes_written == 100, L"D delta != 100");
+		}
+
+		TEST_METHOD(ProcfsCapture)
+		{
+			using namespace crossover::monitor;
+
+			std::istringstream capture(
+				"==> 1451606400000\n"
+				"--> stat\n"
+				"cpu  100 0 100 700 100 0 0 0 0 0\n"
+				"cpu0 100 0 100 700 100 0 0 0 0 0\n"
+				"--> meminfo\n"
+				"MemTotal:        8000000 kB\n"
+				"MemFree:         1000000 kB\n"
+				"MemAvailable:    2000000 kB\n"
+				"--> diskstats\n"
+				"   7       0 loop0 10 0 80 0 0 0 0 0 0 0 0\n"
+				"   8       0 sda 100 0 2000 0 50 0 4000 0 0 0 0\n"
+				"   8       1 sda1 90 0 1800 0 40 0 3000 0 0 0 0\n"
+				" 259       0 nvme0n1 10 0 200 0 5 0 400 0 0 0 0\n"
+				" 259       1 nvme0n1p1 10 0 200 0 5 0 400 0 0 0 0\n"
+				"--> processes\n"
+				"321\n"
+				"==> 1451606401000\n"
+				"--> stat\n"
+				"cpu  160 0 120 800 120 0 0 0 0 0\n"
+				"--> meminfo\n"
+				"MemTotal:        8000000 kB\n"
+				"MemAvailable:    4000000 kB\n"
+				"--> diskstats\n"
+				"   8       0 sda 100 0 2004 0 50 0 4000 0 0 0 0\n"
+				" 259       0 nvme0n1 10 0 200 0 5 0 402 0 0 0 0\n"
+				"--> processes\n"
+				"322\n");
+
+			procfs::capture_reader reader(capture);
+			counter_snapshot snapshot;
+			Assert::IsTrue(reader.next(snapshot), L"first snapshot missing");
+			Assert::IsTrue(snapshot.time_ms == 1451606400000LL, L"time_ms wrong");
+			Assert::IsTrue(snapshot.cpu_total == 1000 && snapshot.cpu_busy == 200, L"cpu counters wrong");
+			Assert::IsTrue(snapshot.memory_total == 8192000000ULL &&
+				snapshot.memory_available == 2048000000ULL, L"memory counters wrong");
+			Assert::AreEqual(snapshot.process_count, 321u, L"process_count != 321");
+			Assert::IsTrue(snapshot.volumes.size() == 2, L"partitions or loop devices not skipped");
+			Assert::IsTrue(snapshot.volumes[0].name == L'a' && snapshot.volumes[0].device == "sda" &&
+				snapshot.volumes[0].bytes_read == 2000 * 512, L"sda wrong");
+			Assert::IsTrue(snapshot.volumes[1].name == L'b' && snapshot.volumes[1].device == "nvme0n1",
+				L"nvme0n1 wrong");
+
+			snapshot_decoder decoder;
+			data sample;
+			decoder.decode(snapshot, sample);
+			Assert::IsTrue(reader.next(snapshot), L"second snapshot missing");
+			Assert::IsTrue(decoder.decode(snapshot, sample), L"second snapshot made no sample");
+			// 80 busy out of 200
+			Assert::AreEqual(sample.get_cpu_percent(), 40.f, L"cpu_percent != 40");
+			Assert::AreEqual(sample.get_memory_percent(), 50.f, L"memory_percent != 50");
+			Assert::IsTrue(sample.get_io_stats()[0].bytes_read == 4 * 512 &&
+				sample.get_io_stats()[1].bytes_written == 2 * 512, L"disk deltas wrong");
+			Assert::IsFalse(reader.next(snapshot), L"capture longer than recorded");
+		}
+
+		/**
+		 * replaying the same trace twice passes on the same messages,
+		 * one sample per snapshot after the first and every one in each rollup width
+		 */
+		TEST_METHOD(ReplayIsDeterministic)
+		{
+			using namespace crossover::monitor;
+			using namespace crossover::monitor::client;
+
+			const auto snapshots = getSnapshots();
+			std::vector<std::vector<utility::string_t>> runs;
+			for (int run = 0; run < 2; ++run) {
+				std::vector<utility::string_t> messages;
+				std::vector<rollup> rollups;
+				application app {std::chrono::minutes(1), [&](const web::json::value &collected_data) {
+					messages.push_back(collected_data.serialize());
+					if (collected_data.has_field(U("rollup"))) {
+						rollups.push_back(rollup::from_json(collected_data));
+					}
+				}, send_mode::both};
+
+				vector_source source(snapshots);
+				const std::uint64_t samples = app.replay(source);
+				Assert::IsTrue(samples == snapshots.size() - 1, L"samples != snapshots - 1");
+
+				for (const auto &width : rollup_builder::widths) {
+					std::uint64_t count = 0;
+					for (const auto &r : rollups) {
+						if (r.width() == width) {
+							count += r.metrics().at(U("process_count")).count;
+						}
+					}
+					Assert::IsTrue(count == samples, L"rollup count != replayed samples");
+				}
+				runs.push_back(messages);
+			}
+			Assert::IsTrue(runs[0] == runs[1], L"replays differ");
+		}
+
+		/**
+		 * check that decoders and replaying applications on separate
+		 * threads each make the samples of their own trace
+		 *
+		 * 1. decode and replay four different traces one after the other
+		 * 2. decode them again, every decoder on its own thread, and
+		 *    every decoder in turn on a single thread
+		 * 3. replay them again, every application on its own thread
+		 * 4. check each against the samples of step 1
+		 */
+		TEST_METHOD(ParallelDecoders_ShouldBeIndependent)
+		{
+			using namespace crossover::monitor;
+
+			const std::size_t count = 4;
+			std::vector<std::vector<counter_snapshot>> traces;
+			std::vector<std::vector<utility::string_t>> expected;
+			std::vector<std::vector<utility::string_t>> expectedMessages;
+			for (std::size_t i = 0; i < count; ++i) {
+				traces.push_back(getSnapshots(7 + i));
+				expected.push_back(decodeAll(traces[i]));
+				expectedMessages.push_back(replayAll(traces[i]));
+				Assert::IsTrue(expected[i].size() == traces[i].size() - 1, L"samples != snapshots - 1");
+			}
+			Assert::IsTrue(expected[0] != expected[1], L"traces make the same samples");
+
+			std::vector<std::vector<utility::string_t>> decoded(count);
+			std::vector<std::vector<utility::string_t>> replayed(count);
+			std::vector<std::thread> threads;
+			for (std::size_t i = 0; i < count; ++i) {
+				threads.emplace_back([&, i]() {
+					decoded[i] = decodeAll(traces[i]);
+				});
+				threads.emplace_back([&, i]() {
+					replayed[i] = replayAll(traces[i]);
+				});
+			}
+			for (auto &thr : threads) {
+				thr.join();
+			}
+
+			std::vector<snapshot_decoder> decoders(count);
+			std::vector<std::vector<utility::string_t>> interleaved(count);
+			data sample;
+			for (std::size_t k = 0; k < traces[0].size(); ++k) {
+				for (std::size_t i = 0; i < count; ++i) {
+					if (decoders[i].decode(traces[i][k], sample)) {
+						interleaved[i].push_back(sample.to_json().serialize());
+					}
+				}
+			}
+
+			for (std::size_t i = 0; i < count; ++i) {
+				Assert::IsTrue(decoded[i] == expected[i], L"decoder on its own thread differs");
+				Assert::IsTrue(interleaved[i] == expected[i], L"decoder sharing a thread differs");
+				Assert::IsTrue(replayed[i] == expectedMessages[i], L"application on its own thread differs");
+			}
+		}
+
+	};
+}
@@ -0,0 +1,262 @@
+#include "CppUnitTest.h"
+
+#include <rollup.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <map>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace CrossMonitorClientTests
+{
+	TEST_CLASS(rollup_UnitTests)
+	{
+		typedef std::pair<crossover::monitor::rollup::clock::time_point,
+						  crossover::monitor::data> sample;
+		// (width in seconds, start) -> rollup
+		typedef std::map<std::pair<long long, crossover::monitor::rollup::clock::time_point>,
+						 crossover::monitor::rollup> rollups;
+
+		/**
+		 * random samples over about 3 hours, in time order, with values
+		 * exactly representable in JSON so that round trips are lossless
+		 */
+		static std::vector<sample> getSamples(std::mt19937& random) {
+			using namespace crossover::monitor;
+
+			std::uniform_int_distribution<int> percent(0, 400);
+			std::uniform_int_distribution<unsigned> processes(1, 500);
+			std::uniform_int_distribution<unsigned> bytes(0, 4000000000u);
+			std::uniform_int_distribution<int> step_ms(0, 20000);
+
+			std::vector<sample> res;
+			rollup::clock::time_point time{ std::chrono::hours(24 * 365 * 46) };
+			const size_t count = std::uniform_int_distribution<size_t>(1, 1500)(random);
+			for (size_t i = 0; i < count; ++i) {
+				time += std::chrono::milliseconds(step_ms(random));
+				res.emplace_back(time, data(percent(random) / 4.f, percent(random) / 4.f, processes(random),
+					{ { bytes(random), bytes(random), L'C' }, { bytes(random), 0, L'D' } }));
+			}
+			return res;
+		}
+
+		/**
+		 * what the server computes from the raw samples: every rollup directly
+		 */
+		static rollups getExpected(const std::vector<sample>& samples) {
+			using namespace crossover::monitor;
+
+			rollups res;
+			for (const auto& width : rollup_builder::widths) {
+				for (const auto& s : samples) {
+					const rollup bucket(width, s.first);
+					auto it = res.emplace(std::make_pair(width.count(), bucket.start()), bucket).first;
+					it->second.add(s.second, s.first);
+				}
+			}
+			return res;
+		}
+
+		static void merge(rollups& into, const crossover::monitor::rollup& r) {
+			auto it = into.emplace(std::make_pair(r.width().count(), r.start()), r);
+			if (!it.second) {
+				it.first->second.merge(r);
+			}
+		}
+
+		static void assertEqual(const rollups& expected, const rollups& actual) {
+			Assert::IsTrue(expected.size() == actual.size(), L"expected.size() != actual.size()");
+
+			for (auto e = expected.begin(), a = actual.begin(); e != expected.end(); ++e, ++a) {
+				Assert::IsTrue(e->first == a->first, L"bucket mismatch");
+
+				const auto& em = e->second.metrics();
+				const auto& am = a->second.metrics();
+				Assert::IsTrue(em.size() == am.size(), L"metric count mismatch");
+				for (auto ei = em.begin(), ai = am.begin(); ei != em.end(); ++ei, ++ai) {
+					Assert::IsTrue(ei->first == ai->first, L"metric name mismatch");
+					Assert::IsTrue(ei->second.count == ai->second.count, L"count mismatch");
+					Assert::IsTrue(ei->second.min == ai->second.min, L"min mismatch");
+					Assert::IsTrue(ei->second.max == ai->second.max, L"max mismatch");
+					Assert::IsTrue(ei->second.last == ai->second.last, L"last mismatch");
+					Assert::IsTrue(ei->second.last_time_ms == ai->second.last_time_ms, L"last_time_ms mismatch");
+					Assert::IsTrue(ei->second.sketch == ai->second.sketch, L"sketch mismatch");
+					// only the sum depends on the order of additions
+					Assert::IsTrue(std::fabs(ei->second.sum - ai->second.sum) <= 1e-9 * std::fabs(ei->second.sum),
+						L"sum mismatch");
+				}
+			}
+		}
+
+	public:
+
+		/**
+		 * check that rollups built on several agents merge into the rollups
+		 * the server computes from all raw samples
+		 *
+		 * 1. for many random sample streams, deal the samples out to a random
+		 *    number of rollup_builders, flushing some of them halfway
+		 * 2. ship every closed rollup through to_json / from_json and
+		 *    merge the ones of the same bucket in random order
+		 * 3. compare with the rollups computed directly from all samples
+		 */
+		TEST_METHOD(RollupMerge_ShouldMatchWholeStream)
+		{
+			using namespace crossover::monitor;
+
+			for (unsigned seed = 1; seed <= 30; ++seed) {
+				std::mt19937 random(seed);
+				const std::vector<sample> samples = getSamples(random);
+
+				std::vector<rollup> shipped;
+				std::vector<rollup_builder> agents;
+				const size_t agent_count = std::uniform_int_distribution<size_t>(1, 4)(random);
+				for (size_t i = 0; i < agent_count; ++i) {
+					agents.emplace_back([&shipped](const rollup& closed) {
+						shipped.push_back(rollup::from_json(closed.to_json()));
+					});
+				}
+
+				std::uniform_int_distribution<size_t> pick(0, agent_count - 1);
+				for (size_t i = 0; i < samples.size(); ++i) {
+					agents[pick(random)].add(samples[i].second, samples[i].first);
+					if (i == samples.size() / 2) {
+						agents[pick(random)].flush();
+					}
+				}
+				for (auto& agent : agents) {
+					agent.flush();
+				}
+
+				std::shuffle(shipped.begin(), shipped.end(), random);
+				rollups actual;
+				for (const auto& r : shipped) {
+					merge(actual, r);
+				}
+
+				assertEqual(getExpected(samples), actual);
+			}
+		}
+
+		/**
+		 * check that rollups read back by rollup::decode() equal the ones
+		 * encoded, that the encoding is smaller than the JSON and that
+		 * truncated input throws
+		 */
+		TEST_METHOD(RollupEncode_ShouldRoundTrip)
+		{
+			using namespace crossover::monitor;
+
+			for (unsigned seed = 1; seed <= 10; ++seed) {
+				std::mt19937 random(seed);
+				const rollups expected = getExpected(getSamples(random));
+
+				std::string encoded;
+				size_t json_size = 0;
+				for (const auto& r : expected) {
+					r.second.encode(encoded);
+					json_size += r.second.to_json().serialize().size();
+				}
+				Assert::IsTrue(encoded.size() < json_size, L"encoding larger than JSON");
+
+				rollups actual;
+				const char* position = encoded.data();
+				while (position != encoded.data() + encoded.size()) {
+					merge(actual, rollup::decode(position, encoded.data() + encoded.size()));
+				}
+				assertEqual(expected, actual);
+
+				Assert::ExpectException<std::invalid_argument>([&encoded]() {
+					const char* position = encoded.data();
+					for (;;) {
+						rollup::decode(position, encoded.data() + encoded.size() / 2);
+					}
+				});
+			}
+		}
+
+		/**
+		 * check quantile_sketch::quantile() stays within the relative accuracy
+		 */
+		TEST_METHOD(QuantileSketch_ShouldBeWithinAccuracy)
+		{
+			using crossover::monitor::quantile_sketch;
+
+			quantile_sketch sketch;
+			for (int i = 1; i <= 100000; ++i) {
+				sketch.add(i);
+			}
+
+			for (double fraction : { 0.01, 0.5, 0.9, 0.99, 0.999 }) {
+				const double expected = 1 + fraction * 99999;
+				const double actual = sketch.quantile(fraction);
+				Assert::IsTrue(std::fabs(actual - expected) <= quantile_sketch::relative_accuracy * expected,
+					L"quantile out of accuracy");
+			}
+
+			quantile_sketch zeros;
+			zeros.add(0);
+			zeros.add(-1);
+			Assert::IsTrue(zeros.quantile(1) == 0, L"zeros.quantile(1) != 0");
+		}
+
+		/**
+		 * check rollup::from_json() throws on malformed input
+		 * and rollup::merge() on a rollup of another bucket
+		 */
+		TEST_METHOD(MalformedRollup_ShouldThrow)
+		{
+			using namespace crossover::monitor;
+
+			Assert::ExpectException<std::invalid_argument>([]() {
+				rollup::from_json(web::json::value::object());
+			});
+
+			const rollup::clock::time_point time{ std::chrono::hours(1) };
+			web::json::value json = rollup(std::chrono::seconds(10), time).to_json();
+			json[U("rollup")][U("start_s")] = web::json::value(3601);
+			Assert::ExpectException<std::invalid_argument>([&json]() {
+				rollup::from_json(json);
+			});
+
+			Assert::ExpectException<std::invalid_argument>([&time]() {
+				rollup r(std::chrono::seconds(10), time);
+				r.merge(rollup(std::chrono::minutes(1), time));
+			});
+		}
+
+		/**
+		 * check that a sample coalescing parts of an earlier one keeps its
+		 * fresh parts through JSON and adds only those to a rollup
+		 */
+		TEST_METHOD(PartialSample_ShouldAddOnlyFreshParts)
+		{
+			using namespace crossover::monitor;
+
+			data sample(12.5f, 40.f, 300, { { 1000, 2000, L'C' } });
+			sample.set_fresh(cpu_part | io_part);
+			const data read = data::from_json(web::json::value::parse(sample.to_json().serialize()));
+			Assert::IsTrue(read.get_fresh() == (cpu_part | io_part), L"fresh parts lost");
+			Assert::IsTrue(data::from_json(data(1.f, 2.f, 3, {}).to_json()).get_fresh() == all_parts, L"whole sample not fresh");
+
+			rollup r(std::chrono::seconds(10), rollup::clock::time_point{ std::chrono::hours(1) });
+			r.add(read, r.start());
+			Assert::IsTrue(r.metrics().count(U("cpu_percent")) == 1, L"cpu_percent not added");
+			Assert::IsTrue(r.metrics().count(U("bytes_read:C")) == 1, L"bytes_read not added");
+			Assert::IsTrue(r.metrics().count(U("memory_percent")) == 0, L"stale memory_percent added");
+			Assert::IsTrue(r.metrics().count(U("process_count")) == 0, L"stale process_count added");
+
+			Assert::ExpectException<std::invalid_argument>([&sample]() {
+				sample.set_fresh(all_parts + 1);
+			});
+		}
+
+	};
+}
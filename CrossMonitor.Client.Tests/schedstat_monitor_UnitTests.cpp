@@ -0,0 +1,200 @@
+#include "CppUnitTest.h"
+
+#if defined(__linux__)
+
+#include <schedstat_monitor.hpp>
+#include <procfs.hpp>
+#include <snapshot.hpp>
+#include <temporary_directory.hpp>
+
+#include <boost/filesystem.hpp>
+
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <system_error>
+#include <vector>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace CrossMonitorClientTests
+{
+	TEST_CLASS(schedstat_monitor_UnitTests)
+	{
+		struct cpu_counters {
+			unsigned cpu;
+			std::uint64_t run_ns;
+			std::uint64_t wait_ns;
+			std::uint64_t timeslices;
+		};
+
+		/**
+		 * /proc/schedstat and the schedstat of processes
+		 */
+		class proc_tree {
+		public:
+			/**
+			 * Writes /proc/schedstat with a scheduling domain after every CPU.
+			 */
+			void write_schedstat(const std::vector<cpu_counters>& cpus, unsigned version = 15) {
+				std::ostringstream text;
+				text << "version " << version << "\ntimestamp 4295032832\n";
+				for (const auto& c : cpus) {
+					text << "cpu" << c.cpu << " 0 0 120 40 80 60 " << c.run_ns << " " << c.wait_ns << " " << c.timeslices << "\n";
+					text << "domain0 00000003 1 2 3 4 5 6 7 8 9 10 11 12 13 14 15 16 17 18 19 20 21 22 23 24\n";
+				}
+				// in place, as procfs files change under their open handles
+				std::ofstream out((root_.path / "schedstat").string(), std::ios::in | std::ios::out | std::ios::trunc);
+				if (!out) {
+					out.open((root_.path / "schedstat").string());
+				}
+				out << text.str();
+			}
+
+			void write_process(unsigned pid, std::uint64_t run_ns, std::uint64_t wait_ns, std::uint64_t timeslices) {
+				const boost::filesystem::path dir = root_.path / std::to_string(pid);
+				boost::filesystem::create_directories(dir);
+				std::ofstream out((dir / "schedstat").string());
+				out << run_ns << " " << wait_ns << " " << timeslices << "\n";
+			}
+
+			void remove_process(unsigned pid) {
+				boost::filesystem::remove_all(root_.path / std::to_string(pid));
+			}
+
+			std::string root() const {
+				return root_.path.string();
+			}
+
+		private:
+			const temporary_directory root_;
+		};
+
+	public:
+
+		/**
+		 * check that every CPU is read, from the handle opened at first and
+		 * into the same counters, and that versions before 15 are refused
+		 */
+		TEST_METHOD(Schedstat_ShouldBeReadInPlace)
+		{
+			using namespace crossover::monitor;
+
+			proc_tree tree;
+			tree.write_schedstat({ { 0, 1000, 200, 10 }, { 1, 2000, 400, 20 }, { 2, 3000, 600, 30 }, { 3, 4000, 800, 40 } });
+			client::os::schedstat_monitor monitor(tree.root());
+			Assert::IsTrue(monitor.cpu_count() == 4, L"cpu count mismatch");
+
+			run_queue_counters queues;
+			monitor.read(queues);
+			Assert::IsTrue(queues.size() == 4, L"run queues read mismatch");
+			for (unsigned c = 0; c < 4; ++c) {
+				Assert::IsTrue(queues.cpus[c] == c && queues.run_ns[c] == 1000 * (c + 1) &&
+					queues.wait_ns[c] == 200 * (c + 1) && queues.timeslices[c] == 10 * (c + 1), L"run queue mismatch");
+			}
+
+			const std::uint64_t* const data = queues.run_ns.data();
+			tree.write_schedstat({ { 0, 5000, 1200, 20 }, { 1, 2000, 400, 20 }, { 2, 3000, 600, 30 }, { 3, 4000, 800, 40 } });
+			monitor.read(queues);
+			Assert::IsTrue(queues.run_ns.data() == data, L"run queues allocated again");
+			Assert::IsTrue(queues.run_ns[0] == 5000 && queues.wait_ns[0] == 1200, L"schedstat not read again");
+
+			const std::string old = "version 14\ncpu0 0 0 0 0 0 0 1 2 3\n";
+			Assert::IsFalse(procfs::parse_schedstat(old.data(), old.size(), queues), L"version 14 accepted");
+			tree.write_schedstat({ { 0, 1, 2, 3 } }, 14);
+			Assert::ExpectException<std::system_error>([&]() {
+				client::os::schedstat_monitor unsupported(tree.root());
+			}, L"version 14 opened");
+		}
+
+		/**
+		 * check the delays over an interval, and that a CPU that went
+		 * offline and came back with its counters reset moved nothing
+		 * rather than wrapping around
+		 */
+		TEST_METHOD(Hotplug_ShouldResetDeltas)
+		{
+			using namespace crossover::monitor;
+
+			proc_tree tree;
+			tree.write_schedstat({ { 0, 1000000, 100000, 100 }, { 1, 1000000, 100000, 100 }, { 2, 9000000, 900000, 900 } });
+			client::os::schedstat_monitor monitor(tree.root());
+
+			run_queue_counters before;
+			run_queue_counters offline;
+			run_queue_counters online;
+			monitor.read(before);
+			// CPU 2 offline, CPU 0 ran 3 ms and waited 1 ms over 10 timeslices
+			tree.write_schedstat({ { 0, 4000000, 1100000, 110 }, { 1, 1000000, 100000, 100 } });
+			monitor.read(offline);
+			// CPU 2 back with fresh counters
+			tree.write_schedstat({ { 0, 4000000, 1100000, 110 }, { 1, 1000000, 100000, 100 }, { 2, 500, 50, 1 } });
+			monitor.read(online);
+			Assert::IsTrue(offline.size() == 2 && online.size() == 3, L"hotplug not followed");
+
+			run_queue_stats stats;
+			float delay_us;
+			float wait_ratio;
+			delta_buffers buffers;
+			snapshot_decoder::run_queue_deltas(before, offline, stats, delay_us, wait_ratio, buffers);
+			Assert::IsTrue(stats.size() == 2 && stats.cpus[1] == 1, L"offline CPU listed");
+			Assert::IsTrue(std::fabs(stats.delay_us[0] - 100.f) < 0.001f, L"delay mismatch");
+			Assert::IsTrue(std::fabs(stats.wait_ratio[0] - 0.25f) < 0.001f, L"wait ratio mismatch");
+			Assert::IsTrue(stats.delay_us[1] == 0.f && stats.wait_ratio[1] == 0.f, L"idle CPU waited");
+			Assert::IsTrue(std::fabs(delay_us - 100.f) < 0.001f && std::fabs(wait_ratio - 0.25f) < 0.001f,
+				L"machine-wide delay mismatch");
+
+			// against the reading before it went offline, its counters went back
+			snapshot_decoder::run_queue_deltas(before, online, stats, delay_us, wait_ratio, buffers);
+			Assert::IsTrue(stats.size() == 3 && stats.cpus[2] == 2, L"CPU back online not listed");
+			Assert::IsTrue(stats.delay_us[2] == 0.f && stats.wait_ratio[2] == 0.f, L"reset counters wrapped around");
+			Assert::IsTrue(std::fabs(delay_us - 100.f) < 0.001f, L"reset CPU counted machine-wide");
+
+			// and has no reading at all against the one while it was offline
+			snapshot_decoder::run_queue_deltas(offline, online, stats, delay_us, wait_ratio, buffers);
+			Assert::IsTrue(stats.delay_us[2] == 0.f && delay_us == 0.f, L"CPU back online moved");
+		}
+
+		/**
+		 * check that the processes that waited the longest since the
+		 * previous reading are listed, longest first, and that processes
+		 * new or gone since then are not
+		 */
+		TEST_METHOD(Processes_ShouldListLongestWaits)
+		{
+			using namespace crossover::monitor;
+
+			proc_tree tree;
+			tree.write_schedstat({ { 0, 1, 1, 1 } });
+			for (unsigned pid = 100; pid < 105; ++pid) {
+				tree.write_process(pid, 1000000, 1000000, 10);
+			}
+			client::os::schedstat_monitor monitor(tree.root());
+
+			process_run_queues processes;
+			monitor.read_processes(2, processes);
+			Assert::IsTrue(processes.empty(), L"waits without a previous reading");
+			Assert::IsTrue(monitor.process_reads() == 5, L"process reads mismatch");
+
+			// 102 waited 4 ms over 8 timeslices while running 4 ms, 104 2 ms
+			tree.write_process(102, 5000000, 5000000, 18);
+			tree.write_process(104, 1000000, 3000000, 12);
+			tree.write_process(101, 1000000, 1500000, 11);
+			tree.remove_process(103);
+			tree.write_process(200, 0, 90000000, 1);
+			monitor.read_processes(2, processes);
+			Assert::IsTrue(processes.size() == 2, L"top processes size mismatch");
+			Assert::IsTrue(processes[0].pid == 102 && processes[1].pid == 104, L"top processes mismatch");
+			Assert::IsTrue(std::fabs(processes[0].delay_us - 500.f) < 0.001f, L"process delay mismatch");
+			Assert::IsTrue(std::fabs(processes[0].wait_ratio - 0.5f) < 0.001f, L"process wait ratio mismatch");
+			Assert::IsTrue(std::fabs(processes[1].wait_ratio - 1.f) < 0.001f, L"process wait ratio mismatch");
+
+			monitor.read_processes(10, processes);
+			Assert::IsTrue(processes.empty(), L"processes waited without a change");
+		}
+	};
+}
+
+#endif
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <boost/filesystem.hpp>
+#include <boost/noncopyable.hpp>
+
+namespace CrossMonitorClientTests {
+
+/**
+ * A fresh directory, removed with everything in it at the end.
+ */
+struct temporary_directory final : public boost::noncopyable {
+	const boost::filesystem::path path;
+
+	temporary_directory()
+		: path(boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("crossmonitor-%%%%-%%%%")) {
+		boost::filesystem::create_directories(path);
+	}
+	~temporary_directory() {
+		boost::system::error_code ignored;
+		boost::filesystem::remove_all(path, ignored);
+	}
+}; //struct temporary_directory
+
+} //namespace CrossMonitorClientTests
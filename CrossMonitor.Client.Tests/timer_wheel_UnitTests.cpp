@@ -0,0 +1,184 @@
+#include "CppUnitTest.h"
+
+#include <timer_wheel.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace CrossMonitorClientTests
+{
+	TEST_CLASS(timer_wheel_UnitTests)
+	{
+		typedef crossover::monitor::timer_wheel::duration duration;
+
+		/**
+		 * the schedule of a timer kept next to the wheel
+		 */
+		struct expected_timer {
+			std::int64_t period;
+			std::int64_t phase;
+			std::int64_t next;
+		};
+
+		/**
+		 * first phase + k * period after now
+		 */
+		static std::int64_t first_after(std::int64_t now, std::int64_t period, std::int64_t phase) {
+			phase %= period;
+			return now < phase ? phase : phase + ((now - phase) / period + 1) * period;
+		}
+
+	public:
+
+		/**
+		 * check that no timer drifts from phase + k * period over a long
+		 * virtual time run, however irregularly the wheel is advanced
+		 *
+		 * 1. add 2000 timers of random periods from 1 ms to 10 minutes
+		 *    and random phases
+		 * 2. advance the wheel over 3 days in random steps, from a
+		 *    millisecond to several minutes, removing and adding a few
+		 *    timers on the way
+		 * 3. every advance must hand out exactly the timers due by then,
+		 *    in the order of their due times, each falling due next at
+		 *    the first phase + k * period after it, with the skipped due
+		 *    times counted in missed()
+		 */
+		TEST_METHOD(LongRun_ShouldNotDrift)
+		{
+			using crossover::monitor::timer_wheel;
+
+			std::mt19937 random(42);
+			std::uniform_int_distribution<std::int64_t> period(1, 600000);
+			std::uniform_int_distribution<int> step_kind(0, 3);
+			std::uniform_int_distribution<std::int64_t> short_step(0, 100);
+			std::uniform_int_distribution<std::int64_t> long_step(0, 400000);
+
+			timer_wheel wheel;
+			std::vector<expected_timer> expected;
+			std::vector<bool> active;
+			const auto add = [&]() {
+				const std::int64_t p = period(random);
+				const std::int64_t phase = std::uniform_int_distribution<std::int64_t>(0, 2 * p)(random);
+				const timer_wheel::timer_id id = wheel.add(duration(p), duration(phase));
+				if (id >= expected.size()) {
+					expected.resize(id + 1);
+					active.resize(id + 1);
+				}
+				Assert::IsTrue(!active[id], L"id of an active timer given out");
+				expected[id] = expected_timer{ p, phase, first_after(wheel.now().count(), p, phase) };
+				active[id] = true;
+			};
+			for (int i = 0; i < 2000; ++i) {
+				add();
+			}
+
+			const std::int64_t end = 3LL * 24 * 3600 * 1000;
+			std::uint64_t missed = 0;
+			std::vector<timer_wheel::timer_id> due;
+			for (std::int64_t now = 0; now < end; ) {
+				now += step_kind(random) == 0 ? long_step(random) : short_step(random);
+
+				size_t count = 0;
+				std::int64_t next = INT64_MAX;
+				for (size_t id = 0; id < expected.size(); ++id) {
+					if (active[id]) {
+						count += expected[id].next <= now ? 1 : 0;
+						next = std::min(next, expected[id].next);
+					}
+				}
+				Assert::IsTrue(wheel.next_due().count() == next, L"next_due() mismatch");
+
+				due.clear();
+				Assert::IsTrue(wheel.advance(duration(now), due) == count, L"advance() count mismatch");
+				Assert::IsTrue(due.size() == count && wheel.now().count() == now, L"due timers mismatch");
+				std::int64_t previous = 0;
+				for (const auto id : due) {
+					expected_timer& t = expected[id];
+					Assert::IsTrue(active[id] && t.next <= now, L"timer not due handed out");
+					Assert::IsTrue(t.next >= previous, L"timers out of due order");
+					previous = t.next;
+
+					const std::int64_t skipped = (now - t.next) / t.period;
+					missed += skipped;
+					t.next += (skipped + 1) * t.period;
+					// never off the schedule it was given
+					Assert::IsTrue((t.next - t.phase % t.period) % t.period == 0, L"timer drifted");
+				}
+				Assert::IsTrue(wheel.missed() == missed, L"missed() mismatch");
+
+				if (short_step(random) == 0) {
+					const size_t id = std::uniform_int_distribution<size_t>(0, expected.size() - 1)(random);
+					if (active[id]) {
+						wheel.remove(id);
+						active[id] = false;
+					}
+					add();
+				}
+			}
+
+			// a timer of a second advanced every second fires on every advance
+			const timer_wheel::timer_id second = wheel.add(std::chrono::seconds(1), duration(250));
+			const std::int64_t start = wheel.now().count();
+			const std::int64_t seconds = end / 1000;
+			due.clear();
+			for (std::int64_t i = 1; i <= seconds; ++i) {
+				wheel.advance(duration(start + 1000 * i), due);
+			}
+			Assert::IsTrue(std::count(due.begin(), due.end(), second) == seconds, L"one second timer drifted");
+		}
+
+		/**
+		 * check add, reschedule and remove, and the errors they throw
+		 */
+		TEST_METHOD(Reschedule_ShouldMoveTimer)
+		{
+			using crossover::monitor::timer_wheel;
+
+			timer_wheel wheel(duration(1000));
+			const timer_wheel::timer_id a = wheel.add(duration(300));
+			const timer_wheel::timer_id b = wheel.add(duration(5000), duration(1000));
+			Assert::IsTrue(wheel.size() == 2, L"size() != 2");
+			// due at now() already handed out, so the next ones come after it
+			Assert::IsTrue(wheel.next_due().count() == 1200, L"a not due at 1200");
+
+			std::vector<timer_wheel::timer_id> due;
+			Assert::IsTrue(wheel.advance(duration(1199), due) == 0, L"a due early");
+			Assert::IsTrue(wheel.advance(duration(1200), due) == 1 && due.back() == a, L"a not due at 1200");
+
+			wheel.reschedule(a, duration(100), duration(50));
+			Assert::IsTrue(wheel.next_due().count() == 1250, L"rescheduled a not due at 1250");
+			due.clear();
+			Assert::IsTrue(wheel.advance(duration(6000), due) == 2, L"a and b not both due");
+			Assert::IsTrue(due[0] == a && due[1] == b, L"a not before b");
+			Assert::IsTrue(wheel.missed() == 47, L"missed() != 47");
+
+			wheel.remove(a);
+			Assert::IsTrue(wheel.size() == 1 && wheel.next_due().count() == 11000, L"a not removed");
+			Assert::IsTrue(wheel.add(duration(10)) == a, L"id of a not given out again");
+
+			Assert::ExpectException<std::invalid_argument>([&wheel]() {
+				wheel.add(duration::zero());
+			});
+			Assert::ExpectException<std::invalid_argument>([&wheel]() {
+				wheel.reschedule(99, duration(10));
+			});
+			Assert::ExpectException<std::invalid_argument>([&wheel, b]() {
+				wheel.remove(b);
+				wheel.remove(b);
+			});
+			Assert::ExpectException<std::invalid_argument>([&wheel, &due]() {
+				wheel.advance(duration(5999), due);
+			});
+			Assert::ExpectException<std::invalid_argument>([]() {
+				timer_wheel(duration(-1));
+			});
+		}
+	};
+}
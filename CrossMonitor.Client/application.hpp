@@ -1,16 +1,102 @@
 #pragma once
 
+#include <anomaly.hpp>
+#include <query_server.hpp>
+#include <snapshot.hpp>
+
 #include <cpprest/json.h>
 #include <boost/noncopyable.hpp>
 
 #include <memory>
 #include <chrono>
+#include <cstddef>
+#include <cstdint>
 #include <functional>
+#include <string>
 
 namespace crossover {
 namespace monitor {
 namespace client {
 
+/**
+ * What the application passes to the collected data handler.
+ */
+enum class send_mode {
+	/**
+	 * Every collected sample, see data::to_json().
+	 */
+	raw,
+	/**
+	 * Only the 10 second, 1 minute and 1 hour rollups as they close,
+	 * see rollup::to_json().
+	 */
+	rollup,
+	/**
+	 * Both of the above.
+	 */
+	both
+};
+
+/**
+ * When a source of the samples is read: at every phase + k * period since
+ * application::run() started.
+ */
+struct source_schedule {
+	/**
+	 * Zero follows runtime_settings::period.
+	 */
+	std::chrono::milliseconds period = std::chrono::milliseconds::zero();
+	std::chrono::milliseconds phase = std::chrono::milliseconds::zero();
+};
+
+/**
+ * Settings a running application can change without losing its state,
+ * see application::reconfigure().
+ */
+struct runtime_settings {
+	/**
+	 * Time between samples.
+	 */
+	std::chrono::milliseconds period = std::chrono::minutes(5);
+	/**
+	 * Time between samples for a while after an anomaly. Sources with a
+	 * longer period are read at this one then.
+	 */
+	std::chrono::milliseconds high_rate_period = std::chrono::seconds(1);
+	/**
+	 * Schedules of the sources of every part of the samples. Sources
+	 * falling due together are read into one sample, which lists the parts
+	 * read for it (see data::get_fresh()); the first sample reads them all.
+	 */
+	source_schedule cpu;
+	source_schedule memory;
+	source_schedule processes;
+	source_schedule io;
+	source_schedule filesystems;
+	source_schedule numa;
+	source_schedule net;
+	/**
+	 * Processes listed in the samples by the time they waited on a run
+	 * queue, see os::collector::set_run_queue_processes().
+	 */
+	std::size_t run_queue_processes = 0;
+};
+
+/**
+ * State file keeping the last reading of the collector between runs,
+ * see os::collector::keep_baseline().
+ */
+struct baseline_options {
+	/**
+	 * Empty keeps none.
+	 */
+	std::string path;
+	/**
+	 * Oldest saved reading the first sample is based on.
+	 */
+	std::chrono::milliseconds max_age = std::chrono::minutes(10);
+};
+
 /**
  * Class handling main application logic.
  * Call run() after construction to run main logic.
@@ -19,10 +105,11 @@ class application final: public boost::noncopyable {
 public:
 	typedef std::function<void(const web::json::value &collected_data)> OnCollectedDataHandler;
 
-private:
+	/**
+	 * Logs the collected data.
+	 */
 	static void collectedDataDefaultHandler(const web::json::value &collected_data);
 
-public:
 	/**
 	 * Constructs a ready to use application object.
 	 * May throw std::exception derived exceptions.
@@ -30,9 +117,21 @@ public:
 	 * @param onCollectedData called each time when data is collected.
 	 * The caller should take care what to do with collected performance data.
 	 * In case of scipping this parameter the default handler will be used.
+	 * @param mode raw samples, rollups or both are passed to onCollectedData.
+	 * @param anomalies if enabled, anomaly events (see anomaly_detector::to_json())
+	 * are passed to onCollectedData as well and sampling switches to the
+	 * high rate for a while after each one.
+	 * @param query if enabled, the samples and the closed rollups are
+	 * served on a local endpoint, see query_server.
+	 * @param baseline if a path is given, the first sample after a restart
+	 * spans the time since the last sample of the previous run.
 	 */
 	application(const std::chrono::minutes& period,
-				OnCollectedDataHandler onCollectedData = collectedDataDefaultHandler);
+				OnCollectedDataHandler onCollectedData = collectedDataDefaultHandler,
+				send_mode mode = send_mode::raw,
+				const anomaly_options& anomalies = anomaly_options(),
+				const query_options& query = query_options(),
+				const baseline_options& baseline = baseline_options());
 	~application();
 
 	/**
@@ -43,12 +142,38 @@ public:
 	 */
 	void run();
 
+	/**
+	 * Runs recorded snapshots through the same pipeline as run(), on the
+	 * calling thread and as fast as possible. The snapshot times are the
+	 * clock; nothing sleeps and the high rate after anomalies has no effect.
+	 * The rollups still open at the end are flushed.
+	 * Call stop() from any thread to break from this call.
+	 * Throws std::runtime_error if the recording is corrupted.
+	 * @return number of samples passed on, one less than the snapshots.
+	 */
+	std::uint64_t replay(snapshot_source& trace);
+
+	/**
+	 * Replaces the settings from now on, in a running application too:
+	 * the collector state and the delta baselines are kept, a pending
+	 * sleep is cut short to the new period. Call it from any thread;
+	 * run() picks the new settings up without taking a lock.
+	 * Throws std::invalid_argument if a period is not positive, or a
+	 * source period or phase negative.
+	 */
+	void reconfigure(const runtime_settings& settings);
+
 	/**
 	 * Call this from any thread or signal handler
 	 * to stop executing after using run().
 	 */
 	void stop() noexcept;
 
+	/**
+	 * @return port of the local query endpoint, 0 if it is disabled.
+	 */
+	unsigned short query_port() const noexcept;
+
 private:
 	class impl;
 
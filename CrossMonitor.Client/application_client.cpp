@@ -4,16 +4,29 @@
 #include <log.hpp>
 #include <utils.hpp>
 #include <data.hpp>
+#include <rollup.hpp>
+#include <anomaly.hpp>
+#include <snapshot.hpp>
+#include <sample_ring.hpp>
+#include <query_server.hpp>
+#include <openmetrics.hpp>
+#include <timer_wheel.hpp>
 
 #include <cpprest/json.h>
 #include <cpprest/http_client.h>
 
 #include <atomic>
+#include <mutex>
 #include <string>
 #include <stdexcept>
 #include <numeric>
+#include <thread>
+#include <algorithm>
+#include <iterator>
+#include <vector>
 
 #define LOG CROSSOVER_MONITOR_LOG
+#define LOGF CROSSOVER_MONITOR_LOGF
 
 using namespace std;
 
@@ -23,30 +36,266 @@ namespace client {
 
 using namespace web;
 
+namespace {
+
+	// closed rollups kept for the query endpoint, an hour rollup
+	// of a machine with many volumes takes some tens of kilobytes
+	const size_t aggregates_bytes = 1024 * 1024;
+	const size_t aggregates_records = 256;
+
+	// OpenMetrics expositions, a few kilobytes each
+	const size_t metrics_bytes = 256 * 1024;
+	const size_t metrics_records = 64;
+
+	int64_t to_ms(const rollup::clock::time_point& time) noexcept {
+		return chrono::duration_cast<chrono::milliseconds>(time.time_since_epoch()).count();
+	}
+
+	// the sources of the sample parts, each with a timer of its own
+	const unsigned source_count = 7;
+
+	/**
+	 * Schedule of a source, numbered in data_part bit order.
+	 */
+	const source_schedule& schedule_of(const runtime_settings& settings, unsigned source) noexcept {
+		switch (source) {
+		case 0:
+			return settings.cpu;
+		case 1:
+			return settings.memory;
+		case 2:
+			return settings.processes;
+		case 3:
+			return settings.io;
+		case 4:
+			return settings.filesystems;
+		case 5:
+			return settings.numa;
+		default:
+			return settings.net;
+		}
+	}
+
+} //namespace
+
 class application::impl final {
 private:
 	atomic<bool> m_stop;
 	atomic<bool> m_running;
-	const std::chrono::minutes m_period;
+	// only the loop reads m_settings; reconfigure() leaves the next ones
+	// in m_pending, where the loop takes them over
+	unique_ptr<const runtime_settings> m_settings;
+	atomic<const runtime_settings*> m_pending;
+	static_assert(ATOMIC_POINTER_LOCK_FREE == 2, "run() would take a lock to read the pending settings");
 	OnCollectedDataHandler m_onCollectedData;
+	const send_mode m_sendMode;
+	os::collector m_collector;
 	data m_collectedData;
+	rollup_builder m_rollups;
+	anomaly_detector m_anomalies;
+	sample_history m_history;
+	sample_history::clock::time_point m_highRateUntil;
+	// the sources are on the high rate schedule
+	bool m_highRate;
+	// drives the sources on the clock of run(), a timer each in data_part
+	// bit order
+	unique_ptr<timer_wheel> m_wheel;
+	timer_wheel::timer_id m_timers[source_count];
+	vector<timer_wheel::timer_id> m_due;
+	// the server reads the rings, so it is declared after them
+	// the rings keep their counters on their own cache lines
+	utils::aligned_ptr<utils::sample_ring> m_samples;
+	utils::aligned_ptr<utils::sample_ring> m_aggregates;
+	utils::aligned_ptr<utils::sample_ring> m_metrics;
+	openmetrics_exporter m_exporter;
+	unique_ptr<query_server> m_query;
 
 public:
-	impl(const chrono::minutes& period, OnCollectedDataHandler onCollectedData)
+	impl(const chrono::minutes& period, OnCollectedDataHandler onCollectedData, send_mode mode,
+		 const anomaly_options& anomalies, const query_options& query, const baseline_options& baseline)
 		: m_stop (false)
 		, m_running(false)
-		, m_period(period)
-		, m_onCollectedData(onCollectedData) {
+		, m_pending(nullptr)
+		, m_onCollectedData(onCollectedData)
+		, m_sendMode(mode)
+		, m_rollups([this](const rollup& closed) {
+			rollup_closed(closed);
+		})
+		, m_anomalies(anomalies)
+		, m_history(anomalies.pre_trigger_samples)
+		, m_highRate(false) {
+		if (query.enabled) {
+			m_samples = utils::make_aligned<utils::sample_ring>(query.history_bytes, query.history_records);
+			m_aggregates = utils::make_aligned<utils::sample_ring>(aggregates_bytes, aggregates_records);
+			m_metrics = utils::make_aligned<utils::sample_ring>(metrics_bytes, metrics_records);
+			m_query.reset(new query_server(query, *m_samples, *m_aggregates, *m_metrics));
+		}
+		if (!baseline.path.empty()) {
+			m_collector.keep_baseline(baseline.path, baseline.max_age);
+		}
+
+		runtime_settings settings;
+		settings.period = period;
+		settings.high_rate_period = anomalies.high_rate_period;
+		m_settings.reset(new runtime_settings(settings));
+	}
+
+	~impl() {
+		delete m_pending.load();
+	}
+
+	unsigned short query_port() const noexcept {
+		return m_query ? m_query->port() : 0;
 	}
 
 private:
-	void collect_data() {
-		m_collectedData.set_cpu_percent(os::cpu_use_percent());
-		m_collectedData.set_process_count(os::process_count());
-		m_collectedData.set_memory_percent(os::memory_use_percent());
+	void detect_anomalies(const sample_history::clock::time_point& now) {
+		m_history.push(m_collectedData, now);
+
+		const auto& events = m_anomalies.check(m_collectedData, now);
+		if (events.empty()) {
+			return;
+		}
+
+		const anomaly_options& options = m_anomalies.options();
+		if (now >= m_highRateUntil) {
+			LOG(warning) << "Anomaly detected, sampling every " << m_settings->high_rate_period.count()
+				<< " ms for " << options.high_rate_duration.count() << " s";
+		}
+		m_highRateUntil = now + options.high_rate_duration;
+
+		for (const auto& event : events) {
+			LOGF(warning, "Anomaly in %1%: value %2%, mean %3%, stddev %4%",
+				*event.metric, event.value, event.mean, event.stddev);
+			m_onCollectedData(anomaly_detector::to_json(event, m_history));
+		}
+	}
+
+	/**
+	 * Renders the sample once, as JSON and as OpenMetrics text,
+	 * for all the query endpoint readers.
+	 */
+	void publish_sample(const rollup::clock::time_point& now) {
+		json::value record;
+		record[U("time_ms")] = json::value(to_ms(now));
+		record[U("data")] = m_collectedData.to_json();
+
+		if (!m_samples->publish(to_ms(now), 0, utility::conversions::to_utf8string(record.serialize()))) {
+			LOG(warning) << "Sample too large for the query endpoint history";
+		}
+
+		m_exporter.update(m_collectedData);
+		if (!m_metrics->publish(to_ms(now), 0, m_exporter.text())) {
+			LOG(warning) << "OpenMetrics exposition too large for the query endpoint";
+		}
+	}
+
+	void rollup_closed(const rollup& closed) {
+		const json::value value = closed.to_json();
+		if (m_aggregates) {
+			const string rendered = utility::conversions::to_utf8string(value.serialize());
+			if (!m_aggregates->publish(to_ms(closed.start()), static_cast<uint32_t>(closed.width().count()), rendered)) {
+				LOG(warning) << "Rollup too large for the query endpoint";
+			}
+		}
+		if (m_sendMode != send_mode::raw) {
+			m_onCollectedData(value);
+		}
+	}
+
+	/**
+	 * Period of a source under the current settings.
+	 */
+	chrono::milliseconds source_period(unsigned source) const noexcept {
+		const source_schedule& schedule = schedule_of(*m_settings, source);
+		const chrono::milliseconds period = schedule.period.count() > 0 ? schedule.period : m_settings->period;
+		return m_highRate ? min(period, m_settings->high_rate_period) : period;
+	}
+
+	/**
+	 * Puts the timer of every source on its period under the current
+	 * settings, keeping its phase.
+	 */
+	void schedule_sources() {
+		m_highRate = sample_history::clock::now() < m_highRateUntil;
+		for (unsigned i = 0; i < source_count; ++i) {
+			m_wheel->reschedule(m_timers[i], source_period(i), schedule_of(*m_settings, i).phase);
+		}
+	}
+
+	/**
+	 * Takes over the settings of the last reconfigure(), if any.
+	 * One atomic load when there are none.
+	 * @return whether the settings changed.
+	 */
+	bool apply_settings() noexcept {
+		if (m_pending.load(memory_order_relaxed) == nullptr) {
+			return false;
+		}
+		m_settings.reset(m_pending.exchange(nullptr, memory_order_acquire));
+		m_collector.set_run_queue_processes(m_settings->run_queue_processes);
+		LOG(info) << "Settings changed, sampling every " << m_settings->period.count() << " ms";
+		return true;
+	}
+
+	/**
+	 * Sleeps until the next source falls due on the wheel, whose clock
+	 * runs from start. The schedules are checked again on every wake up,
+	 * so new settings and the end of a high rate apply without waiting out
+	 * the old periods.
+	 * @return data_part bits of the sources due, 0 if stopped.
+	 */
+	unsigned wait_next_sample(const chrono::steady_clock::time_point& start) {
+		const chrono::milliseconds resolution(100);
+
+		while (!m_stop) {
+			if (apply_settings() || m_highRate != (sample_history::clock::now() < m_highRateUntil)) {
+				schedule_sources();
+			}
 
-		// avoid copying array
-		os::disk_io_stats(m_collectedData.get_io_stats_for_edit());
+			const auto elapsed = chrono::steady_clock::now() - start;
+			m_due.clear();
+			if (m_wheel->advance(chrono::duration_cast<chrono::milliseconds>(elapsed), m_due) > 0) {
+				unsigned parts = 0;
+				for (const auto id : m_due) {
+					parts |= 1u << static_cast<unsigned>(find(begin(m_timers), end(m_timers), id) - begin(m_timers));
+				}
+				return parts;
+			}
+			const auto remaining = m_wheel->next_due() - elapsed;
+			this_thread::sleep_for(min<chrono::steady_clock::duration>(remaining, resolution));
+		}
+		return 0;
+	}
+
+	/**
+	 * Passes m_collectedData on, taken at now.
+	 */
+	void process_sample(const rollup::clock::time_point& now) {
+		if (m_anomalies.options().enabled) {
+			detect_anomalies(now);
+		}
+		if (m_sendMode != send_mode::rollup) {
+			m_onCollectedData(m_collectedData.to_json());
+		}
+		if (m_samples) {
+			publish_sample(now);
+		}
+		if (m_sendMode != send_mode::raw || m_aggregates) {
+			m_rollups.add(m_collectedData, now);
+		}
+	}
+
+	void flush_rollups() noexcept {
+		if (m_sendMode != send_mode::raw || m_aggregates) {
+			try {
+				// the rest of the open buckets merges with them on the server
+				m_rollups.flush();
+			}
+			catch (const std::exception& e) {
+				LOG(error) << "Failed to send rollups to server: " << e.what();
+			}
+		}
 	}
 
 public:
@@ -60,19 +309,28 @@ public:
 
 		LOG(info) << "Starting application loop";
 
-		const chrono::milliseconds resolution(100);
+		apply_settings();
+		const chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		m_wheel.reset(new timer_wheel());
+		for (unsigned i = 0; i < source_count; ++i) {
+			m_timers[i] = m_wheel->add(chrono::milliseconds(1));
+		}
+		schedule_sources();
+		// the first sample reads every source, the timers take over after it
+		unsigned parts = all_parts;
 
 		do {
 			try {
-				collect_data();
-				m_onCollectedData(m_collectedData.to_json());
+				m_collector.collect(m_collectedData, parts);
+				process_sample(rollup::clock::now());
 			}
 			catch (const std::exception& e) {
 				LOG(error) << "Failed to collect and send data to server: "
 					<< e.what();
 			}
-		} while (utils::interruptible_sleep(m_period, resolution, m_stop) !=
-			utils::interruptible_sleep_result::interrupted);
+		} while ((parts = wait_next_sample(start)) != 0);
+
+		flush_rollups();
 
 		// no advantage here to place following lines into scope_exit
 		m_stop = false;
@@ -81,6 +339,63 @@ public:
 		LOG(info) << "Exiting application loop";
 	}
 
+	uint64_t replay(snapshot_source& trace) {
+		if (m_running) {
+			LOG(warning) << "application::replay while running, ignoring call";
+			return 0;
+		}
+
+		m_running = true;
+
+		LOG(info) << "Starting replay";
+
+		snapshot_decoder decoder;
+		counter_snapshot snapshot;
+		uint64_t samples = 0;
+
+		try {
+			while (!m_stop && trace.next(snapshot)) {
+				try {
+					if (decoder.decode(snapshot, m_collectedData)) {
+						process_sample(rollup::clock::time_point(chrono::milliseconds(snapshot.time_ms)));
+						++samples;
+					}
+				}
+				catch (const std::invalid_argument& e) {
+					LOG(error) << "Skipping snapshot at " << snapshot.time_ms << ": " << e.what();
+				}
+			}
+		}
+		catch (...) {
+			m_stop = false;
+			m_running = false;
+			throw;
+		}
+
+		flush_rollups();
+
+		m_stop = false;
+		m_running = false;
+
+		LOG(info) << "Replayed " << samples << " samples";
+		return samples;
+	}
+
+	void reconfigure(const runtime_settings& settings) {
+		if (settings.period <= chrono::milliseconds::zero() ||
+			settings.high_rate_period <= chrono::milliseconds::zero()) {
+			throw invalid_argument("Sample periods must be positive");
+		}
+		for (unsigned i = 0; i < source_count; ++i) {
+			const source_schedule& schedule = schedule_of(settings, i);
+			if (schedule.period < chrono::milliseconds::zero() || schedule.phase < chrono::milliseconds::zero()) {
+				throw invalid_argument("Source periods and phases cannot be negative");
+			}
+		}
+		// settings the loop did not take over yet are superseded
+		delete m_pending.exchange(new runtime_settings(settings), memory_order_acq_rel);
+	}
+
 	void stop() noexcept {
 		if (m_running) {
 			LOG(info) << "Stop requested, waiting for tasks to finish";
@@ -132,22 +447,18 @@ void application::collectedDataDefaultHandler(const web::json::value &collected_
 	LOG(info) << collected_data.serialize();
 }
 
-application::application(const chrono::minutes& period, OnCollectedDataHandler onCollectedData)
-	: m_impl(new impl(period, onCollectedData)) {
+application::application(const chrono::minutes& period, OnCollectedDataHandler onCollectedData,
+						 send_mode mode, const anomaly_options& anomalies, const query_options& query,
+						 const baseline_options& baseline)
+	: m_impl(new impl(period, onCollectedData, mode, anomalies, query, baseline)) {
 	if (period < chrono::minutes(1)) {
 		throw invalid_argument("Invalid arguments to application constructor");
 	}
 
-	// initialize CPU and HDD performance statistics queries at the beginning
-	os::init_cpu_use_percent();
-	os::init_disk_io_stats();
-
 	LOG(info) << "application constructed successfully";
 }
 
 application::~application() {
-	// CPU query needs this call (PdhCloseQuery)
-	os::uninit_cpu_use_percent();
 	LOG(info) << "application destructed successfully";
 }
 
@@ -155,13 +466,20 @@ void application::run() {
 	m_impl->run();
 }
 
+uint64_t application::replay(snapshot_source& trace) {
+	return m_impl->replay(trace);
+}
+
+unsigned short application::query_port() const noexcept {
+	return m_impl->query_port();
+}
+
+void application::reconfigure(const runtime_settings& settings) {
+	m_impl->reconfigure(settings);
+}
+
 void application::stop() noexcept {
 	m_impl->stop();
-
-	// it is needed if console is terminated via close (red) button
-	// because application instance is not destructing that case.
-	// the extra call of this function is safe:
-	os::uninit_cpu_use_percent();
 }
 
 } //namespace client
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "../CrossMonitor.Shared/snapshot.hpp"
+
+#include <boost/noncopyable.hpp>
+
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <string>
+
+namespace crossover {
+namespace monitor {
+namespace client {
+namespace os {
+
+/**
+ * Keeps the last reading of a collector in a small state file, so that
+ * the next run of the agent takes the base of its first sample from it
+ * and that sample spans a real interval rather than reporting zeroes.
+ *
+ * The file is mapped into memory and every save() copies the reading,
+ * encoded as a snapshot journal record, into the mapping, with the boot id
+ * of the kernel and the time since boot. Nothing is synced: the page cache
+ * outlives the agent, and a crash of the machine ends the boot the
+ * reading belongs to anyway. A reading of another boot, older than the
+ * maximum age, cut short by a crash during save() or written by a newer
+ * agent is not loaded.
+ *
+ * Windows has no boot id; the boot is told by the time it happened
+ * there, to the second, and the time since boot includes sleep.
+ */
+class baseline_file final : public boost::noncopyable {
+public:
+	/**
+	 * File holding the boot id of the kernel, empty on Windows for the
+	 * boot time.
+	 */
+	static const char* const default_boot_id_path;
+
+	/**
+	 * Opens path, or creates it.
+	 * Throws std::system_error if it cannot be opened and mapped, or the
+	 * boot id cannot be read, std::invalid_argument if max_age is negative.
+	 * @param max_age oldest reading load() returns.
+	 * @param boot_id_path file holding the boot id of the kernel, empty
+	 * for the boot time.
+	 */
+	baseline_file(const std::string& path, std::chrono::milliseconds max_age,
+				  const std::string& boot_id_path = default_boot_id_path);
+	~baseline_file();
+
+	/**
+	 * Reads the saved reading into snapshot if it is still valid.
+	 * @return false if there is none, or it is not valid.
+	 */
+	bool load(counter_snapshot& snapshot);
+
+	/**
+	 * Saves snapshot, taken now, in place of the last one.
+	 * Throws std::system_error if the file cannot grow to hold it.
+	 */
+	void save(const counter_snapshot& snapshot);
+
+	/**
+	 * Bytes of the file mapped.
+	 */
+	std::size_t capacity() const noexcept;
+
+private:
+	class impl;
+
+	std::unique_ptr<impl> m_impl;
+}; //class baseline_file
+
+} //namespace os
+} //namespace client
+} //namespace monitor
+} //namespace crossover
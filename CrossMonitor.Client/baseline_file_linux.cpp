@@ -0,0 +1,214 @@
+#include "baseline_file.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <system_error>
+
+using namespace std;
+
+namespace crossover {
+namespace monitor {
+namespace client {
+namespace os {
+
+namespace {
+
+	const char file_magic[4] = { 'C', 'M', 'S', 'B' };
+	const uint16_t file_layout = 1;
+	const size_t boot_id_size = 36;
+	const size_t page_size = 4096;
+
+	/**
+	 * Start of the file, followed by the record.
+	 */
+	struct header {
+		char magic[4];
+		uint16_t layout;
+		// journal::version of the record
+		uint16_t record_version;
+		char boot_id[boot_id_size];
+		// bytes of the record, 0 while save() writes it
+		uint32_t length;
+		// CLOCK_BOOTTIME at save()
+		uint64_t boot_time_ns;
+	};
+
+	uint64_t boot_time_ns() noexcept {
+		timespec now;
+		clock_gettime(CLOCK_BOOTTIME, &now);
+		return static_cast<uint64_t>(now.tv_sec) * 1000000000 + static_cast<uint64_t>(now.tv_nsec);
+	}
+
+	/**
+	 * Keeps the stores before it ahead of those after it, as a process
+	 * killed in between leaves them in the mapping.
+	 */
+	void store_fence() noexcept {
+		atomic_signal_fence(memory_order_seq_cst);
+	}
+
+} //namespace
+
+const char* const baseline_file::default_boot_id_path = "/proc/sys/kernel/random/boot_id";
+
+class baseline_file::impl final {
+private:
+	const uint64_t m_maxAgeNs;
+	char m_bootId[boot_id_size];
+	int m_fd;
+	char* m_map;
+	size_t m_capacity;
+	// encoded reading, kept between saves
+	string m_record;
+
+	header& head() const noexcept {
+		return *reinterpret_cast<header*>(m_map);
+	}
+
+	void read_boot_id(const string& path) {
+		const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+		if (fd < 0) {
+			throw system_error(errno, system_category(), path);
+		}
+		const ssize_t size = read(fd, m_bootId, sizeof(m_bootId));
+		const int error = errno;
+		close(fd);
+		if (size < 0) {
+			throw system_error(error, system_category(), path);
+		}
+		memset(m_bootId + size, 0, sizeof(m_bootId) - static_cast<size_t>(size));
+	}
+
+	/**
+	 * Grows the file to hold size bytes, or maps it as it is if it does.
+	 * The previous mapping stays if this one fails.
+	 */
+	void map(size_t size) {
+		struct stat status;
+		if (fstat(m_fd, &status) != 0) {
+			throw system_error(errno, system_category(), "baseline fstat");
+		}
+		size_t capacity = static_cast<size_t>(status.st_size);
+		if (capacity < size) {
+			capacity = max(capacity, page_size);
+			while (capacity < size) {
+				capacity *= 2;
+			}
+			if (ftruncate(m_fd, static_cast<off_t>(capacity)) != 0) {
+				throw system_error(errno, system_category(), "baseline ftruncate");
+			}
+		}
+		void* map = mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+		if (map == MAP_FAILED) {
+			throw system_error(errno, system_category(), "baseline mmap");
+		}
+		if (m_map != nullptr) {
+			munmap(m_map, m_capacity);
+		}
+		m_map = static_cast<char*>(map);
+		m_capacity = capacity;
+	}
+
+public:
+	impl(const string& path, chrono::milliseconds max_age, const string& boot_id_path)
+		: m_maxAgeNs(static_cast<uint64_t>(chrono::duration_cast<chrono::nanoseconds>(max_age).count()))
+		, m_fd(-1)
+		, m_map(nullptr)
+		, m_capacity(0) {
+		if (max_age < chrono::milliseconds::zero()) {
+			throw invalid_argument("baseline max_age cannot be negative");
+		}
+		read_boot_id(boot_id_path);
+		m_fd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+		if (m_fd < 0) {
+			throw system_error(errno, system_category(), path);
+		}
+		try {
+			map(sizeof(header));
+		} catch (...) {
+			close(m_fd);
+			throw;
+		}
+	}
+
+	~impl() {
+		munmap(m_map, m_capacity);
+		close(m_fd);
+	}
+
+	bool load(counter_snapshot& snapshot) {
+		const header& h = head();
+		if (memcmp(h.magic, file_magic, sizeof(file_magic)) != 0 || h.layout != file_layout ||
+			h.length == 0 || h.length > m_capacity - sizeof(header) ||
+			memcmp(h.boot_id, m_bootId, sizeof(m_bootId)) != 0) {
+			return false;
+		}
+		const uint64_t now = boot_time_ns();
+		if (h.boot_time_ns > now || now - h.boot_time_ns > m_maxAgeNs) {
+			return false;
+		}
+		m_record.assign(m_map + sizeof(header), h.length);
+		try {
+			journal::decode(m_record, h.record_version, snapshot);
+		} catch (const runtime_error&) {
+			return false;
+		}
+		return true;
+	}
+
+	void save(const counter_snapshot& snapshot) {
+		journal::encode(snapshot, m_record);
+		if (sizeof(header) + m_record.size() > m_capacity) {
+			map(sizeof(header) + m_record.size());
+		}
+		header& h = head();
+		h.length = 0;
+		store_fence();
+		memcpy(m_map + sizeof(header), m_record.data(), m_record.size());
+		memcpy(h.magic, file_magic, sizeof(file_magic));
+		h.layout = file_layout;
+		h.record_version = journal::version;
+		memcpy(h.boot_id, m_bootId, sizeof(m_bootId));
+		h.boot_time_ns = boot_time_ns();
+		store_fence();
+		h.length = static_cast<uint32_t>(m_record.size());
+	}
+
+	size_t capacity() const noexcept {
+		return m_capacity;
+	}
+}; //class baseline_file::impl
+
+baseline_file::baseline_file(const string& path, chrono::milliseconds max_age, const string& boot_id_path)
+	: m_impl(new impl(path, max_age, boot_id_path)) {
+}
+
+baseline_file::~baseline_file() {
+}
+
+bool baseline_file::load(counter_snapshot& snapshot) {
+	return m_impl->load(snapshot);
+}
+
+void baseline_file::save(const counter_snapshot& snapshot) {
+	m_impl->save(snapshot);
+}
+
+size_t baseline_file::capacity() const noexcept {
+	return m_impl->capacity();
+}
+
+} //namespace os
+} //namespace client
+} //namespace monitor
+} //namespace crossover
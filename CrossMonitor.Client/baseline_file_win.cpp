@@ -0,0 +1,263 @@
+#include "baseline_file.hpp"
+
+#include <Windows.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <system_error>
+
+using namespace std;
+
+namespace crossover {
+namespace monitor {
+namespace client {
+namespace os {
+
+namespace {
+
+	const char file_magic[4] = { 'C', 'M', 'S', 'B' };
+	const uint16_t file_layout = 1;
+	const size_t boot_id_size = 36;
+	const size_t page_size = 4096;
+	// boot times taken from the clock differ by as much as it is adjusted
+	const int64_t boot_time_tolerance_s = 2;
+
+	/**
+	 * Start of the file, followed by the record.
+	 */
+	struct header {
+		char magic[4];
+		uint16_t layout;
+		// journal::version of the record
+		uint16_t record_version;
+		char boot_id[boot_id_size];
+		// bytes of the record, 0 while save() writes it
+		uint32_t length;
+		// GetTickCount64 at save(), sleep included
+		uint64_t boot_time_ns;
+	};
+
+	system_error last_error(const string& what) {
+		return system_error(static_cast<int>(GetLastError()), system_category(), what);
+	}
+
+	uint64_t boot_time_ns() noexcept {
+		return GetTickCount64() * 1000000;
+	}
+
+	/**
+	 * Seconds since 1970 at the boot of the machine.
+	 */
+	int64_t booted_at() noexcept {
+		FILETIME now;
+		GetSystemTimeAsFileTime(&now);
+		// 100 ns units since 1601-01-01
+		const uint64_t now_ms = ((static_cast<uint64_t>(now.dwHighDateTime) << 32) | now.dwLowDateTime) / 10000 -
+			11644473600000ULL;
+		return static_cast<int64_t>((now_ms - GetTickCount64()) / 1000);
+	}
+
+	/**
+	 * Keeps the stores before it ahead of those after it, as a process
+	 * killed in between leaves them in the mapping.
+	 */
+	void store_fence() noexcept {
+		atomic_signal_fence(memory_order_seq_cst);
+	}
+
+} //namespace
+
+const char* const baseline_file::default_boot_id_path = "";
+
+class baseline_file::impl final {
+private:
+	const uint64_t m_maxAgeNs;
+	char m_bootId[boot_id_size];
+	// m_bootId is booted_at(), compared with boot_time_tolerance_s
+	bool m_bootTime;
+	HANDLE m_file;
+	HANDLE m_mapping;
+	char* m_map;
+	size_t m_capacity;
+	// encoded reading, kept between saves
+	string m_record;
+
+	header& head() const noexcept {
+		return *reinterpret_cast<header*>(m_map);
+	}
+
+	void read_boot_id(const string& path) {
+		memset(m_bootId, 0, sizeof(m_bootId));
+		if (path.empty()) {
+			const string id = to_string(booted_at());
+			memcpy(m_bootId, id.data(), min(id.size(), sizeof(m_bootId)));
+			m_bootTime = true;
+			return;
+		}
+		const HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+			NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (file == INVALID_HANDLE_VALUE) {
+			throw last_error(path);
+		}
+		DWORD size = 0;
+		const BOOL done = ReadFile(file, m_bootId, sizeof(m_bootId), &size, NULL);
+		const DWORD error = GetLastError();
+		CloseHandle(file);
+		if (!done) {
+			throw system_error(static_cast<int>(error), system_category(), path);
+		}
+	}
+
+	bool same_boot(const char* id) const noexcept {
+		if (!m_bootTime) {
+			return memcmp(id, m_bootId, sizeof(m_bootId)) == 0;
+		}
+		char saved[boot_id_size + 1];
+		memcpy(saved, id, boot_id_size);
+		saved[boot_id_size] = 0;
+		char* end = nullptr;
+		const long long then = strtoll(saved, &end, 10);
+		return end != saved && llabs(then - strtoll(m_bootId, nullptr, 10)) <= boot_time_tolerance_s;
+	}
+
+	/**
+	 * Grows the file to hold size bytes, or maps it as it is if it does.
+	 * The previous mapping stays if this one fails.
+	 */
+	void map(size_t size) {
+		LARGE_INTEGER status;
+		if (!GetFileSizeEx(m_file, &status)) {
+			throw last_error("baseline GetFileSizeEx");
+		}
+		size_t capacity = static_cast<size_t>(status.QuadPart);
+		if (capacity < size) {
+			capacity = max(capacity, page_size);
+			while (capacity < size) {
+				capacity *= 2;
+			}
+		}
+		// a mapping larger than the file grows it
+		const uint64_t mapped = capacity;
+		const HANDLE mapping = CreateFileMappingW(m_file, NULL, PAGE_READWRITE,
+			static_cast<DWORD>(mapped >> 32), static_cast<DWORD>(mapped), NULL);
+		if (mapping == NULL) {
+			throw last_error("baseline CreateFileMapping");
+		}
+		void* map = MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, capacity);
+		if (map == NULL) {
+			const DWORD error = GetLastError();
+			CloseHandle(mapping);
+			throw system_error(static_cast<int>(error), system_category(), "baseline MapViewOfFile");
+		}
+		unmap();
+		m_mapping = mapping;
+		m_map = static_cast<char*>(map);
+		m_capacity = capacity;
+	}
+
+	void unmap() noexcept {
+		if (m_map != nullptr) {
+			UnmapViewOfFile(m_map);
+			CloseHandle(m_mapping);
+		}
+	}
+
+public:
+	impl(const string& path, chrono::milliseconds max_age, const string& boot_id_path)
+		: m_maxAgeNs(static_cast<uint64_t>(chrono::duration_cast<chrono::nanoseconds>(max_age).count()))
+		, m_bootTime(false)
+		, m_file(INVALID_HANDLE_VALUE)
+		, m_mapping(NULL)
+		, m_map(nullptr)
+		, m_capacity(0) {
+		if (max_age < chrono::milliseconds::zero()) {
+			throw invalid_argument("baseline max_age cannot be negative");
+		}
+		read_boot_id(boot_id_path);
+		m_file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_DELETE,
+			NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (m_file == INVALID_HANDLE_VALUE) {
+			throw last_error(path);
+		}
+		try {
+			map(sizeof(header));
+		} catch (...) {
+			CloseHandle(m_file);
+			throw;
+		}
+	}
+
+	~impl() {
+		unmap();
+		CloseHandle(m_file);
+	}
+
+	bool load(counter_snapshot& snapshot) {
+		const header& h = head();
+		if (memcmp(h.magic, file_magic, sizeof(file_magic)) != 0 || h.layout != file_layout ||
+			h.length == 0 || h.length > m_capacity - sizeof(header) || !same_boot(h.boot_id)) {
+			return false;
+		}
+		const uint64_t now = boot_time_ns();
+		if (h.boot_time_ns > now || now - h.boot_time_ns > m_maxAgeNs) {
+			return false;
+		}
+		m_record.assign(m_map + sizeof(header), h.length);
+		try {
+			journal::decode(m_record, h.record_version, snapshot);
+		} catch (const runtime_error&) {
+			return false;
+		}
+		return true;
+	}
+
+	void save(const counter_snapshot& snapshot) {
+		journal::encode(snapshot, m_record);
+		if (sizeof(header) + m_record.size() > m_capacity) {
+			map(sizeof(header) + m_record.size());
+		}
+		header& h = head();
+		h.length = 0;
+		store_fence();
+		memcpy(m_map + sizeof(header), m_record.data(), m_record.size());
+		memcpy(h.magic, file_magic, sizeof(file_magic));
+		h.layout = file_layout;
+		h.record_version = journal::version;
+		memcpy(h.boot_id, m_bootId, sizeof(m_bootId));
+		h.boot_time_ns = boot_time_ns();
+		store_fence();
+		h.length = static_cast<uint32_t>(m_record.size());
+	}
+
+	size_t capacity() const noexcept {
+		return m_capacity;
+	}
+}; //class baseline_file::impl
+
+baseline_file::baseline_file(const string& path, chrono::milliseconds max_age, const string& boot_id_path)
+	: m_impl(new impl(path, max_age, boot_id_path)) {
+}
+
+baseline_file::~baseline_file() {
+}
+
+bool baseline_file::load(counter_snapshot& snapshot) {
+	return m_impl->load(snapshot);
+}
+
+void baseline_file::save(const counter_snapshot& snapshot) {
+	m_impl->save(snapshot);
+}
+
+size_t baseline_file::capacity() const noexcept {
+	return m_impl->capacity();
+}
+
+} //namespace os
+} //namespace client
+} //namespace monitor
+} //namespace crossover
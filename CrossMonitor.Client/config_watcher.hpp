@@ -0,0 +1,47 @@
+#pragma once
+
+#include <boost/noncopyable.hpp>
+
+#include <functional>
+#include <memory>
+#include <string>
+
+namespace crossover {
+namespace monitor {
+namespace client {
+namespace os {
+
+/**
+ * Calls a handler whenever a file is written or replaced, so that the
+ * agent reloads its configuration without a restart.
+ *
+ * The directory of the file is watched rather than the file itself, so
+ * that an editor or a deployment tool replacing the file by a rename is
+ * seen as well. On Linux the changes come from inotify, on Windows from
+ * directory change notifications. They are waited for by a thread of its
+ * own, which also runs the handler.
+ */
+class config_watcher final : public boost::noncopyable {
+public:
+	typedef std::function<void()> OnChangedHandler;
+
+	/**
+	 * Starts watching. The file does not need to exist yet.
+	 * Throws std::invalid_argument if path names a directory and
+	 * std::system_error if the directory cannot be watched.
+	 * @param onChanged called after each change, once for changes that
+	 * arrive together. Exceptions it throws are logged.
+	 */
+	config_watcher(const std::string& path, OnChangedHandler onChanged);
+	~config_watcher();
+
+private:
+	class impl;
+
+	std::unique_ptr<impl> m_impl;
+}; //class config_watcher
+
+} //namespace os
+} //namespace client
+} //namespace monitor
+} //namespace crossover
@@ -0,0 +1,150 @@
+#include "config_watcher.hpp"
+
+#include "log.hpp"
+
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <stdexcept>
+#include <system_error>
+#include <thread>
+
+#define LOG CROSSOVER_MONITOR_LOG
+
+using namespace std;
+
+namespace crossover {
+namespace monitor {
+namespace client {
+namespace os {
+
+namespace {
+
+	const int stop_check_ms = 100;
+
+	system_error last_error(const char* what) {
+		return system_error(errno, system_category(), what);
+	}
+
+} //namespace
+
+class config_watcher::impl final {
+private:
+	const string m_directory;
+	const string m_name;
+	const OnChangedHandler m_onChanged;
+	int m_inotify;
+	atomic<bool> m_stop;
+	thread m_reader;
+
+public:
+	impl(const string& path, OnChangedHandler onChanged)
+		: m_directory(directory_of(path))
+		, m_name(name_of(path))
+		, m_onChanged(onChanged)
+		, m_inotify(-1)
+		, m_stop(false) {
+		if (m_name.empty()) {
+			throw invalid_argument("Not a file: " + path);
+		}
+
+		m_inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		if (m_inotify < 0) {
+			throw last_error("inotify_init1");
+		}
+		// written in place, or written elsewhere and renamed over it
+		if (inotify_add_watch(m_inotify, m_directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+			const system_error error = last_error(("inotify_add_watch " + m_directory).c_str());
+			close(m_inotify);
+			throw error;
+		}
+
+		m_reader = thread([this]() {
+			read_events();
+		});
+	}
+
+	~impl() {
+		m_stop = true;
+		if (m_reader.joinable()) {
+			m_reader.join();
+		}
+		close(m_inotify);
+	}
+
+private:
+	static string directory_of(const string& path) {
+		const size_t slash = path.find_last_of('/');
+		if (slash == string::npos) {
+			return ".";
+		}
+		return slash == 0 ? "/" : path.substr(0, slash);
+	}
+
+	static string name_of(const string& path) {
+		const size_t slash = path.find_last_of('/');
+		return slash == string::npos ? path : path.substr(slash + 1);
+	}
+
+	/**
+	 * @return true if the events read name the file.
+	 */
+	bool read_batch() noexcept {
+		alignas(inotify_event) char buffer[16 * (sizeof(inotify_event) + NAME_MAX + 1)];
+		bool changed = false;
+
+		for (;;) {
+			const ssize_t size = read(m_inotify, buffer, sizeof(buffer));
+			if (size <= 0) {
+				if (size < 0 && errno != EAGAIN && errno != EINTR) {
+					LOG(error) << "Failed to read configuration changes: " << strerror(errno);
+				}
+				return changed;
+			}
+
+			for (const char* p = buffer; p < buffer + size; ) {
+				const inotify_event* event = reinterpret_cast<const inotify_event*>(p);
+				if (event->len > 0 && m_name == event->name) {
+					changed = true;
+				}
+				if (event->mask & IN_Q_OVERFLOW) {
+					// some were lost, one of them may have been ours
+					changed = true;
+				}
+				p += sizeof(inotify_event) + event->len;
+			}
+		}
+	}
+
+	void read_events() noexcept {
+		while (!m_stop) {
+			pollfd fd = { m_inotify, POLLIN, 0 };
+			if (poll(&fd, 1, stop_check_ms) <= 0 || !read_batch()) {
+				continue;
+			}
+
+			try {
+				m_onChanged();
+			} catch (const exception& e) {
+				LOG(error) << "Failed to apply the changed configuration: " << e.what();
+			}
+		}
+	}
+}; //class config_watcher::impl
+
+config_watcher::config_watcher(const string& path, OnChangedHandler onChanged)
+	: m_impl(new impl(path, onChanged)) {
+}
+
+config_watcher::~config_watcher() {
+}
+
+} //namespace os
+} //namespace client
+} //namespace monitor
+} //namespace crossover
@@ -0,0 +1,127 @@
+#include "config_watcher.hpp"
+
+#include "log.hpp"
+
+#include <Windows.h>
+
+#include <atomic>
+#include <stdexcept>
+#include <system_error>
+#include <thread>
+
+#define LOG CROSSOVER_MONITOR_LOG
+
+using namespace std;
+
+namespace crossover {
+namespace monitor {
+namespace client {
+namespace os {
+
+namespace {
+
+	const DWORD stop_check_ms = 100;
+
+	system_error last_error(const char* what) {
+		return system_error(static_cast<int>(GetLastError()), system_category(), what);
+	}
+
+} //namespace
+
+/**
+ * The notifications only tell that something in the directory changed,
+ * the file's size and last write time tell whether it was the file.
+ */
+class config_watcher::impl final {
+private:
+	const wstring m_path;
+	const OnChangedHandler m_onChanged;
+	HANDLE m_notification;
+	atomic<bool> m_stop;
+	WIN32_FILE_ATTRIBUTE_DATA m_seen;
+	thread m_reader;
+
+public:
+	impl(const string& path, OnChangedHandler onChanged)
+		: m_path(path.begin(), path.end())
+		, m_onChanged(onChanged)
+		, m_notification(INVALID_HANDLE_VALUE)
+		, m_stop(false) {
+		const size_t slash = m_path.find_last_of(L"\\/");
+		if (slash == m_path.size() - 1) {
+			throw invalid_argument("Not a file: " + path);
+		}
+		const wstring directory = slash == wstring::npos ? L"." : m_path.substr(0, slash + 1);
+
+		m_notification = FindFirstChangeNotificationW(directory.c_str(), FALSE,
+			FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_SIZE);
+		if (m_notification == INVALID_HANDLE_VALUE) {
+			throw last_error("FindFirstChangeNotification");
+		}
+		attributes(m_seen);
+
+		m_reader = thread([this]() {
+			read_events();
+		});
+	}
+
+	~impl() {
+		m_stop = true;
+		if (m_reader.joinable()) {
+			m_reader.join();
+		}
+		FindCloseChangeNotification(m_notification);
+	}
+
+private:
+	void attributes(WIN32_FILE_ATTRIBUTE_DATA& data) const noexcept {
+		if (!GetFileAttributesExW(m_path.c_str(), GetFileExInfoStandard, &data)) {
+			ZeroMemory(&data, sizeof(data));
+		}
+	}
+
+	bool changed() noexcept {
+		WIN32_FILE_ATTRIBUTE_DATA now;
+		attributes(now);
+		if (CompareFileTime(&now.ftLastWriteTime, &m_seen.ftLastWriteTime) == 0 &&
+			now.nFileSizeLow == m_seen.nFileSizeLow && now.nFileSizeHigh == m_seen.nFileSizeHigh) {
+			return false;
+		}
+		m_seen = now;
+		return true;
+	}
+
+	void read_events() noexcept {
+		while (!m_stop) {
+			const DWORD status = WaitForSingleObject(m_notification, stop_check_ms);
+			if (status != WAIT_OBJECT_0) {
+				continue;
+			}
+			if (!FindNextChangeNotification(m_notification)) {
+				LOG(error) << "Failed to wait for configuration changes, code: " << GetLastError();
+				return;
+			}
+			if (!changed()) {
+				continue;
+			}
+
+			try {
+				m_onChanged();
+			} catch (const exception& e) {
+				LOG(error) << "Failed to apply the changed configuration: " << e.what();
+			}
+		}
+	}
+}; //class config_watcher::impl
+
+config_watcher::config_watcher(const string& path, OnChangedHandler onChanged)
+	: m_impl(new impl(path, onChanged)) {
+}
+
+config_watcher::~config_watcher() {
+}
+
+} //namespace os
+} //namespace client
+} //namespace monitor
+} //namespace crossover
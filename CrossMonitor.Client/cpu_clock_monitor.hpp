@@ -0,0 +1,60 @@
+#pragma once
+
+#include "../CrossMonitor.Shared/snapshot.hpp"
+
+#include <boost/noncopyable.hpp>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace crossover {
+namespace monitor {
+namespace client {
+namespace os {
+
+/**
+ * Reads the clock and thermal throttling of every online CPU: its
+ * current frequency from cpufreq, the throttle counts of its core and
+ * package from thermal_throttle and its APERF and MPERF counters from
+ * the msr device, which needs root and the msr module.
+ *
+ * The files of every CPU are opened once and stay open, the sysfs ones
+ * read together by a file_batch_reader. A source missing for a CPU, or
+ * for all of them, reads as 0 and is not tried again.
+ */
+class cpu_clock_monitor final : public boost::noncopyable {
+public:
+	/**
+	 * Opens the files of the online CPUs.
+	 * Throws std::system_error if no CPU is listed under cpu_root.
+	 * @param cpu_root sysfs directory of the CPUs.
+	 * @param msr_root directory of the msr devices, <cpu>/msr.
+	 */
+	explicit cpu_clock_monitor(const std::string& cpu_root = "/sys/devices/system/cpu",
+							   const std::string& msr_root = "/dev/cpu");
+	~cpu_clock_monitor();
+
+	/**
+	 * Reads the counters of every CPU into out, in CPU order.
+	 */
+	void read(cpu_core_counters& out);
+
+	std::size_t cpu_count() const noexcept;
+	/**
+	 * Whether any CPU has the source.
+	 */
+	bool has_frequency() const noexcept;
+	bool has_throttles() const noexcept;
+	bool has_aperf_mperf() const noexcept;
+
+private:
+	class impl;
+
+	std::unique_ptr<impl> m_impl;
+}; //class cpu_clock_monitor
+
+} //namespace os
+} //namespace client
+} //namespace monitor
+} //namespace crossover
@@ -0,0 +1,255 @@
+#include "cpu_clock_monitor.hpp"
+#include "file_batch_reader.hpp"
+
+#include "log.hpp"
+#include "procfs.hpp"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <system_error>
+
+#define LOG CROSSOVER_MONITOR_LOG
+
+using namespace std;
+
+namespace crossover {
+namespace monitor {
+namespace client {
+namespace os {
+
+namespace {
+
+	// IA32_MPERF and IA32_APERF
+	const off_t mperf_msr = 0xe7;
+	const off_t aperf_msr = 0xe8;
+
+	// the sysfs files of every CPU, in the order of cpu_files
+	enum cpu_file {
+		frequency_file,
+		core_throttles_file,
+		package_throttles_file,
+		cpu_file_count
+	};
+
+	const char* const cpu_files[cpu_file_count] = {
+		"/cpufreq/scaling_cur_freq",
+		"/thermal_throttle/core_throttle_count",
+		"/thermal_throttle/package_throttle_count"
+	};
+
+	bool read_text(const string& path, string& out) {
+		ifstream in(path);
+		if (!in) {
+			return false;
+		}
+		out.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+		return true;
+	}
+
+	uint64_t parse_number(const char* text, size_t length) noexcept {
+		uint64_t value = 0;
+		for (size_t i = 0; i < length && text[i] >= '0' && text[i] <= '9'; ++i) {
+			value = value * 10 + static_cast<uint64_t>(text[i] - '0');
+		}
+		return value;
+	}
+
+	uint32_t narrow(uint64_t value) noexcept {
+		return static_cast<uint32_t>(min<uint64_t>(value, numeric_limits<uint32_t>::max()));
+	}
+
+	/**
+	 * The online CPUs, from the online list, else from the cpu<n> directories.
+	 */
+	vector<unsigned> list_cpus(const string& cpu_root) {
+		vector<unsigned> cpus;
+		string text;
+		if (read_text(cpu_root + "/online", text)) {
+			procfs::parse_cpulist(text, cpus);
+			if (!cpus.empty()) {
+				return cpus;
+			}
+		}
+
+		DIR* dir = opendir(cpu_root.c_str());
+		if (dir == nullptr) {
+			throw system_error(errno, system_category(), "CPU list " + cpu_root);
+		}
+		while (const dirent* entry = readdir(dir)) {
+			const char* name = entry->d_name;
+			if (strncmp(name, "cpu", 3) == 0 && isdigit(static_cast<unsigned char>(name[3]))) {
+				cpus.push_back(static_cast<unsigned>(strtoul(name + 3, nullptr, 10)));
+			}
+		}
+		closedir(dir);
+		sort(cpus.begin(), cpus.end());
+		return cpus;
+	}
+
+} //namespace
+
+class cpu_clock_monitor::impl final {
+private:
+	struct cpu {
+		unsigned number;
+		uint32_t base_frequency_khz;
+		// index in m_files of every cpu_file, -1 if it is missing
+		int files[cpu_file_count];
+		// msr device, -1 if it cannot be read
+		int msr;
+	};
+
+	vector<cpu> m_cpus;
+	file_batch_reader m_files;
+	bool m_has[cpu_file_count];
+	bool m_hasMsr;
+
+	bool read_msr(int fd, off_t address, uint64_t& value) noexcept {
+		return pread(fd, &value, sizeof(value), address) == static_cast<ssize_t>(sizeof(value));
+	}
+
+	uint64_t file_value(const cpu& c, cpu_file file) const noexcept {
+		const int index = c.files[file];
+		if (index < 0 || m_files.error(index) != 0) {
+			return 0;
+		}
+		return parse_number(m_files.data(index), m_files.length(index));
+	}
+
+public:
+	impl(const string& cpu_root, const string& msr_root)
+		: m_hasMsr(false) {
+		fill(begin(m_has), end(m_has), false);
+
+		const vector<unsigned> numbers = list_cpus(cpu_root);
+		if (numbers.empty()) {
+			throw system_error(ENOENT, system_category(), "no CPU listed in " + cpu_root);
+		}
+
+		string text;
+		for (const unsigned number : numbers) {
+			const string path = cpu_root + "/cpu" + to_string(number);
+			cpu c;
+			c.number = number;
+			// the clock MPERF counts at, not known without intel_pstate
+			c.base_frequency_khz = read_text(path + "/cpufreq/base_frequency", text) ?
+				narrow(parse_number(text.data(), text.size())) : 0;
+			for (unsigned file = 0; file < cpu_file_count; ++file) {
+				c.files[file] = -1;
+				try {
+					c.files[file] = static_cast<int>(m_files.add(path + cpu_files[file], 64));
+					m_has[file] = true;
+				} catch (const system_error&) {
+				}
+			}
+
+			c.msr = open((msr_root + "/" + to_string(number) + "/msr").c_str(), O_RDONLY | O_CLOEXEC);
+			uint64_t probe;
+			if (c.msr >= 0 && !read_msr(c.msr, aperf_msr, probe)) {
+				close(c.msr);
+				c.msr = -1;
+			}
+			m_hasMsr = m_hasMsr || c.msr >= 0;
+			m_cpus.push_back(c);
+		}
+
+		if (!m_has[frequency_file]) {
+			LOG(info) << "cpufreq not available, CPU clocks read as 0";
+		}
+		if (!m_has[core_throttles_file] && !m_has[package_throttles_file]) {
+			LOG(info) << "thermal_throttle not available, throttling reads as 0";
+		}
+		if (!m_hasMsr) {
+			LOG(info) << "APERF/MPERF not readable from " << msr_root << ", effective clocks read as 0";
+		}
+	}
+
+	~impl() {
+		for (const auto& c : m_cpus) {
+			if (c.msr >= 0) {
+				close(c.msr);
+			}
+		}
+	}
+
+	void read(cpu_core_counters& out) {
+		if (m_files.size() > 0) {
+			m_files.read();
+		}
+
+		out.resize(m_cpus.size());
+		for (size_t i = 0; i < m_cpus.size(); ++i) {
+			const cpu& c = m_cpus[i];
+			out.cpus[i] = c.number;
+			out.frequency_khz[i] = narrow(file_value(c, frequency_file));
+			out.base_frequency_khz[i] = c.base_frequency_khz;
+			out.core_throttles[i] = file_value(c, core_throttles_file);
+			out.package_throttles[i] = file_value(c, package_throttles_file);
+			out.aperf[i] = 0;
+			out.mperf[i] = 0;
+			if (c.msr >= 0 && !(read_msr(c.msr, aperf_msr, out.aperf[i]) && read_msr(c.msr, mperf_msr, out.mperf[i]))) {
+				out.aperf[i] = 0;
+				out.mperf[i] = 0;
+			}
+		}
+	}
+
+	size_t cpu_count() const noexcept {
+		return m_cpus.size();
+	}
+
+	bool has_frequency() const noexcept {
+		return m_has[frequency_file];
+	}
+
+	bool has_throttles() const noexcept {
+		return m_has[core_throttles_file] || m_has[package_throttles_file];
+	}
+
+	bool has_aperf_mperf() const noexcept {
+		return m_hasMsr;
+	}
+}; //class cpu_clock_monitor::impl
+
+cpu_clock_monitor::cpu_clock_monitor(const string& cpu_root, const string& msr_root)
+	: m_impl(new impl(cpu_root, msr_root)) {
+}
+
+cpu_clock_monitor::~cpu_clock_monitor() {
+}
+
+void cpu_clock_monitor::read(cpu_core_counters& out) {
+	m_impl->read(out);
+}
+
+size_t cpu_clock_monitor::cpu_count() const noexcept {
+	return m_impl->cpu_count();
+}
+
+bool cpu_clock_monitor::has_frequency() const noexcept {
+	return m_impl->has_frequency();
+}
+
+bool cpu_clock_monitor::has_throttles() const noexcept {
+	return m_impl->has_throttles();
+}
+
+bool cpu_clock_monitor::has_aperf_mperf() const noexcept {
+	return m_impl->has_aperf_mperf();
+}
+
+} //namespace os
+} //namespace client
+} //namespace monitor
+} //namespace crossover
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <boost/noncopyable.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace crossover {
+namespace monitor {
+namespace client {
+namespace os {
+
+/**
+ * Reads a set of small files, such as the procfs files of every tracked
+ * process, all together on every sample.
+ *
+ * The files are opened once and read from their start on every read(),
+ * so a sample costs no open and close calls. On Linux with io_uring the
+ * reads of all files are submitted in one batch, on registered file
+ * descriptors into registered fixed buffers, and their completions waited
+ * for with a single system call per ring full (see ring_entries); without
+ * io_uring, or when the kernel rejects a read, the files are read with
+ * pread. Registering the buffers may need more locked memory than
+ * RLIMIT_MEMLOCK allows, the reads then go through io_uring into the same
+ * buffers unregistered.
+ *
+ * A file filling its buffer is read again whole into a larger one, so
+ * the contents are never cut. A reader is used by one thread at a time.
+ */
+class file_batch_reader final : public boost::noncopyable {
+public:
+	static const std::size_t default_buffer_size = 4096;
+	/**
+	 * Most reads submitted at once.
+	 */
+	static const unsigned ring_entries = 4096;
+
+	/**
+	 * @param use_io_uring false always reads with pread.
+	 */
+	explicit file_batch_reader(bool use_io_uring = true);
+	~file_batch_reader();
+
+	/**
+	 * Opens a file to be read by every read().
+	 * Throws std::system_error if the file cannot be opened.
+	 * @param buffer_size bytes read at first, grows with the contents.
+	 * @return index of the file.
+	 */
+	std::size_t add(const std::string& path, std::size_t buffer_size = default_buffer_size);
+	/**
+	 * Closes every file.
+	 */
+	void clear() noexcept;
+	std::size_t size() const noexcept;
+
+	/**
+	 * Reads every file.
+	 * @return number of files read without an error.
+	 */
+	std::size_t read();
+
+	/**
+	 * Contents of a file as of the last read(), valid until the next
+	 * read(), add() or clear().
+	 */
+	const char* data(std::size_t index) const noexcept;
+	std::size_t length(std::size_t index) const noexcept;
+	/**
+	 * errno of the last read of a file, 0 if it succeeded. The files of a
+	 * process that exited fail with ESRCH.
+	 */
+	int error(std::size_t index) const noexcept;
+
+	/**
+	 * Whether the reads go through io_uring.
+	 */
+	bool uses_io_uring() const noexcept;
+	/**
+	 * System calls made by read() so far, to compare the two ways.
+	 */
+	std::uint64_t system_calls() const noexcept;
+
+private:
+	class impl;
+
+	std::unique_ptr<impl> m_impl;
+}; //class file_batch_reader
+
+} //namespace os
+} //namespace client
+} //namespace monitor
+} //namespace crossover
@@ -0,0 +1,591 @@
+#include "file_batch_reader.hpp"
+
+#include "log.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#if defined(CROSSMONITOR_IO_URING)
+#include <linux/io_uring.h>
+#endif
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <system_error>
+#include <vector>
+
+#define LOG CROSSOVER_MONITOR_LOG
+
+using namespace std;
+
+namespace crossover {
+namespace monitor {
+namespace client {
+namespace os {
+
+/**
+ * io_uring through its system calls rather than liburing, which is not
+ * packaged everywhere the client runs; the reader needs little of it.
+ */
+
+namespace {
+
+	struct file {
+		int fd;
+		size_t capacity;
+		// start of the buffer of the file in the buffer area
+		size_t offset;
+		size_t length;
+		int error;
+		// the contents when they did not fit the buffer
+		bool overflowed;
+		string overflow;
+	};
+
+	/**
+	 * Reads a file that filled its buffer again whole, into a buffer
+	 * growing until it holds the contents. The next layout gives the file
+	 * a buffer of that size.
+	 */
+	void read_whole(file& f, uint64_t& system_calls) noexcept {
+		try {
+			for (;;) {
+				f.capacity *= 2;
+				f.overflow.resize(f.capacity);
+				++system_calls;
+				const ssize_t res = pread(f.fd, &f.overflow[0], f.capacity, 0);
+				if (res < 0) {
+					if (errno == EINTR) {
+						continue;
+					}
+					f.error = errno;
+					f.length = 0;
+					return;
+				}
+				if (static_cast<size_t>(res) < f.capacity) {
+					f.overflow.resize(res);
+					f.overflowed = true;
+					f.length = res;
+					return;
+				}
+			}
+		} catch (const exception&) {
+			f.error = ENOMEM;
+			f.length = 0;
+		}
+	}
+
+#if defined(CROSSMONITOR_IO_URING)
+
+	int io_uring_setup(unsigned entries, io_uring_params* params) noexcept {
+		return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+	}
+
+	int io_uring_enter(int ring, unsigned to_submit, unsigned min_complete, unsigned flags) noexcept {
+		return static_cast<int>(syscall(__NR_io_uring_enter, ring, to_submit, min_complete, flags, nullptr, 0));
+	}
+
+	int io_uring_register(int ring, unsigned opcode, const void* args, unsigned count) noexcept {
+		return static_cast<int>(syscall(__NR_io_uring_register, ring, opcode, args, count));
+	}
+
+	/**
+	 * The submission and completion rings shared with the kernel.
+	 */
+	class ring final {
+	public:
+		/**
+		 * Throws std::system_error if io_uring is not available.
+		 */
+		explicit ring(unsigned entries)
+			: fd_(-1)
+			, sq_(MAP_FAILED)
+			, cq_(MAP_FAILED)
+			, sqes_(MAP_FAILED) {
+			io_uring_params params;
+			memset(&params, 0, sizeof(params));
+			fd_ = io_uring_setup(entries, &params);
+			if (fd_ < 0) {
+				throw system_error(errno, system_category(), "io_uring_setup");
+			}
+			entries_ = params.sq_entries;
+
+			sq_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+			cq_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+			const bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+			if (single_mmap) {
+				sq_size_ = cq_size_ = max(sq_size_, cq_size_);
+			}
+			sq_ = mmap(nullptr, sq_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQ_RING);
+			if (sq_ != MAP_FAILED) {
+				cq_ = single_mmap ? sq_
+					: mmap(nullptr, cq_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_CQ_RING);
+			}
+			if (cq_ != MAP_FAILED) {
+				sqes_ = mmap(nullptr, params.sq_entries * sizeof(io_uring_sqe), PROT_READ | PROT_WRITE,
+					MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQES);
+			}
+			if (sqes_ == MAP_FAILED) {
+				const system_error error(errno, system_category(), "io_uring mmap");
+				release();
+				throw error;
+			}
+
+			char* sq = static_cast<char*>(sq_);
+			sq_tail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+			sq_mask_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+			char* cq = static_cast<char*>(cq_);
+			cq_head_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+			cq_tail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+			cq_mask_ = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+			cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+			// the entries are always filled in ring order
+			unsigned* array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+			for (unsigned i = 0; i < params.sq_entries; ++i) {
+				array[i] = i;
+			}
+		}
+
+		~ring() {
+			release();
+		}
+
+		ring(const ring&) = delete;
+		ring& operator=(const ring&) = delete;
+
+		int fd() const noexcept {
+			return fd_;
+		}
+		unsigned entries() const noexcept {
+			return entries_;
+		}
+
+		/**
+		 * Entry to fill, published by push().
+		 */
+		io_uring_sqe& next() noexcept {
+			io_uring_sqe& res = static_cast<io_uring_sqe*>(sqes_)[(*sq_tail_ + pending_) & sq_mask_];
+			memset(&res, 0, sizeof(res));
+			++pending_;
+			return res;
+		}
+
+		/**
+		 * Hands the entries filled to the kernel.
+		 */
+		void push() noexcept {
+			__atomic_store_n(sq_tail_, *sq_tail_ + pending_, __ATOMIC_RELEASE);
+			pending_ = 0;
+		}
+
+		/**
+		 * Calls f with every completion ready and frees them.
+		 */
+		template <class F>
+		unsigned reap(F f) {
+			unsigned head = *cq_head_;
+			const unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+			const unsigned res = tail - head;
+			for (; head != tail; ++head) {
+				f(cqes_[head & cq_mask_]);
+			}
+			__atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+			return res;
+		}
+
+	private:
+		void release() noexcept {
+			if (sqes_ != MAP_FAILED) {
+				munmap(sqes_, entries_ * sizeof(io_uring_sqe));
+			}
+			if (cq_ != MAP_FAILED && cq_ != sq_) {
+				munmap(cq_, cq_size_);
+			}
+			if (sq_ != MAP_FAILED) {
+				munmap(sq_, sq_size_);
+			}
+			close(fd_);
+		}
+
+		int fd_;
+		unsigned entries_ = 0;
+		unsigned pending_ = 0;
+		void* sq_;
+		size_t sq_size_ = 0;
+		void* cq_;
+		size_t cq_size_ = 0;
+		void* sqes_;
+		unsigned* sq_tail_ = nullptr;
+		unsigned sq_mask_ = 0;
+		unsigned* cq_head_ = nullptr;
+		unsigned* cq_tail_ = nullptr;
+		unsigned cq_mask_ = 0;
+		io_uring_cqe* cqes_ = nullptr;
+	}; //class ring
+
+#endif
+
+} //namespace
+
+class file_batch_reader::impl final {
+private:
+	vector<file> m_files;
+	// the buffers of all files, one after the other, so that they are
+	// registered with io_uring as one
+	vector<char> m_buffers;
+	// the buffers are laid out again before the next read
+	bool m_layout;
+	uint64_t m_systemCalls;
+#if defined(CROSSMONITOR_IO_URING)
+	unique_ptr<ring> m_ring;
+	// what is registered with m_ring is out of date
+	bool m_filesDirty;
+	bool m_buffersDirty;
+	bool m_fixedFiles;
+	bool m_fixedBuffers;
+#endif
+
+	void layout() {
+		size_t size = 0;
+		for (auto& f : m_files) {
+			f.offset = size;
+			size += f.capacity;
+		}
+		m_buffers.assign(size, 0);
+		m_layout = false;
+#if defined(CROSSMONITOR_IO_URING)
+		m_buffersDirty = true;
+#endif
+	}
+
+	void read_pread(file& f) noexcept {
+		for (;;) {
+			++m_systemCalls;
+			const ssize_t res = pread(f.fd, m_buffers.data() + f.offset, f.capacity, 0);
+			if (res >= 0) {
+				complete(f, res);
+				return;
+			}
+			if (errno != EINTR) {
+				f.error = errno;
+				return;
+			}
+		}
+	}
+
+	void complete(file& f, ssize_t res) noexcept {
+		f.length = res;
+		if (static_cast<size_t>(res) == f.capacity) {
+			read_whole(f, m_systemCalls);
+			m_layout = true;
+		}
+	}
+
+#if defined(CROSSMONITOR_IO_URING)
+	void stop_io_uring() noexcept {
+		m_ring.reset();
+		m_fixedFiles = false;
+		m_fixedBuffers = false;
+	}
+
+	/**
+	 * Makes sure the ring can take the reads and what they use is
+	 * registered with it. Returns false if io_uring cannot be used.
+	 */
+	bool prepare() noexcept {
+		unsigned entries = 1;
+		while (entries < m_files.size() && entries < ring_entries) {
+			entries *= 2;
+		}
+		if (!m_ring || m_ring->entries() < entries) {
+			try {
+				m_ring.reset();
+				m_fixedFiles = false;
+				m_fixedBuffers = false;
+				m_ring.reset(new ring(entries));
+				m_filesDirty = true;
+				m_buffersDirty = true;
+			} catch (const exception& e) {
+				LOG(info) << "io_uring not available, reading files with pread: " << e.what();
+				return false;
+			}
+		}
+
+		if (m_filesDirty) {
+			if (m_fixedFiles) {
+				++m_systemCalls;
+				io_uring_register(m_ring->fd(), IORING_UNREGISTER_FILES, nullptr, 0);
+			}
+			vector<int> fds;
+			fds.reserve(m_files.size());
+			for (const auto& f : m_files) {
+				fds.push_back(f.fd);
+			}
+			++m_systemCalls;
+			m_fixedFiles = io_uring_register(m_ring->fd(), IORING_REGISTER_FILES, fds.data(), fds.size()) == 0;
+			m_filesDirty = false;
+		}
+		if (m_buffersDirty) {
+			if (m_fixedBuffers) {
+				++m_systemCalls;
+				io_uring_register(m_ring->fd(), IORING_UNREGISTER_BUFFERS, nullptr, 0);
+			}
+			iovec buffers = { m_buffers.data(), m_buffers.size() };
+			++m_systemCalls;
+			m_fixedBuffers = io_uring_register(m_ring->fd(), IORING_REGISTER_BUFFERS, &buffers, 1) == 0;
+			m_buffersDirty = false;
+		}
+		return true;
+	}
+
+	/**
+	 * Reads the files from first on, a ring full of them.
+	 * Returns the number of files read and fills retry with those the
+	 * kernel cannot read through io_uring.
+	 */
+	size_t read_ring(size_t first, vector<size_t>& retry) {
+		const size_t count = min<size_t>(m_files.size() - first, m_ring->entries());
+		for (size_t i = first; i < first + count; ++i) {
+			const file& f = m_files[i];
+			io_uring_sqe& sqe = m_ring->next();
+			sqe.opcode = m_fixedBuffers ? IORING_OP_READ_FIXED : IORING_OP_READ;
+			sqe.flags = m_fixedFiles ? IOSQE_FIXED_FILE : 0;
+			sqe.fd = m_fixedFiles ? static_cast<int>(i) : f.fd;
+			sqe.off = 0;
+			sqe.addr = reinterpret_cast<uint64_t>(m_buffers.data() + f.offset);
+			sqe.len = static_cast<unsigned>(f.capacity);
+			sqe.buf_index = 0;
+			sqe.user_data = i;
+		}
+		m_ring->push();
+
+		size_t submitted = 0;
+		size_t completed = 0;
+		while (completed < count) {
+			++m_systemCalls;
+			const int res = io_uring_enter(m_ring->fd(), static_cast<unsigned>(count - submitted),
+				static_cast<unsigned>(count - completed), IORING_ENTER_GETEVENTS);
+			if (res < 0) {
+				if (errno == EINTR) {
+					continue;
+				}
+				throw system_error(errno, system_category(), "io_uring_enter");
+			}
+			submitted += res;
+			completed += m_ring->reap([&](const io_uring_cqe& cqe) {
+				file& f = m_files[cqe.user_data];
+				if (cqe.res >= 0) {
+					complete(f, cqe.res);
+				} else if (cqe.res == -EINVAL || cqe.res == -EOPNOTSUPP) {
+					retry.push_back(cqe.user_data);
+				} else {
+					f.error = -cqe.res;
+				}
+			});
+		}
+		return count;
+	}
+#endif
+
+public:
+	explicit impl(bool use_io_uring)
+		: m_layout(false)
+		, m_systemCalls(0)
+#if defined(CROSSMONITOR_IO_URING)
+		, m_filesDirty(false)
+		, m_buffersDirty(false)
+		, m_fixedFiles(false)
+		, m_fixedBuffers(false)
+#endif
+	{
+#if defined(CROSSMONITOR_IO_URING)
+		if (use_io_uring) {
+			try {
+				m_ring.reset(new ring(1));
+			} catch (const exception& e) {
+				LOG(info) << "io_uring not available, reading files with pread: " << e.what();
+			}
+		}
+#else
+		(void)use_io_uring;
+#endif
+	}
+
+	~impl() {
+		clear();
+	}
+
+	size_t add(const string& path, size_t buffer_size) {
+		if (buffer_size == 0) {
+			throw invalid_argument("Expected a buffer size above 0");
+		}
+		const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+		if (fd < 0) {
+			throw system_error(errno, system_category(), path);
+		}
+		try {
+			m_files.push_back(file{ fd, buffer_size, 0, 0, 0, false, string() });
+		} catch (...) {
+			close(fd);
+			throw;
+		}
+		m_layout = true;
+#if defined(CROSSMONITOR_IO_URING)
+		m_filesDirty = true;
+#endif
+		return m_files.size() - 1;
+	}
+
+	void clear() noexcept {
+#if defined(CROSSMONITOR_IO_URING)
+		// the registered files hold on to the descriptors
+		if (m_ring && m_fixedFiles) {
+			io_uring_register(m_ring->fd(), IORING_UNREGISTER_FILES, nullptr, 0);
+			m_fixedFiles = false;
+		}
+		m_filesDirty = true;
+#endif
+		for (const auto& f : m_files) {
+			close(f.fd);
+		}
+		m_files.clear();
+		m_layout = true;
+	}
+
+	size_t size() const noexcept {
+		return m_files.size();
+	}
+
+	size_t read() {
+		if (m_layout) {
+			layout();
+		}
+		for (auto& f : m_files) {
+			f.length = 0;
+			f.error = 0;
+			if (f.overflowed) {
+				f.overflowed = false;
+				string().swap(f.overflow);
+			}
+		}
+
+		bool done = false;
+#if defined(CROSSMONITOR_IO_URING)
+		if (m_ring && !m_files.empty()) {
+			if (!prepare()) {
+				stop_io_uring();
+			} else {
+				try {
+					vector<size_t> retry;
+					for (size_t first = 0; first < m_files.size();) {
+						first += read_ring(first, retry);
+					}
+					if (retry.size() == m_files.size()) {
+						LOG(info) << "io_uring cannot read these files, reading them with pread";
+						stop_io_uring();
+					}
+					for (const size_t i : retry) {
+						read_pread(m_files[i]);
+					}
+					done = true;
+				} catch (const system_error& e) {
+					LOG(error) << "io_uring failed, reading files with pread: " << e.what();
+					stop_io_uring();
+					for (auto& f : m_files) {
+						f.length = 0;
+						f.error = 0;
+					}
+				}
+			}
+		}
+#endif
+		if (!done) {
+			for (auto& f : m_files) {
+				read_pread(f);
+			}
+		}
+
+		return count_if(m_files.begin(), m_files.end(), [](const file& f) {
+			return f.error == 0;
+		});
+	}
+
+	const char* data(size_t index) const noexcept {
+		const file& f = m_files[index];
+		return f.overflowed ? f.overflow.data() : m_buffers.data() + f.offset;
+	}
+
+	size_t length(size_t index) const noexcept {
+		return m_files[index].length;
+	}
+
+	int error(size_t index) const noexcept {
+		return m_files[index].error;
+	}
+
+	bool uses_io_uring() const noexcept {
+#if defined(CROSSMONITOR_IO_URING)
+		return m_ring != nullptr;
+#else
+		return false;
+#endif
+	}
+
+	uint64_t system_calls() const noexcept {
+		return m_systemCalls;
+	}
+};
+
+file_batch_reader::file_batch_reader(bool use_io_uring)
+	: m_impl(new impl(use_io_uring)) {
+}
+
+file_batch_reader::~file_batch_reader() {
+}
+
+size_t file_batch_reader::add(const string& path, size_t buffer_size) {
+	return m_impl->add(path, buffer_size);
+}
+
+void file_batch_reader::clear() noexcept {
+	m_impl->clear();
+}
+
+size_t file_batch_reader::size() const noexcept {
+	return m_impl->size();
+}
+
+size_t file_batch_reader::read() {
+	return m_impl->read();
+}
+
+const char* file_batch_reader::data(size_t index) const noexcept {
+	return m_impl->data(index);
+}
+
+size_t file_batch_reader::length(size_t index) const noexcept {
+	return m_impl->length(index);
+}
+
+int file_batch_reader::error(size_t index) const noexcept {
+	return m_impl->error(index);
+}
+
+bool file_batch_reader::uses_io_uring() const noexcept {
+	return m_impl->uses_io_uring();
+}
+
+uint64_t file_batch_reader::system_calls() const noexcept {
+	return m_impl->system_calls();
+}
+
+} //namespace os
+} //namespace client
+} //namespace monitor
+} //namespace crossover
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "../CrossMonitor.Shared/data.hpp"
+
+#include <boost/noncopyable.hpp>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+
+namespace crossover {
+namespace monitor {
+namespace client {
+namespace os {
+
+/**
+ * Reads the capacity of the mounted filesystems without letting one of
+ * them stall the caller.
+ *
+ * The mount table, /proc/self/mountinfo, stays open and is parsed again
+ * only when poll() reports that it changed. statfs runs on a helper
+ * thread, one mount at a time: a mount that does not answer within the
+ * timeout, as one of a hung NFS server, is left out of this and the later
+ * readings until its call returns. The helper stuck in the call is left
+ * to it and a new one takes over, so there is at most one stuck helper
+ * per hung mount.
+ */
+class filesystem_monitor final : public boost::noncopyable {
+public:
+	/**
+	 * Reads the capacity of the mount at path into fs, mount_point
+	 * included. Called on the helper threads.
+	 * @return false if it failed.
+	 */
+	typedef std::function<bool(const std::string& path, fs_stat& fs)> stat_function;
+
+	/**
+	 * Opens and parses the mount table.
+	 * Throws std::system_error if it cannot be opened.
+	 * @param timeout longest wait for the capacity of one mount.
+	 * @param stat reads the capacity of a mount, statfs if empty.
+	 * @param mount_table mountinfo file to watch.
+	 */
+	explicit filesystem_monitor(const std::chrono::milliseconds& timeout = std::chrono::seconds(1),
+								stat_function stat = stat_function(),
+								const std::string& mount_table = "/proc/self/mountinfo");
+	~filesystem_monitor();
+
+	/**
+	 * Reads the capacity of every mount that answers in time into out, in
+	 * mount table order. Mounts whose capacity cannot be read are left out.
+	 */
+	void read(fs_stats& out);
+
+	/**
+	 * Times the mount table was parsed, the first one included.
+	 */
+	std::uint64_t mount_table_reads() const noexcept;
+	/**
+	 * Mounts left out of the last read() because their call timed out,
+	 * then or before, and has not returned yet.
+	 */
+	std::size_t hung_mounts() const noexcept;
+
+private:
+	class impl;
+
+	std::unique_ptr<impl> m_impl;
+}; //class filesystem_monitor
+
+} //namespace os
+} //namespace client
+} //namespace monitor
+} //namespace crossover
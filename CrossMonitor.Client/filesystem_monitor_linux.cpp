@@ -0,0 +1,292 @@
+#include "filesystem_monitor.hpp"
+
+#include "log.hpp"
+#include "procfs.hpp"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/statvfs.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#define LOG CROSSOVER_MONITOR_LOG
+
+using namespace std;
+
+namespace crossover {
+namespace monitor {
+namespace client {
+namespace os {
+
+namespace {
+
+	/**
+	 * What a helper thread was asked and answered, shared with the thread
+	 * so that a helper stuck in a call can outlive the monitor.
+	 */
+	struct helper {
+		mutex lock;
+		condition_variable wake;
+		// mount to read, empty when idle
+		string path;
+		bool done = false;
+		bool answered = false;
+		fs_stat result;
+		// the monitor let go of the helper, which ends after its call
+		bool abandoned = false;
+	};
+
+	void serve(shared_ptr<helper> h, filesystem_monitor::stat_function stat) {
+		unique_lock<mutex> lock(h->lock);
+		for (;;) {
+			h->wake.wait(lock, [&h]() {
+				return !h->path.empty() || h->abandoned;
+			});
+			if (h->path.empty()) {
+				return;
+			}
+
+			const string path = h->path;
+			lock.unlock();
+			fs_stat fs;
+			bool answered;
+			try {
+				answered = stat(path, fs);
+			} catch (const exception&) {
+				answered = false;
+			}
+			lock.lock();
+
+			h->path.clear();
+			h->result = fs;
+			h->answered = answered;
+			h->done = true;
+			h->wake.notify_all();
+			if (h->abandoned) {
+				return;
+			}
+		}
+	}
+
+	bool statfs_mount(const string& path, fs_stat& fs) noexcept {
+		struct statvfs st;
+		if (statvfs(path.c_str(), &st) != 0) {
+			return false;
+		}
+		const uint64_t unit = st.f_frsize != 0 ? st.f_frsize : st.f_bsize;
+		fs.mount_point = path;
+		fs.size_bytes = st.f_blocks * unit;
+		fs.used_bytes = (st.f_blocks - min<uint64_t>(st.f_bfree, st.f_blocks)) * unit;
+		fs.available_bytes = min<uint64_t>(st.f_bavail, st.f_blocks) * unit;
+		fs.inodes = st.f_files;
+		fs.inodes_used = st.f_files - min<uint64_t>(st.f_ffree, st.f_files);
+		return true;
+	}
+
+	enum class call_result {
+		answered,
+		failed,
+		timed_out
+	};
+
+} //namespace
+
+class filesystem_monitor::impl final {
+private:
+	const chrono::milliseconds m_timeout;
+	const stat_function m_stat;
+	int m_table;
+	string m_text;
+	vector<procfs::mount_entry> m_mounts;
+	uint64_t m_tableReads;
+	size_t m_hungMounts;
+	// the helper taking the next call, none until the first one
+	shared_ptr<helper> m_helper;
+	thread m_thread;
+	// mount point -> abandoned helper still in its call
+	map<string, shared_ptr<helper>> m_hung;
+
+	void read_mount_table() {
+		m_text.clear();
+		char buffer[16 * 1024];
+		off_t offset = 0;
+		for (;;) {
+			const ssize_t res = pread(m_table, buffer, sizeof(buffer), offset);
+			if (res < 0) {
+				if (errno == EINTR) {
+					continue;
+				}
+				throw system_error(errno, system_category(), "mount table read");
+			}
+			if (res == 0) {
+				break;
+			}
+			m_text.append(buffer, static_cast<size_t>(res));
+			offset += res;
+		}
+		procfs::parse_mountinfo(m_text, m_mounts);
+		++m_tableReads;
+	}
+
+	/**
+	 * The kernel flags the mount table with POLLPRI when a mount comes
+	 * or goes; other files never are.
+	 */
+	bool mount_table_changed() noexcept {
+		pollfd p = { m_table, POLLPRI, 0 };
+		return poll(&p, 1, 0) > 0 && (p.revents & (POLLPRI | POLLERR)) != 0;
+	}
+
+	call_result call(const string& path, fs_stat& fs) {
+		if (!m_helper) {
+			m_helper = make_shared<helper>();
+			m_thread = thread(serve, m_helper, m_stat);
+		}
+
+		const shared_ptr<helper> h = m_helper;
+		unique_lock<mutex> lock(h->lock);
+		h->path = path;
+		h->done = false;
+		h->wake.notify_all();
+		if (!h->wake.wait_for(lock, m_timeout, [&h]() { return h->done; })) {
+			h->abandoned = true;
+			lock.unlock();
+			m_thread.detach();
+			m_helper.reset();
+			m_hung[path] = h;
+			return call_result::timed_out;
+		}
+		if (!h->answered) {
+			return call_result::failed;
+		}
+		fs = h->result;
+		return call_result::answered;
+	}
+
+	/**
+	 * @return whether the call of an abandoned helper on the mount is
+	 * still running.
+	 */
+	bool still_hung(const string& path) {
+		const auto it = m_hung.find(path);
+		if (it == m_hung.end()) {
+			return false;
+		}
+		{
+			lock_guard<mutex> lock(it->second->lock);
+			if (!it->second->done) {
+				return true;
+			}
+		}
+		m_hung.erase(it);
+		LOG(info) << "Filesystem " << path << " answers again";
+		return false;
+	}
+
+public:
+	impl(const chrono::milliseconds& timeout, stat_function stat, const string& mount_table)
+		: m_timeout(timeout)
+		, m_stat(stat ? stat : stat_function(statfs_mount))
+		, m_table(-1)
+		, m_tableReads(0)
+		, m_hungMounts(0) {
+		m_table = open(mount_table.c_str(), O_RDONLY | O_CLOEXEC);
+		if (m_table < 0) {
+			throw system_error(errno, system_category(), "mount table open " + mount_table);
+		}
+		try {
+			read_mount_table();
+		} catch (...) {
+			close(m_table);
+			throw;
+		}
+	}
+
+	~impl() {
+		if (m_helper) {
+			{
+				lock_guard<mutex> lock(m_helper->lock);
+				m_helper->abandoned = true;
+				m_helper->wake.notify_all();
+			}
+			m_thread.join();
+		}
+		// the abandoned helpers end with their calls
+		for (const auto& hung : m_hung) {
+			lock_guard<mutex> lock(hung.second->lock);
+			hung.second->abandoned = true;
+		}
+		close(m_table);
+	}
+
+	void read(fs_stats& out) {
+		if (mount_table_changed()) {
+			read_mount_table();
+			LOG(info) << "Mount table changed, " << m_mounts.size() << " filesystems";
+		}
+
+		out.clear();
+		size_t hung = 0;
+		for (const auto& mount : m_mounts) {
+			if (still_hung(mount.mount_point)) {
+				++hung;
+				continue;
+			}
+			fs_stat fs;
+			switch (call(mount.mount_point, fs)) {
+			case call_result::answered:
+				out.push_back(fs);
+				break;
+			case call_result::timed_out:
+				LOG(warning) << "Filesystem " << mount.mount_point << " (" << mount.fs_type
+					<< ") did not answer in " << m_timeout.count() << " ms, skipping it until it does";
+				++hung;
+				break;
+			case call_result::failed:
+				break;
+			}
+		}
+		m_hungMounts = hung;
+	}
+
+	uint64_t mount_table_reads() const noexcept {
+		return m_tableReads;
+	}
+
+	size_t hung_mounts() const noexcept {
+		return m_hungMounts;
+	}
+};
+
+filesystem_monitor::filesystem_monitor(const chrono::milliseconds& timeout, stat_function stat,
+									   const string& mount_table)
+	: m_impl(new impl(timeout, stat, mount_table)) {
+}
+
+filesystem_monitor::~filesystem_monitor() {
+}
+
+void filesystem_monitor::read(fs_stats& out) {
+	m_impl->read(out);
+}
+
+uint64_t filesystem_monitor::mount_table_reads() const noexcept {
+	return m_impl->mount_table_reads();
+}
+
+size_t filesystem_monitor::hung_mounts() const noexcept {
+	return m_impl->hung_mounts();
+}
+
+} //namespace os
+} //namespace client
+} //namespace monitor
+} //namespace crossover
@@ -1,4 +1,6 @@
 #include "application.hpp"
+#include "config_watcher.hpp"
+#include "settings_file.hpp"
 
 #include "log.hpp"
 #include "os.hpp"
@@ -8,6 +10,7 @@
 #include <cstdlib>
 #include <stdexcept>
 #include <iostream>
+#include <memory>
 #include <string>
 #include <chrono>
 
@@ -18,13 +21,36 @@ namespace po = boost::program_options;
 #define LOG CROSSOVER_MONITOR_LOG
 
 int main(int argc, char* argv[]) {
-	log::init();
-	LOG(info) << "Crossover Monitor Client Started";
 	po::options_description description;
 	description.add_options()
 		("help", "Show this message")
 		("minutes", po::value<unsigned>()->default_value(5), "Period between reports in seconds")
-		("logfile", po::value<string>(), "Log file");
+		("send", po::value<string>()->default_value("raw"), "What to send: raw samples, rollup or both")
+		("anomaly", "Detect anomalies on the agent and sample at a high rate after them")
+		("anomaly-z", po::value<double>()->default_value(5), "Anomaly z-score threshold")
+		("anomaly-seasonal", "Keep a separate anomaly baseline for every hour of the day")
+		("anomaly-pre-trigger", po::value<size_t>()->default_value(16), "Raw samples attached to an anomaly event")
+		("anomaly-high-rate-ms", po::value<unsigned>()->default_value(1000), "Sampling period after an anomaly in milliseconds")
+		("cpu-period-ms", po::value<unsigned>()->default_value(0), "CPU sampling period in milliseconds, 0 to sample every report")
+		("memory-period-ms", po::value<unsigned>()->default_value(0), "Memory sampling period in milliseconds, 0 to sample every report")
+		("process-period-ms", po::value<unsigned>()->default_value(0), "Process count sampling period in milliseconds, 0 to sample every report")
+		("io-period-ms", po::value<unsigned>()->default_value(0), "Disk I/O sampling period in milliseconds, 0 to sample every report")
+		("fs-period-ms", po::value<unsigned>()->default_value(0), "Filesystem capacity sampling period in milliseconds, 0 to sample every report")
+		("numa-period-ms", po::value<unsigned>()->default_value(0), "NUMA node sampling period in milliseconds, 0 to sample every report")
+		("net-period-ms", po::value<unsigned>()->default_value(0), "TCP/IP stack sampling period in milliseconds, 0 to sample every report")
+		("run-queue-top", po::value<size_t>()->default_value(0), "Processes listed by their run-queue wait, 0 for none")
+		("query", "Serve the latest sample, rollups, history and OpenMetrics on a local HTTP endpoint")
+		("query-port", po::value<unsigned short>()->default_value(8089), "Local query endpoint port on 127.0.0.1")
+		("query-history-mb", po::value<size_t>()->default_value(4), "Memory kept for the query endpoint history in megabytes")
+		("state-file", po::value<string>(), "File keeping the last reading between runs, so that the first sample after a restart is a real one")
+		("state-max-age-ms", po::value<unsigned>()->default_value(600000), "Oldest reading of the state file the first sample is based on, in milliseconds")
+		("logfile", po::value<string>(), "Log file")
+		("binlogfile", po::value<string>(), "Binary log file, see CrossMonitor.LogDecoder")
+		("log-sync", "Format and write log records on the calling thread")
+		("log-queue", po::value<size_t>()->default_value(8192), "Asynchronous log queue capacity (records)")
+		("log-flush-ms", po::value<unsigned>()->default_value(1000), "Asynchronous log flush interval in milliseconds")
+		("log-overflow", po::value<string>()->default_value("drop"), "Full asynchronous log queue policy: drop or block")
+		("config", po::value<string>(), "Configuration file with minutes, anomaly-high-rate-ms, run-queue-top and the source periods, reloaded when it changes");
 
 	po::variables_map vm;
 	try {
@@ -48,18 +74,82 @@ int main(int argc, char* argv[]) {
 		return EXIT_FAILURE;
 	}
 
+	log::options log_options;
+	log_options.asynchronous = !vm.count("log-sync");
+	log_options.queue_capacity = vm["log-queue"].as<size_t>();
+	log_options.flush_interval = chrono::milliseconds(vm["log-flush-ms"].as<unsigned>());
+
+	const string &overflowStr = vm["log-overflow"].as<string>();
+	if (overflowStr == "drop") {
+		log_options.overflow = log::overflow_policy::drop;
+	} else if (overflowStr == "block") {
+		log_options.overflow = log::overflow_policy::block;
+	} else {
+		cout << "Expected drop or block for log-overflow parameter" << endl;
+		return EXIT_FAILURE;
+	}
+
+	log::init(log_options);
+	LOG(info) << "Crossover Monitor Client Started";
+
 	if (vm.count("logfile")) {
 		const string &logfileStr = vm["logfile"].as<string>();
 		if (logfileStr.empty()) {
 			cout << "Expected value for logfile parameter" << endl;
+			log::shutdown();
 			return EXIT_FAILURE;
 		}
 
 		log::set_file(logfileStr);
 	}
 
+	if (vm.count("binlogfile")) {
+		const string &binlogfileStr = vm["binlogfile"].as<string>();
+		if (binlogfileStr.empty()) {
+			cout << "Expected value for binlogfile parameter" << endl;
+			log::shutdown();
+			return EXIT_FAILURE;
+		}
+
+		log::set_binary_file(binlogfileStr);
+	}
+
+	client::send_mode mode;
+	const string &sendStr = vm["send"].as<string>();
+	if (sendStr == "raw") {
+		mode = client::send_mode::raw;
+	} else if (sendStr == "rollup") {
+		mode = client::send_mode::rollup;
+	} else if (sendStr == "both") {
+		mode = client::send_mode::both;
+	} else {
+		cout << "Expected raw, rollup or both for send parameter" << endl;
+		log::shutdown();
+		return EXIT_FAILURE;
+	}
+
+	anomaly_options anomalies;
+	anomalies.enabled = vm.count("anomaly") != 0;
+	anomalies.z_threshold = vm["anomaly-z"].as<double>();
+	anomalies.season_buckets = vm.count("anomaly-seasonal") ? 24 : 1;
+	anomalies.pre_trigger_samples = vm["anomaly-pre-trigger"].as<size_t>();
+	anomalies.high_rate_period = chrono::milliseconds(vm["anomaly-high-rate-ms"].as<unsigned>());
+
+	query_options query;
+	query.enabled = vm.count("query") != 0;
+	query.port = vm["query-port"].as<unsigned short>();
+	query.history_bytes = vm["query-history-mb"].as<size_t>() * 1024 * 1024;
+	query.history_records = query.history_bytes / 256;
+
+	client::baseline_options baseline;
+	if (vm.count("state-file")) {
+		baseline.path = vm["state-file"].as<string>();
+	}
+	baseline.max_age = chrono::milliseconds(vm["state-max-age-ms"].as<unsigned>());
+
 	try {
-		client::application app(chrono::minutes(vm["minutes"].as<unsigned>()));
+		client::application app(chrono::minutes(vm["minutes"].as<unsigned>()),
+			client::application::collectedDataDefaultHandler, mode, anomalies, query, baseline);
 		
 		os::set_termination_handler([&app]() {
 			try {
@@ -69,16 +159,37 @@ int main(int argc, char* argv[]) {
 			}
 		});
 
+		client::runtime_settings defaults;
+		defaults.period = chrono::minutes(vm["minutes"].as<unsigned>());
+		defaults.high_rate_period = anomalies.high_rate_period;
+		defaults.run_queue_processes = vm["run-queue-top"].as<size_t>();
+		client::read_source_periods(vm, defaults);
+
+		unique_ptr<client::os::config_watcher> watcher;
+		if (vm.count("config")) {
+			const string configStr = vm["config"].as<string>();
+			app.reconfigure(client::load_settings(configStr, defaults));
+			watcher.reset(new client::os::config_watcher(configStr, [&app, configStr, defaults]() {
+				LOG(info) << "Reloading " << configStr;
+				app.reconfigure(client::load_settings(configStr, defaults));
+			}));
+		} else {
+			app.reconfigure(defaults);
+		}
+
 		app.run();
 	} catch (const std::exception& e) {
 		LOG(error) << e.what();
+		log::shutdown();
 		return EXIT_FAILURE;
 	} catch (...) {
 		LOG(error) << "Unknown exception, exiting";
+		log::shutdown();
 		return EXIT_FAILURE;
 	}
 
 	LOG(info) << "Exiting gracefully";
+	log::shutdown();
 
 	return EXIT_SUCCESS;
 }
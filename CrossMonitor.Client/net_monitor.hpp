@@ -0,0 +1,57 @@
+#pragma once
+
+#include "../CrossMonitor.Shared/data.hpp"
+
+#include <boost/noncopyable.hpp>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace crossover {
+namespace monitor {
+namespace client {
+namespace os {
+
+/**
+ * Reads the health of the TCP/IP stack: retransmits, resets and UDP
+ * receive buffer errors from /proc/net/snmp, listen queue overflows and
+ * drops from /proc/net/netstat, and the sockets and their memory from
+ * /proc/net/sockstat.
+ *
+ * The three files stay open and are read together by a file_batch_reader.
+ * The columns of the fields in snmp and netstat are looked up once, and
+ * again only if the kernel lists other ones.
+ */
+class net_monitor final : public boost::noncopyable {
+public:
+	/**
+	 * Opens the files.
+	 * Throws std::system_error if one of them is missing.
+	 * @param proc_root procfs directory.
+	 */
+	explicit net_monitor(const std::string& proc_root = "/proc");
+	~net_monitor();
+
+	/**
+	 * Reads the counters since boot and the sockets now into out.
+	 * Throws std::system_error if a file cannot be read.
+	 */
+	void read(net_stats& out);
+
+	/**
+	 * Times the columns of snmp and netstat were looked up, the first
+	 * ones included.
+	 */
+	std::uint64_t column_lookups() const noexcept;
+
+private:
+	class impl;
+
+	std::unique_ptr<impl> m_impl;
+}; //class net_monitor
+
+} //namespace os
+} //namespace client
+} //namespace monitor
+} //namespace crossover
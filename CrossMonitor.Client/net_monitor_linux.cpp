@@ -0,0 +1,113 @@
+#include "net_monitor.hpp"
+#include "file_batch_reader.hpp"
+
+#include "procfs.hpp"
+
+#include <unistd.h>
+
+#include <cstdint>
+#include <system_error>
+
+using namespace std;
+
+namespace crossover {
+namespace monitor {
+namespace client {
+namespace os {
+
+namespace {
+
+	const char* const files[] = { "/net/snmp", "/net/netstat", "/net/sockstat" };
+
+	enum file_index {
+		snmp_file,
+		netstat_file,
+		sockstat_file
+	};
+
+	// the fields of snmp and netstat, in the order of their values
+	enum snmp_field {
+		retransmits_field,
+		resets_sent_field,
+		established_resets_field,
+		receive_buffer_errors_field,
+		snmp_field_count
+	};
+
+	enum netstat_field {
+		listen_overflows_field,
+		listen_drops_field,
+		netstat_field_count
+	};
+
+} //namespace
+
+class net_monitor::impl final {
+private:
+	const string m_procRoot;
+	file_batch_reader m_files;
+	procfs::net_table_columns m_snmp;
+	procfs::net_table_columns m_netstat;
+	const uint64_t m_pageSize;
+
+	void check(file_index index) const {
+		if (m_files.error(index) != 0) {
+			throw system_error(m_files.error(index), system_category(), "read " + m_procRoot + files[index]);
+		}
+	}
+
+public:
+	impl(const string& proc_root)
+		: m_procRoot(proc_root)
+		, m_snmp({ "Tcp:RetransSegs", "Tcp:OutRsts", "Tcp:EstabResets", "Udp:RcvbufErrors" })
+		, m_netstat({ "TcpExt:ListenOverflows", "TcpExt:ListenDrops" })
+		, m_pageSize(static_cast<uint64_t>(sysconf(_SC_PAGESIZE))) {
+		// netstat has a few hundred fields on recent kernels
+		for (const char* file : files) {
+			m_files.add(proc_root + file, 8192);
+		}
+	}
+
+	void read(net_stats& out) {
+		m_files.read();
+		check(snmp_file);
+		check(netstat_file);
+		check(sockstat_file);
+
+		uint64_t snmp[snmp_field_count];
+		uint64_t netstat[netstat_field_count];
+		m_snmp.parse(m_files.data(snmp_file), m_files.length(snmp_file), snmp);
+		m_netstat.parse(m_files.data(netstat_file), m_files.length(netstat_file), netstat);
+		out.tcp_retransmits = snmp[retransmits_field];
+		out.tcp_resets_sent = snmp[resets_sent_field];
+		out.tcp_established_resets = snmp[established_resets_field];
+		out.udp_receive_buffer_errors = snmp[receive_buffer_errors_field];
+		out.listen_overflows = netstat[listen_overflows_field];
+		out.listen_drops = netstat[listen_drops_field];
+		procfs::parse_sockstat(m_files.data(sockstat_file), m_files.length(sockstat_file), m_pageSize, out);
+	}
+
+	uint64_t column_lookups() const noexcept {
+		return m_snmp.lookups() + m_netstat.lookups();
+	}
+}; //class net_monitor::impl
+
+net_monitor::net_monitor(const string& proc_root)
+	: m_impl(new impl(proc_root)) {
+}
+
+net_monitor::~net_monitor() {
+}
+
+void net_monitor::read(net_stats& out) {
+	m_impl->read(out);
+}
+
+uint64_t net_monitor::column_lookups() const noexcept {
+	return m_impl->column_lookups();
+}
+
+} //namespace os
+} //namespace client
+} //namespace monitor
+} //namespace crossover
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "../CrossMonitor.Shared/snapshot.hpp"
+
+#include <boost/noncopyable.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace crossover {
+namespace monitor {
+namespace client {
+namespace os {
+
+/**
+ * Reads the counters of every NUMA node: its memory from node<n>/meminfo,
+ * its numa_miss and numa_foreign pages from node<n>/numastat and the CPU
+ * time of its CPUs, summed from the per-CPU lines of /proc/stat.
+ *
+ * The topology, which nodes there are and which CPUs belong to each, is
+ * read once and kept, with the meminfo and numastat files of every node
+ * open to be read together. It is read again only when the kernel reports
+ * a CPU, memory block or node going on or offline on its uevent socket.
+ */
+class numa_monitor final : public boost::noncopyable {
+public:
+	/**
+	 * Reads the topology.
+	 * Throws std::system_error if node_root cannot be listed.
+	 * @param node_root sysfs directory of the nodes.
+	 * @param hotplug_events false never reads the topology again by itself.
+	 */
+	explicit numa_monitor(const std::string& node_root = "/sys/devices/system/node",
+						  bool hotplug_events = true);
+	~numa_monitor();
+
+	/**
+	 * Reads the counters of every node into out, in node order.
+	 * @param stat contents of /proc/stat, for the CPU times.
+	 */
+	void read(const std::string& stat, numa_counters& out);
+
+	/**
+	 * Reads the topology again, as a hotplug event does.
+	 */
+	void refresh();
+
+	std::size_t node_count() const noexcept;
+	/**
+	 * Node of a CPU, -1 if it is in none.
+	 */
+	int node_of(unsigned cpu) const noexcept;
+	/**
+	 * Times the topology was read, the first one included.
+	 */
+	std::uint64_t topology_reads() const noexcept;
+
+private:
+	class impl;
+
+	std::unique_ptr<impl> m_impl;
+}; //class numa_monitor
+
+} //namespace os
+} //namespace client
+} //namespace monitor
+} //namespace crossover
@@ -0,0 +1,247 @@
+#include "numa_monitor.hpp"
+#include "file_batch_reader.hpp"
+
+#include "log.hpp"
+#include "procfs.hpp"
+
+#include <dirent.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <linux/netlink.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <system_error>
+
+#define LOG CROSSOVER_MONITOR_LOG
+
+using namespace std;
+
+namespace crossover {
+namespace monitor {
+namespace client {
+namespace os {
+
+namespace {
+
+	// kernel uevents, as opposed to the ones udev sends again
+	const unsigned kernel_uevent_group = 1;
+
+	bool read_text(const string& path, string& out) {
+		ifstream in(path);
+		if (!in) {
+			return false;
+		}
+		out.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+		return true;
+	}
+
+	/**
+	 * Nodes listed in the topology and the files read for them, replaced
+	 * as a whole when the topology changes.
+	 */
+	struct topology {
+		// node numbers, in order
+		vector<unsigned> nodes;
+		// node index of every CPU, -1 for none
+		vector<int> cpu_nodes;
+		// meminfo and numastat of every node, at 2 * index and 2 * index + 1
+		file_batch_reader files;
+	};
+
+} //namespace
+
+class numa_monitor::impl final {
+private:
+	const string m_root;
+	int m_socket;
+	unique_ptr<topology> m_topology;
+	uint64_t m_topologyReads;
+	string m_text;
+	vector<procfs::cpu_time> m_cpus;
+	char m_event[8192];
+
+	unique_ptr<topology> read_topology() const {
+		DIR* dir = opendir(m_root.c_str());
+		if (dir == nullptr) {
+			throw system_error(errno, system_category(), "NUMA node list " + m_root);
+		}
+		unique_ptr<topology> res(new topology());
+		while (const dirent* entry = readdir(dir)) {
+			const char* name = entry->d_name;
+			if (strncmp(name, "node", 4) == 0 && isdigit(static_cast<unsigned char>(name[4]))) {
+				res->nodes.push_back(static_cast<unsigned>(strtoul(name + 4, nullptr, 10)));
+			}
+		}
+		closedir(dir);
+		sort(res->nodes.begin(), res->nodes.end());
+
+		string text;
+		vector<unsigned> cpus;
+		for (size_t i = 0; i < res->nodes.size(); ++i) {
+			const string node = m_root + "/node" + to_string(res->nodes[i]);
+			if (read_text(node + "/cpulist", text)) {
+				procfs::parse_cpulist(text, cpus);
+				for (const unsigned cpu : cpus) {
+					if (cpu >= res->cpu_nodes.size()) {
+						res->cpu_nodes.resize(cpu + 1, -1);
+					}
+					res->cpu_nodes[cpu] = static_cast<int>(i);
+				}
+			}
+			res->files.add(node + "/meminfo");
+			res->files.add(node + "/numastat");
+		}
+		return res;
+	}
+
+	/**
+	 * @return whether a uevent received since the last call reports a
+	 * topology change.
+	 */
+	bool hotplugged() noexcept {
+		bool res = false;
+		for (;;) {
+			const ssize_t length = recv(m_socket, m_event, sizeof(m_event), MSG_DONTWAIT);
+			if (length < 0) {
+				if (errno == EINTR) {
+					continue;
+				}
+				// ENOBUFS: events were dropped, one may have been a change
+				return res || errno == ENOBUFS;
+			}
+			res = res || procfs::topology_uevent(m_event, static_cast<size_t>(length));
+		}
+	}
+
+public:
+	impl(const string& node_root, bool hotplug_events)
+		: m_root(node_root)
+		, m_socket(-1)
+		, m_topologyReads(0) {
+		m_topology = read_topology();
+		++m_topologyReads;
+
+		if (!hotplug_events) {
+			return;
+		}
+		m_socket = socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK, NETLINK_KOBJECT_UEVENT);
+		sockaddr_nl address = {};
+		address.nl_family = AF_NETLINK;
+		address.nl_groups = kernel_uevent_group;
+		if (m_socket < 0 || bind(m_socket, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+			LOG(info) << "Hotplug events not available, the NUMA topology is read once, code: " << errno;
+			if (m_socket >= 0) {
+				close(m_socket);
+				m_socket = -1;
+			}
+		}
+	}
+
+	~impl() {
+		if (m_socket >= 0) {
+			close(m_socket);
+		}
+	}
+
+	void refresh() {
+		m_topology = read_topology();
+		++m_topologyReads;
+		LOG(info) << "NUMA topology changed, " << m_topology->nodes.size() << " nodes";
+	}
+
+	void read(const string& stat, numa_counters& out) {
+		if (m_socket >= 0 && hotplugged()) {
+			try {
+				refresh();
+			} catch (const exception& e) {
+				LOG(error) << "Failed to read the NUMA topology, keeping the last one: " << e.what();
+			}
+		}
+
+		topology& t = *m_topology;
+		out.clear();
+		out.resize(t.nodes.size());
+		copy(t.nodes.begin(), t.nodes.end(), out.nodes.begin());
+		if (t.nodes.empty()) {
+			return;
+		}
+
+		procfs::parse_stat_cpus(stat, m_cpus);
+		for (const auto& cpu : m_cpus) {
+			if (cpu.cpu < t.cpu_nodes.size() && t.cpu_nodes[cpu.cpu] >= 0) {
+				const size_t node = t.cpu_nodes[cpu.cpu];
+				out.cpu_total[node] += cpu.total;
+				out.cpu_busy[node] += cpu.busy;
+			}
+		}
+
+		t.files.read();
+		for (size_t i = 0; i < t.nodes.size(); ++i) {
+			for (size_t file = 2 * i; file < 2 * i + 2; ++file) {
+				bool parsed = false;
+				if (t.files.error(file) == 0) {
+					m_text.assign(t.files.data(file), t.files.length(file));
+					parsed = file % 2 == 0 ?
+						procfs::parse_node_meminfo(m_text, out.memory_total[i], out.memory_available[i]) :
+						procfs::parse_numastat(m_text, out.numa_miss[i], out.numa_foreign[i]);
+				}
+				if (!parsed) {
+					LOG(error) << "Failed to read NUMA node " << t.nodes[i] << (file % 2 == 0 ? " meminfo" : " numastat");
+				}
+			}
+		}
+	}
+
+	size_t node_count() const noexcept {
+		return m_topology->nodes.size();
+	}
+
+	int node_of(unsigned cpu) const noexcept {
+		const topology& t = *m_topology;
+		return cpu < t.cpu_nodes.size() && t.cpu_nodes[cpu] >= 0 ?
+			static_cast<int>(t.nodes[t.cpu_nodes[cpu]]) : -1;
+	}
+
+	uint64_t topology_reads() const noexcept {
+		return m_topologyReads;
+	}
+}; //class numa_monitor::impl
+
+numa_monitor::numa_monitor(const string& node_root, bool hotplug_events)
+	: m_impl(new impl(node_root, hotplug_events)) {
+}
+
+numa_monitor::~numa_monitor() {
+}
+
+void numa_monitor::read(const string& stat, numa_counters& out) {
+	m_impl->read(stat, out);
+}
+
+void numa_monitor::refresh() {
+	m_impl->refresh();
+}
+
+size_t numa_monitor::node_count() const noexcept {
+	return m_impl->node_count();
+}
+
+int numa_monitor::node_of(unsigned cpu) const noexcept {
+	return m_impl->node_of(cpu);
+}
+
+uint64_t numa_monitor::topology_reads() const noexcept {
+	return m_impl->topology_reads();
+}
+
+} //namespace os
+} //namespace client
+} //namespace monitor
+} //namespace crossover
@@ -2,6 +2,14 @@
 
 #include "../CrossMonitor.Shared/os.hpp"
 #include "../CrossMonitor.Shared/data.hpp"
+#include "../CrossMonitor.Shared/snapshot.hpp"
+
+#include <boost/noncopyable.hpp>
+
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <string>
 
 namespace crossover {
 namespace monitor {
@@ -9,35 +17,67 @@ namespace client {
 namespace os {
 
 /**
-* Init CPU use percent. Call it once on start.
-*/
-bool init_cpu_use_percent() noexcept;
-/**
-* Init IO statistics for logical drives.
-*/
-void init_disk_io_stats() noexcept;
-
-/**
- * Gets the number of currently running processes.
+ * Reads the counters of the machine into data samples.
+ * Every collector owns what it reads with and two snapshots, the previous
+ * reading and the current one, which swap after each sample; the sample
+ * itself is snapshot_decoder::sample() of the two. Collectors share no
+ * state, so any number of them can run on different threads.
+ * A collector is used by one thread at a time.
  */
-unsigned process_count() noexcept;
-/**
-* Gets CPU use percentage (0 to 100).
-*/
-float cpu_use_percent() noexcept;
-/**
-* Gets physical memory use percentage (0 to 100).
-*/
-float memory_use_percent() noexcept;
-/**
-* Gets IO statistics of logical drives.
-*/
-void disk_io_stats(IO_stats &io_stats) noexcept;
+class collector final : public boost::noncopyable {
+public:
+	/**
+	 * Least milliseconds the first sample spans when its base is the
+	 * first reading.
+	 */
+	static const unsigned bootstrap_ms = 250;
 
-/**
-* Uninit CPU use percent. Call it once on finish.
-*/
-void uninit_cpu_use_percent() noexcept;
+	/**
+	 * Opens the OS sources and takes the first reading, the base of the
+	 * first sample unless keep_baseline() restores a saved one. A source
+	 * that fails to open is logged and reads as unchanged.
+	 */
+	collector();
+	~collector();
+
+	/**
+	 * Takes a reading and makes out the sample since the previous one:
+	 * CPU use, run-queue delay and the clock and throttling of every CPU
+	 * over the interval, memory use, process count, filesystem capacity and
+	 * open sockets now, bytes moved per volume, the use of every NUMA node
+	 * and the events of the TCP/IP stack during it.
+	 * The first sample is a real one too: collect() waits until
+	 * bootstrap_ms have passed since the first reading if need be.
+	 * Throws std::invalid_argument if the reading holds values data rejects.
+	 * @param parts data_part bits of the sources to read; out keeps the
+	 * other parts, and their next sample spans the time since they were
+	 * last read (see data::get_fresh()).
+	 */
+	void collect(data& out, unsigned parts = all_parts);
+
+	/**
+	 * Lists that many processes, those that waited the longest on a run
+	 * queue, in the samples of the CPU part from now on; none by default.
+	 * Reading them scans every process.
+	 */
+	void set_run_queue_processes(std::size_t count) noexcept;
+
+	/**
+	 * Saves every reading to the state file at path from now on (see
+	 * baseline_file). Before the first sample, also takes its base from
+	 * the reading saved there if it is at most max_age old and of this
+	 * boot, so that the first sample after a restart spans the time since
+	 * the last one.
+	 * A file that cannot be opened or saved to is logged and the
+	 * collector goes on without it.
+	 */
+	void keep_baseline(const std::string& path, std::chrono::milliseconds max_age);
+
+private:
+	class impl;
+
+	std::unique_ptr<impl> m_impl;
+}; //class collector
 
 } //namespace os
 } //namespace client
@@ -0,0 +1,375 @@
+#include "os.hpp"
+#include "baseline_file.hpp"
+#include "cpu_clock_monitor.hpp"
+#include "file_batch_reader.hpp"
+#include "filesystem_monitor.hpp"
+#include "net_monitor.hpp"
+#include "numa_monitor.hpp"
+#include "process_tracker.hpp"
+#include "schedstat_monitor.hpp"
+
+#include "log.hpp"
+#include "procfs.hpp"
+#include "snapshot.hpp"
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <utility>
+
+#define LOG CROSSOVER_MONITOR_LOG
+
+using namespace std;
+
+namespace crossover {
+namespace monitor {
+namespace client {
+namespace os {
+
+/**
+ * Reads the same counters as the Windows backend from procfs.
+ * The process count comes from the collector's process_tracker if the
+ * process events are available, from a scan of /proc otherwise.
+ * The procfs files stay open and are read together by a file_batch_reader
+ * on every sample. The clock and throttling of every CPU come from a
+ * cpu_clock_monitor, filesystem capacity from a filesystem_monitor, so
+ * that a hung mount is skipped rather than stalling the sample, the
+ * NUMA nodes from a numa_monitor, the run queues from a
+ * schedstat_monitor and the TCP/IP stack from a net_monitor. Every
+ * reading goes to the baseline_file, if one is kept.
+ */
+
+namespace {
+
+	const char* const files[] = { "/proc/stat", "/proc/meminfo", "/proc/diskstats" };
+
+	enum file_index {
+		stat_file,
+		meminfo_file,
+		diskstats_file
+	};
+
+} //namespace
+
+class collector::impl final {
+private:
+	// read into m_current, which becomes m_previous after the sample;
+	// both keep their volumes and m_text its buffer between samples
+	counter_snapshot m_previous;
+	counter_snapshot m_current;
+	delta_buffers m_buffers;
+	string m_text;
+	file_batch_reader m_files;
+	// every file of files was opened, at its file_index
+	bool m_opened;
+	unique_ptr<process_tracker> m_tracker;
+	unique_ptr<cpu_clock_monitor> m_clocks;
+	unique_ptr<filesystem_monitor> m_filesystems;
+	unique_ptr<numa_monitor> m_numa;
+	unique_ptr<schedstat_monitor> m_schedstat;
+	unique_ptr<net_monitor> m_net;
+	// processes listed in the samples by their run-queue wait
+	size_t m_runQueueProcesses;
+	unique_ptr<baseline_file> m_baseline;
+	// when the first reading was taken, and whether it is still the base
+	// of the first sample rather than one restored from m_baseline
+	chrono::steady_clock::time_point m_firstReading;
+	bool m_bootstrap;
+	bool m_sampled;
+
+	bool read_file(file_index index, string& out) noexcept {
+		if (!m_opened || m_files.error(index) != 0) {
+			return false;
+		}
+		try {
+			out.assign(m_files.data(index), m_files.length(index));
+			return true;
+		} catch (const exception&) {
+			return false;
+		}
+	}
+
+	void read_cpu(counter_snapshot& snapshot) noexcept {
+		if (!read_file(stat_file, m_text) || !procfs::parse_stat(m_text, snapshot)) {
+			LOG(error) << "Failed to read CPU use from /proc/stat";
+			snapshot.cpu_total = m_previous.cpu_total;
+			snapshot.cpu_busy = m_previous.cpu_busy;
+		}
+	}
+
+	void read_clocks(counter_snapshot& snapshot) noexcept {
+		if (!m_clocks) {
+			snapshot.cores.clear();
+			return;
+		}
+		try {
+			m_clocks->read(snapshot.cores);
+		} catch (const exception& e) {
+			LOG(error) << "Failed to read the CPU clocks: " << e.what();
+			snapshot.cores = m_previous.cores;
+		}
+	}
+
+	void read_run_queues(counter_snapshot& snapshot) noexcept {
+		if (!m_schedstat) {
+			snapshot.run_queues.clear();
+			snapshot.waiting_processes.clear();
+			return;
+		}
+		try {
+			m_schedstat->read(snapshot.run_queues);
+		} catch (const exception& e) {
+			LOG(error) << "Failed to read the run queues: " << e.what();
+			snapshot.run_queues = m_previous.run_queues;
+		}
+		try {
+			if (m_runQueueProcesses > 0) {
+				m_schedstat->read_processes(m_runQueueProcesses, snapshot.waiting_processes);
+			} else {
+				snapshot.waiting_processes.clear();
+			}
+		} catch (const exception& e) {
+			LOG(error) << "Failed to read the run queues of the processes: " << e.what();
+			snapshot.waiting_processes.clear();
+		}
+	}
+
+	void read_memory(counter_snapshot& snapshot) noexcept {
+		if (!read_file(meminfo_file, m_text) || !procfs::parse_meminfo(m_text, snapshot)) {
+			LOG(error) << "Failed to read memory use from /proc/meminfo";
+			snapshot.memory_total = 0;
+			snapshot.memory_available = 0;
+		}
+	}
+
+	void read_disks(counter_snapshot& snapshot) noexcept {
+		try {
+			if (!read_file(diskstats_file, m_text)) {
+				LOG(error) << "Failed to read /proc/diskstats";
+				snapshot.volumes = m_previous.volumes;
+				return;
+			}
+			procfs::parse_diskstats(m_text, snapshot);
+		} catch (const exception& e) {
+			LOG(error) << "Failed to parse /proc/diskstats: " << e.what();
+			snapshot.volumes.clear();
+		}
+	}
+
+	void read_filesystems(counter_snapshot& snapshot) noexcept {
+		if (!m_filesystems) {
+			snapshot.filesystems.clear();
+			return;
+		}
+		try {
+			m_filesystems->read(snapshot.filesystems);
+		} catch (const exception& e) {
+			LOG(error) << "Failed to read filesystem capacity: " << e.what();
+			snapshot.filesystems = m_previous.filesystems;
+		}
+	}
+
+	void read_numa(counter_snapshot& snapshot) noexcept {
+		if (!m_numa) {
+			snapshot.numa_nodes.clear();
+			return;
+		}
+		try {
+			if (!read_file(stat_file, m_text)) {
+				m_text.clear();
+			}
+			m_numa->read(m_text, snapshot.numa_nodes);
+		} catch (const exception& e) {
+			LOG(error) << "Failed to read the NUMA nodes: " << e.what();
+			snapshot.numa_nodes = m_previous.numa_nodes;
+		}
+	}
+
+	void read_net(counter_snapshot& snapshot) noexcept {
+		if (!m_net) {
+			snapshot.has_net = false;
+			return;
+		}
+		try {
+			m_net->read(snapshot.net);
+			snapshot.has_net = true;
+		} catch (const exception& e) {
+			LOG(error) << "Failed to read the TCP/IP stack: " << e.what();
+			snapshot.has_net = m_previous.has_net;
+			snapshot.net = m_previous.net;
+		}
+	}
+
+	void read(counter_snapshot& snapshot, unsigned parts) noexcept {
+		snapshot.time_ms = chrono::duration_cast<chrono::milliseconds>(
+			chrono::system_clock::now().time_since_epoch()).count();
+		// the procfs files are read together, only the parts due are parsed
+		if (m_opened && (parts & (cpu_part | memory_part | io_part | numa_part))) {
+			try {
+				m_files.read();
+			} catch (const exception& e) {
+				LOG(error) << "Failed to read procfs: " << e.what();
+			}
+		}
+		if (parts & cpu_part) {
+			read_cpu(snapshot);
+			read_clocks(snapshot);
+			read_run_queues(snapshot);
+		}
+		if (parts & memory_part) {
+			read_memory(snapshot);
+		}
+		if (parts & io_part) {
+			read_disks(snapshot);
+		}
+		if (parts & process_part) {
+			snapshot.process_count = m_tracker ? m_tracker->stats().count : process_tracker::scan();
+		}
+		if (parts & fs_part) {
+			read_filesystems(snapshot);
+		}
+		if (parts & numa_part) {
+			read_numa(snapshot);
+		}
+		if (parts & net_part) {
+			read_net(snapshot);
+		}
+	}
+
+	void save_baseline() noexcept {
+		try {
+			m_baseline->save(m_previous);
+		} catch (const exception& e) {
+			LOG(error) << "Failed to save the baseline, no longer kept: " << e.what();
+			m_baseline.reset();
+		}
+	}
+
+public:
+	impl()
+		: m_opened(false)
+		, m_runQueueProcesses(0)
+		, m_bootstrap(true)
+		, m_sampled(false) {
+		try {
+			for (const char* path : files) {
+				m_files.add(path);
+			}
+			m_opened = true;
+		} catch (const exception& e) {
+			LOG(error) << "Failed to open procfs: " << e.what();
+		}
+		try {
+			m_tracker.reset(new process_tracker());
+		} catch (const system_error& e) {
+			LOG(info) << "Process events not available, counting processes in /proc: " << e.what();
+		} catch (const exception& e) {
+			LOG(error) << "Failed to start the process tracker: " << e.what();
+		}
+		try {
+			m_clocks.reset(new cpu_clock_monitor());
+			if (!m_clocks->has_frequency() && !m_clocks->has_throttles() && !m_clocks->has_aperf_mperf()) {
+				m_clocks.reset();
+			}
+		} catch (const system_error& e) {
+			LOG(info) << "CPU clocks not available: " << e.what();
+		} catch (const exception& e) {
+			LOG(error) << "Failed to open the CPU clocks: " << e.what();
+		}
+		try {
+			m_filesystems.reset(new filesystem_monitor());
+		} catch (const exception& e) {
+			LOG(error) << "Failed to open the mount table: " << e.what();
+		}
+		try {
+			m_numa.reset(new numa_monitor());
+		} catch (const system_error& e) {
+			LOG(info) << "NUMA nodes not available: " << e.what();
+		} catch (const exception& e) {
+			LOG(error) << "Failed to read the NUMA topology: " << e.what();
+		}
+		try {
+			m_schedstat.reset(new schedstat_monitor());
+		} catch (const system_error& e) {
+			LOG(info) << "Run queues not available: " << e.what();
+		} catch (const exception& e) {
+			LOG(error) << "Failed to open the run queues: " << e.what();
+		}
+		try {
+			m_net.reset(new net_monitor());
+		} catch (const exception& e) {
+			LOG(error) << "Failed to open the TCP/IP stack counters: " << e.what();
+		}
+		read(m_previous, all_parts);
+		m_firstReading = chrono::steady_clock::now();
+	}
+
+	void collect(data& out, unsigned parts) {
+		if (!m_sampled) {
+			m_sampled = true;
+			if (m_bootstrap) {
+				this_thread::sleep_until(m_firstReading + chrono::milliseconds(bootstrap_ms));
+			}
+		}
+		read(m_current, parts);
+		snapshot_decoder::carry(m_previous, m_current, parts);
+		// swapped first, the next interval starts here even if data
+		// rejects this reading; m_current now holds the one before
+		swap(m_previous, m_current);
+		if (m_baseline) {
+			save_baseline();
+		}
+		snapshot_decoder::sample(m_current, m_previous, out, m_buffers, parts);
+	}
+
+	void set_run_queue_processes(size_t count) noexcept {
+		m_runQueueProcesses = count;
+	}
+
+	void keep_baseline(const string& path, chrono::milliseconds max_age) {
+		try {
+			m_baseline.reset(new baseline_file(path, max_age));
+		} catch (const exception& e) {
+			LOG(error) << "Failed to open the baseline " << path << ": " << e.what();
+			return;
+		}
+		if (m_sampled) {
+			return;
+		}
+		if (m_baseline->load(m_current)) {
+			swap(m_previous, m_current);
+			m_bootstrap = false;
+			LOG(info) << "First sample based on the reading saved in " << path;
+		} else {
+			LOG(info) << "No valid reading in " << path << ", the first sample spans " << bootstrap_ms << " ms";
+		}
+	}
+};
+
+const unsigned collector::bootstrap_ms;
+
+collector::collector()
+	: m_impl(new impl()) {
+}
+
+collector::~collector() {
+}
+
+void collector::collect(data& out, unsigned parts) {
+	m_impl->collect(out, parts);
+}
+
+void collector::set_run_queue_processes(size_t count) noexcept {
+	m_impl->set_run_queue_processes(count);
+}
+
+void collector::keep_baseline(const string& path, chrono::milliseconds max_age) {
+	m_impl->keep_baseline(path, max_age);
+}
+
+} //namespace os
+} //namespace client
+} //namespace monitor
+} //namespace crossover
@@ -1,15 +1,20 @@
 #include "os.hpp"
+#include "baseline_file.hpp"
 
 #include "log.hpp"
+#include "snapshot.hpp"
 
 #include <Windows.h>
 #include <Psapi.h>
-#include <Pdh.h>
-#include <pdhmsg.h>
 
-#include <vector>
-#include <mutex>
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <string>
 #include <thread>
+#include <utility>
+#include <vector>
 
 #define LOG CROSSOVER_MONITOR_LOG
 
@@ -20,10 +25,6 @@ namespace monitor {
 namespace client {
 namespace os {
 
-PDH_HQUERY query = NULL;
-PDH_HCOUNTER cpu_counter;
-std::vector<IO_stat<__int64>> volumes_data;
-
 static unsigned process_count_helper(size_t max) noexcept {
 	//This vector should always be of type DWORD, beware of the code below
 	//that uses the size of DWORD to compute the max size of the internal
@@ -52,135 +53,240 @@ static unsigned process_count_helper(size_t max) noexcept {
 	return needed / sizeof(DWORD);
 }
 
-unsigned process_count() noexcept {
+static unsigned process_count() noexcept {
 	return process_count_helper(1024 * 5);
 }
 
-bool init_cpu_use_percent() noexcept {
-	PDH_STATUS status;
-	
-	status = PdhOpenQuery(NULL, NULL, &query);
-	if (status != ERROR_SUCCESS) {
-		LOG(error) << "PdhOpenQuery returned error code: " << status;
-		return false;
-	}
+static uint64_t to_uint64(const FILETIME& time) noexcept {
+	return (static_cast<uint64_t>(time.dwHighDateTime) << 32) | time.dwLowDateTime;
+}
 
-	status = PdhAddEnglishCounter(query,
-		L"\\Processor(_Total)\\% Processor Time",
-		NULL,
-		&cpu_counter);
-	if (status != ERROR_SUCCESS) {
-		LOG(error) << "PdhAddEnglishCounter returned error code: " << status;
-		return false;
+/**
+ * Raw counters like the procfs backend reads, so that samples are
+ * snapshot_decoder::sample() of two readings on every platform: CPU time
+ * from GetSystemTimes, bytes moved per drive from IOCTL_DISK_PERFORMANCE,
+ * capacity per local drive from GetDiskFreeSpaceEx. The drives are listed
+ * again whenever GetLogicalDrives reports another set. Network drives are
+ * left out of the capacity, whose calls would block on a hung server.
+ * NUMA nodes, the clocks of the CPUs, the run queues and the TCP/IP stack
+ * are not read, samples list none. Every reading goes to the
+ * baseline_file, if one is kept.
+ */
+class collector::impl final {
+private:
+	// read into m_current, which becomes m_previous after the sample;
+	// both keep their volumes between samples
+	counter_snapshot m_previous;
+	counter_snapshot m_current;
+	delta_buffers m_buffers;
+	vector<wchar_t> m_drives;
+	// GetLogicalDrives of m_drives
+	DWORD m_driveMask;
+	unique_ptr<baseline_file> m_baseline;
+	// when the first reading was taken, and whether it is still the base
+	// of the first sample rather than one restored from m_baseline
+	chrono::steady_clock::time_point m_firstReading;
+	bool m_bootstrap;
+	bool m_sampled;
+
+	void list_drives() noexcept {
+		const DWORD mask = GetLogicalDrives();
+		if (mask == m_driveMask) {
+			return;
+		}
+		m_driveMask = mask;
+		m_drives.clear();
+		for (wchar_t drive = L'A'; drive <= L'Z'; ++drive) {
+			if (mask & (1u << (drive - L'A'))) {
+				m_drives.push_back(drive);
+			}
+		}
 	}
 
-	status = PdhCollectQueryData(query);
-	if (status != ERROR_SUCCESS) {
-		LOG(error) << "PdhCollectQueryData returned error code: " << status;
-		return false;
+	void read_cpu(counter_snapshot& snapshot) noexcept {
+		FILETIME idle, kernel, user;
+		if (!GetSystemTimes(&idle, &kernel, &user)) {
+			LOG(error) << "Failed to get CPU times, code: " << GetLastError();
+			snapshot.cpu_total = m_previous.cpu_total;
+			snapshot.cpu_busy = m_previous.cpu_busy;
+			return;
+		}
+		// kernel time includes the idle time
+		snapshot.cpu_total = to_uint64(kernel) + to_uint64(user);
+		snapshot.cpu_busy = snapshot.cpu_total - to_uint64(idle);
 	}
 
-	return true;
-}
+	void read_memory(counter_snapshot& snapshot) noexcept {
+		MEMORYSTATUSEX mem;
+		mem.dwLength = sizeof(mem);
 
-void uninit_cpu_use_percent() noexcept {
-	if (query) {
-		PDH_STATUS status = PdhCloseQuery(query);
-		if (status != ERROR_SUCCESS)
-			LOG(error) << "PdhCloseQuery returned error code: " << status;
-
-		query = NULL;
+		if (!GlobalMemoryStatusEx(&mem)) {
+			LOG(error) << "Failed to get memory info, code: " << GetLastError();
+			snapshot.memory_total = 0;
+			snapshot.memory_available = 0;
+			return;
+		}
+		snapshot.memory_total = mem.ullTotalPhys;
+		snapshot.memory_available = mem.ullAvailPhys;
 	}
-}
 
-float cpu_use_percent() noexcept {
-	static mutex m;
-	const lock_guard<mutex> guard(m);
+	void read_disks(counter_snapshot& snapshot) noexcept {
+		list_drives();
+		// the volumes keep their capacity, no allocation after the first reading
+		snapshot.volumes.resize(m_drives.size());
+		size_t answered = 0;
+		for (const wchar_t drive : m_drives) {
+			wchar_t query[16] = L"";
+			wsprintf(query, L"\\\\.\\%c:", drive);
+			HANDLE dev = CreateFile(query,
+				FILE_READ_ATTRIBUTES,
+				FILE_SHARE_READ | FILE_SHARE_WRITE,
+				NULL, OPEN_EXISTING, 0, NULL);
+			if (dev == INVALID_HANDLE_VALUE) {
+				continue;
+			}
+
+			DISK_PERFORMANCE disk_info;
+			DWORD bytes;
+			const BOOL done = DeviceIoControl(dev, IOCTL_DISK_PERFORMANCE, NULL,
+				0, &disk_info, sizeof(disk_info), &bytes, NULL);
+			CloseHandle(dev);
+			if (!done) {
+				continue;
+			}
+
+			if (disk_info.BytesRead.QuadPart == 0 && disk_info.BytesWritten.QuadPart == 0)
+				continue;
+
+			volume_counters& volume = snapshot.volumes[answered++];
+			volume.name = drive;
+			volume.bytes_read = static_cast<uint64_t>(disk_info.BytesRead.QuadPart);
+			volume.bytes_written = static_cast<uint64_t>(disk_info.BytesWritten.QuadPart);
+		}
+		snapshot.volumes.resize(answered);
+	}
 
-	PDH_FMT_COUNTERVALUE value;
-	PDH_STATUS status;
-	DWORD counter_type;
-	if ((status = PdhCollectQueryData(query)) != ERROR_SUCCESS) {
-		LOG(error) << "Error collecting CPU usage data, code: " << status;
-		return 0;
+	void read_filesystems(counter_snapshot& snapshot) noexcept {
+		list_drives();
+		snapshot.filesystems.clear();
+		for (const wchar_t drive : m_drives) {
+			const wchar_t root[] = { drive, L':', L'\\', 0 };
+			const UINT type = GetDriveTypeW(root);
+			if (type != DRIVE_FIXED && type != DRIVE_REMOVABLE) {
+				continue;
+			}
+			ULARGE_INTEGER available, total, free;
+			if (!GetDiskFreeSpaceExW(root, &available, &total, &free)) {
+				continue;
+			}
+			fs_stat fs;
+			fs.mount_point = string(1, static_cast<char>(drive)) + ":\\";
+			fs.size_bytes = total.QuadPart;
+			fs.used_bytes = total.QuadPart - free.QuadPart;
+			fs.available_bytes = available.QuadPart;
+			// NTFS has no inode limit
+			fs.inodes = 0;
+			fs.inodes_used = 0;
+			snapshot.filesystems.push_back(fs);
+		}
 	}
-	if((status = PdhGetFormattedCounterValue(cpu_counter, 
-											PDH_FMT_DOUBLE, 
-											&counter_type,
-											&value)) != ERROR_SUCCESS) {
-		LOG(error) << "Error formatting CPU usage data, code: " << status;
-		return 0;
+
+	void read(counter_snapshot& snapshot, unsigned parts) noexcept {
+		FILETIME now;
+		GetSystemTimeAsFileTime(&now);
+		// 100 ns units since 1601-01-01
+		snapshot.time_ms = static_cast<int64_t>(to_uint64(now) / 10000 - 11644473600000ULL);
+		if (parts & cpu_part) {
+			read_cpu(snapshot);
+		}
+		if (parts & memory_part) {
+			read_memory(snapshot);
+		}
+		if (parts & io_part) {
+			read_disks(snapshot);
+		}
+		if (parts & process_part) {
+			snapshot.process_count = process_count();
+		}
+		if (parts & fs_part) {
+			read_filesystems(snapshot);
+		}
 	}
-	return static_cast<float>(value.doubleValue);
-}
 
-float memory_use_percent() noexcept {
-	MEMORYSTATUSEX mem;
-	mem.dwLength = sizeof(mem);
-	
-	if (!GlobalMemoryStatusEx(&mem)) {
-		LOG(error) << "Failed to get memory info, code: " << GetLastError();
-		return 0;
+	void save_baseline() noexcept {
+		try {
+			m_baseline->save(m_previous);
+		} catch (const exception& e) {
+			LOG(error) << "Failed to save the baseline, no longer kept: " << e.what();
+			m_baseline.reset();
+		}
 	}
 
-	const float available = 100.0f * mem.ullAvailPhys / mem.ullTotalPhys;
-	const float used = 100 - available;
-	return used;
-}
+public:
+	impl()
+		: m_driveMask(0)
+		, m_bootstrap(true)
+		, m_sampled(false) {
+		read(m_previous, all_parts);
+		m_firstReading = chrono::steady_clock::now();
+	}
 
-void init_disk_io_stats() noexcept {
-	const DWORD mydrives = 64;
-	wchar_t lpBuffer[mydrives];
-	DWORD test = GetLogicalDriveStringsW(mydrives, lpBuffer);
+	void collect(data& out, unsigned parts) {
+		if (!m_sampled) {
+			m_sampled = true;
+			if (m_bootstrap) {
+				this_thread::sleep_until(m_firstReading + chrono::milliseconds(bootstrap_ms));
+			}
+		}
+		read(m_current, parts);
+		snapshot_decoder::carry(m_previous, m_current, parts);
+		// swapped first, the next interval starts here even if data
+		// rejects this reading; m_current now holds the one before
+		swap(m_previous, m_current);
+		if (m_baseline) {
+			save_baseline();
+		}
+		snapshot_decoder::sample(m_current, m_previous, out, m_buffers, parts);
+	}
 
-	volumes_data.clear();
-	DWORD index = 0;
-	while (index < test) {
-		volumes_data.push_back({-1, -1, lpBuffer[index] });
-		index += wcslen(lpBuffer + index) + 1;
+	void keep_baseline(const string& path, chrono::milliseconds max_age) {
+		try {
+			m_baseline.reset(new baseline_file(path, max_age));
+		} catch (const exception& e) {
+			LOG(error) << "Failed to open the baseline " << path << ": " << e.what();
+			return;
+		}
+		if (m_sampled) {
+			return;
+		}
+		if (m_baseline->load(m_current)) {
+			swap(m_previous, m_current);
+			m_bootstrap = false;
+			LOG(info) << "First sample based on the reading saved in " << path;
+		} else {
+			LOG(info) << "No valid reading in " << path << ", the first sample spans " << bootstrap_ms << " ms";
+		}
 	}
-}
+};
 
-void disk_io_stats(IO_stats &io_stats) noexcept {
-	io_stats.clear();
-	io_stats.reserve(volumes_data.size());
+const unsigned collector::bootstrap_ms;
 
-	for (auto &single_volume_data : volumes_data) {
-		wchar_t query[16] = L"";
-		wsprintf(query, L"\\\\.\\%c:", single_volume_data.partition_name);
-		HANDLE dev = CreateFile(query,
-			FILE_READ_ATTRIBUTES,
-			FILE_SHARE_READ | FILE_SHARE_WRITE,
-			NULL, OPEN_EXISTING, 0, NULL);
-		if (dev == INVALID_HANDLE_VALUE) {
-			continue;
-		}
+collector::collector()
+	: m_impl(new impl()) {
+}
 
-		DISK_PERFORMANCE disk_info;
-		DWORD bytes;
+collector::~collector() {
+}
 
-		if(!DeviceIoControl(dev, IOCTL_DISK_PERFORMANCE, NULL,
-			0, &disk_info, sizeof(disk_info), &bytes, NULL)) {
-			continue;
-		}
+void collector::collect(data& out, unsigned parts) {
+	m_impl->collect(out, parts);
+}
 
-		if (disk_info.BytesRead.QuadPart == 0 && disk_info.BytesWritten.QuadPart == 0)
-			continue;
+void collector::set_run_queue_processes(size_t) noexcept {
+}
 
-		IO_stat<unsigned> res_data;
-		res_data.partition_name = single_volume_data.partition_name;
-		if (single_volume_data.bytes_read < 0 || single_volume_data.bytes_written < 0) {
-			res_data.bytes_read = 0;
-			res_data.bytes_written = 0;
-		}
-		else {
-			res_data.bytes_read = static_cast<unsigned>(disk_info.BytesRead.QuadPart - single_volume_data.bytes_read);
-			res_data.bytes_written = static_cast<unsigned>(disk_info.BytesWritten.QuadPart - single_volume_data.bytes_written);
-		}
-		io_stats.push_back(std::move(res_data));
-		single_volume_data.bytes_read = disk_info.BytesRead.QuadPart;
-		single_volume_data.bytes_written = disk_info.BytesWritten.QuadPart;
-	}
+void collector::keep_baseline(const string& path, chrono::milliseconds max_age) {
+	m_impl->keep_baseline(path, max_age);
 }
 
 } //namespace os
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <boost/noncopyable.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+
+namespace crossover {
+namespace monitor {
+namespace client {
+namespace os {
+
+/**
+ * Process lifecycle counters, see process_tracker.
+ */
+struct process_stats {
+	/**
+	 * Live processes. A process is gone as soon as it exits, even if its
+	 * parent did not reap it yet.
+	 */
+	unsigned count;
+	/**
+	 * Processes started, exec calls and processes exited since the tracker
+	 * started. Threads are not counted.
+	 */
+	std::uint64_t forks;
+	std::uint64_t execs;
+	std::uint64_t exits;
+	/**
+	 * Times count was corrected with a full scan.
+	 */
+	std::uint64_t resyncs;
+};
+
+/**
+ * Events per second between two process_stats.
+ */
+struct process_rates {
+	double forks;
+	double execs;
+	double exits;
+};
+
+/**
+ * Keeps the process count up to date from kernel process events instead
+ * of enumerating the processes on every sample, and catches processes
+ * that live shorter than the sampling period.
+ *
+ * On Linux the events come from the netlink proc connector, which needs
+ * CAP_NET_ADMIN. Events are read by a thread of its own. When the kernel
+ * drops events because the socket buffer is full, and every resync_period
+ * anyway, the count is corrected with a full scan of /proc.
+ */
+class process_tracker final : public boost::noncopyable {
+public:
+	/**
+	 * Subscribes to the process events and counts the live processes.
+	 * Throws std::system_error if the events are not available.
+	 */
+	explicit process_tracker(const std::chrono::seconds& resync_period = std::chrono::seconds(60));
+	~process_tracker();
+
+	process_stats stats() const noexcept;
+
+	/**
+	 * Counts the live processes the slow way.
+	 */
+	static unsigned scan() noexcept;
+
+	static process_rates rates(const process_stats& earlier, const process_stats& later,
+							   const std::chrono::duration<double>& elapsed) noexcept;
+
+private:
+	class impl;
+
+	std::unique_ptr<impl> m_impl;
+}; //class process_tracker
+
+} //namespace os
+} //namespace client
+} //namespace monitor
+} //namespace crossover
@@ -0,0 +1,250 @@
+#include "process_tracker.hpp"
+
+#include "counter_kernels.hpp"
+#include "log.hpp"
+
+#include <dirent.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <linux/cn_proc.h>
+#include <linux/connector.h>
+#include <linux/netlink.h>
+
+#include <atomic>
+#include <cctype>
+#include <cerrno>
+#include <system_error>
+#include <thread>
+
+#define LOG CROSSOVER_MONITOR_LOG
+
+using namespace std;
+
+namespace crossover {
+namespace monitor {
+namespace client {
+namespace os {
+
+namespace {
+
+	// the kernel drops events when this fills up between two reads
+	const int receive_buffer_size = 4 * 1024 * 1024;
+	const int stop_check_ms = 100;
+
+	system_error last_error(const char* what) {
+		return system_error(errno, system_category(), what);
+	}
+
+	/**
+	 * Sends a proc connector (un)subscribe request.
+	 */
+	bool send_mcast_op(int socket, proc_cn_mcast_op op) noexcept {
+		alignas(nlmsghdr) char buffer[NLMSG_SPACE(sizeof(cn_msg) + sizeof(proc_cn_mcast_op))] = {};
+
+		nlmsghdr* header = reinterpret_cast<nlmsghdr*>(buffer);
+		header->nlmsg_len = NLMSG_LENGTH(sizeof(cn_msg) + sizeof(proc_cn_mcast_op));
+		header->nlmsg_type = NLMSG_DONE;
+		header->nlmsg_pid = 0;
+
+		cn_msg* message = static_cast<cn_msg*>(NLMSG_DATA(header));
+		message->id.idx = CN_IDX_PROC;
+		message->id.val = CN_VAL_PROC;
+		message->len = sizeof(proc_cn_mcast_op);
+		*reinterpret_cast<proc_cn_mcast_op*>(message->data) = op;
+
+		return send(socket, header, header->nlmsg_len, 0) >= 0;
+	}
+
+} //namespace
+
+class process_tracker::impl final {
+private:
+	const chrono::seconds m_resyncPeriod;
+	int m_socket;
+	atomic<bool> m_stop;
+	atomic<long long> m_count;
+	atomic<uint64_t> m_forks;
+	atomic<uint64_t> m_execs;
+	atomic<uint64_t> m_exits;
+	atomic<uint64_t> m_resyncs;
+	thread m_reader;
+
+public:
+	impl(const chrono::seconds& resync_period)
+		: m_resyncPeriod(resync_period)
+		, m_socket(-1)
+		, m_stop(false)
+		, m_count(0)
+		, m_forks(0)
+		, m_execs(0)
+		, m_exits(0)
+		, m_resyncs(0) {
+		m_socket = socket(PF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC, NETLINK_CONNECTOR);
+		if (m_socket < 0) {
+			throw last_error("proc connector socket");
+		}
+
+		// needs privileges above the rmem_max limit, the default is kept otherwise
+		if (setsockopt(m_socket, SOL_SOCKET, SO_RCVBUFFORCE, &receive_buffer_size, sizeof(receive_buffer_size)) < 0) {
+			setsockopt(m_socket, SOL_SOCKET, SO_RCVBUF, &receive_buffer_size, sizeof(receive_buffer_size));
+		}
+
+		sockaddr_nl address = {};
+		address.nl_family = AF_NETLINK;
+		address.nl_groups = CN_IDX_PROC;
+		if (bind(m_socket, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0 ||
+			!send_mcast_op(m_socket, PROC_CN_MCAST_LISTEN)) {
+			const system_error error = last_error("proc connector subscribe");
+			close(m_socket);
+			throw error;
+		}
+
+		// events from now on are applied on top of the scan; a process
+		// starting or exiting during the scan may be off by one until the
+		// next resync
+		m_count = scan();
+		m_reader = thread([this]() {
+			read_events();
+		});
+	}
+
+	~impl() {
+		m_stop = true;
+		if (m_reader.joinable()) {
+			m_reader.join();
+		}
+		send_mcast_op(m_socket, PROC_CN_MCAST_IGNORE);
+		close(m_socket);
+	}
+
+	process_stats stats() const noexcept {
+		process_stats res;
+		const long long count = m_count;
+		res.count = count > 0 ? static_cast<unsigned>(count) : 0;
+		res.forks = m_forks;
+		res.execs = m_execs;
+		res.exits = m_exits;
+		res.resyncs = m_resyncs;
+		return res;
+	}
+
+private:
+	void resync() noexcept {
+		m_count = scan();
+		++m_resyncs;
+	}
+
+	void read_events() noexcept {
+		alignas(nlmsghdr) char buffer[16 * 1024];
+		auto next_resync = chrono::steady_clock::now() + m_resyncPeriod;
+
+		while (!m_stop) {
+			pollfd fd = { m_socket, POLLIN, 0 };
+			const int ready = poll(&fd, 1, stop_check_ms);
+
+			if (chrono::steady_clock::now() >= next_resync) {
+				resync();
+				next_resync = chrono::steady_clock::now() + m_resyncPeriod;
+			}
+			if (ready <= 0) {
+				continue;
+			}
+
+			const ssize_t size = recv(m_socket, buffer, sizeof(buffer), 0);
+			if (size < 0) {
+				if (errno == ENOBUFS) {
+					LOG(warning) << "Process events lost, counting processes again";
+					resync();
+					next_resync = chrono::steady_clock::now() + m_resyncPeriod;
+				} else if (errno != EINTR && errno != EAGAIN) {
+					LOG(error) << "Failed to read process events, code: " << errno;
+					return;
+				}
+				continue;
+			}
+
+			int left = static_cast<int>(size);
+			for (nlmsghdr* header = reinterpret_cast<nlmsghdr*>(buffer);
+				 NLMSG_OK(header, left); header = NLMSG_NEXT(header, left)) {
+				if (header->nlmsg_type == NLMSG_ERROR || header->nlmsg_type == NLMSG_NOOP) {
+					continue;
+				}
+				const cn_msg* message = static_cast<const cn_msg*>(NLMSG_DATA(header));
+				if (message->id.idx == CN_IDX_PROC && message->id.val == CN_VAL_PROC) {
+					apply(*reinterpret_cast<const proc_event*>(message->data));
+				}
+			}
+		}
+	}
+
+	void apply(const proc_event& event) noexcept {
+		// the events are sent for every thread, only the thread group
+		// leaders are processes
+		switch (event.what) {
+		case proc_event::PROC_EVENT_FORK:
+			if (event.event_data.fork.child_pid == event.event_data.fork.child_tgid) {
+				++m_forks;
+				++m_count;
+			}
+			break;
+		case proc_event::PROC_EVENT_EXEC:
+			++m_execs;
+			break;
+		case proc_event::PROC_EVENT_EXIT:
+			if (event.event_data.exit.process_pid == event.event_data.exit.process_tgid) {
+				++m_exits;
+				--m_count;
+			}
+			break;
+		default:
+			break;
+		}
+	}
+}; //class process_tracker::impl
+
+process_tracker::process_tracker(const chrono::seconds& resync_period)
+	: m_impl(new impl(resync_period)) {
+}
+
+process_tracker::~process_tracker() {
+}
+
+process_stats process_tracker::stats() const noexcept {
+	return m_impl->stats();
+}
+
+unsigned process_tracker::scan() noexcept {
+	DIR* proc = opendir("/proc");
+	if (proc == nullptr) {
+		LOG(error) << "Failed to open /proc, code: " << errno;
+		return 0;
+	}
+
+	unsigned res = 0;
+	while (const dirent* entry = readdir(proc)) {
+		if (isdigit(static_cast<unsigned char>(entry->d_name[0]))) {
+			++res;
+		}
+	}
+	closedir(proc);
+	return res;
+}
+
+process_rates process_tracker::rates(const process_stats& earlier, const process_stats& later,
+									 const chrono::duration<double>& elapsed) noexcept {
+	const uint64_t before[3] = { earlier.forks, earlier.execs, earlier.exits };
+	const uint64_t after[3] = { later.forks, later.execs, later.exits };
+	uint64_t moved[3];
+	kernels::deltas(before, after, moved, 3);
+
+	double per_second[3];
+	kernels::rates(moved, elapsed.count(), per_second, 3);
+	return process_rates{ per_second[0], per_second[1], per_second[2] };
+}
+
+} //namespace os
+} //namespace client
+} //namespace monitor
+} //namespace crossover
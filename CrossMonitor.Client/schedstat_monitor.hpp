@@ -0,0 +1,69 @@
+#pragma once
+
+#include "../CrossMonitor.Shared/data.hpp"
+#include "../CrossMonitor.Shared/snapshot.hpp"
+
+#include <boost/noncopyable.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace crossover {
+namespace monitor {
+namespace client {
+namespace os {
+
+/**
+ * Reads the run queue of every CPU from /proc/schedstat, which needs a
+ * kernel built with CONFIG_SCHEDSTATS, and, if asked, the processes that
+ * waited the longest on them from /proc/<pid>/schedstat.
+ *
+ * /proc/schedstat stays open and is parsed in place into the same
+ * counters every time, so that a reading allocates nothing once the CPUs
+ * are known. The processes are listed again on every reading; each one is
+ * compared with its previous reading, a new process waits from its next.
+ */
+class schedstat_monitor final : public boost::noncopyable {
+public:
+	/**
+	 * Opens /proc/schedstat.
+	 * Throws std::system_error if it is missing or of a version older
+	 * than 15.
+	 * @param proc_root procfs directory.
+	 */
+	explicit schedstat_monitor(const std::string& proc_root = "/proc");
+	~schedstat_monitor();
+
+	/**
+	 * Reads the counters of every CPU into out, in CPU order.
+	 * Throws std::system_error if the file cannot be read.
+	 */
+	void read(run_queue_counters& out);
+
+	/**
+	 * Reads the processes that waited the longest on a run queue since the
+	 * previous call into out, longest first; processes that did not wait
+	 * are left out.
+	 * @param top most processes in out.
+	 */
+	void read_processes(std::size_t top, process_run_queues& out);
+
+	std::size_t cpu_count() const noexcept;
+	/**
+	 * /proc/<pid>/schedstat files read so far.
+	 */
+	std::uint64_t process_reads() const noexcept;
+
+private:
+	class impl;
+
+	std::unique_ptr<impl> m_impl;
+}; //class schedstat_monitor
+
+} //namespace os
+} //namespace client
+} //namespace monitor
+} //namespace crossover
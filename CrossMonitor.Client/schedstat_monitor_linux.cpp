@@ -0,0 +1,167 @@
+#include "schedstat_monitor.hpp"
+#include "file_batch_reader.hpp"
+
+#include "log.hpp"
+#include "procfs.hpp"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <system_error>
+#include <unordered_map>
+
+#define LOG CROSSOVER_MONITOR_LOG
+
+using namespace std;
+
+namespace crossover {
+namespace monitor {
+namespace client {
+namespace os {
+
+class schedstat_monitor::impl final {
+private:
+	struct times {
+		uint64_t run_ns;
+		uint64_t wait_ns;
+		uint64_t timeslices;
+	};
+
+	struct waiter {
+		unsigned pid;
+		uint64_t run_ns;
+		uint64_t wait_ns;
+		uint64_t timeslices;
+	};
+
+	const string m_procRoot;
+	file_batch_reader m_files;
+	size_t m_cpus;
+	// of the previous read_processes() and the current one, swapped after it
+	unordered_map<unsigned, times> m_previous;
+	unordered_map<unsigned, times> m_current;
+	vector<waiter> m_waiters;
+	uint64_t m_processReads;
+
+	bool read_process(const char* pid, times& out) noexcept {
+		const string path = m_procRoot + "/" + pid + "/schedstat";
+		const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+		if (fd < 0) {
+			// the process exited since it was listed
+			return false;
+		}
+		char text[128];
+		const ssize_t length = ::read(fd, text, sizeof(text));
+		close(fd);
+		++m_processReads;
+		return length > 0 &&
+			procfs::parse_process_schedstat(text, static_cast<size_t>(length), out.run_ns, out.wait_ns, out.timeslices);
+	}
+
+public:
+	impl(const string& proc_root)
+		: m_procRoot(proc_root)
+		, m_cpus(0)
+		, m_processReads(0) {
+		// a line of about 100 bytes per CPU and more per scheduling domain
+		m_files.add(proc_root + "/schedstat", 64 * 1024);
+		run_queue_counters probe;
+		read(probe);
+		m_cpus = probe.size();
+	}
+
+	void read(run_queue_counters& out) {
+		m_files.read();
+		if (m_files.error(0) != 0) {
+			throw system_error(m_files.error(0), system_category(), "read " + m_procRoot + "/schedstat");
+		}
+		if (!procfs::parse_schedstat(m_files.data(0), m_files.length(0), out)) {
+			throw system_error(ENOTSUP, system_category(), m_procRoot + "/schedstat version not supported");
+		}
+	}
+
+	void read_processes(size_t top, process_run_queues& out) {
+		out.clear();
+		m_current.clear();
+		m_waiters.clear();
+
+		DIR* dir = opendir(m_procRoot.c_str());
+		if (dir == nullptr) {
+			throw system_error(errno, system_category(), "list " + m_procRoot);
+		}
+		while (const dirent* entry = readdir(dir)) {
+			char* end;
+			const unsigned long pid = strtoul(entry->d_name, &end, 10);
+			times now;
+			if (*end != '\0' || end == entry->d_name || !read_process(entry->d_name, now)) {
+				continue;
+			}
+			m_current.emplace(static_cast<unsigned>(pid), now);
+
+			const auto before = m_previous.find(static_cast<unsigned>(pid));
+			// a pid reused since the previous reading counts from its new process
+			if (before == m_previous.end() || now.wait_ns <= before->second.wait_ns ||
+				now.run_ns < before->second.run_ns || now.timeslices < before->second.timeslices) {
+				continue;
+			}
+			m_waiters.push_back({ static_cast<unsigned>(pid), now.run_ns - before->second.run_ns,
+				now.wait_ns - before->second.wait_ns, now.timeslices - before->second.timeslices });
+		}
+		closedir(dir);
+		swap(m_previous, m_current);
+
+		const size_t count = min(top, m_waiters.size());
+		partial_sort(m_waiters.begin(), m_waiters.begin() + count, m_waiters.end(),
+			[](const waiter& a, const waiter& b) { return a.wait_ns > b.wait_ns; });
+		out.reserve(count);
+		for (size_t i = 0; i < count; ++i) {
+			const waiter& w = m_waiters[i];
+			process_run_queue process;
+			process.pid = w.pid;
+			process.delay_us = w.timeslices == 0 ? 0.f : static_cast<float>(w.wait_ns / 1000.0 / w.timeslices);
+			process.wait_ratio = static_cast<float>(static_cast<double>(w.wait_ns) / (w.wait_ns + w.run_ns));
+			out.push_back(process);
+		}
+	}
+
+	size_t cpu_count() const noexcept {
+		return m_cpus;
+	}
+
+	uint64_t process_reads() const noexcept {
+		return m_processReads;
+	}
+}; //class schedstat_monitor::impl
+
+schedstat_monitor::schedstat_monitor(const string& proc_root)
+	: m_impl(new impl(proc_root)) {
+}
+
+schedstat_monitor::~schedstat_monitor() {
+}
+
+void schedstat_monitor::read(run_queue_counters& out) {
+	m_impl->read(out);
+}
+
+void schedstat_monitor::read_processes(size_t top, process_run_queues& out) {
+	m_impl->read_processes(top, out);
+}
+
+size_t schedstat_monitor::cpu_count() const noexcept {
+	return m_impl->cpu_count();
+}
+
+uint64_t schedstat_monitor::process_reads() const noexcept {
+	return m_impl->process_reads();
+}
+
+} //namespace os
+} //namespace client
+} //namespace monitor
+} //namespace crossover
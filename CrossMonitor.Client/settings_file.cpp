@@ -0,0 +1,70 @@
+#include "settings_file.hpp"
+
+#include <boost/program_options.hpp>
+
+#include <chrono>
+#include <fstream>
+#include <stdexcept>
+
+using namespace std;
+namespace po = boost::program_options;
+
+namespace crossover {
+namespace monitor {
+namespace client {
+
+const char* const source_period_options[] = {
+	"cpu-period-ms", "memory-period-ms", "process-period-ms", "io-period-ms", "fs-period-ms", "numa-period-ms",
+	"net-period-ms"
+};
+const size_t source_period_option_count = sizeof(source_period_options) / sizeof(source_period_options[0]);
+
+void read_source_periods(const po::variables_map& vm, runtime_settings& settings) {
+	source_schedule* const schedules[] = {
+		&settings.cpu, &settings.memory, &settings.processes, &settings.io, &settings.filesystems, &settings.numa,
+		&settings.net
+	};
+	static_assert(sizeof(schedules) / sizeof(schedules[0]) == sizeof(source_period_options) / sizeof(source_period_options[0]),
+		"a source period without an option");
+	for (size_t i = 0; i < source_period_option_count; ++i) {
+		if (vm.count(source_period_options[i])) {
+			schedules[i]->period = chrono::milliseconds(vm[source_period_options[i]].as<unsigned>());
+		}
+	}
+}
+
+runtime_settings load_settings(const string& path, const runtime_settings& defaults) {
+	po::options_description description;
+	description.add_options()
+		("minutes", po::value<unsigned>())
+		("anomaly-high-rate-ms", po::value<unsigned>())
+		("run-queue-top", po::value<size_t>());
+	for (size_t i = 0; i < source_period_option_count; ++i) {
+		description.add_options()(source_period_options[i], po::value<unsigned>());
+	}
+
+	ifstream in(path);
+	if (!in) {
+		throw runtime_error("Failed to open configuration file " + path);
+	}
+	po::variables_map vm;
+	po::store(po::parse_config_file(in, description), vm);
+	po::notify(vm);
+
+	runtime_settings res = defaults;
+	if (vm.count("minutes")) {
+		res.period = chrono::minutes(vm["minutes"].as<unsigned>());
+	}
+	if (vm.count("anomaly-high-rate-ms")) {
+		res.high_rate_period = chrono::milliseconds(vm["anomaly-high-rate-ms"].as<unsigned>());
+	}
+	if (vm.count("run-queue-top")) {
+		res.run_queue_processes = vm["run-queue-top"].as<size_t>();
+	}
+	read_source_periods(vm, res);
+	return res;
+}
+
+} //namespace client
+} //namespace monitor
+} //namespace crossover
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "application.hpp"
+
+#include <boost/program_options/variables_map.hpp>
+
+#include <cstddef>
+#include <string>
+
+namespace crossover {
+namespace monitor {
+namespace client {
+
+/**
+ * Names of the options of the source periods, in data_part bit order.
+ */
+extern const char* const source_period_options[];
+extern const std::size_t source_period_option_count;
+
+/**
+ * Copies the source periods found in vm to settings.
+ */
+void read_source_periods(const boost::program_options::variables_map& vm, runtime_settings& settings);
+
+/**
+ * Reads the settings a running agent can change from a configuration
+ * file: key=value lines with the names of the command line options,
+ * minutes, anomaly-high-rate-ms, run-queue-top and the source periods.
+ * Those left out keep the values of defaults. Throws std::exception
+ * derived exceptions if the file cannot be read or holds anything else.
+ */
+runtime_settings load_settings(const std::string& path, const runtime_settings& defaults);
+
+} //namespace client
+} //namespace monitor
+} //namespace crossover
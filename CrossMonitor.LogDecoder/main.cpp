@@ -0,0 +1,200 @@
+#include <arrow_ipc.hpp>
+#include <binlog.hpp>
+#include <data.hpp>
+
+#include <cpprest/json.h>
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/program_options.hpp>
+
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+using namespace std;
+using namespace crossover::monitor;
+namespace po = boost::program_options;
+namespace trivial = boost::log::trivial;
+
+/**
+ * Parses "YYYY-mm-dd HH:MM:SS[.ffffff]" into microseconds since 1970-01-01,
+ * the representation of binary log timestamps.
+ */
+static uint64_t parse_time(const string& text) {
+	using namespace boost::posix_time;
+	const ptime epoch(boost::gregorian::date(1970, 1, 1));
+	return static_cast<uint64_t>((time_from_string(text) - epoch).total_microseconds());
+}
+
+static web::json::value to_json(const log::binary::record& rec) {
+	web::json::value out;
+	out[U("timestamp")] = web::json::value::number(rec.timestamp);
+	out[U("thread_id")] = web::json::value::number(rec.thread_id);
+
+	ostringstream severity;
+	severity << rec.severity;
+	out[U("severity")] = web::json::value::string(utility::conversions::to_string_t(severity.str()));
+	out[U("format")] = web::json::value::string(utility::conversions::to_string_t(rec.args.format()));
+
+	vector<web::json::value> args;
+	for (size_t i = 0; i < rec.args.size(); ++i) {
+		const auto& arg = rec.args[i];
+		switch (arg.kind) {
+		case log::arguments::type::int64:
+			args.push_back(web::json::value::number(arg.i));
+			break;
+		case log::arguments::type::uint64:
+			args.push_back(web::json::value::number(arg.u));
+			break;
+		case log::arguments::type::float64:
+			args.push_back(web::json::value::number(arg.d));
+			break;
+		case log::arguments::type::string:
+			args.push_back(web::json::value::string(utility::conversions::to_string_t(arg.s)));
+			break;
+		}
+	}
+	out[U("args")] = web::json::value::array(args);
+	out[U("message")] = web::json::value::string(utility::conversions::to_string_t(rec.args.render()));
+
+	return out;
+}
+
+/**
+ * Adds the sample a record logs, as the client logs what it collects, to
+ * the Arrow file; other records are skipped. Returns whether it was one.
+ */
+static bool append_sample(const log::binary::record& rec, arrow_writer& writer) {
+	const string message = rec.args.render();
+	if (message.empty() || message[0] != '{') {
+		return false;
+	}
+	try {
+		const data sample = data::from_json(web::json::value::parse(utility::conversions::to_string_t(message)));
+		writer.append(sample, static_cast<int64_t>(rec.timestamp / 1000));
+	} catch (const invalid_argument&) {
+		return false;
+	} catch (const web::json::json_exception&) {
+		return false;
+	}
+	return true;
+}
+
+int main(int argc, char* argv[]) {
+	po::options_description description("Usage: CrossMonitor.LogDecoder [options] <binary log file>");
+	description.add_options()
+		("help", "Show this message")
+		("input", po::value<string>()->required(), "Binary log file")
+		("output", po::value<string>()->default_value("text"), "Output format: text, json (one object per line) or arrow (the samples logged, see --arrow-file)")
+		("arrow-file", po::value<string>(), "Arrow IPC file the arrow output writes, for pyarrow or pandas.read_feather()")
+		("from", po::value<string>(), "Skip records older than this time (YYYY-mm-dd HH:MM:SS)")
+		("to", po::value<string>(), "Skip records newer than this time (YYYY-mm-dd HH:MM:SS)")
+		("severity", po::value<string>()->default_value("trace"), "Skip records below this severity");
+
+	po::positional_options_description positional;
+	positional.add("input", 1);
+
+	po::variables_map vm;
+	try {
+		po::store(po::command_line_parser(argc, argv).options(description).positional(positional).run(), vm);
+		if (vm.count("help")) {
+			cout << description << endl;
+			return EXIT_SUCCESS;
+		}
+		po::notify(vm);
+	} catch (const exception& e) {
+		cerr << "Error while parsing command line: " << e.what() << endl;
+		cout << description << endl;
+		return EXIT_FAILURE;
+	}
+
+	const string& output = vm["output"].as<string>();
+	if (output != "text" && output != "json" && output != "arrow") {
+		cerr << "Expected text, json or arrow for output parameter" << endl;
+		return EXIT_FAILURE;
+	}
+	if ((output == "arrow") != (vm.count("arrow-file") != 0)) {
+		cerr << "The arrow output and the arrow-file parameter go together" << endl;
+		return EXIT_FAILURE;
+	}
+
+	log::binary::filter filter;
+	try {
+		if (vm.count("from")) {
+			filter.from = parse_time(vm["from"].as<string>());
+		}
+		if (vm.count("to")) {
+			filter.to = parse_time(vm["to"].as<string>());
+		}
+		istringstream severity(vm["severity"].as<string>());
+		if (!(severity >> filter.min_severity)) {
+			throw invalid_argument("unknown severity: " + severity.str());
+		}
+	} catch (const exception& e) {
+		cerr << "Invalid filter: " << e.what() << endl;
+		return EXIT_FAILURE;
+	}
+
+	ifstream in(vm["input"].as<string>(), ios::binary);
+	if (!in) {
+		cerr << "Failed to open " << vm["input"].as<string>() << endl;
+		return EXIT_FAILURE;
+	}
+
+	ofstream arrow_out;
+	if (output == "arrow") {
+		arrow_out.open(vm["arrow-file"].as<string>(), ios::binary);
+		if (!arrow_out) {
+			cerr << "Failed to open " << vm["arrow-file"].as<string>() << endl;
+			return EXIT_FAILURE;
+		}
+	}
+
+	uint64_t records = 0;
+	uint64_t samples = 0;
+	try {
+		log::binary::reader reader(in);
+		log::binary::record rec;
+		unique_ptr<arrow_writer> arrow;
+		if (output == "arrow") {
+			arrow.reset(new arrow_writer(arrow_out));
+		}
+
+		while (reader.next(rec, filter)) {
+			if (arrow) {
+				if (append_sample(rec, *arrow)) {
+					++samples;
+				}
+			} else if (output == "json") {
+				cout << utility::conversions::to_utf8string(to_json(rec).serialize()) << '\n';
+			} else {
+				cout << rec.to_text() << '\n';
+			}
+			++records;
+		}
+		if (arrow) {
+			arrow->close();
+			arrow_out.flush();
+			if (!arrow_out) {
+				throw runtime_error("Failed to write " + vm["arrow-file"].as<string>());
+			}
+			cerr << samples << " samples in " << arrow->batches() << " record batches written, ";
+		}
+
+		cerr << records << " records decoded, "
+			 << reader.blocks_read() << " blocks read, "
+			 << reader.blocks_skipped() << " blocks and "
+			 << reader.records_skipped() << " records skipped" << endl;
+	} catch (const exception& e) {
+		cout.flush();
+		cerr << e.what() << " (after " << records << " records)" << endl;
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
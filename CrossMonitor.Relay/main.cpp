@@ -0,0 +1,373 @@
+#include <relay_server.hpp>
+#include <os.hpp>
+
+#include <log.hpp>
+
+#include <boost/asio.hpp>
+#include <boost/program_options.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define LOG CROSSOVER_MONITOR_LOG
+
+using namespace std;
+using namespace crossover::monitor;
+namespace po = boost::program_options;
+namespace asio = boost::asio;
+using asio::ip::tcp;
+
+/**
+ * Receives the records of the agents of many hosts and forwards rack
+ * rollups upstream, see relay_server. With --swarm, runs against
+ * synthetic agents and a counting upstream on loopback instead and
+ * reports the compression and throughput.
+ */
+
+namespace {
+
+	/**
+	 * One connection to the upstream server per shard, so that the shards
+	 * share nothing here either. A failed connection is opened again for
+	 * the next batch.
+	 */
+	class upstream final {
+	public:
+		upstream(const string& address, unsigned shards)
+			: sockets_(shards) {
+			const size_t colon = address.rfind(':');
+			if (colon == string::npos || colon == 0 || colon + 1 == address.size()) {
+				throw invalid_argument("Expected host:port, not " + address);
+			}
+			host_ = address.substr(0, colon);
+			port_ = address.substr(colon + 1);
+		}
+
+		/**
+		 * Called by the shard on its own thread.
+		 */
+		void send(unsigned shard, const string& batch) {
+			unique_ptr<tcp::socket>& socket = sockets_[shard];
+			try {
+				if (!socket) {
+					socket.reset(new tcp::socket(io_service_));
+					tcp::resolver resolver(io_service_);
+					asio::connect(*socket, resolver.resolve(tcp::resolver::query(host_, port_)));
+				}
+				asio::write(*socket, asio::buffer(batch));
+			} catch (...) {
+				socket.reset();
+				throw;
+			}
+		}
+
+	private:
+		string host_;
+		string port_;
+		// only the blocking operations of the sockets are used, it never runs
+		asio::io_service io_service_;
+		vector<unique_ptr<tcp::socket>> sockets_;
+	}; //class upstream
+
+	/**
+	 * Upstream server on loopback that decodes the batches it receives and
+	 * counts them.
+	 */
+	class counting_sink final {
+	public:
+		counting_sink()
+			: acceptor_(io_service_, tcp::endpoint(asio::ip::address_v4::loopback(), 0))
+			, bytes_(0)
+			, rollups_(0) {
+			accept();
+			thread_ = thread([this]() {
+				try {
+					io_service_.run();
+				} catch (const exception& e) {
+					LOG(error) << "Upstream stopped: " << e.what();
+				}
+			});
+		}
+
+		~counting_sink() {
+			io_service_.stop();
+			thread_.join();
+		}
+
+		unsigned short port() const {
+			return acceptor_.local_endpoint().port();
+		}
+		uint64_t bytes() const noexcept {
+			return bytes_;
+		}
+		uint64_t rollups() const noexcept {
+			return rollups_;
+		}
+
+	private:
+		struct connection {
+			explicit connection(asio::io_service& io_service)
+				: socket(io_service) {
+			}
+
+			tcp::socket socket;
+			char chunk[64 * 1024];
+			// start of a batch not received whole yet
+			string pending;
+		};
+
+		void accept() {
+			auto next = make_shared<connection>(io_service_);
+			acceptor_.async_accept(next->socket, [this, next](const boost::system::error_code& error) {
+				if (!error) {
+					read(next);
+					accept();
+				}
+			});
+		}
+
+		void read(const shared_ptr<connection>& c) {
+			c->socket.async_read_some(asio::buffer(c->chunk), [this, c](const boost::system::error_code& error, size_t size) {
+				if (error) {
+					return;
+				}
+				c->pending.append(c->chunk, size);
+
+				vector<rack_rollup> decoded;
+				const char* position = c->pending.data();
+				while (relay_batch::decode(position, c->pending.data() + c->pending.size(), decoded)) {
+				}
+				c->pending.erase(0, position - c->pending.data());
+				// rollups first, the bytes tell that everything arrived
+				rollups_ += decoded.size();
+				bytes_ += size;
+				read(c);
+			});
+		}
+
+		asio::io_service io_service_;
+		tcp::acceptor acceptor_;
+		atomic<uint64_t> bytes_;
+		atomic<uint64_t> rollups_;
+		thread thread_;
+	}; //class counting_sink
+
+	struct swarm_options {
+		unsigned hosts;
+		unsigned racks;
+		unsigned samples;
+		unsigned agents;
+	};
+
+	/**
+	 * What every agent connection sends: the samples of its share of the
+	 * hosts, one per host and second, in time order.
+	 */
+	vector<string> swarm_records(const swarm_options& swarm, uint64_t& records) {
+		mt19937 random(42);
+		uniform_int_distribution<int> percent(0, 400);
+		uniform_int_distribution<unsigned> processes(150, 400);
+		uniform_int_distribution<unsigned> bytes(0, 1 << 20);
+
+		vector<string> res(swarm.agents);
+		records = 0;
+		const int64_t start_ms = 16801LL * 24 * 60 * 60 * 1000;
+		for (unsigned second = 0; second < swarm.samples; ++second) {
+			for (unsigned host = 0; host < swarm.hosts; ++host) {
+				const data d(percent(random) / 4.f, percent(random) / 4.f, processes(random),
+					{ { bytes(random), bytes(random), L'C' }, { bytes(random), bytes(random), L'D' } });
+
+				web::json::value record;
+				record[U("host")] = web::json::value(utility::conversions::to_string_t("host-" + to_string(host)));
+				record[U("rack")] = web::json::value(utility::conversions::to_string_t("rack-" + to_string(host % swarm.racks)));
+				record[U("time_ms")] = web::json::value(start_ms + second * 1000 + host % 1000);
+				record[U("data")] = d.to_json();
+
+				string& out = res[host % swarm.agents];
+				out += utility::conversions::to_utf8string(record.serialize());
+				out += '\n';
+				++records;
+			}
+		}
+		return res;
+	}
+
+	int run_swarm(relay_options options, const swarm_options& swarm) {
+		if (swarm.hosts == 0 || swarm.racks == 0 || swarm.agents == 0) {
+			throw invalid_argument("Expected at least one host, rack and agent");
+		}
+		options.address = "127.0.0.1";
+		options.port = 0;
+
+		uint64_t records;
+		const vector<string> payloads = swarm_records(swarm, records);
+
+		counting_sink sink;
+		upstream up("127.0.0.1:" + to_string(sink.port()), options.shards);
+		relay_server relay(options, [&up](unsigned shard, const string& batch) {
+			up.send(shard, batch);
+		});
+
+		const auto start = chrono::steady_clock::now();
+		vector<thread> agents;
+		for (const auto& payload : payloads) {
+			agents.emplace_back([&relay, &payload]() {
+				try {
+					asio::io_service io_service;
+					tcp::socket socket(io_service);
+					socket.connect(tcp::endpoint(asio::ip::address_v4::loopback(), relay.port()));
+					asio::write(socket, asio::buffer(payload));
+				} catch (const exception& e) {
+					LOG(error) << "Agent failed: " << e.what();
+				}
+			});
+		}
+		for (auto& agent : agents) {
+			agent.join();
+		}
+		for (int i = 0; i < 60000; ++i) {
+			const auto stats = relay.stats();
+			if (stats.records + stats.rejected_records >= records) {
+				break;
+			}
+			this_thread::sleep_for(chrono::milliseconds(1));
+		}
+		const chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+
+		relay.flush();
+		const auto stats = relay.stats();
+		for (int i = 0; i < 1000 && sink.bytes() < stats.forwarded_bytes; ++i) {
+			this_thread::sleep_for(chrono::milliseconds(10));
+		}
+
+		const double per_s = elapsed.count() > 0 ? stats.records / elapsed.count() : 0;
+		cout << "relay"
+			<< " shards=" << relay.shards()
+			<< " hosts=" << swarm.hosts
+			<< " racks=" << swarm.racks
+			<< " records=" << stats.records
+			<< " rejected=" << stats.rejected_records
+			<< " routed=" << stats.routed_records
+			<< " ingested_bytes=" << stats.ingested_bytes
+			<< " forwarded_bytes=" << stats.forwarded_bytes
+			<< " upstream_bytes=" << sink.bytes()
+			<< " forwarded_per_ingested=" << (stats.ingested_bytes > 0
+				? static_cast<double>(stats.forwarded_bytes) / stats.ingested_bytes : 0)
+			<< " forwarded_rollups=" << stats.forwarded_rollups
+			<< " upstream_rollups=" << sink.rollups()
+			<< " seconds=" << elapsed.count()
+			<< " records_per_s=" << per_s
+			<< " records_per_s_per_core=" << per_s / relay.shards()
+			<< endl;
+
+		return stats.rejected_records == 0 && sink.rollups() == stats.forwarded_rollups ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+} //namespace
+
+int main(int argc, char* argv[]) {
+	po::options_description description("Usage: CrossMonitor.Relay [options]");
+	description.add_options()
+		("help", "Show this message")
+		("address", po::value<string>()->default_value("0.0.0.0"), "Address to listen on for agents")
+		("port", po::value<unsigned short>()->default_value(8090), "TCP port to listen on for agents")
+		("shards", po::value<unsigned>()->default_value(0), "Shard threads, 0 for one per core")
+		("width", po::value<unsigned>()->default_value(10), "Width of the rack rollups in seconds")
+		("lateness", po::value<unsigned>()->default_value(10), "Seconds a rack rollup waits for late records")
+		("forward", po::value<string>(), "host:port of the upstream server")
+		("swarm", "Relay synthetic agents to a counting upstream on loopback and report")
+		("swarm-hosts", po::value<unsigned>()->default_value(1000), "Hosts of the swarm")
+		("swarm-racks", po::value<unsigned>()->default_value(25), "Racks of the swarm")
+		("swarm-samples", po::value<unsigned>()->default_value(60), "Samples of each host of the swarm, a second apart")
+		("swarm-agents", po::value<unsigned>()->default_value(16), "Connections the swarm sends over")
+		("logfile", po::value<string>(), "Log asynchronously to this file instead of the console");
+
+	po::variables_map vm;
+	try {
+		po::store(po::parse_command_line(argc, argv, description), vm);
+		if (vm.count("help")) {
+			cout << description << endl;
+			return EXIT_SUCCESS;
+		}
+		po::notify(vm);
+	} catch (const exception& e) {
+		cerr << "Error while parsing command line: " << e.what() << endl;
+		cout << description << endl;
+		return EXIT_FAILURE;
+	}
+
+	if (!vm.count("swarm") && !vm.count("forward")) {
+		cerr << "Expected --forward or --swarm" << endl;
+		return EXIT_FAILURE;
+	}
+
+	if (vm.count("logfile")) {
+		log::options log_options;
+		log_options.asynchronous = true;
+		log_options.console = false;
+		log::init(log_options);
+		log::set_file(vm["logfile"].as<string>());
+	}
+
+	relay_options options;
+	options.address = vm["address"].as<string>();
+	options.port = vm["port"].as<unsigned short>();
+	options.shards = vm["shards"].as<unsigned>();
+	if (options.shards == 0) {
+		options.shards = max(1u, thread::hardware_concurrency());
+	}
+	options.width = chrono::seconds(vm["width"].as<unsigned>());
+	options.lateness = chrono::seconds(vm["lateness"].as<unsigned>());
+
+	int res = EXIT_SUCCESS;
+	try {
+		if (vm.count("swarm")) {
+			swarm_options swarm;
+			swarm.hosts = vm["swarm-hosts"].as<unsigned>();
+			swarm.racks = vm["swarm-racks"].as<unsigned>();
+			swarm.samples = vm["swarm-samples"].as<unsigned>();
+			swarm.agents = vm["swarm-agents"].as<unsigned>();
+			res = run_swarm(options, swarm);
+		} else {
+			mutex m;
+			condition_variable stopped;
+			bool stop = false;
+
+			upstream up(vm["forward"].as<string>(), options.shards);
+			relay_server relay(options, [&up](unsigned shard, const string& batch) {
+				up.send(shard, batch);
+			});
+
+			os::set_termination_handler([&]() {
+				lock_guard<mutex> lock(m);
+				stop = true;
+				stopped.notify_all();
+			});
+
+			unique_lock<mutex> lock(m);
+			stopped.wait(lock, [&stop]() {
+				return stop;
+			});
+			// the relay forwards what it holds as it is destroyed
+		}
+	} catch (const exception& e) {
+		cerr << e.what() << endl;
+		log::shutdown();
+		return EXIT_FAILURE;
+	}
+
+	log::shutdown();
+	return res;
+}
@@ -0,0 +1,21 @@
+#!/bin/sh
+# Records procfs counters for CrossMonitor.Replay --procfs.
+# Usage: capture_procfs.sh [interval seconds] [snapshots] > capture.txt
+
+interval=${1:-1}
+snapshots=${2:-3600}
+
+i=0
+while [ "$i" -lt "$snapshots" ]; do
+	echo "==> $(date +%s%3N)"
+	echo "--> stat"
+	cat /proc/stat
+	echo "--> meminfo"
+	cat /proc/meminfo
+	echo "--> diskstats"
+	cat /proc/diskstats
+	echo "--> processes"
+	ls -d /proc/[0-9]* | wc -l
+	i=$((i + 1))
+	sleep "$interval"
+done
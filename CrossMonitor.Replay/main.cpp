@@ -0,0 +1,217 @@
+#include <application.hpp>
+#include <snapshot.hpp>
+#include <procfs.hpp>
+
+#include <log.hpp>
+
+#include <boost/program_options.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+
+using namespace std;
+using namespace crossover::monitor;
+namespace po = boost::program_options;
+
+/**
+ * Feeds a recorded trace through the collector pipeline as fast as possible
+ * and reports the throughput. Without a trace, a synthetic one is generated.
+ */
+
+namespace {
+
+	/**
+	 * One second snapshots of a machine with four volumes and a busy day.
+	 */
+	class synthetic_source final : public snapshot_source {
+	public:
+		explicit synthetic_source(uint64_t count)
+			: count_(count)
+			, index_(0)
+			, random_(42) {
+			snapshot_.time_ms = 16801LL * 24 * 60 * 60 * 1000;
+			snapshot_.memory_total = 16ULL * 1024 * 1024 * 1024;
+			for (wchar_t name = L'C'; name < L'G'; ++name) {
+				snapshot_.volumes.push_back(volume_counters{ name, string(), 0, 0 });
+			}
+		}
+
+		bool next(counter_snapshot& snapshot) override {
+			if (index_ == count_) {
+				return false;
+			}
+			++index_;
+
+			uniform_int_distribution<uint64_t> busy(0, 100);
+			uniform_int_distribution<uint64_t> bytes(0, 1 << 20);
+			snapshot_.time_ms += 1000;
+			snapshot_.cpu_total += 100;
+			snapshot_.cpu_busy += busy(random_);
+			snapshot_.memory_available = snapshot_.memory_total / 2 + bytes(random_);
+			snapshot_.process_count = 200 + static_cast<unsigned>(index_ % 50);
+			for (auto& volume : snapshot_.volumes) {
+				volume.bytes_read += bytes(random_);
+				volume.bytes_written += bytes(random_);
+			}
+			snapshot = snapshot_;
+			return true;
+		}
+
+	private:
+		const uint64_t count_;
+		uint64_t index_;
+		mt19937_64 random_;
+		counter_snapshot snapshot_;
+	}; //class synthetic_source
+
+	/**
+	 * Copies every snapshot into a journal while passing it on.
+	 */
+	class recording_source final : public snapshot_source {
+	public:
+		recording_source(snapshot_source& source, ostream& out)
+			: source_(source)
+			, writer_(out) {
+		}
+
+		bool next(counter_snapshot& snapshot) override {
+			if (!source_.next(snapshot)) {
+				return false;
+			}
+			writer_.append(snapshot);
+			return true;
+		}
+
+	private:
+		snapshot_source& source_;
+		journal::writer writer_;
+	}; //class recording_source
+
+} //namespace
+
+int main(int argc, char* argv[]) {
+	po::options_description description("Usage: CrossMonitor.Replay [options]");
+	description.add_options()
+		("help", "Show this message")
+		("journal", po::value<string>(), "Snapshot journal to replay")
+		("procfs", po::value<string>(), "procfs capture to replay, see capture_procfs.sh")
+		("synthetic", po::value<uint64_t>()->default_value(1000000), "Snapshots to generate without a trace")
+		("write-journal", po::value<string>(), "Also write the replayed snapshots to this journal")
+		("send", po::value<string>()->default_value("both"), "What to pass on: raw samples, rollup or both")
+		("anomaly", "Detect anomalies")
+		("print", "Log everything passed on instead of only serializing it")
+		("logfile", po::value<string>(), "Log asynchronously to this file instead of the console")
+		("binlogfile", po::value<string>(), "Log asynchronously to this binary log instead of the console");
+
+	po::variables_map vm;
+	try {
+		po::store(po::parse_command_line(argc, argv, description), vm);
+		if (vm.count("help")) {
+			cout << description << endl;
+			return EXIT_SUCCESS;
+		}
+		po::notify(vm);
+	} catch (const exception& e) {
+		cerr << "Error while parsing command line: " << e.what() << endl;
+		cout << description << endl;
+		return EXIT_FAILURE;
+	}
+
+	client::send_mode mode;
+	const string& sendStr = vm["send"].as<string>();
+	if (sendStr == "raw") {
+		mode = client::send_mode::raw;
+	} else if (sendStr == "rollup") {
+		mode = client::send_mode::rollup;
+	} else if (sendStr == "both") {
+		mode = client::send_mode::both;
+	} else {
+		cerr << "Expected raw, rollup or both for send parameter" << endl;
+		return EXIT_FAILURE;
+	}
+
+	anomaly_options anomalies;
+	anomalies.enabled = vm.count("anomaly") != 0;
+
+	// like the client does, so that --print runs its logging pipeline
+	if (vm.count("logfile") || vm.count("binlogfile")) {
+		log::options log_options;
+		log_options.asynchronous = true;
+		log_options.console = false;
+		log::init(log_options);
+		if (vm.count("logfile")) {
+			log::set_file(vm["logfile"].as<string>());
+		}
+		if (vm.count("binlogfile")) {
+			log::set_binary_file(vm["binlogfile"].as<string>());
+		}
+	}
+
+	try {
+		ifstream in;
+		unique_ptr<snapshot_source> source;
+		if (vm.count("journal")) {
+			in.open(vm["journal"].as<string>(), ios::binary);
+			if (!in) {
+				throw runtime_error("Failed to open " + vm["journal"].as<string>());
+			}
+			source.reset(new journal::reader(in));
+		} else if (vm.count("procfs")) {
+			in.open(vm["procfs"].as<string>());
+			if (!in) {
+				throw runtime_error("Failed to open " + vm["procfs"].as<string>());
+			}
+			source.reset(new procfs::capture_reader(in));
+		} else {
+			source.reset(new synthetic_source(vm["synthetic"].as<uint64_t>()));
+		}
+
+		ofstream out;
+		unique_ptr<snapshot_source> recording;
+		if (vm.count("write-journal")) {
+			out.open(vm["write-journal"].as<string>(), ios::binary);
+			if (!out) {
+				throw runtime_error("Failed to open " + vm["write-journal"].as<string>());
+			}
+			recording.reset(new recording_source(*source, out));
+		}
+
+		uint64_t messages = 0;
+		uint64_t bytes = 0;
+		const bool print = vm.count("print") != 0;
+		client::application app(chrono::minutes(1), [&](const web::json::value& collected_data) {
+			if (print) {
+				client::application::collectedDataDefaultHandler(collected_data);
+			}
+			bytes += collected_data.serialize().size();
+			++messages;
+		}, mode, anomalies);
+
+		const auto start = chrono::steady_clock::now();
+		const uint64_t samples = app.replay(recording ? *recording : *source);
+		const chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+
+		cout << "replay"
+			<< " samples=" << samples
+			<< " messages=" << messages
+			<< " serialized_chars=" << bytes
+			<< " seconds=" << elapsed.count()
+			<< " samples_per_s=" << (elapsed.count() > 0 ? samples / elapsed.count() : 0)
+			<< " per_sample_ns=" << (samples > 0 ? elapsed.count() * 1e9 / samples : 0)
+			<< endl;
+	} catch (const exception& e) {
+		cerr << e.what() << endl;
+		log::shutdown();
+		return EXIT_FAILURE;
+	}
+
+	log::shutdown();
+	return EXIT_SUCCESS;
+}
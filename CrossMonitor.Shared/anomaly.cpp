@@ -0,0 +1,223 @@
+#include "anomaly.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+
+using namespace std;
+
+namespace crossover {
+namespace monitor {
+
+using namespace web;
+
+namespace {
+
+	const int64_t ms_per_day = 24 * 60 * 60 * 1000;
+
+	int64_t to_ms(const sample_history::clock::time_point& time) noexcept {
+		return chrono::duration_cast<chrono::milliseconds>(time.time_since_epoch()).count();
+	}
+
+	const utility::char_t* to_string(anomaly_kind kind) noexcept {
+		switch (kind) {
+		case anomaly_kind::zscore:
+			return U("zscore");
+		case anomaly_kind::cusum_up:
+			return U("cusum_up");
+		case anomaly_kind::cusum_down:
+			return U("cusum_down");
+		}
+		return U("unknown");
+	}
+
+} //namespace
+
+metric_baseline::metric_baseline() noexcept
+	: cusum_high_(0)
+	, cusum_low_(0)
+	, outside_(false) {
+	seasons_.fill(moments{ 0, 0, 0 });
+}
+
+bool metric_baseline::update(double value, int64_t time_ms, const anomaly_options& options,
+							 anomaly_event& event) noexcept {
+	const int64_t time_of_day = ((time_ms % ms_per_day) + ms_per_day) % ms_per_day;
+	moments& season = seasons_[static_cast<size_t>(time_of_day * options.season_buckets / ms_per_day)];
+
+	bool raised = false;
+	if (season.count >= options.warmup) {
+		const double stddev = max({ sqrt(season.variance),
+			options.min_stddev, options.min_stddev_fraction * fabs(season.mean) });
+		const double z = (value - season.mean) / stddev;
+
+		event.value = value;
+		event.mean = season.mean;
+		event.stddev = stddev;
+		event.time_ms = time_ms;
+
+		cusum_high_ = max(0.0, cusum_high_ + z - options.cusum_drift);
+		cusum_low_ = max(0.0, cusum_low_ - z - options.cusum_drift);
+
+		const bool outside = fabs(z) > options.z_threshold;
+		if (outside && !outside_) {
+			event.kind = anomaly_kind::zscore;
+			event.score = z;
+			raised = true;
+		} else if (cusum_high_ > options.cusum_threshold) {
+			event.kind = anomaly_kind::cusum_up;
+			event.score = cusum_high_;
+			raised = true;
+		} else if (cusum_low_ > options.cusum_threshold) {
+			event.kind = anomaly_kind::cusum_down;
+			event.score = cusum_low_;
+			raised = true;
+		}
+		outside_ = outside;
+		if (raised) {
+			cusum_high_ = 0;
+			cusum_low_ = 0;
+		}
+	}
+
+	if (season.count++ == 0) {
+		season.mean = value;
+		season.variance = 0;
+	} else {
+		const double diff = value - season.mean;
+		const double increment = options.alpha * diff;
+		season.mean += increment;
+		season.variance = (1 - options.alpha) * (season.variance + diff * increment);
+	}
+
+	return raised;
+}
+
+sample_history::sample_history(size_t capacity)
+	: first_(0)
+	, size_(0) {
+	if (capacity == 0) {
+		throw invalid_argument("sample_history capacity cannot be zero");
+	}
+	samples_.resize(capacity);
+}
+
+void sample_history::push(const data& sample, const clock::time_point& time) {
+	auto& slot = samples_[(first_ + size_) % samples_.size()];
+	slot.first = time;
+	slot.second = sample;
+
+	if (size_ < samples_.size()) {
+		++size_;
+	} else {
+		first_ = (first_ + 1) % samples_.size();
+	}
+}
+
+json::value sample_history::to_json() const {
+	vector<json::value> samples;
+	for (size_t i = 0; i < size_; ++i) {
+		json::value part;
+		part[U("time_ms")] = json::value(to_ms(time(i)));
+		part[U("data")] = sample(i).to_json();
+		samples.push_back(part);
+	}
+	return json::value::array(samples);
+}
+
+anomaly_detector::anomaly_detector(const anomaly_options& options)
+	: options_(options) {
+	if (!(options.alpha > 0 && options.alpha <= 1)) {
+		throw invalid_argument("anomaly alpha must be in (0, 1]: " + std::to_string(options.alpha));
+	}
+	if (options.season_buckets < 1 || options.season_buckets > metric_baseline::max_season_buckets) {
+		throw invalid_argument("anomaly season_buckets out of range: " + std::to_string(options.season_buckets));
+	}
+	if (options.z_threshold <= 0 || options.cusum_threshold <= 0 || options.cusum_drift < 0) {
+		throw invalid_argument("anomaly thresholds must be positive");
+	}
+	if (options.pre_trigger_samples == 0) {
+		throw invalid_argument("anomaly pre_trigger_samples cannot be zero");
+	}
+	if (options.high_rate_period.count() <= 0) {
+		throw invalid_argument("anomaly high_rate_period must be positive");
+	}
+}
+
+const vector<anomaly_event>& anomaly_detector::check(const data& sample,
+													 const sample_history::clock::time_point& time) {
+	const int64_t time_ms = to_ms(time);
+	events_.clear();
+
+	// parts carried over from an earlier sample were checked with it
+	const unsigned fresh = sample.get_fresh();
+	if (fresh & cpu_part) {
+		update(0, field::cpu_percent, 0, sample.get_cpu_percent(), time_ms);
+	}
+	if (fresh & memory_part) {
+		update(1, field::memory_percent, 0, sample.get_memory_percent(), time_ms);
+	}
+	if (fresh & process_part) {
+		update(2, field::process_count, 0, sample.get_process_count(), time_ms);
+	}
+
+	if (fresh & io_part) {
+		size_t hint = 3;
+		for (const auto& io_stat : sample.get_io_stats()) {
+			update(hint++, field::bytes_read, io_stat.partition_name, io_stat.bytes_read, time_ms);
+			update(hint++, field::bytes_written, io_stat.partition_name, io_stat.bytes_written, time_ms);
+		}
+	}
+
+	return events_;
+}
+
+void anomaly_detector::update(size_t hint, field kind, wchar_t partition, double value, int64_t time_ms) {
+	// metrics keep the order of the first sample, so the hint is right
+	// unless the volumes changed
+	auto it = metrics_.begin() + min(hint, metrics_.size());
+	if (it == metrics_.end() || it->kind != kind || it->partition != partition) {
+		it = find_if(metrics_.begin(), metrics_.end(), [&](const metric& m) {
+			return m.kind == kind && m.partition == partition;
+		});
+	}
+
+	if (it == metrics_.end()) {
+		static const utility::char_t* names[] = {
+			U("cpu_percent"), U("memory_percent"), U("process_count"), U("bytes_read:"), U("bytes_written:")
+		};
+		utility::string_t name = names[static_cast<int>(kind)];
+		if (partition != 0) {
+			name += static_cast<utility::char_t>(partition);
+		}
+		metrics_.push_back(metric{ kind, partition, name, metric_baseline() });
+		events_.reserve(metrics_.size());
+		it = metrics_.end() - 1;
+	}
+
+	anomaly_event event;
+	if (it->baseline.update(value, time_ms, options_, event)) {
+		event.metric = &it->name;
+		events_.push_back(event);
+	}
+}
+
+json::value anomaly_detector::to_json(const anomaly_event& event, const sample_history& history) {
+	json::value body;
+	body[U("metric")] = json::value::string(*event.metric);
+	body[U("kind")] = json::value::string(to_string(event.kind));
+	body[U("value")] = json::value(event.value);
+	body[U("mean")] = json::value(event.mean);
+	body[U("stddev")] = json::value(event.stddev);
+	body[U("score")] = json::value(event.score);
+	body[U("time_ms")] = json::value(event.time_ms);
+	body[U("pre_trigger")] = history.to_json();
+
+	json::value out;
+	out[U("anomaly")] = body;
+	return out;
+}
+
+} //namespace monitor
+} //namespace crossover
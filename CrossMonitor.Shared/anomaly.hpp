@@ -0,0 +1,209 @@
+#pragma once
+
+#include "data.hpp"
+
+#include <cpprest/json.h>
+#include <boost/noncopyable.hpp>
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <utility>
+#include <vector>
+
+namespace crossover {
+namespace monitor {
+
+/**
+ * Anomaly detection setup. Thresholds are in standard deviations
+ * of the metric baseline.
+ */
+struct anomaly_options {
+	bool enabled = false;
+	/**
+	 * Weight of the newest sample in the EWMA mean and variance (0 to 1].
+	 */
+	double alpha = 0.02;
+	/**
+	 * Samples a baseline needs before it may raise events.
+	 */
+	unsigned warmup = 30;
+	/**
+	 * Number of time-of-day (UTC) buckets with a baseline of their own,
+	 * 1 to metric_baseline::max_season_buckets. 1 turns seasonality off.
+	 */
+	unsigned season_buckets = 1;
+	/**
+	 * An event is raised when |value - mean| exceeds this many deviations.
+	 */
+	double z_threshold = 5;
+	/**
+	 * CUSUM slack per sample and decision threshold.
+	 */
+	double cusum_drift = 0.5;
+	double cusum_threshold = 10;
+	/**
+	 * The deviation used for scoring is at least the larger of these,
+	 * so that flat metrics do not alarm on the smallest change.
+	 */
+	double min_stddev = 0.5;
+	double min_stddev_fraction = 0.05;
+	/**
+	 * Raw samples attached to an event, the last one is the anomalous sample.
+	 */
+	std::size_t pre_trigger_samples = 16;
+	/**
+	 * Sampling period used for high_rate_duration after an event.
+	 */
+	std::chrono::milliseconds high_rate_period = std::chrono::seconds(1);
+	std::chrono::seconds high_rate_duration = std::chrono::minutes(5);
+};
+
+enum class anomaly_kind {
+	zscore,
+	cusum_up,
+	cusum_down
+};
+
+struct anomaly_event final {
+	/**
+	 * Points to the metric name held by the anomaly_detector.
+	 */
+	const utility::string_t* metric;
+	anomaly_kind kind;
+	double value;
+	double mean;
+	double stddev;
+	/**
+	 * z-score or CUSUM statistic that crossed its threshold.
+	 */
+	double score;
+	std::int64_t time_ms;
+};
+
+/**
+ * Streaming baseline of one metric: EWMA mean and variance per
+ * time-of-day bucket plus a two-sided CUSUM of the standardized residuals.
+ * Fixed size, update() is O(1) and does not allocate.
+ */
+class metric_baseline final {
+public:
+	static const unsigned max_season_buckets = 24;
+
+	metric_baseline() noexcept;
+
+	/**
+	 * Scores value against the baseline, then adds it to the baseline.
+	 * A z-score event is raised once when the metric leaves the normal
+	 * range and again only after it came back. CUSUM restarts after an event.
+	 * @return true if event was filled in.
+	 */
+	bool update(double value, std::int64_t time_ms, const anomaly_options& options,
+				anomaly_event& event) noexcept;
+
+private:
+	struct moments {
+		std::uint64_t count;
+		double mean;
+		double variance;
+	};
+
+	std::array<moments, max_season_buckets> seasons_;
+	double cusum_high_;
+	double cusum_low_;
+	bool outside_;
+}; //class metric_baseline
+
+/**
+ * The last raw samples, oldest first. Fixed capacity; once every slot was
+ * used, push() copies into the existing slots without allocating.
+ */
+class sample_history final {
+public:
+	typedef std::chrono::system_clock clock;
+
+	explicit sample_history(std::size_t capacity);
+
+	void push(const data& sample, const clock::time_point& time);
+
+	std::size_t size() const noexcept {
+		return size_;
+	}
+	/**
+	 * @param index 0 is the oldest sample.
+	 */
+	const data& sample(std::size_t index) const noexcept {
+		return samples_[(first_ + index) % samples_.size()].second;
+	}
+	const clock::time_point& time(std::size_t index) const noexcept {
+		return samples_[(first_ + index) % samples_.size()].first;
+	}
+
+	/**
+	 * [{"time_ms": t, "data": data::to_json()}, ...]
+	 */
+	web::json::value to_json() const;
+
+private:
+	std::vector<std::pair<clock::time_point, data>> samples_;
+	std::size_t first_;
+	std::size_t size_;
+}; //class sample_history
+
+/**
+ * Keeps a metric_baseline for every data metric, named like the rollup
+ * metrics, and reports the metrics that turned abnormal.
+ */
+class anomaly_detector final : public boost::noncopyable {
+public:
+	/**
+	 * Throws std::invalid_argument if the options are out of range.
+	 */
+	explicit anomaly_detector(const anomaly_options& options);
+
+	const anomaly_options& options() const noexcept {
+		return options_;
+	}
+
+	/**
+	 * Updates the baseline of every fresh metric of the sample, see
+	 * data::get_fresh().
+	 * Allocates only the first time a metric is seen.
+	 * @return events raised by this sample, valid until the next call.
+	 */
+	const std::vector<anomaly_event>& check(const data& sample, const sample_history::clock::time_point& time);
+
+	/**
+	 * {"anomaly": {"metric", "kind", "value", "mean", "stddev", "score",
+	 * "time_ms", "pre_trigger": sample_history::to_json()}}
+	 */
+	static web::json::value to_json(const anomaly_event& event, const sample_history& history);
+
+private:
+	enum class field {
+		cpu_percent,
+		memory_percent,
+		process_count,
+		bytes_read,
+		bytes_written
+	};
+
+	struct metric {
+		field kind;
+		wchar_t partition;
+		utility::string_t name;
+		metric_baseline baseline;
+	};
+
+	void update(std::size_t hint, field kind, wchar_t partition, double value, std::int64_t time_ms);
+
+	const anomaly_options options_;
+	// deque keeps the names in place for anomaly_event::metric
+	std::deque<metric> metrics_;
+	std::vector<anomaly_event> events_;
+}; //class anomaly_detector
+
+} //namespace monitor
+} //namespace crossover
@@ -0,0 +1,485 @@
+#include "arrow_ipc.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+using namespace std;
+
+namespace crossover {
+namespace monitor {
+
+namespace {
+
+	const char file_magic[8] = { 'A', 'R', 'R', 'O', 'W', '1', 0, 0 };
+	const uint32_t continuation = 0xffffffff;
+	const size_t alignment = 8;
+
+	// MetadataVersion V5, MessageHeader RecordBatch and Schema
+	const uint16_t metadata_version = 4;
+	const uint8_t header_schema = 1;
+	const uint8_t header_record_batch = 3;
+
+	// Type union members, and the units and precisions used
+	const uint8_t type_int = 2;
+	const uint8_t type_float = 3;
+	const uint8_t type_utf8 = 5;
+	const uint8_t type_timestamp = 10;
+	const uint8_t type_list = 12;
+	const uint8_t type_struct = 13;
+	const uint16_t precision_single = 1;
+	const uint16_t unit_millisecond = 1;
+
+	void put_fixed(string& out, uint64_t value, size_t bytes) {
+		for (size_t i = 0; i < bytes; ++i) {
+			out.push_back(static_cast<char>(value >> (8 * i)));
+		}
+	}
+
+	size_t padding(uint64_t size) noexcept {
+		return static_cast<size_t>((alignment - size % alignment) % alignment);
+	}
+
+	/**
+	 * Writes a FlatBuffer front to back: every table, string and vector is
+	 * written after the offset referring to it, its slot, which is patched
+	 * then. The fields of a table are added first and written by table().
+	 */
+	class flatbuffer final {
+	public:
+		/**
+		 * Slot of the root table.
+		 */
+		static const size_t root = 0;
+
+		explicit flatbuffer(string& out)
+			: out_(out) {
+			out_.clear();
+			put_fixed(out_, 0, 4);
+		}
+
+		void scalar(uint16_t id, uint64_t value, size_t size) {
+			fields_.push_back(field{ id, size, value, false });
+		}
+
+		/**
+		 * Adds an offset to a table, string or vector written later.
+		 */
+		void child(uint16_t id) {
+			fields_.push_back(field{ id, 4, 0, true });
+		}
+
+		/**
+		 * Writes the table of the fields added, its vtable first.
+		 * @return slots of its children, in the order of their ids.
+		 */
+		vector<size_t> table(size_t slot) {
+			vector<field> fields;
+			fields.swap(fields_);
+			uint16_t slots = 0;
+			for (const auto& f : fields) {
+				slots = max<uint16_t>(slots, f.id + 1);
+			}
+			align(2, 0);
+			const size_t vtable = out_.size();
+			out_.append(4 + 2 * slots, '\0');
+
+			// the widest fields first, each aligned with no padding
+			// from there on
+			stable_sort(fields.begin(), fields.end(), [](const field& a, const field& b) {
+				return a.size > b.size;
+			});
+			const bool wide = !fields.empty() && fields.front().size == 8;
+			align(wide ? 8 : 4, wide ? 4 : 0);
+			const size_t start = out_.size();
+			put_fixed(out_, start - vtable, 4);
+			patch(slot, start);
+
+			vector<pair<uint16_t, size_t>> children;
+			for (const auto& f : fields) {
+				align(f.size, 0);
+				set16(vtable + 4 + 2 * f.id, out_.size() - start);
+				if (f.child) {
+					children.emplace_back(f.id, out_.size());
+				}
+				put_fixed(out_, f.value, f.size);
+			}
+			set16(vtable, 4 + 2 * slots);
+			set16(vtable + 2, out_.size() - start);
+
+			sort(children.begin(), children.end());
+			vector<size_t> out;
+			for (const auto& c : children) {
+				out.push_back(c.second);
+			}
+			return out;
+		}
+
+		void text(size_t slot, const string& text) {
+			align(4, 0);
+			patch(slot, out_.size());
+			put_fixed(out_, text.size(), 4);
+			out_ += text;
+			out_.push_back('\0');
+		}
+
+		/**
+		 * Writes a vector of count tables.
+		 * @return slots of the tables.
+		 */
+		vector<size_t> tables(size_t slot, size_t count) {
+			align(4, 0);
+			patch(slot, out_.size());
+			put_fixed(out_, count, 4);
+			vector<size_t> slots;
+			for (size_t i = 0; i < count; ++i) {
+				slots.push_back(out_.size());
+				put_fixed(out_, 0, 4);
+			}
+			return slots;
+		}
+
+		/**
+		 * Writes a vector of count structs of 8 byte alignment, encoded
+		 * one after the other in bytes.
+		 */
+		void structs(size_t slot, const string& bytes, size_t count) {
+			align(8, 4);
+			patch(slot, out_.size());
+			put_fixed(out_, count, 4);
+			out_ += bytes;
+		}
+
+		/**
+		 * Pads the buffer to the alignment of the IPC format.
+		 */
+		void finish() {
+			align(alignment, 0);
+		}
+
+	private:
+		struct field {
+			uint16_t id;
+			size_t size;
+			uint64_t value;
+			bool child;
+		};
+
+		/**
+		 * Pads to an offset of residue modulo size.
+		 */
+		void align(size_t size, size_t residue) {
+			while (out_.size() % size != residue) {
+				out_.push_back('\0');
+			}
+		}
+
+		void set16(size_t offset, size_t value) noexcept {
+			out_[offset] = static_cast<char>(value);
+			out_[offset + 1] = static_cast<char>(value >> 8);
+		}
+
+		void patch(size_t slot, size_t target) noexcept {
+			const size_t offset = target - slot;
+			for (size_t i = 0; i < 4; ++i) {
+				out_[slot + i] = static_cast<char>(offset >> (8 * i));
+			}
+		}
+
+		string& out_;
+		vector<field> fields_;
+	}; //class flatbuffer
+
+	/**
+	 * Field of the schema and the fields of its children.
+	 */
+	struct field_spec {
+		const char* name;
+		uint8_t type;
+		// bit width of an int, precision of a float
+		uint16_t width;
+		const field_spec* children;
+		size_t child_count;
+	};
+
+	const field_spec io_stat_fields[] = {
+		{ "partition_name", type_utf8, 0, nullptr, 0 },
+		{ "bytes_read", type_int, 32, nullptr, 0 },
+		{ "bytes_written", type_int, 32, nullptr, 0 }
+	};
+
+	const field_spec io_stats_item[] = {
+		{ "item", type_struct, 0, io_stat_fields, 3 }
+	};
+
+	const field_spec schema_fields[] = {
+		{ "time", type_timestamp, 0, nullptr, 0 },
+		{ "fresh", type_int, 8, nullptr, 0 },
+		{ "cpu_percent", type_float, precision_single, nullptr, 0 },
+		{ "memory_percent", type_float, precision_single, nullptr, 0 },
+		{ "process_count", type_int, 32, nullptr, 0 },
+		{ "run_queue_delay_us", type_float, precision_single, nullptr, 0 },
+		{ "run_queue_wait_ratio", type_float, precision_single, nullptr, 0 },
+		{ "io_stats", type_list, 0, io_stats_item, 1 }
+	};
+
+	void write_field(flatbuffer& fb, size_t slot, const field_spec& spec) {
+		fb.child(0);
+		fb.scalar(1, 0, 1);
+		fb.scalar(2, spec.type, 1);
+		fb.child(3);
+		fb.child(5);
+		const vector<size_t> slots = fb.table(slot);
+		fb.text(slots[0], spec.name);
+
+		switch (spec.type) {
+		case type_int:
+			fb.scalar(0, spec.width, 4);
+			fb.scalar(1, 0, 1);
+			fb.table(slots[1]);
+			break;
+		case type_float:
+			fb.scalar(0, spec.width, 2);
+			fb.table(slots[1]);
+			break;
+		case type_timestamp:
+			fb.scalar(0, unit_millisecond, 2);
+			fb.child(1);
+			fb.text(fb.table(slots[1])[0], "UTC");
+			break;
+		default:
+			fb.table(slots[1]);
+			break;
+		}
+
+		// readers want the children of every field, even none
+		const vector<size_t> children = fb.tables(slots[2], spec.child_count);
+		for (size_t i = 0; i < spec.child_count; ++i) {
+			write_field(fb, children[i], spec.children[i]);
+		}
+	}
+
+	void write_schema(flatbuffer& fb, size_t slot) {
+		const size_t count = sizeof(schema_fields) / sizeof(schema_fields[0]);
+		fb.scalar(0, 0, 2);
+		fb.child(1);
+		const vector<size_t> fields = fb.tables(fb.table(slot)[0], count);
+		for (size_t i = 0; i < count; ++i) {
+			write_field(fb, fields[i], schema_fields[i]);
+		}
+	}
+
+	/**
+	 * Writes a Message of the header type; the header table is written
+	 * to the slot returned.
+	 */
+	size_t write_message_table(flatbuffer& fb, uint8_t header_type, uint64_t body_length) {
+		fb.scalar(0, metadata_version, 2);
+		fb.scalar(1, header_type, 1);
+		fb.child(2);
+		fb.scalar(3, body_length, 8);
+		return fb.table(flatbuffer::root)[0];
+	}
+
+} //namespace
+
+arrow_writer::arrow_writer(ostream& out, format f, size_t batch_rows)
+	: out_(out)
+	, format_(f)
+	, batch_rows_(batch_rows)
+	, written_(0)
+	, closed_(false)
+	, io_offsets_(1, 0)
+	, name_offsets_(1, 0) {
+	if (batch_rows == 0) {
+		throw invalid_argument("Arrow record batches must hold at least one row");
+	}
+	if (format_ == format::file) {
+		out_.write(file_magic, sizeof(file_magic));
+		written_ += sizeof(file_magic);
+	}
+
+	flatbuffer fb(metadata_);
+	write_schema(fb, write_message_table(fb, header_schema, 0));
+	fb.finish();
+	write_message(metadata_);
+}
+
+arrow_writer::~arrow_writer() {
+	try {
+		close();
+	} catch (...) {
+	}
+}
+
+void arrow_writer::append(const data& sample, int64_t time_ms) {
+	if (closed_) {
+		throw logic_error("Arrow writer already closed");
+	}
+	time_ms_.push_back(time_ms);
+	fresh_.push_back(static_cast<uint8_t>(sample.get_fresh()));
+	cpu_percent_.push_back(sample.get_cpu_percent());
+	memory_percent_.push_back(sample.get_memory_percent());
+	process_count_.push_back(sample.get_process_count());
+	run_queue_delay_us_.push_back(sample.get_run_queue_delay_us());
+	run_queue_wait_ratio_.push_back(sample.get_run_queue_wait_ratio());
+
+	for (const auto& io_stat : sample.get_io_stats()) {
+		// partition names are drive letters, and one character of UTF-8
+		const wchar_t name = io_stat.partition_name;
+		if (name < 0x80) {
+			names_.push_back(static_cast<char>(name));
+		} else if (name < 0x800) {
+			names_.push_back(static_cast<char>(0xc0 | (name >> 6)));
+			names_.push_back(static_cast<char>(0x80 | (name & 0x3f)));
+		} else {
+			names_.push_back(static_cast<char>(0xe0 | ((name >> 12) & 0x0f)));
+			names_.push_back(static_cast<char>(0x80 | ((name >> 6) & 0x3f)));
+			names_.push_back(static_cast<char>(0x80 | (name & 0x3f)));
+		}
+		name_offsets_.push_back(static_cast<int32_t>(names_.size()));
+		bytes_read_.push_back(io_stat.bytes_read);
+		bytes_written_.push_back(io_stat.bytes_written);
+	}
+	io_offsets_.push_back(static_cast<int32_t>(bytes_read_.size()));
+
+	if (time_ms_.size() == batch_rows_) {
+		flush();
+	}
+}
+
+void arrow_writer::flush() {
+	if (time_ms_.empty()) {
+		return;
+	}
+	const uint64_t rows = time_ms_.size();
+	const uint64_t volumes = bytes_read_.size();
+
+	// the buffers in the order of the fields, depth first; no validity
+	// bitmaps, as there are no nulls
+	const pair<const void*, size_t> buffers[] = {
+		{ nullptr, 0 }, { time_ms_.data(), time_ms_.size() * sizeof(int64_t) },
+		{ nullptr, 0 }, { fresh_.data(), fresh_.size() },
+		{ nullptr, 0 }, { cpu_percent_.data(), cpu_percent_.size() * sizeof(float) },
+		{ nullptr, 0 }, { memory_percent_.data(), memory_percent_.size() * sizeof(float) },
+		{ nullptr, 0 }, { process_count_.data(), process_count_.size() * sizeof(uint32_t) },
+		{ nullptr, 0 }, { run_queue_delay_us_.data(), run_queue_delay_us_.size() * sizeof(float) },
+		{ nullptr, 0 }, { run_queue_wait_ratio_.data(), run_queue_wait_ratio_.size() * sizeof(float) },
+		{ nullptr, 0 }, { io_offsets_.data(), io_offsets_.size() * sizeof(int32_t) },
+		{ nullptr, 0 },
+		{ nullptr, 0 }, { name_offsets_.data(), name_offsets_.size() * sizeof(int32_t) }, { names_.data(), names_.size() },
+		{ nullptr, 0 }, { bytes_read_.data(), bytes_read_.size() * sizeof(uint32_t) },
+		{ nullptr, 0 }, { bytes_written_.data(), bytes_written_.size() * sizeof(uint32_t) }
+	};
+	// the lengths of the fields in the same order
+	const uint64_t nodes[] = { rows, rows, rows, rows, rows, rows, rows, rows, volumes, volumes, volumes, volumes };
+
+	string node_bytes;
+	for (const uint64_t length : nodes) {
+		put_fixed(node_bytes, length, 8);
+		put_fixed(node_bytes, 0, 8);
+	}
+	string buffer_bytes;
+	uint64_t body_length = 0;
+	for (const auto& buffer : buffers) {
+		put_fixed(buffer_bytes, body_length, 8);
+		put_fixed(buffer_bytes, buffer.second, 8);
+		body_length += buffer.second + padding(buffer.second);
+	}
+
+	flatbuffer fb(metadata_);
+	const size_t header = write_message_table(fb, header_record_batch, body_length);
+	fb.scalar(0, rows, 8);
+	fb.child(1);
+	fb.child(2);
+	const vector<size_t> slots = fb.table(header);
+	fb.structs(slots[0], node_bytes, sizeof(nodes) / sizeof(nodes[0]));
+	fb.structs(slots[1], buffer_bytes, sizeof(buffers) / sizeof(buffers[0]));
+	fb.finish();
+
+	const uint64_t offset = written_;
+	write_message(metadata_);
+	blocks_.push_back(block{ offset, static_cast<uint32_t>(written_ - offset), body_length });
+	for (const auto& buffer : buffers) {
+		write_buffer(buffer.first, buffer.second);
+	}
+
+	time_ms_.clear();
+	fresh_.clear();
+	cpu_percent_.clear();
+	memory_percent_.clear();
+	process_count_.clear();
+	run_queue_delay_us_.clear();
+	run_queue_wait_ratio_.clear();
+	io_offsets_.resize(1);
+	name_offsets_.resize(1);
+	names_.clear();
+	bytes_read_.clear();
+	bytes_written_.clear();
+}
+
+void arrow_writer::close() {
+	if (closed_) {
+		return;
+	}
+	flush();
+	closed_ = true;
+
+	string end;
+	put_fixed(end, continuation, 4);
+	put_fixed(end, 0, 4);
+	out_.write(end.data(), end.size());
+	written_ += end.size();
+	if (format_ == format::stream) {
+		out_.flush();
+		return;
+	}
+
+	string blocks;
+	for (const auto& b : blocks_) {
+		put_fixed(blocks, b.offset, 8);
+		put_fixed(blocks, b.metadata_length, 4);
+		put_fixed(blocks, 0, 4);
+		put_fixed(blocks, b.body_length, 8);
+	}
+	flatbuffer fb(metadata_);
+	fb.scalar(0, metadata_version, 2);
+	fb.child(1);
+	fb.child(2);
+	fb.child(3);
+	const vector<size_t> slots = fb.table(flatbuffer::root);
+	write_schema(fb, slots[0]);
+	fb.structs(slots[1], string(), 0);
+	fb.structs(slots[2], blocks, blocks_.size());
+	fb.finish();
+
+	string trailer;
+	put_fixed(trailer, metadata_.size(), 4);
+	trailer.append(file_magic, 6);
+	out_.write(metadata_.data(), metadata_.size());
+	out_.write(trailer.data(), trailer.size());
+	written_ += metadata_.size() + trailer.size();
+	out_.flush();
+}
+
+void arrow_writer::write_message(const string& metadata) {
+	// the metadata is already padded, the body follows it aligned
+	string prefix;
+	put_fixed(prefix, continuation, 4);
+	put_fixed(prefix, metadata.size(), 4);
+	out_.write(prefix.data(), prefix.size());
+	out_.write(metadata.data(), metadata.size());
+	written_ += prefix.size() + metadata.size();
+}
+
+void arrow_writer::write_buffer(const void* data, size_t size) {
+	static const char zeros[alignment] = {};
+	if (size > 0) {
+		out_.write(static_cast<const char*>(data), size);
+	}
+	out_.write(zeros, padding(size));
+	written_ += size + padding(size);
+}
+
+} //namespace monitor
+} //namespace crossover
@@ -0,0 +1,125 @@
+#pragma once
+
+#include "data.hpp"
+
+#include <boost/noncopyable.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace crossover {
+namespace monitor {
+
+/**
+ * Writes samples as Apache Arrow IPC record batches, for dataframes to
+ * load without parsing JSON:
+ *
+ *   time                  timestamp[ms, tz=UTC]
+ *   fresh                 uint8, data_part bits (see data::get_fresh())
+ *   cpu_percent           float
+ *   memory_percent        float
+ *   process_count         uint32
+ *   run_queue_delay_us    float
+ *   run_queue_wait_ratio  float
+ *   io_stats              list<struct<partition_name: string,
+ *                              bytes_read: uint32, bytes_written: uint32>>
+ *
+ * No column holds nulls. The file format is what pyarrow.ipc.open_file()
+ * and pandas.read_feather() read (Feather version 2), the stream format
+ * what pyarrow.ipc.open_stream() reads as it is written.
+ *
+ * Every column is a buffer of its values, appended to in place, and a
+ * batch is written from the buffers as they are: there is no object per
+ * sample, and the buffers keep their memory from one batch to the next.
+ * The values are written in the byte order of the host, little-endian
+ * on every platform the monitor runs on, as the schema says.
+ */
+class arrow_writer final : public boost::noncopyable {
+public:
+	enum class format {
+		file,
+		stream
+	};
+
+	static const std::size_t default_batch_rows = 64 * 1024;
+
+	/**
+	 * Writes the start of the file and the schema to out.
+	 * Throws std::invalid_argument if batch_rows is 0.
+	 * @param batch_rows samples of a record batch.
+	 */
+	explicit arrow_writer(std::ostream& out, format f = format::file,
+						  std::size_t batch_rows = default_batch_rows);
+	/**
+	 * Calls close() if it was not.
+	 */
+	~arrow_writer();
+
+	/**
+	 * Adds sample, taken at time_ms since 1970, to the batch; writes the
+	 * batch once it holds batch_rows samples.
+	 * Throws std::logic_error after close().
+	 */
+	void append(const data& sample, std::int64_t time_ms);
+
+	/**
+	 * Writes the samples appended since the last batch as one, if any.
+	 */
+	void flush();
+
+	/**
+	 * Writes the last batch and the end of the stream, and the footer of
+	 * the file format. Nothing can be appended after it.
+	 */
+	void close();
+
+	/**
+	 * Record batches written so far.
+	 */
+	std::size_t batches() const noexcept {
+		return blocks_.size();
+	}
+
+private:
+	/**
+	 * A record batch of the file: offset, metadata and body sizes.
+	 */
+	struct block {
+		std::uint64_t offset;
+		std::uint32_t metadata_length;
+		std::uint64_t body_length;
+	};
+
+	void write_message(const std::string& metadata);
+	void write_buffer(const void* data, std::size_t size);
+
+	std::ostream& out_;
+	const format format_;
+	const std::size_t batch_rows_;
+	std::uint64_t written_;
+	bool closed_;
+	std::vector<block> blocks_;
+	// metadata of the last message, kept between batches
+	std::string metadata_;
+
+	// the columns, in the order of the schema
+	std::vector<std::int64_t> time_ms_;
+	std::vector<std::uint8_t> fresh_;
+	std::vector<float> cpu_percent_;
+	std::vector<float> memory_percent_;
+	std::vector<std::uint32_t> process_count_;
+	std::vector<float> run_queue_delay_us_;
+	std::vector<float> run_queue_wait_ratio_;
+	// io_stats: volumes of every sample, then their names and counters
+	std::vector<std::int32_t> io_offsets_;
+	std::vector<std::int32_t> name_offsets_;
+	std::string names_;
+	std::vector<std::uint32_t> bytes_read_;
+	std::vector<std::uint32_t> bytes_written_;
+}; //class arrow_writer
+
+} //namespace monitor
+} //namespace crossover
@@ -0,0 +1,443 @@
+#include "binlog.hpp"
+
+#include <boost/log/attributes/current_thread_id.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
+#include <cstdio>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+
+using namespace std;
+
+namespace crossover {
+namespace monitor {
+namespace log {
+namespace binary {
+
+namespace trivial = boost::log::trivial;
+
+static const char file_magic[4] = { 'C', 'M', 'B', 'L' };
+static const uint16_t file_version = 1;
+static const uint32_t block_magic = 0x4b4c4243; // "CBLK"
+static const size_t block_header_size = 4 * 4 + 3 * 8 + 1;
+
+static const char* const message_format = "%1%";
+
+enum definition_kind : uint8_t {
+	format_definition = 0,
+	thread_definition = 1
+};
+
+static void put_fixed(string& out, uint64_t value, size_t bytes) {
+	for (size_t i = 0; i < bytes; ++i) {
+		out.push_back(static_cast<char>(value >> (8 * i)));
+	}
+}
+
+static void put_varint(string& out, uint64_t value) {
+	while (value >= 0x80) {
+		out.push_back(static_cast<char>(value | 0x80));
+		value >>= 7;
+	}
+	out.push_back(static_cast<char>(value));
+}
+
+static void put_signed(string& out, int64_t value) {
+	put_varint(out, (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63));
+}
+
+static void put_string(string& out, const char* data, size_t size) {
+	put_varint(out, size);
+	out.append(data, size);
+}
+
+static void put_argument(string& out, const arguments::value& v) {
+	out.push_back(static_cast<char>(v.kind));
+	switch (v.kind) {
+	case arguments::type::int64:
+		put_signed(out, v.i);
+		break;
+	case arguments::type::uint64:
+		put_varint(out, v.u);
+		break;
+	case arguments::type::float64: {
+		uint64_t bits;
+		memcpy(&bits, &v.d, sizeof(bits));
+		put_fixed(out, bits, sizeof(bits));
+		break;
+	}
+	case arguments::type::string:
+		put_string(out, v.s.data(), v.s.size());
+		break;
+	}
+}
+
+/**
+ * Bounds checked decoding of a byte range.
+ */
+class cursor final {
+public:
+	cursor(const string& data, size_t position, size_t end)
+		: data_(data), position_(position), end_(end) {
+	}
+
+	size_t position() const noexcept {
+		return position_;
+	}
+
+	uint64_t fixed(size_t bytes) {
+		need(bytes);
+		uint64_t value = 0;
+		for (size_t i = 0; i < bytes; ++i) {
+			value |= static_cast<uint64_t>(static_cast<uint8_t>(data_[position_++])) << (8 * i);
+		}
+		return value;
+	}
+
+	uint64_t varint() {
+		uint64_t value = 0;
+		for (unsigned shift = 0; shift < 64; shift += 7) {
+			need(1);
+			const uint8_t byte = static_cast<uint8_t>(data_[position_++]);
+			value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+			if (!(byte & 0x80)) {
+				return value;
+			}
+		}
+		throw runtime_error("corrupted binary log: varint too long");
+	}
+
+	int64_t signed_varint() {
+		const uint64_t value = varint();
+		return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+	}
+
+	string bytes() {
+		const uint64_t size = varint();
+		need(size);
+		string result(data_, position_, static_cast<size_t>(size));
+		position_ += static_cast<size_t>(size);
+		return result;
+	}
+
+	arguments::value argument() {
+		arguments::value v;
+		v.kind = static_cast<arguments::type>(fixed(1));
+		switch (v.kind) {
+		case arguments::type::int64:
+			v.i = signed_varint();
+			break;
+		case arguments::type::uint64:
+			v.u = varint();
+			break;
+		case arguments::type::float64: {
+			const uint64_t bits = fixed(8);
+			memcpy(&v.d, &bits, sizeof(bits));
+			break;
+		}
+		case arguments::type::string:
+			v.s = bytes();
+			break;
+		default:
+			throw runtime_error("corrupted binary log: unknown argument type");
+		}
+		return v;
+	}
+
+private:
+	void need(uint64_t bytes) const {
+		if (bytes > end_ - position_) {
+			throw runtime_error("corrupted binary log: record out of bounds");
+		}
+	}
+
+	const string& data_;
+	size_t position_;
+	const size_t end_;
+};
+
+static uint8_t severity_bit(trivial::severity_level severity) noexcept {
+	return static_cast<uint8_t>(1u << static_cast<unsigned>(severity));
+}
+
+record::record()
+	: timestamp(0)
+	, severity(trivial::info)
+	, thread_id(0)
+	, args(nullptr) {
+}
+
+string record::to_text() const {
+	using namespace boost::posix_time;
+	const ptime time = ptime(boost::gregorian::date(1970, 1, 1)) + microseconds(timestamp);
+	const auto date = time.date();
+	const auto day_time = time.time_of_day();
+
+	char stamp[64];
+	snprintf(stamp, sizeof(stamp), "%04d-%02d-%02d %02d:%02d:%02d.%06d",
+		static_cast<int>(date.year()), static_cast<int>(date.month()), static_cast<int>(date.day()),
+		static_cast<int>(day_time.hours()), static_cast<int>(day_time.minutes()),
+		static_cast<int>(day_time.seconds()), static_cast<int>(day_time.fractional_seconds()));
+
+	typedef boost::log::attributes::current_thread_id::value_type::native_type native_thread_id;
+
+	ostringstream out;
+	out << '[' << stamp << "] [0x" << hex << setfill('0') << setw(2 * sizeof(native_thread_id))
+		<< thread_id << dec << "] [" << severity << "] ";
+	args.render(out);
+	return out.str();
+}
+
+writer::writer(ostream& out)
+	: out_(out)
+	, count_(0)
+	, base_timestamp_(0)
+	, min_timestamp_(0)
+	, max_timestamp_(0)
+	, severities_(0) {
+	string header(file_magic, sizeof(file_magic));
+	put_fixed(header, file_version, 2);
+	out_.write(header.data(), header.size());
+}
+
+uint32_t writer::intern_format(const char* format) {
+	format_.assign(format);
+	auto it = formats_.find(format_);
+	if (it != formats_.end()) {
+		return it->second;
+	}
+
+	// id 0 is the implicit format of plain messages
+	const uint32_t id = static_cast<uint32_t>(formats_.size() + 1);
+	formats_.emplace(format_, id);
+
+	definitions_.push_back(format_definition);
+	put_varint(definitions_, id);
+	put_string(definitions_, format_.data(), format_.size());
+	return id;
+}
+
+uint32_t writer::intern_thread(uint64_t thread_id) {
+	auto it = threads_.find(thread_id);
+	if (it != threads_.end()) {
+		return it->second;
+	}
+
+	const uint32_t index = static_cast<uint32_t>(threads_.size());
+	threads_.emplace(thread_id, index);
+
+	definitions_.push_back(thread_definition);
+	put_varint(definitions_, index);
+	put_varint(definitions_, thread_id);
+	return index;
+}
+
+void writer::begin_record(uint64_t timestamp, trivial::severity_level severity,
+						  uint64_t thread_id, uint32_t format_id, size_t argc) {
+	if (count_ == 0) {
+		base_timestamp_ = min_timestamp_ = max_timestamp_ = timestamp;
+	} else {
+		min_timestamp_ = min(min_timestamp_, timestamp);
+		max_timestamp_ = max(max_timestamp_, timestamp);
+	}
+	severities_ |= severity_bit(severity);
+
+	record_.clear();
+	put_signed(record_, static_cast<int64_t>(timestamp - base_timestamp_));
+	record_.push_back(static_cast<char>(severity));
+	put_varint(record_, intern_thread(thread_id));
+	put_varint(record_, format_id);
+	record_.push_back(static_cast<char>(argc));
+}
+
+void writer::end_record() {
+	put_varint(records_, record_.size());
+	records_ += record_;
+	++count_;
+}
+
+void writer::append(uint64_t timestamp, trivial::severity_level severity,
+					uint64_t thread_id, const arguments& args) {
+	const uint32_t format_id = args.format() ? intern_format(args.format()) : 0;
+	begin_record(timestamp, severity, thread_id, format_id, args.size());
+	for (size_t i = 0; i < args.size(); ++i) {
+		put_argument(record_, args[i]);
+	}
+	end_record();
+}
+
+void writer::append(uint64_t timestamp, trivial::severity_level severity,
+					uint64_t thread_id, const string& message) {
+	begin_record(timestamp, severity, thread_id, 0, 1);
+	record_.push_back(static_cast<char>(arguments::type::string));
+	put_string(record_, message.data(), message.size());
+	end_record();
+}
+
+void writer::write_block() {
+	if (count_ == 0) {
+		return;
+	}
+
+	string header;
+	header.reserve(block_header_size);
+	put_fixed(header, block_magic, 4);
+	put_fixed(header, definitions_.size(), 4);
+	put_fixed(header, records_.size(), 4);
+	put_fixed(header, count_, 4);
+	put_fixed(header, base_timestamp_, 8);
+	put_fixed(header, min_timestamp_, 8);
+	put_fixed(header, max_timestamp_, 8);
+	put_fixed(header, severities_, 1);
+
+	out_.write(header.data(), header.size());
+	out_.write(definitions_.data(), definitions_.size());
+	out_.write(records_.data(), records_.size());
+
+	definitions_.clear();
+	records_.clear();
+	count_ = 0;
+	severities_ = 0;
+}
+
+reader::reader(istream& in)
+	: in_(in)
+	, position_(0)
+	, base_timestamp_(0)
+	, blocks_read_(0)
+	, blocks_skipped_(0)
+	, records_skipped_(0) {
+	string header(sizeof(file_magic) + 2, '\0');
+	if (!in_.read(&header[0], header.size()) ||
+		memcmp(header.data(), file_magic, sizeof(file_magic)) != 0) {
+		throw runtime_error("not a binary log file");
+	}
+	cursor c(header, sizeof(file_magic), header.size());
+	if (c.fixed(2) != file_version) {
+		throw runtime_error("unsupported binary log version");
+	}
+	formats_.push_back(message_format);
+}
+
+bool reader::load_block(const filter& f) {
+	string header(block_header_size, '\0');
+	for (;;) {
+		if (!in_.read(&header[0], header.size())) {
+			if (in_.gcount() == 0) {
+				return false;
+			}
+			throw runtime_error("corrupted binary log: truncated block header");
+		}
+
+		cursor c(header, 0, header.size());
+		if (c.fixed(4) != block_magic) {
+			throw runtime_error("corrupted binary log: bad block magic");
+		}
+		const size_t definitions_size = static_cast<size_t>(c.fixed(4));
+		const size_t records_size = static_cast<size_t>(c.fixed(4));
+		c.fixed(4); // record count
+		const uint64_t base = c.fixed(8);
+		const uint64_t min_timestamp = c.fixed(8);
+		const uint64_t max_timestamp = c.fixed(8);
+		const uint8_t severities = static_cast<uint8_t>(c.fixed(1));
+
+		// definitions are needed by later blocks, always read them
+		string definitions(definitions_size, '\0');
+		if (!in_.read(&definitions[0], definitions_size)) {
+			throw runtime_error("corrupted binary log: truncated definitions");
+		}
+		cursor d(definitions, 0, definitions.size());
+		while (d.position() < definitions.size()) {
+			const uint64_t kind = d.fixed(1);
+			const uint64_t id = d.varint();
+			if (kind == format_definition) {
+				format_strings_.push_back(d.bytes());
+				if (formats_.size() <= id) {
+					formats_.resize(static_cast<size_t>(id) + 1, message_format);
+				}
+				formats_[static_cast<size_t>(id)] = format_strings_.back().c_str();
+			} else if (kind == thread_definition) {
+				if (threads_.size() <= id) {
+					threads_.resize(static_cast<size_t>(id) + 1, 0);
+				}
+				threads_[static_cast<size_t>(id)] = d.varint();
+			} else {
+				throw runtime_error("corrupted binary log: unknown definition");
+			}
+		}
+
+		uint8_t wanted = 0;
+		for (int s = f.min_severity; s <= trivial::fatal; ++s) {
+			wanted |= severity_bit(static_cast<trivial::severity_level>(s));
+		}
+
+		if (max_timestamp < f.from || min_timestamp > f.to || !(severities & wanted)) {
+			in_.seekg(records_size, ios::cur);
+			if (!in_) {
+				throw runtime_error("corrupted binary log: truncated block");
+			}
+			++blocks_skipped_;
+			continue;
+		}
+
+		block_.resize(records_size);
+		if (!in_.read(&block_[0], records_size)) {
+			throw runtime_error("corrupted binary log: truncated block");
+		}
+		position_ = 0;
+		base_timestamp_ = base;
+		++blocks_read_;
+		return true;
+	}
+}
+
+bool reader::next(record& rec, const filter& f) {
+	for (;;) {
+		if (position_ >= block_.size()) {
+			block_.clear();
+			position_ = 0;
+			if (!load_block(f)) {
+				return false;
+			}
+		}
+
+		cursor c(block_, position_, block_.size());
+		const size_t size = static_cast<size_t>(c.varint());
+		const size_t end = c.position() + size;
+		if (end > block_.size()) {
+			throw runtime_error("corrupted binary log: record out of bounds");
+		}
+		position_ = end;
+
+		cursor r(block_, c.position(), end);
+		const uint64_t timestamp = base_timestamp_ + r.signed_varint();
+		const auto severity = static_cast<trivial::severity_level>(r.fixed(1));
+		if (!f.accepts(timestamp, severity)) {
+			++records_skipped_;
+			continue;
+		}
+
+		const uint64_t thread = r.varint();
+		const uint64_t format = r.varint();
+		const size_t argc = static_cast<size_t>(r.fixed(1));
+		if (thread >= threads_.size() || format >= formats_.size()) {
+			throw runtime_error("corrupted binary log: undefined thread or format");
+		}
+
+		rec.timestamp = timestamp;
+		rec.severity = severity;
+		rec.thread_id = threads_[static_cast<size_t>(thread)];
+		rec.args = arguments(formats_[static_cast<size_t>(format)]);
+		for (size_t i = 0; i < argc; ++i) {
+			rec.args.push_back(r.argument());
+		}
+		return true;
+	}
+}
+
+} //namespace binary
+} //namespace log
+} //namespace monitor
+} //namespace crossover
@@ -0,0 +1,176 @@
+#pragma once
+
+#include "log.hpp"
+
+#include <boost/noncopyable.hpp>
+
+#include <cstdint>
+#include <deque>
+#include <istream>
+#include <limits>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Compact binary log format.
+ *
+ * A file is a header ("CMBL" + format version) followed by blocks.
+ * Every block starts with a fixed size header holding the byte sizes of its
+ * two sections, the record count, the timestamp range and a mask of the
+ * severities it contains, so a reader can skip whole blocks without looking
+ * at the records. The first section defines the format strings and thread ids
+ * first used in the block, the second holds the records. A record is
+ * length prefixed and starts with its timestamp and severity, so records
+ * outside a filter are skipped without decoding their arguments.
+ *
+ * Integers are LEB128 varints (zigzag for signed values), doubles and the
+ * block header fields are little-endian fixed width.
+ */
+
+namespace crossover {
+namespace monitor {
+namespace log {
+namespace binary {
+
+	/**
+	 * A decoded log record.
+	 */
+	struct record {
+		/**
+		 * Microseconds since 1970-01-01 of the record TimeStamp attribute.
+		 */
+		std::uint64_t timestamp;
+		boost::log::trivial::severity_level severity;
+		/**
+		 * Native id of the logging thread.
+		 */
+		std::uint64_t thread_id;
+		/**
+		 * Format string and arguments. Plain CROSSOVER_MONITOR_LOG records
+		 * have the format "%1%" and the message as their only argument.
+		 */
+		arguments args;
+
+		record();
+
+		/**
+		 * Formats the record like the text log sinks do.
+		 */
+		std::string to_text() const;
+	};
+
+	/**
+	 * Encodes records into blocks. Records are buffered in memory until
+	 * write_block() is called, which makes one block of them.
+	 */
+	class writer final : public boost::noncopyable {
+	public:
+		/**
+		 * Writes the file header to out.
+		 */
+		explicit writer(std::ostream& out);
+
+		void append(std::uint64_t timestamp, boost::log::trivial::severity_level severity,
+					std::uint64_t thread_id, const arguments& args);
+		void append(std::uint64_t timestamp, boost::log::trivial::severity_level severity,
+					std::uint64_t thread_id, const std::string& message);
+
+		/**
+		 * Number of buffered bytes not yet written out.
+		 */
+		std::size_t pending() const noexcept {
+			return definitions_.size() + records_.size();
+		}
+
+		/**
+		 * Writes the buffered records as one block. Does nothing if there are none.
+		 */
+		void write_block();
+
+	private:
+		std::uint32_t intern_format(const char* format);
+		std::uint32_t intern_thread(std::uint64_t thread_id);
+		void begin_record(std::uint64_t timestamp, boost::log::trivial::severity_level severity,
+						  std::uint64_t thread_id, std::uint32_t format_id, std::size_t argc);
+		void end_record();
+
+		std::ostream& out_;
+		// by content: records rebuilt from a binary log point to the
+		// formats of the reader, which it frees or reuses
+		std::unordered_map<std::string, std::uint32_t> formats_;
+		// format looked up, kept to not allocate for every record
+		std::string format_;
+		std::unordered_map<std::uint64_t, std::uint32_t> threads_;
+		std::string definitions_;
+		std::string records_;
+		std::string record_;
+		std::uint32_t count_;
+		std::uint64_t base_timestamp_;
+		std::uint64_t min_timestamp_;
+		std::uint64_t max_timestamp_;
+		std::uint8_t severities_;
+	}; //class writer
+
+	/**
+	 * Records to return from reader::next.
+	 */
+	struct filter {
+		std::uint64_t from = 0;
+		std::uint64_t to = std::numeric_limits<std::uint64_t>::max();
+		boost::log::trivial::severity_level min_severity = boost::log::trivial::trace;
+
+		bool accepts(std::uint64_t timestamp,
+					 boost::log::trivial::severity_level severity) const noexcept {
+			return timestamp >= from && timestamp <= to && severity >= min_severity;
+		}
+	};
+
+	/**
+	 * Decodes a binary log, skipping blocks and records rejected by a filter.
+	 */
+	class reader final : public boost::noncopyable {
+	public:
+		/**
+		 * Throws std::runtime_error if the stream is not a binary log.
+		 */
+		explicit reader(std::istream& in);
+
+		/**
+		 * Reads the next record accepted by f.
+		 * Throws std::runtime_error on a corrupted or truncated file.
+		 * @return false at the end of the file.
+		 */
+		bool next(record& rec, const filter& f = filter());
+
+		std::uint64_t blocks_read() const noexcept {
+			return blocks_read_;
+		}
+		std::uint64_t blocks_skipped() const noexcept {
+			return blocks_skipped_;
+		}
+		std::uint64_t records_skipped() const noexcept {
+			return records_skipped_;
+		}
+
+	private:
+		bool load_block(const filter& f);
+
+		std::istream& in_;
+		// deque keeps the strings in place, records point to them
+		std::deque<std::string> format_strings_;
+		std::vector<const char*> formats_;
+		std::vector<std::uint64_t> threads_;
+		std::string block_;
+		std::size_t position_;
+		std::uint64_t base_timestamp_;
+		std::uint64_t blocks_read_;
+		std::uint64_t blocks_skipped_;
+		std::uint64_t records_skipped_;
+	}; //class reader
+
+} //namespace binary
+} //namespace log
+} //namespace monitor
+} //namespace crossover
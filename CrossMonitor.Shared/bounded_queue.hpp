@@ -0,0 +1,124 @@
+#pragma once
+
+#include <boost/noncopyable.hpp>
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+namespace crossover {
+namespace monitor {
+namespace utils {
+
+	/**
+	 * Bounded multi-producer multi-consumer lock-free FIFO queue.
+	 * Every slot carries a sequence number telling producers and consumers
+	 * whether it is free or filled, so push and pop are a single CAS on the
+	 * respective cursor plus a store to the slot. Memory is allocated once in
+	 * the constructor, push and pop never allocate.
+	 * T must be default constructible and move assignable.
+	 */
+	template<typename T>
+	class bounded_queue final : public boost::noncopyable {
+	public:
+		/**
+		 * Constructor. Throws std::invalid_argument if capacity
+		 * is not a power of two greater than one.
+		 * @param capacity Maximum number of elements held by the queue.
+		 */
+		explicit bounded_queue(std::size_t capacity)
+			: mask_(capacity - 1)
+			, cells_(new cell[capacity])
+			, enqueue_pos_(0)
+			, dequeue_pos_(0) {
+			if (capacity < 2 || (capacity & (capacity - 1)) != 0) {
+				throw std::invalid_argument(
+					"bounded_queue capacity must be a power of two: " + std::to_string(capacity));
+			}
+			for (std::size_t i = 0; i < capacity; ++i) {
+				cells_[i].sequence.store(i, std::memory_order_relaxed);
+			}
+		}
+
+		/**
+		 * Attempts to append an element. Never blocks.
+		 * @return false if the queue is full, the element is left untouched then.
+		 */
+		bool try_push(T &&value) noexcept {
+			std::size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+			for (;;) {
+				cell &c = cells_[pos & mask_];
+				const std::size_t seq = c.sequence.load(std::memory_order_acquire);
+				const std::ptrdiff_t diff =
+					static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos);
+				if (diff == 0) {
+					if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+						c.value = std::move(value);
+						c.sequence.store(pos + 1, std::memory_order_release);
+						return true;
+					}
+				} else if (diff < 0) {
+					return false;
+				} else {
+					pos = enqueue_pos_.load(std::memory_order_relaxed);
+				}
+			}
+		}
+		bool try_push(const T &value) {
+			T copy(value);
+			return try_push(std::move(copy));
+		}
+
+		/**
+		 * Attempts to take the oldest element. Never blocks.
+		 * @return false if the queue is empty.
+		 */
+		bool try_pop(T &value) noexcept {
+			std::size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+			for (;;) {
+				cell &c = cells_[pos & mask_];
+				const std::size_t seq = c.sequence.load(std::memory_order_acquire);
+				const std::ptrdiff_t diff =
+					static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos + 1);
+				if (diff == 0) {
+					if (dequeue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+						value = std::move(c.value);
+						c.value = T();
+						c.sequence.store(pos + mask_ + 1, std::memory_order_release);
+						return true;
+					}
+				} else if (diff < 0) {
+					return false;
+				} else {
+					pos = dequeue_pos_.load(std::memory_order_relaxed);
+				}
+			}
+		}
+
+		/**
+		 * Maximum number of elements held by the queue.
+		 */
+		std::size_t capacity() const noexcept {
+			return mask_ + 1;
+		}
+
+	private:
+		struct cell {
+			std::atomic<std::size_t> sequence;
+			T value;
+		};
+
+		const std::size_t mask_;
+		std::unique_ptr<cell[]> cells_;
+		// producers and consumers hammer different cursors,
+		// keep them on separate cache lines
+		alignas(64) std::atomic<std::size_t> enqueue_pos_;
+		alignas(64) std::atomic<std::size_t> dequeue_pos_;
+	}; //class bounded_queue
+
+} //namespace utils
+} //namespace monitor
+} //namespace crossover
@@ -0,0 +1,187 @@
+#include "counter_kernels.hpp"
+#include "counter_kernels_impl.hpp"
+
+#if defined(CROSSMONITOR_KERNELS_X86) && defined(_MSC_VER)
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+using namespace std;
+
+namespace crossover {
+namespace monitor {
+namespace kernels {
+
+namespace detail {
+
+	static void scalar_deltas(const uint64_t* before, const uint64_t* after,
+							  uint64_t* out, size_t count, unsigned counter_bits) {
+		if (counter_bits >= 64) {
+			for (size_t i = 0; i < count; ++i) {
+				out[i] = after[i] >= before[i] ? after[i] - before[i] : 0;
+			}
+		} else {
+			const uint64_t mask = (uint64_t(1) << counter_bits) - 1;
+			for (size_t i = 0; i < count; ++i) {
+				out[i] = (after[i] - before[i]) & mask;
+			}
+		}
+	}
+
+	static void scalar_rates(const uint64_t* deltas, double seconds, double* out, size_t count) {
+		for (size_t i = 0; i < count; ++i) {
+			out[i] = static_cast<double>(deltas[i]) / seconds;
+		}
+	}
+
+	static void scalar_percentages(const uint64_t* part, const uint64_t* whole, float* out, size_t count) {
+		for (size_t i = 0; i < count; ++i) {
+			const uint64_t clamped = min(part[i], whole[i]);
+			out[i] = whole[i]
+				? static_cast<float>(100.0 * static_cast<double>(clamped) / static_cast<double>(whole[i]))
+				: 0.f;
+		}
+	}
+
+	static void scalar_saturate(const uint64_t* values, unsigned* out, size_t count) {
+		for (size_t i = 0; i < count; ++i) {
+			out[i] = static_cast<unsigned>(min<uint64_t>(values[i], numeric_limits<unsigned>::max()));
+		}
+	}
+
+	const table scalar = { &scalar_deltas, &scalar_rates, &scalar_percentages, &scalar_saturate };
+
+} //namespace detail
+
+namespace {
+
+	bool cpu_has(isa set) noexcept {
+#if defined(CROSSMONITOR_KERNELS_X86)
+#if defined(_MSC_VER)
+		int info[4];
+		__cpuid(info, 0);
+		const int highest = info[0];
+		__cpuid(info, 1);
+		const bool sse2 = (info[3] & (1 << 26)) != 0;
+		// AVX state saved by the OS, then AVX2 itself
+		const bool avx = (info[2] & (1 << 27)) && (info[2] & (1 << 28)) &&
+			(_xgetbv(0) & 6) == 6;
+		bool avx2 = false;
+		if (avx && highest >= 7) {
+			__cpuidex(info, 7, 0);
+			avx2 = (info[1] & (1 << 5)) != 0;
+		}
+#else
+		__builtin_cpu_init();
+		const bool sse2 = __builtin_cpu_supports("sse2") != 0;
+		const bool avx2 = __builtin_cpu_supports("avx2") != 0;
+#endif
+		switch (set) {
+		case isa::scalar:
+			return true;
+		case isa::sse2:
+			return sse2;
+		case isa::avx2:
+			return avx2;
+		}
+		return false;
+#else
+		return set == isa::scalar;
+#endif
+	}
+
+	const detail::table& table_of(isa set) noexcept {
+		switch (set) {
+#if defined(CROSSMONITOR_KERNELS_X86)
+		case isa::sse2:
+			return detail::sse2;
+		case isa::avx2:
+			return detail::avx2;
+#endif
+		default:
+			return detail::scalar;
+		}
+	}
+
+	isa best() noexcept {
+		if (cpu_has(isa::avx2)) {
+			return isa::avx2;
+		}
+		return cpu_has(isa::sse2) ? isa::sse2 : isa::scalar;
+	}
+
+	// both set together by select(), read without a lock by every call
+	atomic<const detail::table*> current(nullptr);
+	atomic<isa> current_isa(isa::scalar);
+
+	const detail::table& kernel() noexcept {
+		const detail::table* res = current.load(memory_order_acquire);
+		if (!res) {
+			const isa set = best();
+			current_isa.store(set, memory_order_relaxed);
+			res = &table_of(set);
+			current.store(res, memory_order_release);
+		}
+		return *res;
+	}
+
+} //namespace
+
+const char* name(isa set) noexcept {
+	switch (set) {
+	case isa::sse2:
+		return "sse2";
+	case isa::avx2:
+		return "avx2";
+	default:
+		return "scalar";
+	}
+}
+
+bool supported(isa set) noexcept {
+	return cpu_has(set);
+}
+
+isa active() noexcept {
+	kernel();
+	return current_isa.load(memory_order_relaxed);
+}
+
+void select(isa set) {
+	if (!supported(set)) {
+		throw invalid_argument(string("instruction set not supported: ") + name(set));
+	}
+	current_isa.store(set, memory_order_relaxed);
+	current.store(&table_of(set), memory_order_release);
+}
+
+void deltas(const uint64_t* before, const uint64_t* after,
+			uint64_t* out, size_t count, unsigned counter_bits) noexcept {
+	kernel().deltas(before, after, out, count, max(1u, counter_bits));
+}
+
+void rates(const uint64_t* deltas, double seconds, double* out, size_t count) noexcept {
+	if (!(seconds > 0)) {
+		fill(out, out + count, 0.0);
+		return;
+	}
+	kernel().rates(deltas, seconds, out, count);
+}
+
+void percentages(const uint64_t* part, const uint64_t* whole, float* out, size_t count) noexcept {
+	kernel().percentages(part, whole, out, count);
+}
+
+void saturate(const uint64_t* values, unsigned* out, size_t count) noexcept {
+	kernel().saturate(values, out, count);
+}
+
+} //namespace kernels
+} //namespace monitor
+} //namespace crossover
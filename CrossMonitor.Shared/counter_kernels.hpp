@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace crossover {
+namespace monitor {
+
+/**
+ * Arithmetic the collectors do on every sample, over arrays of counters
+ * (one array per field, e.g. the bytes read of every volume): deltas
+ * between two readings, rates, percentages and narrowing to the unsigned
+ * of data. Every function has a scalar, an SSE2 and an AVX2 version,
+ * the best one the CPU supports is picked at the first call. All versions
+ * give bit for bit the same results, only the speed differs.
+ * Input and output arrays may not overlap, except out and after of deltas.
+ */
+namespace kernels {
+
+	enum class isa {
+		scalar,
+		sse2,
+		avx2
+	};
+
+	/**
+	 * @return the name of the instruction set, "scalar", "sse2" or "avx2".
+	 */
+	const char* name(isa set) noexcept;
+
+	/**
+	 * @return true if this build and the CPU it runs on can use the set.
+	 */
+	bool supported(isa set) noexcept;
+
+	/**
+	 * @return the instruction set the kernels use.
+	 */
+	isa active() noexcept;
+
+	/**
+	 * Makes the kernels use another instruction set, for tests and
+	 * benchmarks. Throws std::invalid_argument if it is not supported.
+	 */
+	void select(isa set);
+
+	/**
+	 * out[i] = after[i] - before[i]. A 64 bit counter that went backwards
+	 * was reset (reboot, device replaced) and gives 0; a narrower one
+	 * wrapped around and gives the distance modulo 2^counter_bits.
+	 * @param counter_bits width of the counters, 1 to 64.
+	 */
+	void deltas(const std::uint64_t* before, const std::uint64_t* after,
+				std::uint64_t* out, std::size_t count, unsigned counter_bits = 64) noexcept;
+
+	/**
+	 * out[i] = deltas[i] / seconds, 0 if seconds is not positive.
+	 */
+	void rates(const std::uint64_t* deltas, double seconds,
+			   double* out, std::size_t count) noexcept;
+
+	/**
+	 * out[i] = 100 * part[i] / whole[i], with part clamped to whole,
+	 * 0 where whole is 0.
+	 */
+	void percentages(const std::uint64_t* part, const std::uint64_t* whole,
+					 float* out, std::size_t count) noexcept;
+
+	/**
+	 * out[i] = values[i], UINT_MAX if it does not fit.
+	 */
+	void saturate(const std::uint64_t* values, unsigned* out, std::size_t count) noexcept;
+
+} //namespace kernels
+
+} //namespace monitor
+} //namespace crossover
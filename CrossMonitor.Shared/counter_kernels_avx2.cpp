@@ -0,0 +1,110 @@
+#include "counter_kernels_impl.hpp"
+
+#if defined(CROSSMONITOR_KERNELS_X86)
+
+#include <immintrin.h>
+
+namespace crossover {
+namespace monitor {
+namespace kernels {
+namespace detail {
+
+namespace {
+
+	const std::size_t width = 4;
+
+	/**
+	 * Exact uint64 to double with a single rounding, see the SSE2 version.
+	 */
+	inline __m256d to_double(__m256i v) {
+		const __m256i low_mask = _mm256_set1_epi64x(0xffffffff);
+		const __m256i exp52 = _mm256_set1_epi64x(0x4330000000000000LL);
+		const __m256i exp84 = _mm256_set1_epi64x(0x4530000000000000LL);
+		// 2^84 + 2^52
+		const __m256d bias = _mm256_castsi256_pd(_mm256_set1_epi64x(0x4530000000100000LL));
+
+		const __m256i low = _mm256_or_si256(_mm256_and_si256(v, low_mask), exp52);
+		const __m256i high = _mm256_or_si256(_mm256_srli_epi64(v, 32), exp84);
+		return _mm256_add_pd(_mm256_sub_pd(_mm256_castsi256_pd(high), bias), _mm256_castsi256_pd(low));
+	}
+
+	/**
+	 * All ones where a - b borrows, that is where a < b.
+	 */
+	inline __m256i borrow_mask(__m256i a, __m256i b, __m256i difference) {
+		const __m256i borrow = _mm256_or_si256(_mm256_andnot_si256(a, b),
+			_mm256_andnot_si256(_mm256_xor_si256(a, b), difference));
+		return _mm256_sub_epi64(_mm256_setzero_si256(), _mm256_srli_epi64(borrow, 63));
+	}
+
+	void deltas(const std::uint64_t* before, const std::uint64_t* after,
+				std::uint64_t* out, std::size_t count, unsigned counter_bits) {
+		std::size_t i = 0;
+		if (counter_bits >= 64) {
+			for (; i + width <= count; i += width) {
+				const __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(before + i));
+				const __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(after + i));
+				const __m256i difference = _mm256_sub_epi64(a, b);
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i),
+					_mm256_andnot_si256(borrow_mask(a, b, difference), difference));
+			}
+		} else {
+			const __m256i wrap = _mm256_set1_epi64x(static_cast<long long>((std::uint64_t(1) << counter_bits) - 1));
+			for (; i + width <= count; i += width) {
+				const __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(before + i));
+				const __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(after + i));
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm256_and_si256(_mm256_sub_epi64(a, b), wrap));
+			}
+		}
+		scalar.deltas(before + i, after + i, out + i, count - i, counter_bits);
+	}
+
+	void rates(const std::uint64_t* deltas, double seconds, double* out, std::size_t count) {
+		const __m256d divisor = _mm256_set1_pd(seconds);
+		std::size_t i = 0;
+		for (; i + width <= count; i += width) {
+			const __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(deltas + i));
+			_mm256_storeu_pd(out + i, _mm256_div_pd(to_double(d), divisor));
+		}
+		scalar.rates(deltas + i, seconds, out + i, count - i);
+	}
+
+	void percentages(const std::uint64_t* part, const std::uint64_t* whole, float* out, std::size_t count) {
+		const __m256d hundred = _mm256_set1_pd(100.0);
+		std::size_t i = 0;
+		for (; i + width <= count; i += width) {
+			const __m256i p = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(part + i));
+			const __m256i w = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(whole + i));
+			const __m256i over = borrow_mask(w, p, _mm256_sub_epi64(w, p));
+			const __m256i clamped = _mm256_blendv_epi8(p, w, over);
+			const __m256d percent = _mm256_div_pd(_mm256_mul_pd(hundred, to_double(clamped)), to_double(w));
+			const __m256i empty = _mm256_cmpeq_epi64(w, _mm256_setzero_si256());
+			const __m256d res = _mm256_andnot_pd(_mm256_castsi256_pd(empty), percent);
+			_mm_storeu_ps(out + i, _mm256_cvtpd_ps(res));
+		}
+		scalar.percentages(part + i, whole + i, out + i, count - i);
+	}
+
+	void saturate(const std::uint64_t* values, unsigned* out, std::size_t count) {
+		const __m256i low_halves = _mm256_setr_epi32(0, 2, 4, 6, 0, 2, 4, 6);
+		std::size_t i = 0;
+		for (; i + width <= count; i += width) {
+			const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(values + i));
+			const __m256i fits = _mm256_cmpeq_epi64(_mm256_srli_epi64(v, 32), _mm256_setzero_si256());
+			const __m256i res = _mm256_or_si256(v, _mm256_andnot_si256(fits, _mm256_set1_epi32(-1)));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i),
+				_mm256_castsi256_si128(_mm256_permutevar8x32_epi32(res, low_halves)));
+		}
+		scalar.saturate(values + i, out + i, count - i);
+	}
+
+} //namespace
+
+const table avx2 = { &deltas, &rates, &percentages, &saturate };
+
+} //namespace detail
+} //namespace kernels
+} //namespace monitor
+} //namespace crossover
+
+#endif
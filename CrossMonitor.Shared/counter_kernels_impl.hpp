@@ -0,0 +1,44 @@
+#pragma once
+
+/**
+ * Internal to the counter_kernels*.cpp files. The SSE2 and AVX2 versions
+ * live in files of their own, built with the instruction set enabled, and
+ * include nothing but this and the intrinsics: an inline function of a
+ * standard header instantiated there could replace the plain one elsewhere.
+ */
+
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define CROSSMONITOR_KERNELS_X86
+#endif
+
+namespace crossover {
+namespace monitor {
+namespace kernels {
+namespace detail {
+
+	struct table {
+		void (*deltas)(const std::uint64_t* before, const std::uint64_t* after,
+					   std::uint64_t* out, std::size_t count, unsigned counter_bits);
+		void (*rates)(const std::uint64_t* deltas, double seconds, double* out, std::size_t count);
+		void (*percentages)(const std::uint64_t* part, const std::uint64_t* whole,
+							float* out, std::size_t count);
+		void (*saturate)(const std::uint64_t* values, unsigned* out, std::size_t count);
+	};
+
+	/**
+	 * The reference versions, the vector ones use them for the elements
+	 * left over after the last full vector.
+	 */
+	extern const table scalar;
+#if defined(CROSSMONITOR_KERNELS_X86)
+	extern const table sse2;
+	extern const table avx2;
+#endif
+
+} //namespace detail
+} //namespace kernels
+} //namespace monitor
+} //namespace crossover
@@ -0,0 +1,120 @@
+#include "counter_kernels_impl.hpp"
+
+#if defined(CROSSMONITOR_KERNELS_X86)
+
+#include <emmintrin.h>
+
+namespace crossover {
+namespace monitor {
+namespace kernels {
+namespace detail {
+
+namespace {
+
+	const std::size_t width = 2;
+
+	/**
+	 * Exact uint64 to double with a single rounding, like the cast:
+	 * the high and the low half go into the mantissas of 2^84 and 2^52.
+	 */
+	inline __m128d to_double(__m128i v) {
+		const __m128i low_mask = _mm_set_epi32(0, -1, 0, -1);
+		const __m128i exp52 = _mm_set_epi32(0x43300000, 0, 0x43300000, 0);
+		const __m128i exp84 = _mm_set_epi32(0x45300000, 0, 0x45300000, 0);
+		// 2^84 + 2^52
+		const __m128d bias = _mm_castsi128_pd(_mm_set_epi32(0x45300000, 0x00100000, 0x45300000, 0x00100000));
+
+		const __m128i low = _mm_or_si128(_mm_and_si128(v, low_mask), exp52);
+		const __m128i high = _mm_or_si128(_mm_srli_epi64(v, 32), exp84);
+		return _mm_add_pd(_mm_sub_pd(_mm_castsi128_pd(high), bias), _mm_castsi128_pd(low));
+	}
+
+	/**
+	 * All ones where a - b borrows, that is where a < b.
+	 */
+	inline __m128i borrow_mask(__m128i a, __m128i b, __m128i difference) {
+		const __m128i borrow = _mm_or_si128(_mm_andnot_si128(a, b),
+			_mm_andnot_si128(_mm_xor_si128(a, b), difference));
+		return _mm_sub_epi64(_mm_setzero_si128(), _mm_srli_epi64(borrow, 63));
+	}
+
+	/**
+	 * All ones where v is 0.
+	 */
+	inline __m128i zero_mask(__m128i v) {
+		const __m128i halves = _mm_cmpeq_epi32(v, _mm_setzero_si128());
+		return _mm_and_si128(halves, _mm_shuffle_epi32(halves, _MM_SHUFFLE(2, 3, 0, 1)));
+	}
+
+	void deltas(const std::uint64_t* before, const std::uint64_t* after,
+				std::uint64_t* out, std::size_t count, unsigned counter_bits) {
+		std::size_t i = 0;
+		if (counter_bits >= 64) {
+			for (; i + width <= count; i += width) {
+				const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(before + i));
+				const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(after + i));
+				const __m128i difference = _mm_sub_epi64(a, b);
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i),
+					_mm_andnot_si128(borrow_mask(a, b, difference), difference));
+			}
+		} else {
+			const std::uint64_t mask = (std::uint64_t(1) << counter_bits) - 1;
+			const __m128i wrap = _mm_set_epi32(static_cast<int>(mask >> 32), static_cast<int>(mask),
+				static_cast<int>(mask >> 32), static_cast<int>(mask));
+			for (; i + width <= count; i += width) {
+				const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(before + i));
+				const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(after + i));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_and_si128(_mm_sub_epi64(a, b), wrap));
+			}
+		}
+		scalar.deltas(before + i, after + i, out + i, count - i, counter_bits);
+	}
+
+	void rates(const std::uint64_t* deltas, double seconds, double* out, std::size_t count) {
+		const __m128d divisor = _mm_set1_pd(seconds);
+		std::size_t i = 0;
+		for (; i + width <= count; i += width) {
+			const __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(deltas + i));
+			_mm_storeu_pd(out + i, _mm_div_pd(to_double(d), divisor));
+		}
+		scalar.rates(deltas + i, seconds, out + i, count - i);
+	}
+
+	void percentages(const std::uint64_t* part, const std::uint64_t* whole, float* out, std::size_t count) {
+		const __m128d hundred = _mm_set1_pd(100.0);
+		std::size_t i = 0;
+		for (; i + width <= count; i += width) {
+			const __m128i p = _mm_loadu_si128(reinterpret_cast<const __m128i*>(part + i));
+			const __m128i w = _mm_loadu_si128(reinterpret_cast<const __m128i*>(whole + i));
+			// part clamped to whole: whole where whole - part borrows
+			const __m128i over = borrow_mask(w, p, _mm_sub_epi64(w, p));
+			const __m128i clamped = _mm_or_si128(_mm_andnot_si128(over, p), _mm_and_si128(over, w));
+			const __m128d percent = _mm_div_pd(_mm_mul_pd(hundred, to_double(clamped)), to_double(w));
+			const __m128d res = _mm_andnot_pd(_mm_castsi128_pd(zero_mask(w)), percent);
+			_mm_storel_pi(reinterpret_cast<__m64*>(out + i), _mm_cvtpd_ps(res));
+		}
+		scalar.percentages(part + i, whole + i, out + i, count - i);
+	}
+
+	void saturate(const std::uint64_t* values, unsigned* out, std::size_t count) {
+		std::size_t i = 0;
+		for (; i + width <= count; i += width) {
+			const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(values + i));
+			// the low half, or all ones where the high half is not 0
+			const __m128i fits = _mm_cmpeq_epi32(_mm_srli_epi64(v, 32), _mm_setzero_si128());
+			const __m128i res = _mm_or_si128(v, _mm_andnot_si128(fits, _mm_set1_epi32(-1)));
+			_mm_storel_epi64(reinterpret_cast<__m128i*>(out + i), _mm_shuffle_epi32(res, _MM_SHUFFLE(3, 1, 2, 0)));
+		}
+		scalar.saturate(values + i, out + i, count - i);
+	}
+
+} //namespace
+
+const table sse2 = { &deltas, &rates, &percentages, &saturate };
+
+} //namespace detail
+} //namespace kernels
+} //namespace monitor
+} //namespace crossover
+
+#endif
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstdint>
 #include <stdexcept>
 #include <string>
 #include <vector>
@@ -17,6 +18,230 @@ struct IO_stat {
 };
 typedef std::vector<IO_stat<unsigned>> IO_stats;
 
+/**
+ * Capacity of one mounted filesystem. Filesystems without inodes, as
+ * NTFS, report none.
+ */
+struct fs_stat {
+	/**
+	 * UTF-8 path of the mount point, a drive root on Windows.
+	 */
+	std::string mount_point;
+	std::uint64_t size_bytes;
+	std::uint64_t used_bytes;
+	/**
+	 * Free bytes unprivileged users can take, less than size_bytes -
+	 * used_bytes when blocks are reserved for root.
+	 */
+	std::uint64_t available_bytes;
+	std::uint64_t inodes;
+	std::uint64_t inodes_used;
+
+	bool operator==(const fs_stat &rhs) const noexcept {
+		return mount_point == rhs.mount_point && size_bytes == rhs.size_bytes &&
+			used_bytes == rhs.used_bytes && available_bytes == rhs.available_bytes &&
+			inodes == rhs.inodes && inodes_used == rhs.inodes_used;
+	}
+};
+typedef std::vector<fs_stat> fs_stats;
+
+/**
+ * Use of one NUMA node over a sample interval.
+ */
+struct numa_node_stat {
+	/**
+	 * Node number, as in /sys/devices/system/node/node<n>.
+	 */
+	unsigned node;
+	/**
+	 * Use of the CPUs of the node, 0 to 100.
+	 */
+	float cpu_percent;
+	/**
+	 * Use of the memory of the node, 0 to 100.
+	 */
+	float memory_percent;
+	/**
+	 * Pages allocated on the node during the interval although the
+	 * process wanted another one (numa_miss), and pages allocated on
+	 * another node although the process wanted this one (numa_foreign).
+	 */
+	std::uint64_t numa_miss;
+	std::uint64_t numa_foreign;
+
+	bool operator==(const numa_node_stat &rhs) const noexcept {
+		return node == rhs.node && cpu_percent == rhs.cpu_percent && memory_percent == rhs.memory_percent &&
+			numa_miss == rhs.numa_miss && numa_foreign == rhs.numa_foreign;
+	}
+};
+typedef std::vector<numa_node_stat> numa_stats;
+
+/**
+ * Clock and throttling of every CPU over a sample interval, as flat
+ * arrays of one value per CPU, in the order of cpus. A value a CPU does
+ * not report is 0.
+ */
+struct cpu_core_stats {
+	/**
+	 * CPU numbers, as in /sys/devices/system/cpu/cpu<n>.
+	 */
+	std::vector<unsigned> cpus;
+	/**
+	 * Clock at the end of the interval, as cpufreq reports it.
+	 */
+	std::vector<std::uint32_t> frequency_khz;
+	/**
+	 * Average clock while the CPU was busy during the interval, from its
+	 * APERF and MPERF counters.
+	 */
+	std::vector<std::uint32_t> effective_frequency_khz;
+	/**
+	 * Times the core, and the package of the CPU, were throttled for
+	 * heat during the interval. CPUs of one package report the same
+	 * package throttles.
+	 */
+	std::vector<std::uint64_t> core_throttles;
+	std::vector<std::uint64_t> package_throttles;
+
+	std::size_t size() const noexcept {
+		return cpus.size();
+	}
+	bool empty() const noexcept {
+		return cpus.empty();
+	}
+	void resize(std::size_t count) {
+		cpus.resize(count);
+		frequency_khz.resize(count);
+		effective_frequency_khz.resize(count);
+		core_throttles.resize(count);
+		package_throttles.resize(count);
+	}
+
+	bool operator==(const cpu_core_stats &rhs) const noexcept {
+		return cpus == rhs.cpus && frequency_khz == rhs.frequency_khz &&
+			effective_frequency_khz == rhs.effective_frequency_khz &&
+			core_throttles == rhs.core_throttles && package_throttles == rhs.package_throttles;
+	}
+};
+
+/**
+ * Run-queue delay of every CPU over a sample interval, as flat arrays of
+ * one value per CPU, in the order of cpus.
+ */
+struct run_queue_stats {
+	std::vector<unsigned> cpus;
+	/**
+	 * Mean time a task waited on the run queue of the CPU before each of
+	 * its timeslices, 0 without timeslices.
+	 */
+	std::vector<float> delay_us;
+	/**
+	 * Share of the time tasks were runnable on the CPU that they spent
+	 * waiting for it, 0 to 1: 0.5 is one task waiting for each running.
+	 */
+	std::vector<float> wait_ratio;
+
+	std::size_t size() const noexcept {
+		return cpus.size();
+	}
+	bool empty() const noexcept {
+		return cpus.empty();
+	}
+	void resize(std::size_t count) {
+		cpus.resize(count);
+		delay_us.resize(count);
+		wait_ratio.resize(count);
+	}
+
+	bool operator==(const run_queue_stats &rhs) const noexcept {
+		return cpus == rhs.cpus && delay_us == rhs.delay_us && wait_ratio == rhs.wait_ratio;
+	}
+};
+
+/**
+ * Run-queue delay of one process over a sample interval, as of
+ * run_queue_stats.
+ */
+struct process_run_queue {
+	unsigned pid;
+	float delay_us;
+	float wait_ratio;
+
+	bool operator==(const process_run_queue &rhs) const noexcept {
+		return pid == rhs.pid && delay_us == rhs.delay_us && wait_ratio == rhs.wait_ratio;
+	}
+};
+typedef std::vector<process_run_queue> process_run_queues;
+
+/**
+ * Health of the TCP/IP stack: events over a sample interval, as counted
+ * by /proc/net/snmp and /proc/net/netstat, and the sockets open at its end,
+ * as /proc/net/sockstat lists them.
+ */
+struct net_stats {
+	/**
+	 * TCP segments sent again.
+	 */
+	std::uint64_t tcp_retransmits;
+	/**
+	 * TCP resets sent, and connections reset while established or
+	 * closing on the peer.
+	 */
+	std::uint64_t tcp_resets_sent;
+	std::uint64_t tcp_established_resets;
+	/**
+	 * Connections dropped because a listen queue was full, and for any
+	 * reason before they were accepted.
+	 */
+	std::uint64_t listen_overflows;
+	std::uint64_t listen_drops;
+	/**
+	 * UDP datagrams dropped because a socket receive buffer was full.
+	 */
+	std::uint64_t udp_receive_buffer_errors;
+	/**
+	 * Sockets of every kind, TCP sockets in use, orphaned and in TIME_WAIT,
+	 * and UDP sockets in use.
+	 */
+	std::uint32_t sockets;
+	std::uint32_t tcp_sockets;
+	std::uint32_t tcp_orphans;
+	std::uint32_t tcp_time_wait;
+	std::uint32_t udp_sockets;
+	/**
+	 * Memory the TCP and UDP sockets hold.
+	 */
+	std::uint64_t tcp_memory_bytes;
+	std::uint64_t udp_memory_bytes;
+
+	bool operator==(const net_stats &rhs) const noexcept {
+		return tcp_retransmits == rhs.tcp_retransmits && tcp_resets_sent == rhs.tcp_resets_sent &&
+			tcp_established_resets == rhs.tcp_established_resets && listen_overflows == rhs.listen_overflows &&
+			listen_drops == rhs.listen_drops && udp_receive_buffer_errors == rhs.udp_receive_buffer_errors &&
+			sockets == rhs.sockets && tcp_sockets == rhs.tcp_sockets && tcp_orphans == rhs.tcp_orphans &&
+			tcp_time_wait == rhs.tcp_time_wait && udp_sockets == rhs.udp_sockets &&
+			tcp_memory_bytes == rhs.tcp_memory_bytes && udp_memory_bytes == rhs.udp_memory_bytes;
+	}
+	bool operator!=(const net_stats &rhs) const noexcept {
+		return !(*this == rhs);
+	}
+};
+
+/**
+ * The parts of a data sample, each read from a source of its own, as
+ * bits of a mask, see data::get_fresh().
+ */
+enum data_part : unsigned {
+	cpu_part = 1 << 0,
+	memory_part = 1 << 1,
+	process_part = 1 << 2,
+	io_part = 1 << 3,
+	fs_part = 1 << 4,
+	numa_part = 1 << 5,
+	net_part = 1 << 6,
+	all_parts = cpu_part | memory_part | process_part | io_part | fs_part | numa_part | net_part
+};
+
 /**
  * Class representing the data sent and received 
  * by both client and server components.
@@ -33,7 +258,13 @@ public:
 	data(	float cpu_percent,
 			float memory_percent,
 			unsigned process_count,
-			const IO_stats &io_stats) {
+			const IO_stats &io_stats)
+		: cpu_percent_(0.f)
+		, run_queue_delay_us_(0.f)
+		, run_queue_wait_ratio_(0.f)
+		, net_stats_()
+		, has_net_stats_(false)
+		, fresh_(all_parts) {
 		set_cpu_percent(cpu_percent);
 		set_memory_percent(memory_percent);
 		set_process_count(process_count);
@@ -41,7 +272,12 @@ public:
 	}
 
 	data()
-		: cpu_percent_(-1.f) {
+		: cpu_percent_(0.f)
+		, run_queue_delay_us_(0.f)
+		, run_queue_wait_ratio_(0.f)
+		, net_stats_()
+		, has_net_stats_(false)
+		, fresh_(all_parts) {
 	}
 
 	data& operator=(const data& rhs) = default;	
@@ -55,7 +291,7 @@ public:
 			throw std::invalid_argument(
 				"cpu_percent out of range: " + std::to_string(cpu_percent));
 		}
-		cpu_percent_ = cpu_percent_ < 0.f ? 0.f : cpu_percent;
+		cpu_percent_ = cpu_percent;
 	}
 	float get_cpu_percent() const noexcept {
 		return cpu_percent_;
@@ -121,39 +357,454 @@ public:
 	}
 
 	/**
-	* convert data into JSON format.
+	* Setter. Throws std::invalid_argument if the arrays differ in size.
+	* The cores are part of the CPU part of a sample.
+	*/
+	void set_cpu_cores(const cpu_core_stats &cores) {
+		const std::size_t count = cores.cpus.size();
+		if (cores.frequency_khz.size() != count || cores.effective_frequency_khz.size() != count ||
+			cores.core_throttles.size() != count || cores.package_throttles.size() != count) {
+			throw std::invalid_argument("cpu_cores arrays differ in size");
+		}
+		cpu_cores_ = cores;
+	}
+	const cpu_core_stats &get_cpu_cores() const noexcept {
+		return cpu_cores_;
+	}
+
+	/**
+	* Setter. Throws std::invalid_argument if the arrays differ in size or
+	* a value is out of range. The run queues are part of the CPU part of
+	* a sample, with run_queue_delay_us and run_queue_wait_ratio over all
+	* CPUs.
+	* @param delay_us mean delay of a timeslice on any CPU.
+	* @param wait_ratio share of the runnable time of all CPUs spent waiting.
+	*/
+	void set_run_queues(const run_queue_stats &cpus, float delay_us, float wait_ratio) {
+		const std::size_t count = cpus.cpus.size();
+		if (cpus.delay_us.size() != count || cpus.wait_ratio.size() != count) {
+			throw std::invalid_argument("run_queues arrays differ in size");
+		}
+		for (std::size_t i = 0; i < count; ++i) {
+			check_run_queue(cpus.delay_us[i], cpus.wait_ratio[i]);
+		}
+		check_run_queue(delay_us, wait_ratio);
+		run_queues_ = cpus;
+		run_queue_delay_us_ = delay_us;
+		run_queue_wait_ratio_ = wait_ratio;
+	}
+	const run_queue_stats &get_run_queues() const noexcept {
+		return run_queues_;
+	}
+	float get_run_queue_delay_us() const noexcept {
+		return run_queue_delay_us_;
+	}
+	float get_run_queue_wait_ratio() const noexcept {
+		return run_queue_wait_ratio_;
+	}
+
+	/**
+	* Setter. Throws std::invalid_argument if a value is out of range.
+	* @param processes the processes that waited the longest during the
+	* interval, longest first. Part of the CPU part of a sample.
+	*/
+	void set_process_run_queues(const process_run_queues &processes) {
+		for (const auto &process : processes) {
+			check_run_queue(process.delay_us, process.wait_ratio);
+		}
+		process_run_queues_ = processes;
+	}
+	const process_run_queues &get_process_run_queues() const noexcept {
+		return process_run_queues_;
+	}
+
+	/**
+	* Setter. Throws std::invalid_argument if a mount point is empty or a
+	* filesystem uses more bytes or inodes than it has.
+	*/
+	void set_fs_stats(const fs_stats &filesystems) {
+		for (const auto &fs : filesystems) {
+			if (fs.mount_point.empty()) {
+				throw std::invalid_argument("mount_point cannot be empty");
+			}
+			if (fs.used_bytes > fs.size_bytes || fs.available_bytes > fs.size_bytes) {
+				throw std::invalid_argument("filesystem bytes out of range: " + fs.mount_point);
+			}
+			if (fs.inodes_used > fs.inodes) {
+				throw std::invalid_argument("filesystem inodes out of range: " + fs.mount_point);
+			}
+		}
+		fs_stats_ = filesystems;
+	}
+	const fs_stats &get_fs_stats() const noexcept {
+		return fs_stats_;
+	}
+
+	/**
+	* Setter. Throws std::invalid_argument if a percentage is out of range
+	* or a node is listed twice.
+	*/
+	void set_numa_stats(const numa_stats &nodes) {
+		for (auto it = nodes.begin(); it != nodes.end(); ++it) {
+			if (it->cpu_percent < 0 || it->cpu_percent > 100 ||
+				it->memory_percent < 0 || it->memory_percent > 100) {
+				throw std::invalid_argument("NUMA node percent out of range: " + std::to_string(it->node));
+			}
+			for (auto other = nodes.begin(); other != it; ++other) {
+				if (other->node == it->node) {
+					throw std::invalid_argument("NUMA node listed twice: " + std::to_string(it->node));
+				}
+			}
+		}
+		numa_stats_ = nodes;
+	}
+	const numa_stats &get_numa_stats() const noexcept {
+		return numa_stats_;
+	}
+
+	/**
+	* Setter. Samples of a machine whose network is not read have none.
+	*/
+	void set_net_stats(const net_stats &net) noexcept {
+		net_stats_ = net;
+		has_net_stats_ = true;
+	}
+	const net_stats &get_net_stats() const noexcept {
+		return net_stats_;
+	}
+	bool has_net_stats() const noexcept {
+		return has_net_stats_;
+	}
+
+	/**
+	* Setter. Throws std::invalid_argument if the argument is out of range.
+	* @param parts data_part bits of the parts read for this sample, the
+	* others hold the values of an earlier one.
+	*/
+	void set_fresh(unsigned parts) {
+		if ((parts & ~static_cast<unsigned>(all_parts)) != 0) {
+			throw std::invalid_argument("unknown data parts: " + std::to_string(parts));
+		}
+		fresh_ = parts;
+	}
+	unsigned get_fresh() const noexcept {
+		return fresh_;
+	}
+
+	/**
+	* convert data into JSON format. A sample with parts of an earlier one
+	* lists the fields read for it under "fresh".
 	*/
 	web::json::value to_json() const {
 		web::json::value out;
-		out[L"cpu_percent"] = cpu_percent_;
-		out[L"process_count"] = process_count_;
-		out[L"memory_percent"] = memory_percent_;
+		out[U("cpu_percent")] = cpu_percent_;
+		if (!run_queues_.empty()) {
+			out[U("run_queue_delay_us")] = run_queue_delay_us_;
+			out[U("run_queue_wait_ratio")] = run_queue_wait_ratio_;
+			web::json::value cpus;
+			cpus[U("cpu")] = array_of(run_queues_.cpus);
+			cpus[U("delay_us")] = array_of(run_queues_.delay_us);
+			cpus[U("wait_ratio")] = array_of(run_queues_.wait_ratio);
+			out[U("run_queues")] = cpus;
+		}
+		if (!process_run_queues_.empty()) {
+			std::vector<web::json::value> processes;
+			for (const auto &process : process_run_queues_) {
+				web::json::value p;
+				p[U("pid")] = process.pid;
+				p[U("delay_us")] = process.delay_us;
+				p[U("wait_ratio")] = process.wait_ratio;
+				processes.push_back(p);
+			}
+			out[U("process_run_queues")] = web::json::value::array(processes);
+		}
+		out[U("process_count")] = process_count_;
+		out[U("memory_percent")] = memory_percent_;
 
 		std::vector<web::json::value> parts;
 		for (const auto &io_stat : io_stats_) {
 			web::json::value part_details;
-			part_details[L"bytes_read"] = io_stat.bytes_read;
-			part_details[L"bytes_written"] = io_stat.bytes_written;
+			part_details[U("bytes_read")] = io_stat.bytes_read;
+			part_details[U("bytes_written")] = io_stat.bytes_written;
 
 			web::json::value part;
-			std::wstring str(&io_stat.partition_name, 1);
+			utility::string_t str(1, static_cast<utility::char_t>(io_stat.partition_name));
 			part[str] = part_details;
 
 			parts.push_back(part);
 		}
 
 		if (!parts.empty()) {
-			out[L"volumme_io"] = web::json::value::array(parts);
+			out[U("volumme_io")] = web::json::value::array(parts);
+		}
+
+		if (!cpu_cores_.empty()) {
+			web::json::value cores;
+			cores[U("cpu")] = array_of(cpu_cores_.cpus);
+			cores[U("frequency_khz")] = array_of(cpu_cores_.frequency_khz);
+			cores[U("effective_frequency_khz")] = array_of(cpu_cores_.effective_frequency_khz);
+			cores[U("core_throttles")] = array_of(cpu_cores_.core_throttles);
+			cores[U("package_throttles")] = array_of(cpu_cores_.package_throttles);
+			out[U("cpu_cores")] = cores;
+		}
+
+		if (!fs_stats_.empty()) {
+			std::vector<web::json::value> filesystems;
+			for (const auto &fs : fs_stats_) {
+				web::json::value filesystem;
+				filesystem[U("mount_point")] = web::json::value(utility::conversions::to_string_t(fs.mount_point));
+				filesystem[U("size_bytes")] = web::json::value(fs.size_bytes);
+				filesystem[U("used_bytes")] = web::json::value(fs.used_bytes);
+				filesystem[U("available_bytes")] = web::json::value(fs.available_bytes);
+				filesystem[U("inodes")] = web::json::value(fs.inodes);
+				filesystem[U("inodes_used")] = web::json::value(fs.inodes_used);
+				filesystems.push_back(filesystem);
+			}
+			out[U("filesystems")] = web::json::value::array(filesystems);
+		}
+
+		if (!numa_stats_.empty()) {
+			std::vector<web::json::value> nodes;
+			for (const auto &stat : numa_stats_) {
+				web::json::value node;
+				node[U("node")] = stat.node;
+				node[U("cpu_percent")] = stat.cpu_percent;
+				node[U("memory_percent")] = stat.memory_percent;
+				node[U("numa_miss")] = web::json::value(stat.numa_miss);
+				node[U("numa_foreign")] = web::json::value(stat.numa_foreign);
+				nodes.push_back(node);
+			}
+			out[U("numa_nodes")] = web::json::value::array(nodes);
+		}
+
+		if (has_net_stats_) {
+			web::json::value net;
+			net[U("tcp_retransmits")] = web::json::value(net_stats_.tcp_retransmits);
+			net[U("tcp_resets_sent")] = web::json::value(net_stats_.tcp_resets_sent);
+			net[U("tcp_established_resets")] = web::json::value(net_stats_.tcp_established_resets);
+			net[U("listen_overflows")] = web::json::value(net_stats_.listen_overflows);
+			net[U("listen_drops")] = web::json::value(net_stats_.listen_drops);
+			net[U("udp_receive_buffer_errors")] = web::json::value(net_stats_.udp_receive_buffer_errors);
+			net[U("sockets")] = net_stats_.sockets;
+			net[U("tcp_sockets")] = net_stats_.tcp_sockets;
+			net[U("tcp_orphans")] = net_stats_.tcp_orphans;
+			net[U("tcp_time_wait")] = net_stats_.tcp_time_wait;
+			net[U("udp_sockets")] = net_stats_.udp_sockets;
+			net[U("tcp_memory_bytes")] = web::json::value(net_stats_.tcp_memory_bytes);
+			net[U("udp_memory_bytes")] = web::json::value(net_stats_.udp_memory_bytes);
+			out[U("net")] = net;
+		}
+
+		if (fresh_ != all_parts) {
+			std::vector<web::json::value> fresh;
+			for (unsigned i = 0; i < part_count; ++i) {
+				if (fresh_ & (1u << i)) {
+					fresh.push_back(web::json::value(part_names()[i]));
+				}
+			}
+			out[U("fresh")] = web::json::value::array(fresh);
 		}
 
 		return out;
 	}
 
+	/**
+	* read data written by to_json(). Throws std::invalid_argument if a field
+	* is missing, of the wrong type or out of range.
+	*/
+	static data from_json(const web::json::value &value) {
+		try {
+			IO_stats io_stats;
+			if (value.is_object() && value.has_field(U("volumme_io"))) {
+				for (const auto &part : value.at(U("volumme_io")).as_array()) {
+					for (const auto &partition : part.as_object()) {
+						if (partition.first.size() != 1) {
+							throw std::invalid_argument("partition name must be one character");
+						}
+						const web::json::value &details = partition.second;
+						io_stats.push_back({
+							field(details, U("bytes_read")).as_number().to_uint32(),
+							field(details, U("bytes_written")).as_number().to_uint32(),
+							static_cast<wchar_t>(partition.first[0]) });
+					}
+				}
+			}
+
+			data res(
+				static_cast<float>(field(value, U("cpu_percent")).as_double()),
+				static_cast<float>(field(value, U("memory_percent")).as_double()),
+				field(value, U("process_count")).as_number().to_uint32(),
+				io_stats);
+
+			if (value.has_field(U("cpu_cores"))) {
+				const web::json::value &cores = value.at(U("cpu_cores"));
+				cpu_core_stats stats;
+				for (const auto &v : field(cores, U("cpu")).as_array()) {
+					stats.cpus.push_back(v.as_number().to_uint32());
+				}
+				for (const auto &v : field(cores, U("frequency_khz")).as_array()) {
+					stats.frequency_khz.push_back(v.as_number().to_uint32());
+				}
+				for (const auto &v : field(cores, U("effective_frequency_khz")).as_array()) {
+					stats.effective_frequency_khz.push_back(v.as_number().to_uint32());
+				}
+				for (const auto &v : field(cores, U("core_throttles")).as_array()) {
+					stats.core_throttles.push_back(v.as_number().to_uint64());
+				}
+				for (const auto &v : field(cores, U("package_throttles")).as_array()) {
+					stats.package_throttles.push_back(v.as_number().to_uint64());
+				}
+				res.set_cpu_cores(stats);
+			}
+
+			if (value.has_field(U("run_queues"))) {
+				const web::json::value &queues = value.at(U("run_queues"));
+				run_queue_stats cpus;
+				for (const auto &v : field(queues, U("cpu")).as_array()) {
+					cpus.cpus.push_back(v.as_number().to_uint32());
+				}
+				for (const auto &v : field(queues, U("delay_us")).as_array()) {
+					cpus.delay_us.push_back(static_cast<float>(v.as_double()));
+				}
+				for (const auto &v : field(queues, U("wait_ratio")).as_array()) {
+					cpus.wait_ratio.push_back(static_cast<float>(v.as_double()));
+				}
+				res.set_run_queues(cpus,
+					static_cast<float>(field(value, U("run_queue_delay_us")).as_double()),
+					static_cast<float>(field(value, U("run_queue_wait_ratio")).as_double()));
+			}
+
+			if (value.has_field(U("process_run_queues"))) {
+				process_run_queues processes;
+				for (const auto &p : value.at(U("process_run_queues")).as_array()) {
+					processes.push_back({
+						field(p, U("pid")).as_number().to_uint32(),
+						static_cast<float>(field(p, U("delay_us")).as_double()),
+						static_cast<float>(field(p, U("wait_ratio")).as_double()) });
+				}
+				res.set_process_run_queues(processes);
+			}
+
+			if (value.has_field(U("filesystems"))) {
+				fs_stats filesystems;
+				for (const auto &filesystem : value.at(U("filesystems")).as_array()) {
+					filesystems.push_back({
+						utility::conversions::to_utf8string(field(filesystem, U("mount_point")).as_string()),
+						field(filesystem, U("size_bytes")).as_number().to_uint64(),
+						field(filesystem, U("used_bytes")).as_number().to_uint64(),
+						field(filesystem, U("available_bytes")).as_number().to_uint64(),
+						field(filesystem, U("inodes")).as_number().to_uint64(),
+						field(filesystem, U("inodes_used")).as_number().to_uint64() });
+				}
+				res.set_fs_stats(filesystems);
+			}
+
+			if (value.has_field(U("numa_nodes"))) {
+				numa_stats nodes;
+				for (const auto &node : value.at(U("numa_nodes")).as_array()) {
+					nodes.push_back({
+						field(node, U("node")).as_number().to_uint32(),
+						static_cast<float>(field(node, U("cpu_percent")).as_double()),
+						static_cast<float>(field(node, U("memory_percent")).as_double()),
+						field(node, U("numa_miss")).as_number().to_uint64(),
+						field(node, U("numa_foreign")).as_number().to_uint64() });
+				}
+				res.set_numa_stats(nodes);
+			}
+
+			if (value.has_field(U("net"))) {
+				const web::json::value &net = value.at(U("net"));
+				net_stats stats;
+				stats.tcp_retransmits = field(net, U("tcp_retransmits")).as_number().to_uint64();
+				stats.tcp_resets_sent = field(net, U("tcp_resets_sent")).as_number().to_uint64();
+				stats.tcp_established_resets = field(net, U("tcp_established_resets")).as_number().to_uint64();
+				stats.listen_overflows = field(net, U("listen_overflows")).as_number().to_uint64();
+				stats.listen_drops = field(net, U("listen_drops")).as_number().to_uint64();
+				stats.udp_receive_buffer_errors = field(net, U("udp_receive_buffer_errors")).as_number().to_uint64();
+				stats.sockets = field(net, U("sockets")).as_number().to_uint32();
+				stats.tcp_sockets = field(net, U("tcp_sockets")).as_number().to_uint32();
+				stats.tcp_orphans = field(net, U("tcp_orphans")).as_number().to_uint32();
+				stats.tcp_time_wait = field(net, U("tcp_time_wait")).as_number().to_uint32();
+				stats.udp_sockets = field(net, U("udp_sockets")).as_number().to_uint32();
+				stats.tcp_memory_bytes = field(net, U("tcp_memory_bytes")).as_number().to_uint64();
+				stats.udp_memory_bytes = field(net, U("udp_memory_bytes")).as_number().to_uint64();
+				res.set_net_stats(stats);
+			}
+
+			if (value.has_field(U("fresh"))) {
+				unsigned fresh = 0;
+				for (const auto &name : value.at(U("fresh")).as_array()) {
+					unsigned i = 0;
+					while (i < part_count && part_names()[i] != name.as_string()) {
+						++i;
+					}
+					if (i == part_count) {
+						throw std::invalid_argument("unknown fresh field: " + utility::conversions::to_utf8string(name.as_string()));
+					}
+					fresh |= 1u << i;
+				}
+				res.set_fresh(fresh);
+			}
+			return res;
+		} catch (const web::json::json_exception &e) {
+			throw std::invalid_argument(std::string("malformed data: ") + e.what());
+		}
+	}
+
 private:
+	static const unsigned part_count = 7;
+
+	/**
+	 * JSON field of every data_part, in bit order.
+	 */
+	static const utility::char_t *const *part_names() noexcept {
+		static const utility::char_t *const names[part_count] = {
+			U("cpu_percent"), U("memory_percent"), U("process_count"), U("volumme_io"), U("filesystems"), U("numa_nodes"),
+			U("net")
+		};
+		return names;
+	}
+
+	static void check_run_queue(float delay_us, float wait_ratio) {
+		if (!(delay_us >= 0)) {
+			throw std::invalid_argument("run queue delay_us out of range: " + std::to_string(delay_us));
+		}
+		if (!(wait_ratio >= 0 && wait_ratio <= 1)) {
+			throw std::invalid_argument("run queue wait_ratio out of range: " + std::to_string(wait_ratio));
+		}
+	}
+
+	template<typename T>
+	static web::json::value array_of(const std::vector<T> &values) {
+		std::vector<web::json::value> res;
+		res.reserve(values.size());
+		for (const T v : values) {
+			res.push_back(web::json::value(v));
+		}
+		return web::json::value::array(res);
+	}
+
+	static const web::json::value &field(const web::json::value &value, const utility::string_t &name) {
+		if (!value.is_object() || !value.has_field(name)) {
+			throw std::invalid_argument("missing field: " + utility::conversions::to_utf8string(name));
+		}
+		return value.at(name);
+	}
+
 	float cpu_percent_;
+	run_queue_stats run_queues_;
+	float run_queue_delay_us_;
+	float run_queue_wait_ratio_;
+	process_run_queues process_run_queues_;
 	float memory_percent_;
 	unsigned process_count_;
 	IO_stats io_stats_;
+	cpu_core_stats cpu_cores_;
+	fs_stats fs_stats_;
+	numa_stats numa_stats_;
+	net_stats net_stats_;
+	bool has_net_stats_;
+	unsigned fresh_;
 }; //struct data
 
 } //namespace monitor
@@ -1,10 +1,30 @@
 #include "log.hpp"
+#include "binlog.hpp"
+#include "bounded_queue.hpp"
 
 #include <boost/log/utility/setup/common_attributes.hpp>
 #include <boost/log/utility/setup/console.hpp>
 #include <boost/log/utility/setup/file.hpp>
 #include <boost/log/support/date_time.hpp>
 #include <boost/log/expressions.hpp>
+#include <boost/log/expressions/formatters/wrap_formatter.hpp>
+#include <boost/log/sinks/async_frontend.hpp>
+#include <boost/log/sinks/basic_sink_backend.hpp>
+#include <boost/log/sinks/sync_frontend.hpp>
+#include <boost/log/sinks/text_ostream_backend.hpp>
+#include <boost/core/null_deleter.hpp>
+#include <boost/parameter/keyword.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/format.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 #define LOG CROSSOVER_MONITOR_LOG
 
@@ -14,32 +34,392 @@ namespace log {
 
 using namespace boost::log;
 
-const formatter logFmt = expressions::format("[%1%] [%2%] [%3%] %4%")
-	% expressions::format_date_time<boost::posix_time::ptime >("TimeStamp", "%Y-%m-%d %H:%M:%S.f")
-	% expressions::attr<attributes::current_thread_id::value_type>("ThreadID")
-	% trivial::severity
-	% expressions::smessage;
+BOOST_LOG_ATTRIBUTE_KEYWORD(timestamp_attribute, "TimeStamp", boost::posix_time::ptime)
+BOOST_LOG_ATTRIBUTE_KEYWORD(thread_id_attribute, "ThreadID", attributes::current_thread_id::value_type)
+
+void arguments::render(std::ostream& out) const {
+	if (!format_) {
+		return;
+	}
+
+	try {
+		boost::format f(format_);
+		for (std::size_t i = 0; i < count_; ++i) {
+			const value& v = values_[i];
+			switch (v.kind) {
+			case type::int64: f % v.i; break;
+			case type::uint64: f % v.u; break;
+			case type::float64: f % v.d; break;
+			case type::string: f % v.s; break;
+			}
+		}
+		out << f;
+	} catch (const boost::io::format_error&) {
+		out << format_;
+		for (std::size_t i = 0; i < count_; ++i) {
+			const value& v = values_[i];
+			out << ' ';
+			switch (v.kind) {
+			case type::int64: out << v.i; break;
+			case type::uint64: out << v.u; break;
+			case type::float64: out << v.d; break;
+			case type::string: out << v.s; break;
+			}
+		}
+	}
+}
+
+std::string arguments::render() const {
+	std::ostringstream out;
+	render(out);
+	return out.str();
+}
+
+// structured records carry no message, they are rendered by the sink
+static void format_message(const record_view& rec, formatting_ostream& strm) {
+	if (auto args = rec[arguments_attribute]) {
+		std::ostringstream out;
+		args->render(out);
+		strm << out.str();
+	} else {
+		strm << rec[expressions::smessage];
+	}
+}
+
+const formatter logFmt = expressions::stream
+	<< "[" << expressions::format_date_time(timestamp_attribute, "%Y-%m-%d %H:%M:%S.%f")
+	<< "] [" << thread_id_attribute
+	<< "] [" << trivial::severity
+	<< "] " << expressions::wrap_formatter(&format_message);
+
+/**
+ * Sink backend writing records in the binary log format, see binlog.hpp.
+ * Records are collected into a block which is written out when it grows
+ * past block_size, on flush, or after every record with auto_flush.
+ */
+class binary_backend final :
+	public sinks::basic_sink_backend<
+		sinks::combine_requirements<sinks::synchronized_feeding, sinks::flushing>::type> {
+public:
+	binary_backend(const std::string& filename, bool auto_flush)
+		: file_(filename, std::ios::binary | std::ios::trunc)
+		, writer_(file_)
+		, auto_flush_(auto_flush) {
+		if (!file_.is_open()) {
+			throw std::runtime_error("Failed to open binary log file: " + filename);
+		}
+	}
+
+	void consume(const record_view& rec) {
+		static const boost::posix_time::ptime epoch(boost::gregorian::date(1970, 1, 1));
+		const std::size_t block_size = 64 * 1024;
+
+		auto time = rec[timestamp_attribute];
+		auto thread = rec[thread_id_attribute];
+		const std::uint64_t timestamp = time ? (*time - epoch).total_microseconds() : 0;
+		const std::uint64_t thread_id = thread ? thread->native_id() : 0;
+		auto level = rec[trivial::severity];
+		const auto severity = level ? *level : trivial::info;
+
+		if (auto args = rec[arguments_attribute]) {
+			writer_.append(timestamp, severity, thread_id, *args);
+		} else if (auto message = rec[expressions::smessage]) {
+			writer_.append(timestamp, severity, thread_id, *message);
+		} else {
+			writer_.append(timestamp, severity, thread_id, std::string());
+		}
+
+		if (auto_flush_ || writer_.pending() >= block_size) {
+			writer_.write_block();
+			if (auto_flush_) {
+				file_.flush();
+			}
+		}
+	}
+
+	void flush() {
+		writer_.write_block();
+		file_.flush();
+	}
+
+private:
+	std::ofstream file_;
+	binary::writer writer_;
+	const bool auto_flush_;
+};
+
+namespace keywords {
+	BOOST_PARAMETER_KEYWORD(tag, queue_capacity)
+	BOOST_PARAMETER_KEYWORD(tag, overflow)
+}
+
+/**
+ * Boost.Log queueing strategy for asynchronous_sink backed by
+ * utils::bounded_queue, so that a logging thread never takes a lock.
+ */
+class lockfree_fifo_queue {
+public:
+	/**
+	 * Number of records dropped since the last call.
+	 */
+	std::size_t take_dropped() noexcept {
+		return dropped_.exchange(0);
+	}
+
+protected:
+	template<typename ArgsT>
+	explicit lockfree_fifo_queue(const ArgsT& args)
+		: queue_(round_up(args[keywords::queue_capacity | std::size_t(8192)]))
+		, overflow_(args[keywords::overflow | overflow_policy::drop])
+		, dropped_(0)
+		, interrupted_(false) {
+	}
+
+	void enqueue(const record_view& rec) {
+		record_view copy(rec);
+		while (!queue_.try_push(std::move(copy))) {
+			if (overflow_ == overflow_policy::drop) {
+				++dropped_;
+				return;
+			}
+			std::this_thread::yield();
+		}
+	}
+
+	bool try_enqueue(const record_view& rec) {
+		record_view copy(rec);
+		return queue_.try_push(std::move(copy));
+	}
+
+	bool try_dequeue_ready(record_view& rec) {
+		return queue_.try_pop(rec);
+	}
+
+	bool try_dequeue(record_view& rec) {
+		return queue_.try_pop(rec);
+	}
+
+	// only used by asynchronous_sink::run(), the drain thread below
+	// polls with feed_records() instead
+	bool dequeue_ready(record_view& rec) {
+		while (!interrupted_.exchange(false)) {
+			if (queue_.try_pop(rec)) {
+				return true;
+			}
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		return false;
+	}
+
+	void interrupt_dequeue() {
+		interrupted_ = true;
+	}
+
+private:
+	static std::size_t round_up(std::size_t capacity) noexcept {
+		std::size_t result = 2;
+		while (result < capacity) {
+			result <<= 1;
+		}
+		return result;
+	}
+
+	utils::bounded_queue<record_view> queue_;
+	const overflow_policy overflow_;
+	std::atomic<std::size_t> dropped_;
+	std::atomic<bool> interrupted_;
+};
+
+typedef sinks::asynchronous_sink<sinks::text_ostream_backend, lockfree_fifo_queue> async_text_sink;
+typedef sinks::asynchronous_sink<binary_backend, lockfree_fifo_queue> async_binary_sink;
+
+/**
+ * Background thread writing out the queued records of all asynchronous sinks.
+ * Records are formatted and written in batches every drain_period and
+ * the streams are flushed every flush_interval.
+ */
+class drain final {
+public:
+	explicit drain(const std::chrono::milliseconds& flush_interval)
+		: stop_(false)
+		, flush_interval_(flush_interval)
+		, dropped_(0) {
+		thread_ = std::thread([this] { run(); });
+	}
+
+	~drain() {
+		stop_ = true;
+		thread_.join();
+	}
+
+	/**
+	 * Takes the numbers of records the sinks dropped since the last call.
+	 * @return the number taken.
+	 */
+	std::size_t collect_dropped() {
+		std::size_t dropped = 0;
+		std::lock_guard<std::mutex> lock(mutex_);
+		for (auto& sink : sinks_) {
+			dropped += sink.take_dropped();
+		}
+		dropped_ += dropped;
+		return dropped;
+	}
+
+	/**
+	 * Records dropped by the sinks, as of the last collect_dropped().
+	 */
+	std::uint64_t dropped() const noexcept {
+		return dropped_;
+	}
+
+	template<typename SinkT>
+	void add(const boost::shared_ptr<SinkT>& sink) {
+		drained entry;
+		entry.feed = [sink](bool flush) {
+			if (flush) {
+				sink->flush();
+			} else {
+				sink->feed_records();
+			}
+		};
+		entry.take_dropped = [sink] { return sink->take_dropped(); };
+
+		std::lock_guard<std::mutex> lock(mutex_);
+		sinks_.push_back(entry);
+	}
+
+private:
+	void run() noexcept {
+		const std::chrono::milliseconds drain_period(10);
+		auto last_flush = std::chrono::steady_clock::now();
+
+		while (!stop_) {
+			const auto now = std::chrono::steady_clock::now();
+			const bool flush_due = now - last_flush >= flush_interval_;
+			if (flush_due) {
+				last_flush = now;
+			}
+
+			{
+				std::lock_guard<std::mutex> lock(mutex_);
+				for (auto& sink : sinks_) {
+					try {
+						sink.feed(flush_due);
+					} catch (const std::exception&) {
+						// flush() is feeding the sink on another thread,
+						// nothing left to do for this one
+					}
+				}
+			}
+
+			const std::size_t dropped = collect_dropped();
+			if (dropped) {
+				LOG(warning) << "Log queue overflow, dropped " << dropped << " records";
+			}
+
+			std::this_thread::sleep_for(std::min(drain_period, flush_interval_));
+		}
+	}
+
+	struct drained {
+		std::function<void(bool flush)> feed;
+		std::function<std::size_t()> take_dropped;
+	};
+
+	std::thread thread_;
+	std::atomic<bool> stop_;
+	const std::chrono::milliseconds flush_interval_;
+	std::mutex mutex_;
+	std::vector<drained> sinks_;
+	std::atomic<std::uint64_t> dropped_;
+};
+
+static std::mutex mutex_;
+static options options_;
+static std::unique_ptr<drain> drain_;
+
+static void add_async_stream(const boost::shared_ptr<std::ostream>& stream) {
+	auto backend = boost::make_shared<sinks::text_ostream_backend>();
+	backend->add_stream(stream);
+	backend->auto_flush(false);
+
+	auto sink = boost::make_shared<async_text_sink>(backend,
+		boost::log::keywords::start_thread = false,
+		keywords::queue_capacity = options_.queue_capacity,
+		keywords::overflow = options_.overflow);
+	sink->set_formatter(logFmt);
+
+	core::get()->add_sink(sink);
+	drain_->add(sink);
+}
+
+static void add_async_binary(const std::string& filename) {
+	auto backend = boost::make_shared<binary_backend>(filename, false);
+
+	auto sink = boost::make_shared<async_binary_sink>(backend,
+		boost::log::keywords::start_thread = false,
+		keywords::queue_capacity = options_.queue_capacity,
+		keywords::overflow = options_.overflow);
+
+	core::get()->add_sink(sink);
+	drain_->add(sink);
+}
 
 void init() noexcept {
+	init(options());
+}
+
+void init(const options& opts) noexcept {
 	try {
 		add_common_attributes();
 
-		auto logger = add_console_log(std::clog);
-		logger->set_formatter(logFmt);
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			options_ = opts;
 
-		LOG(info) << "Added Console log";
+			if (options_.asynchronous) {
+				drain_.reset(new drain(options_.flush_interval));
+			}
+
+			if (!options_.console) {
+				return;
+			}
+
+			if (options_.asynchronous) {
+				add_async_stream(boost::shared_ptr<std::ostream>(&std::clog, boost::null_deleter()));
+			} else {
+				auto logger = add_console_log(std::clog);
+				logger->set_formatter(logFmt);
+			}
+		}
+
+		LOG(info) << "Added Console log" << (opts.asynchronous ? " (asynchronous)" : "");
 	}
 	catch (const std::exception& e) {
 		LOG(error) << e.what();
 	}
 }
+
 void set_file(const std::string& filename) noexcept {
 	try {
-		auto logger = add_file_log(
-			keywords::file_name = filename,
-			keywords::auto_flush = true
-		);
-		logger->set_formatter(logFmt);
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+
+			if (options_.asynchronous) {
+				auto file = boost::make_shared<std::ofstream>(filename);
+				if (!file->is_open()) {
+					throw std::runtime_error("Failed to open log file: " + filename);
+				}
+				add_async_stream(file);
+			} else {
+				auto logger = add_file_log(
+					boost::log::keywords::file_name = filename,
+					boost::log::keywords::auto_flush = true
+				);
+				logger->set_formatter(logFmt);
+			}
+		}
 
 		LOG(info) << "Added file log: " << filename;
 	} catch (const std::exception& e) {
@@ -47,6 +427,57 @@ void set_file(const std::string& filename) noexcept {
 	}
 }
 
+void set_binary_file(const std::string& filename) noexcept {
+	try {
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+
+			if (options_.asynchronous) {
+				add_async_binary(filename);
+			} else {
+				auto backend = boost::make_shared<binary_backend>(filename, true);
+				core::get()->add_sink(boost::make_shared<sinks::synchronous_sink<binary_backend>>(backend));
+			}
+		}
+
+		LOG(info) << "Added binary file log: " << filename;
+	} catch (const std::exception& e) {
+		LOG(error) << e.what();
+	}
+}
+
+void flush() noexcept {
+	try {
+		core::get()->flush();
+	} catch (...) {
+		// nothing sensible to report to, the sinks are what failed
+	}
+}
+
+std::uint64_t dropped_records() noexcept {
+	try {
+		std::lock_guard<std::mutex> lock(mutex_);
+		if (!drain_) {
+			return 0;
+		}
+		drain_->collect_dropped();
+		return drain_->dropped();
+	} catch (...) {
+		return 0;
+	}
+}
+
+void shutdown() noexcept {
+	try {
+		std::lock_guard<std::mutex> lock(mutex_);
+		drain_.reset();
+		core::get()->flush();
+		core::get()->remove_all_sinks();
+		options_ = options();
+	} catch (...) {
+	}
+}
+
 } //namespace log
 } //namespace monitor
 } //namespace crossover
@@ -1,8 +1,17 @@
 #pragma once
 
 #include <boost/log/trivial.hpp>
+#include <boost/log/expressions/keyword.hpp>
+#include <boost/log/utility/formatting_ostream.hpp>
+#include <boost/log/utility/manipulators/add_value.hpp>
 
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
 #include <string>
+#include <type_traits>
 
 /**
  * Main loggin output stream based on BOOST_LOG_TRIVIAL.
@@ -13,19 +22,208 @@
  */
 #define CROSSOVER_MONITOR_LOG BOOST_LOG_TRIVIAL
 
+/**
+ * Structured logging. The record keeps the format string and the typed
+ * arguments instead of a formatted message; text sinks render it with
+ * boost::format on the writing thread, the binary sink stores the interned
+ * format id and the raw argument values.
+ * Use: CROSSOVER_MONITOR_LOGF(level, "cpu %1% memory %2%", cpu, memory);
+ * The format must be a string literal, at most arguments::max_count
+ * arguments are allowed.
+ */
+#define CROSSOVER_MONITOR_LOGF(level, ...) \
+	BOOST_LOG_SEV(::boost::log::trivial::logger::get(), ::boost::log::trivial::level) \
+		<< ::boost::log::add_value(::crossover::monitor::log::arguments_attribute, \
+								   ::crossover::monitor::log::arguments(__VA_ARGS__))
+
 namespace crossover {
 namespace monitor {
 namespace log {
 
+	/**
+	 * Format string and typed arguments of a structured log record.
+	 * See CROSSOVER_MONITOR_LOGF.
+	 */
+	class arguments final {
+	public:
+		static const std::size_t max_count = 8;
+
+		enum class type : std::uint8_t {
+			int64,
+			uint64,
+			float64,
+			string
+		};
+
+		struct value {
+			type kind;
+			union {
+				std::int64_t i;
+				std::uint64_t u;
+				double d;
+			};
+			std::string s;
+		};
+
+		template<typename... Args>
+		explicit arguments(const char* format, const Args&... args)
+			: format_(format)
+			, count_(0) {
+			static_assert(sizeof...(Args) <= max_count, "too many log arguments");
+			add_all(args...);
+		}
+
+		const char* format() const noexcept {
+			return format_;
+		}
+		std::size_t size() const noexcept {
+			return count_;
+		}
+		const value& operator[](std::size_t index) const noexcept {
+			return values_[index];
+		}
+
+		/**
+		 * Appends an argument, used when rebuilding records from a binary log.
+		 * Arguments beyond max_count are ignored.
+		 */
+		void push_back(const value& v) {
+			if (count_ < max_count) {
+				values_[count_++] = v;
+			}
+		}
+
+		/**
+		 * Renders the format string with the arguments.
+		 * A malformed format is written as is, followed by the arguments.
+		 */
+		void render(std::ostream& out) const;
+		std::string render() const;
+
+	private:
+		void add_all() noexcept {
+		}
+		template<typename T, typename... Rest>
+		void add_all(const T& first, const Rest&... rest) {
+			add(first);
+			add_all(rest...);
+		}
+
+		template<typename T>
+		typename std::enable_if<std::is_floating_point<T>::value>::type add(T v) {
+			next(type::float64).d = v;
+		}
+		template<typename T>
+		typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value>::type add(T v) {
+			next(type::int64).i = v;
+		}
+		template<typename T>
+		typename std::enable_if<std::is_integral<T>::value && std::is_unsigned<T>::value>::type add(T v) {
+			next(type::uint64).u = v;
+		}
+		template<typename T>
+		typename std::enable_if<!std::is_arithmetic<T>::value>::type add(const T& v) {
+			value& slot = next(type::string);
+			boost::log::formatting_ostream out(slot.s);
+			out << v;
+			out.flush();
+		}
+
+		value& next(type kind) noexcept {
+			value& slot = values_[count_++];
+			slot.kind = kind;
+			return slot;
+		}
+
+		const char* format_;
+		std::size_t count_;
+		std::array<value, max_count> values_;
+	}; //class arguments
+
+	BOOST_LOG_ATTRIBUTE_KEYWORD(arguments_attribute, "Arguments", arguments)
+
+	/**
+	 * What an asynchronous sink does with a record when its queue is full.
+	 */
+	enum class overflow_policy {
+		/**
+		 * The record is discarded and counted, the caller never waits.
+		 * The number of dropped records is reported by the drain thread.
+		 */
+		drop,
+		/**
+		 * The caller yields until the drain thread frees a slot.
+		 */
+		block
+	};
+
+	/**
+	 * Logging setup. Default constructed options give the
+	 * synchronous behaviour: every record is formatted and written
+	 * on the calling thread and flushed right away.
+	 */
+	struct options {
+		/**
+		 * If true records are put on a bounded lock-free queue and
+		 * formatted and written by a background drain thread.
+		 */
+		bool asynchronous = false;
+		/**
+		 * Maximum number of records waiting in a sink queue
+		 * (rounded up to a power of two).
+		 */
+		std::size_t queue_capacity = 8192;
+		/**
+		 * Maximum time written records may stay in the stream buffers
+		 * before the drain thread flushes them.
+		 */
+		std::chrono::milliseconds flush_interval = std::chrono::milliseconds(1000);
+		/**
+		 * What to do with a record when the queue is full.
+		 */
+		overflow_policy overflow = overflow_policy::drop;
+		/**
+		 * If false nothing is written to the console, only to the files
+		 * added with set_file() and set_binary_file().
+		 */
+		bool console = true;
+	};
+
 	/**
 	 * Call this once at the start of the application to set up logging.
 	 */
 	void init() noexcept;
+	/**
+	 * Same as init(), with explicit logging options.
+	 * @param opts synchronous or asynchronous logging setup.
+	 */
+	void init(const options& opts) noexcept;
 	/**
 	 * If called logs will be written to a file as well as the console.
 	 * @param filename path to the log file.
 	 */
 	void set_file(const std::string& filename) noexcept;
+	/**
+	 * If called logs will also be written to a file in the compact binary
+	 * format, see binlog.hpp. Decode it with CrossMonitor.LogDecoder.
+	 * @param filename path to the binary log file.
+	 */
+	void set_binary_file(const std::string& filename) noexcept;
+	/**
+	 * Writes out every queued record and flushes all sinks. Blocks until done.
+	 * Safe to call from the termination handler.
+	 */
+	void flush() noexcept;
+	/**
+	 * @return number of records the asynchronous sinks dropped since init()
+	 * because their queue was full, see overflow_policy::drop.
+	 */
+	std::uint64_t dropped_records() noexcept;
+	/**
+	 * Flushes and removes all sinks and stops the drain thread.
+	 * init() may be called again afterwards.
+	 */
+	void shutdown() noexcept;
 
 } //namespace log
 } //namespace monitor
@@ -0,0 +1,473 @@
+#include "openmetrics.hpp"
+
+#include <algorithm>
+#include <string>
+
+using namespace std;
+
+namespace crossover {
+namespace monitor {
+
+namespace {
+
+	// widths of the largest values: 100.000, UINT_MAX and UINT64_MAX
+	const size_t percent_width = 7;
+	const size_t gauge_width = 10;
+	const size_t counter_width = 20;
+
+	uint64_t to_thousandths(float percent) noexcept {
+		return static_cast<uint64_t>(percent * 1000.0 + 0.5);
+	}
+
+	/**
+	 * Writes value right aligned and zero padded over width characters.
+	 */
+	void write_value(char* out, size_t width, bool thousandths, uint64_t value) noexcept {
+		char* p = out + width;
+		if (thousandths) {
+			for (int i = 0; i < 3; ++i) {
+				*--p = static_cast<char>('0' + value % 10);
+				value /= 10;
+			}
+			*--p = '.';
+		}
+		while (p != out) {
+			*--p = static_cast<char>('0' + value % 10);
+			value /= 10;
+		}
+	}
+
+	/**
+	 * Partition names are drive letters, anything else is replaced
+	 * rather than escaped.
+	 */
+	char label_char(wchar_t c) noexcept {
+		return c >= 0x20 && c < 0x7f && c != L'"' && c != L'\\' ? static_cast<char>(c) : '_';
+	}
+
+	/**
+	 * Mount points are any UTF-8 path, escaped as OpenMetrics label values.
+	 */
+	void append_label(string& out, const string& value) {
+		for (const char c : value) {
+			if (c == '\\' || c == '"') {
+				out += '\\';
+				out += c;
+			} else if (c == '\n') {
+				out += "\\n";
+			} else {
+				out += c;
+			}
+		}
+	}
+
+	// the gauges of every filesystem, in the order of the spans
+	const size_t fs_fields = 5;
+
+	uint64_t fs_field(const fs_stat& fs, size_t field) noexcept {
+		switch (field) {
+		case 0:
+			return fs.size_bytes;
+		case 1:
+			return fs.used_bytes;
+		case 2:
+			return fs.available_bytes;
+		case 3:
+			return fs.inodes;
+		default:
+			return fs.inodes_used;
+		}
+	}
+
+	// the counters of the TCP/IP stack, then its gauges, in the order of the spans
+	const size_t net_counters = 6;
+	const size_t net_gauges = 7;
+
+	uint64_t net_counter(const net_stats& net, size_t counter) noexcept {
+		switch (counter) {
+		case 0:
+			return net.tcp_retransmits;
+		case 1:
+			return net.tcp_resets_sent;
+		case 2:
+			return net.tcp_established_resets;
+		case 3:
+			return net.listen_overflows;
+		case 4:
+			return net.listen_drops;
+		default:
+			return net.udp_receive_buffer_errors;
+		}
+	}
+
+	uint64_t net_gauge(const net_stats& net, size_t gauge) noexcept {
+		switch (gauge) {
+		case 0:
+			return net.sockets;
+		case 1:
+			return net.tcp_sockets;
+		case 2:
+			return net.tcp_orphans;
+		case 3:
+			return net.tcp_time_wait;
+		case 4:
+			return net.udp_sockets;
+		case 5:
+			return net.tcp_memory_bytes;
+		default:
+			return net.udp_memory_bytes;
+		}
+	}
+
+} //namespace
+
+const char* const openmetrics_exporter::content_type = "application/openmetrics-text; version=1.0.0; charset=utf-8";
+
+openmetrics_exporter::openmetrics_exporter()
+	: renders_(0)
+	, net_(false)
+	, net_totals_(net_counters, 0) {
+}
+
+void openmetrics_exporter::update(const data& sample) {
+	const IO_stats& io_stats = sample.get_io_stats();
+	const size_t count = io_stats.size();
+
+	const fs_stats& filesystems = sample.get_fs_stats();
+	const numa_stats& nodes = sample.get_numa_stats();
+	const cpu_core_stats& cores = sample.get_cpu_cores();
+	const run_queue_stats& run_queues = sample.get_run_queues();
+	bool same = count == partitions_.size() && filesystems.size() == mount_points_.size() &&
+		nodes.size() == nodes_.size() && cores.cpus == cpus_ && run_queues.cpus == run_queue_cpus_ &&
+		sample.has_net_stats() == net_ && !text_.empty();
+	for (size_t i = 0; same && i < count; ++i) {
+		same = io_stats[i].partition_name == partitions_[i];
+	}
+	for (size_t i = 0; same && i < filesystems.size(); ++i) {
+		same = filesystems[i].mount_point == mount_points_[i];
+	}
+	for (size_t i = 0; same && i < nodes.size(); ++i) {
+		same = nodes[i].node == nodes_[i];
+	}
+
+	if (!same) {
+		// keep the totals of the partitions still there
+		vector<wchar_t> partitions(count);
+		vector<uint64_t> totals(2 * count, 0);
+		for (size_t i = 0; i < count; ++i) {
+			partitions[i] = io_stats[i].partition_name;
+			const auto it = find(partitions_.begin(), partitions_.end(), partitions[i]);
+			if (it != partitions_.end()) {
+				const size_t old = it - partitions_.begin();
+				totals[i] = totals_[old];
+				totals[count + i] = totals_[partitions_.size() + old];
+			}
+		}
+		partitions_.swap(partitions);
+		totals_.swap(totals);
+
+		// and of the nodes still there
+		vector<unsigned> node_numbers(nodes.size());
+		vector<uint64_t> numa_totals(2 * nodes.size(), 0);
+		for (size_t i = 0; i < nodes.size(); ++i) {
+			node_numbers[i] = nodes[i].node;
+			const auto it = find(nodes_.begin(), nodes_.end(), node_numbers[i]);
+			if (it != nodes_.end()) {
+				const size_t old = it - nodes_.begin();
+				numa_totals[i] = numa_totals_[old];
+				numa_totals[nodes.size() + i] = numa_totals_[nodes_.size() + old];
+			}
+		}
+		nodes_.swap(node_numbers);
+		numa_totals_.swap(numa_totals);
+
+		// and of the CPUs still there
+		vector<uint64_t> core_totals(2 * cores.size(), 0);
+		for (size_t i = 0; i < cores.size(); ++i) {
+			const auto it = find(cpus_.begin(), cpus_.end(), cores.cpus[i]);
+			if (it != cpus_.end()) {
+				const size_t old = it - cpus_.begin();
+				core_totals[i] = core_totals_[old];
+				core_totals[cores.size() + i] = core_totals_[cpus_.size() + old];
+			}
+		}
+		cpus_ = cores.cpus;
+		core_totals_.swap(core_totals);
+		run_queue_cpus_ = run_queues.cpus;
+		net_ = sample.has_net_stats();
+	}
+
+	// bytes of a sample that is not fresh in them were counted already
+	if (sample.get_fresh() & io_part) {
+		for (size_t i = 0; i < count; ++i) {
+			totals_[i] += io_stats[i].bytes_read;
+			totals_[count + i] += io_stats[i].bytes_written;
+		}
+	}
+	if (sample.get_fresh() & numa_part) {
+		for (size_t i = 0; i < nodes.size(); ++i) {
+			numa_totals_[i] += nodes[i].numa_miss;
+			numa_totals_[nodes.size() + i] += nodes[i].numa_foreign;
+		}
+	}
+	if ((sample.get_fresh() & net_part) && net_) {
+		for (size_t counter = 0; counter < net_counters; ++counter) {
+			net_totals_[counter] += net_counter(sample.get_net_stats(), counter);
+		}
+	}
+	if (sample.get_fresh() & cpu_part) {
+		for (size_t i = 0; i < cores.size(); ++i) {
+			core_totals_[i] += cores.core_throttles[i];
+			core_totals_[cores.size() + i] += cores.package_throttles[i];
+		}
+	}
+
+	if (!same) {
+		mount_points_.clear();
+		for (const auto& fs : filesystems) {
+			mount_points_.push_back(fs.mount_point);
+		}
+		render(sample);
+		return;
+	}
+
+	patch(spans_[0], to_thousandths(sample.get_cpu_percent()));
+	patch(spans_[1], to_thousandths(sample.get_memory_percent()));
+	patch(spans_[2], sample.get_process_count());
+	for (size_t i = 0; i < totals_.size(); ++i) {
+		patch(spans_[3 + i], totals_[i]);
+	}
+	span* fs_spans = &spans_[3 + totals_.size()];
+	for (size_t field = 0; field < fs_fields; ++field) {
+		for (const auto& fs : filesystems) {
+			patch(*fs_spans++, fs_field(fs, field));
+		}
+	}
+	span* numa_spans = fs_spans;
+	for (const auto& node : nodes) {
+		patch(*numa_spans++, to_thousandths(node.cpu_percent));
+	}
+	for (const auto& node : nodes) {
+		patch(*numa_spans++, to_thousandths(node.memory_percent));
+	}
+	for (const auto total : numa_totals_) {
+		patch(*numa_spans++, total);
+	}
+	span* core_spans = numa_spans;
+	for (const auto khz : cores.frequency_khz) {
+		patch(*core_spans++, khz * 1000ull);
+	}
+	for (const auto khz : cores.effective_frequency_khz) {
+		patch(*core_spans++, khz * 1000ull);
+	}
+	for (const auto total : core_totals_) {
+		patch(*core_spans++, total);
+	}
+	span* run_queue_spans = core_spans;
+	if (!run_queue_cpus_.empty()) {
+		patch(*run_queue_spans++, to_thousandths(sample.get_run_queue_delay_us()));
+		patch(*run_queue_spans++, to_thousandths(sample.get_run_queue_wait_ratio() * 100.f));
+		for (const auto delay_us : run_queues.delay_us) {
+			patch(*run_queue_spans++, to_thousandths(delay_us));
+		}
+		for (const auto wait_ratio : run_queues.wait_ratio) {
+			patch(*run_queue_spans++, to_thousandths(wait_ratio * 100.f));
+		}
+	}
+	if (net_) {
+		span* net_spans = run_queue_spans;
+		for (const auto total : net_totals_) {
+			patch(*net_spans++, total);
+		}
+		for (size_t gauge = 0; gauge < net_gauges; ++gauge) {
+			patch(*net_spans++, net_gauge(sample.get_net_stats(), gauge));
+		}
+	}
+}
+
+void openmetrics_exporter::render(const data& sample) {
+	text_.clear();
+	spans_.clear();
+
+	auto family = [this](const char* name, const char* type, const char* help) {
+		text_ += "# TYPE ";
+		text_ += name;
+		text_ += ' ';
+		text_ += type;
+		text_ += "\n# HELP ";
+		text_ += name;
+		text_ += ' ';
+		text_ += help;
+		text_ += '\n';
+	};
+	auto value = [this](const string& sample_name, size_t width, bool thousandths, uint64_t v) {
+		text_ += sample_name;
+		text_ += ' ';
+		spans_.push_back(span{ text_.size(), width, thousandths, v });
+		text_.append(width, '0');
+		write_value(&text_[spans_.back().offset], width, thousandths, v);
+		text_ += '\n';
+	};
+	auto partition = [this](const char* name, size_t i) {
+		return string(name) + "{partition_name=\"" + label_char(partitions_[i]) + "\"}";
+	};
+
+	family("crossmonitor_cpu_percent", "gauge", "CPU use in percent.");
+	value("crossmonitor_cpu_percent", percent_width, true, to_thousandths(sample.get_cpu_percent()));
+	family("crossmonitor_memory_percent", "gauge", "Physical memory use in percent.");
+	value("crossmonitor_memory_percent", percent_width, true, to_thousandths(sample.get_memory_percent()));
+	family("crossmonitor_processes", "gauge", "Number of processes.");
+	value("crossmonitor_processes", gauge_width, false, sample.get_process_count());
+
+	const size_t count = partitions_.size();
+	if (count > 0) {
+		family("crossmonitor_disk_read_bytes", "counter", "Bytes read from the partition.");
+		for (size_t i = 0; i < count; ++i) {
+			value(partition("crossmonitor_disk_read_bytes_total", i), counter_width, false, totals_[i]);
+		}
+		family("crossmonitor_disk_written_bytes", "counter", "Bytes written to the partition.");
+		for (size_t i = 0; i < count; ++i) {
+			value(partition("crossmonitor_disk_written_bytes_total", i), counter_width, false, totals_[count + i]);
+		}
+	}
+
+	if (!mount_points_.empty()) {
+		static const char* const names[fs_fields] = {
+			"crossmonitor_filesystem_size_bytes", "crossmonitor_filesystem_used_bytes",
+			"crossmonitor_filesystem_available_bytes", "crossmonitor_filesystem_inodes",
+			"crossmonitor_filesystem_inodes_used"
+		};
+		static const char* const helps[fs_fields] = {
+			"Size of the filesystem.", "Bytes used on the filesystem.",
+			"Bytes of the filesystem available to unprivileged users.", "Inodes of the filesystem.",
+			"Inodes used on the filesystem."
+		};
+		for (size_t field = 0; field < fs_fields; ++field) {
+			family(names[field], "gauge", helps[field]);
+			for (const auto& fs : sample.get_fs_stats()) {
+				string sample_name = names[field];
+				sample_name += "{mountpoint=\"";
+				append_label(sample_name, fs.mount_point);
+				sample_name += "\"}";
+				value(sample_name, counter_width, false, fs_field(fs, field));
+			}
+		}
+	}
+
+	if (!nodes_.empty()) {
+		const numa_stats& nodes = sample.get_numa_stats();
+		auto node = [this](const char* name, size_t i) {
+			return string(name) + "{node=\"" + to_string(nodes_[i]) + "\"}";
+		};
+		family("crossmonitor_numa_cpu_percent", "gauge", "Use of the CPUs of the NUMA node in percent.");
+		for (size_t i = 0; i < nodes.size(); ++i) {
+			value(node("crossmonitor_numa_cpu_percent", i), percent_width, true, to_thousandths(nodes[i].cpu_percent));
+		}
+		family("crossmonitor_numa_memory_percent", "gauge", "Use of the memory of the NUMA node in percent.");
+		for (size_t i = 0; i < nodes.size(); ++i) {
+			value(node("crossmonitor_numa_memory_percent", i), percent_width, true, to_thousandths(nodes[i].memory_percent));
+		}
+		family("crossmonitor_numa_miss_pages", "counter", "Pages allocated on the NUMA node although another one was wanted.");
+		for (size_t i = 0; i < nodes.size(); ++i) {
+			value(node("crossmonitor_numa_miss_pages_total", i), counter_width, false, numa_totals_[i]);
+		}
+		family("crossmonitor_numa_foreign_pages", "counter", "Pages wanted on the NUMA node but allocated on another one.");
+		for (size_t i = 0; i < nodes.size(); ++i) {
+			value(node("crossmonitor_numa_foreign_pages_total", i), counter_width, false, numa_totals_[nodes.size() + i]);
+		}
+	}
+
+	if (!cpus_.empty()) {
+		const cpu_core_stats& cores = sample.get_cpu_cores();
+		auto cpu = [this](const char* name, size_t i) {
+			return string(name) + "{cpu=\"" + to_string(cpus_[i]) + "\"}";
+		};
+		family("crossmonitor_cpu_frequency_hertz", "gauge", "Clock of the CPU.");
+		for (size_t i = 0; i < cpus_.size(); ++i) {
+			value(cpu("crossmonitor_cpu_frequency_hertz", i), counter_width, false, cores.frequency_khz[i] * 1000ull);
+		}
+		family("crossmonitor_cpu_effective_frequency_hertz", "gauge", "Average clock of the CPU while busy, from APERF/MPERF.");
+		for (size_t i = 0; i < cpus_.size(); ++i) {
+			value(cpu("crossmonitor_cpu_effective_frequency_hertz", i), counter_width, false,
+				cores.effective_frequency_khz[i] * 1000ull);
+		}
+		family("crossmonitor_cpu_core_throttles", "counter", "Thermal throttling events of the core of the CPU.");
+		for (size_t i = 0; i < cpus_.size(); ++i) {
+			value(cpu("crossmonitor_cpu_core_throttles_total", i), counter_width, false, core_totals_[i]);
+		}
+		family("crossmonitor_cpu_package_throttles", "counter", "Thermal throttling events of the package of the CPU.");
+		for (size_t i = 0; i < cpus_.size(); ++i) {
+			value(cpu("crossmonitor_cpu_package_throttles_total", i), counter_width, false, core_totals_[cpus_.size() + i]);
+		}
+	}
+
+	if (!run_queue_cpus_.empty()) {
+		const run_queue_stats& run_queues = sample.get_run_queues();
+		auto cpu = [this](const char* name, size_t i) {
+			return string(name) + "{cpu=\"" + to_string(run_queue_cpus_[i]) + "\"}";
+		};
+		family("crossmonitor_run_queue_delay_microseconds", "gauge", "Mean wait of a timeslice on a run queue.");
+		value("crossmonitor_run_queue_delay_microseconds", counter_width, true,
+			to_thousandths(sample.get_run_queue_delay_us()));
+		family("crossmonitor_run_queue_wait_percent", "gauge", "Runnable time spent waiting on a run queue in percent.");
+		value("crossmonitor_run_queue_wait_percent", percent_width, true,
+			to_thousandths(sample.get_run_queue_wait_ratio() * 100.f));
+		family("crossmonitor_cpu_run_queue_delay_microseconds", "gauge", "Mean wait of a timeslice on the run queue of the CPU.");
+		for (size_t i = 0; i < run_queue_cpus_.size(); ++i) {
+			value(cpu("crossmonitor_cpu_run_queue_delay_microseconds", i), counter_width, true,
+				to_thousandths(run_queues.delay_us[i]));
+		}
+		family("crossmonitor_cpu_run_queue_wait_percent", "gauge",
+			"Runnable time spent waiting on the run queue of the CPU in percent.");
+		for (size_t i = 0; i < run_queue_cpus_.size(); ++i) {
+			value(cpu("crossmonitor_cpu_run_queue_wait_percent", i), percent_width, true,
+				to_thousandths(run_queues.wait_ratio[i] * 100.f));
+		}
+	}
+
+	if (net_) {
+		static const char* const counter_names[net_counters] = {
+			"crossmonitor_tcp_retransmitted_segments", "crossmonitor_tcp_resets_sent",
+			"crossmonitor_tcp_established_resets", "crossmonitor_tcp_listen_overflows",
+			"crossmonitor_tcp_listen_drops", "crossmonitor_udp_receive_buffer_errors"
+		};
+		static const char* const counter_helps[net_counters] = {
+			"TCP segments sent again.", "TCP resets sent.",
+			"TCP connections reset while established or closing on the peer.",
+			"TCP connections dropped because a listen queue was full.",
+			"TCP connections dropped before they were accepted.",
+			"UDP datagrams dropped because a socket receive buffer was full."
+		};
+		static const char* const gauge_names[net_gauges] = {
+			"crossmonitor_sockets", "crossmonitor_tcp_sockets", "crossmonitor_tcp_orphan_sockets",
+			"crossmonitor_tcp_time_wait_sockets", "crossmonitor_udp_sockets",
+			"crossmonitor_tcp_memory_bytes", "crossmonitor_udp_memory_bytes"
+		};
+		static const char* const gauge_helps[net_gauges] = {
+			"Sockets of every kind.", "TCP sockets in use.", "TCP sockets no longer attached to a process.",
+			"TCP sockets in TIME_WAIT.", "UDP sockets in use.", "Memory of the TCP sockets.",
+			"Memory of the UDP sockets."
+		};
+		for (size_t counter = 0; counter < net_counters; ++counter) {
+			family(counter_names[counter], "counter", counter_helps[counter]);
+			value(string(counter_names[counter]) + "_total", counter_width, false, net_totals_[counter]);
+		}
+		for (size_t gauge = 0; gauge < net_gauges; ++gauge) {
+			family(gauge_names[gauge], "gauge", gauge_helps[gauge]);
+			value(gauge_names[gauge], counter_width, false, net_gauge(sample.get_net_stats(), gauge));
+		}
+	}
+
+	text_ += "# EOF\n";
+	++renders_;
+}
+
+void openmetrics_exporter::patch(span& s, uint64_t value) noexcept {
+	if (s.value != value) {
+		s.value = value;
+		write_value(&text_[s.offset], s.width, s.thousandths, value);
+	}
+}
+
+} //namespace monitor
+} //namespace crossover
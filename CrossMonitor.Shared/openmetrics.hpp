@@ -0,0 +1,127 @@
+#pragma once
+
+#include "data.hpp"
+
+#include <boost/noncopyable.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace crossover {
+namespace monitor {
+
+/**
+ * Keeps an OpenMetrics text exposition of the latest sample:
+ *
+ *   crossmonitor_cpu_percent                              gauge
+ *   crossmonitor_memory_percent                           gauge
+ *   crossmonitor_processes                                gauge
+ *   crossmonitor_disk_read_bytes_total{partition_name}    counter
+ *   crossmonitor_disk_written_bytes_total{partition_name} counter
+ *   crossmonitor_filesystem_size_bytes{mountpoint}        gauge
+ *   crossmonitor_filesystem_used_bytes{mountpoint}        gauge
+ *   crossmonitor_filesystem_available_bytes{mountpoint}   gauge
+ *   crossmonitor_filesystem_inodes{mountpoint}            gauge
+ *   crossmonitor_filesystem_inodes_used{mountpoint}       gauge
+ *   crossmonitor_numa_cpu_percent{node}                   gauge
+ *   crossmonitor_numa_memory_percent{node}                gauge
+ *   crossmonitor_numa_miss_pages_total{node}              counter
+ *   crossmonitor_numa_foreign_pages_total{node}           counter
+ *   crossmonitor_cpu_frequency_hertz{cpu}                 gauge
+ *   crossmonitor_cpu_effective_frequency_hertz{cpu}       gauge
+ *   crossmonitor_cpu_core_throttles_total{cpu}            counter
+ *   crossmonitor_cpu_package_throttles_total{cpu}         counter
+ *   crossmonitor_run_queue_delay_microseconds             gauge
+ *   crossmonitor_run_queue_wait_percent                   gauge
+ *   crossmonitor_cpu_run_queue_delay_microseconds{cpu}    gauge
+ *   crossmonitor_cpu_run_queue_wait_percent{cpu}          gauge
+ *   crossmonitor_tcp_retransmitted_segments_total         counter
+ *   crossmonitor_tcp_resets_sent_total                    counter
+ *   crossmonitor_tcp_established_resets_total             counter
+ *   crossmonitor_tcp_listen_overflows_total               counter
+ *   crossmonitor_tcp_listen_drops_total                   counter
+ *   crossmonitor_udp_receive_buffer_errors_total          counter
+ *   crossmonitor_sockets                                  gauge
+ *   crossmonitor_tcp_sockets                              gauge
+ *   crossmonitor_tcp_orphan_sockets                       gauge
+ *   crossmonitor_tcp_time_wait_sockets                    gauge
+ *   crossmonitor_udp_sockets                              gauge
+ *   crossmonitor_tcp_memory_bytes                         gauge
+ *   crossmonitor_udp_memory_bytes                         gauge
+ *
+ * The disk, NUMA, throttle and TCP/IP counters add up the per-sample
+ * counts of data::io_stats, data::numa_stats, data::cpu_cores and
+ * data::net_stats, of the samples fresh in them.
+ *
+ * Values are written zero padded to a fixed width, so the text is rendered
+ * once and later samples only overwrite the value spans that changed.
+ * It is rendered again only when the set of partitions, mount points,
+ * NUMA nodes or CPUs, of the clocks or the run queues, changes. The run
+ * queues and the TCP/IP stack are left out where they are not read.
+ */
+class openmetrics_exporter final : public boost::noncopyable {
+public:
+	static const char* const content_type;
+
+	openmetrics_exporter();
+
+	void update(const data& sample);
+
+	/**
+	 * @return the exposition, "# EOF" terminated, valid until the next update().
+	 */
+	const std::string& text() const noexcept {
+		return text_;
+	}
+
+	/**
+	 * @return number of times the text was rendered from scratch.
+	 */
+	std::size_t renders() const noexcept {
+		return renders_;
+	}
+
+private:
+	struct span {
+		std::size_t offset;
+		std::size_t width;
+		/**
+		 * Value written as value / 1000 with three decimals.
+		 */
+		bool thousandths;
+		/**
+		 * Value currently in the text.
+		 */
+		std::uint64_t value;
+	};
+
+	void render(const data& sample);
+	void patch(span& s, std::uint64_t value) noexcept;
+
+	std::string text_;
+	std::size_t renders_;
+	// cpu, memory and processes, read and written per partition, every
+	// filesystem gauge per mount point, cpu, memory, miss and foreign per
+	// NUMA node, then clock, effective clock and throttles per CPU, then
+	// the run-queue delay and wait, of the machine and per CPU, then the
+	// TCP/IP counters and gauges
+	std::vector<span> spans_;
+	std::vector<wchar_t> partitions_;
+	std::vector<std::string> mount_points_;
+	std::vector<unsigned> nodes_;
+	std::vector<std::uint64_t> totals_;
+	// miss per node, then foreign
+	std::vector<std::uint64_t> numa_totals_;
+	std::vector<unsigned> cpus_;
+	// core throttles per CPU, then package throttles
+	std::vector<std::uint64_t> core_totals_;
+	std::vector<unsigned> run_queue_cpus_;
+	// the samples list the TCP/IP stack
+	bool net_;
+	std::vector<std::uint64_t> net_totals_;
+}; //class openmetrics_exporter
+
+} //namespace monitor
+} //namespace crossover
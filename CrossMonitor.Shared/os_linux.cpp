@@ -0,0 +1,91 @@
+#include "os.hpp"
+#include "log.hpp"
+
+#include <csignal>
+#include <cerrno>
+#include <unistd.h>
+
+#include <initializer_list>
+#include <mutex>
+#include <thread>
+
+#define LOG CROSSOVER_MONITOR_LOG
+
+using namespace std;
+
+namespace crossover {
+namespace monitor {
+namespace os {
+
+static mutex mutex_;
+static function<void()> handler_;
+static int pipe_[2] = { -1, -1 };
+
+/**
+ * Only async-signal-safe calls here: the handler runs on a thread of its
+ * own, woken up through the pipe.
+ */
+static void signal_helper(int) {
+	const int saved = errno;
+	const char byte = 1;
+	if (write(pipe_[1], &byte, 1) < 0) {
+		// the pipe is full, a termination is already pending
+	}
+	errno = saved;
+}
+
+static void handler_thread() {
+	char byte;
+	while (read(pipe_[0], &byte, 1) < 0 && errno == EINTR) {
+	}
+
+	try {
+		lock_guard<mutex> lock(mutex_);
+		if (handler_) {
+			handler_();
+		}
+	} catch (const std::exception& e) {
+		LOG(error) << "Termination handler threw an exception: "
+				   << e.what();
+	} catch (...) {
+		LOG(error) << "Termination handler threw an unknown exception: ";
+	}
+	// a second signal gets the default action, which ends the process
+	log::flush();
+	signal(SIGINT, SIG_DFL);
+	signal(SIGTERM, SIG_DFL);
+	signal(SIGHUP, SIG_DFL);
+}
+
+void set_termination_handler(const std::function<void()>& handler) noexcept {
+	static once_flag once;
+	call_once(once, [&handler] {
+		handler_ = handler;
+		if (pipe(pipe_) != 0) {
+			LOG(error) << "Failed to set termination handler, code: " << errno;
+			return;
+		}
+
+		try {
+			thread(&handler_thread).detach();
+		} catch (const std::exception& e) {
+			LOG(error) << "Failed to set termination handler: " << e.what();
+			return;
+		}
+
+		struct sigaction action = {};
+		action.sa_handler = &signal_helper;
+		sigemptyset(&action.sa_mask);
+		action.sa_flags = SA_RESTART;
+		for (int signal_number : { SIGINT, SIGTERM, SIGHUP }) {
+			if (sigaction(signal_number, &action, nullptr) != 0) {
+				LOG(error) << "Failed to set termination handler for signal "
+						   << signal_number << ", code: " << errno;
+			}
+		}
+	});
+}
+
+} //namespace os
+} //namespace monitor
+} //namespace crossover
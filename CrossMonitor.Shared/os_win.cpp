@@ -35,6 +35,9 @@ static BOOL WINAPI handler_helper(DWORD type) {
 		} catch (...) {
 			LOG(error) << "Termination handler threw an unknown exception: ";
 		}
+		// the process may be killed as soon as this returns (CTRL_CLOSE_EVENT),
+		// write out whatever the asynchronous log sinks still hold
+		log::flush();
 		return TRUE;
 	default:
 		return FALSE;
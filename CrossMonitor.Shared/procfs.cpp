@@ -0,0 +1,717 @@
+#include "procfs.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+using namespace std;
+
+namespace crossover {
+namespace monitor {
+namespace procfs {
+
+namespace {
+
+	const char snapshot_marker[] = "==> ";
+	const char section_marker[] = "--> ";
+
+	bool starts_with(const string& text, const char* prefix) noexcept {
+		return text.compare(0, strlen(prefix), prefix) == 0;
+	}
+
+	/**
+	 * @return the text after prefix on the first line starting with it, nullptr if none does.
+	 */
+	const char* find_line(const string& text, const char* prefix) noexcept {
+		const size_t length = strlen(prefix);
+		for (size_t pos = 0; pos < text.size();) {
+			if (text.compare(pos, length, prefix) == 0) {
+				return text.c_str() + pos + length;
+			}
+			pos = text.find('\n', pos);
+			if (pos == string::npos) {
+				break;
+			}
+			++pos;
+		}
+		return nullptr;
+	}
+
+	/**
+	 * @return the text after the "Node <n> <name>" of the first line of a
+	 * node meminfo with that name, nullptr if none has it.
+	 */
+	const char* find_node_line(const string& text, const char* name) noexcept {
+		const size_t length = strlen(name);
+		for (size_t pos = 0; pos < text.size();) {
+			const char* p = text.c_str() + pos;
+			if (strncmp(p, "Node ", 5) == 0) {
+				p += 5;
+				while (*p >= '0' && *p <= '9') {
+					++p;
+				}
+				while (*p == ' ') {
+					++p;
+				}
+				if (strncmp(p, name, length) == 0) {
+					return p + length;
+				}
+			}
+			pos = text.find('\n', pos);
+			if (pos == string::npos) {
+				break;
+			}
+			++pos;
+		}
+		return nullptr;
+	}
+
+	/**
+	 * Reads the next decimal number, skipping blanks, advancing p past it.
+	 */
+	uint64_t number(const char*& p) noexcept {
+		char* end;
+		const uint64_t value = strtoull(p, &end, 10);
+		p = end;
+		return value;
+	}
+
+	/**
+	 * Reads the next decimal number before end, skipping blanks, advancing
+	 * p past it; text read from a file is not NUL terminated.
+	 * @return false if there is none.
+	 */
+	bool number(const char*& p, const char* end, uint64_t& value) noexcept {
+		while (p < end && *p == ' ') {
+			++p;
+		}
+		if (p == end || *p < '0' || *p > '9') {
+			return false;
+		}
+		value = 0;
+		for (; p < end && *p >= '0' && *p <= '9'; ++p) {
+			value = value * 10 + static_cast<uint64_t>(*p - '0');
+		}
+		return true;
+	}
+
+	/**
+	 * @return the start of the line after p, end if p is on the last.
+	 */
+	const char* next_line(const char* p, const char* end) noexcept {
+		const char* const newline = static_cast<const char*>(memchr(p, '\n', static_cast<size_t>(end - p)));
+		return newline != nullptr ? newline + 1 : end;
+	}
+
+	/**
+	 * Skips the blank separated field at p, and the blanks before it.
+	 */
+	void skip_field(const char*& p, const char* end) noexcept {
+		while (p < end && *p == ' ') {
+			++p;
+		}
+		while (p < end && *p != ' ' && *p != '\n') {
+			++p;
+		}
+	}
+
+	/**
+	 * @return the end of the line at p, its newline or end.
+	 */
+	const char* line_end(const char* p, const char* end) noexcept {
+		const char* const newline = static_cast<const char*>(memchr(p, '\n', static_cast<size_t>(end - p)));
+		return newline != nullptr ? newline : end;
+	}
+
+	uint32_t narrow(uint64_t value) noexcept {
+		return static_cast<uint32_t>(min<uint64_t>(value, numeric_limits<uint32_t>::max()));
+	}
+
+	/**
+	 * Finds the value after key on a "<Label>: key value key value" line.
+	 * @return false if the line does not have key.
+	 */
+	bool find_value(const char* p, const char* end, const char* key, uint64_t& value) noexcept {
+		const size_t length = strlen(key);
+		skip_field(p, end);
+		while (p < end) {
+			while (p < end && *p == ' ') {
+				++p;
+			}
+			const char* const name = p;
+			skip_field(p, end);
+			if (static_cast<size_t>(p - name) == length && memcmp(name, key, length) == 0) {
+				return number(p, end, value);
+			}
+			skip_field(p, end);
+		}
+		return false;
+	}
+
+	bool skipped_device(const string& name) noexcept {
+		static const char* const prefixes[] = { "loop", "ram", "zram", "sr", "fd", "dm-", "md" };
+		for (const char* prefix : prefixes) {
+			if (starts_with(name, prefix)) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	/**
+	 * sda1 of sda, nvme0n1p1 of nvme0n1, mmcblk0p1 of mmcblk0
+	 */
+	bool is_partition_of(const string& name, const string& disk) noexcept {
+		if (name.size() <= disk.size() || name.compare(0, disk.size(), disk) != 0) {
+			return false;
+		}
+		size_t pos = disk.size();
+		if (name[pos] == 'p') {
+			++pos;
+		}
+		if (pos == name.size()) {
+			return false;
+		}
+		for (; pos < name.size(); ++pos) {
+			if (name[pos] < '0' || name[pos] > '9') {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	bool pseudo_filesystem(const string& type) noexcept {
+		static const char* const types[] = {
+			"autofs", "binfmt_misc", "bpf", "cgroup", "cgroup2", "configfs", "debugfs", "devpts",
+			"devtmpfs", "efivarfs", "fusectl", "hugetlbfs", "mqueue", "nsfs", "proc", "pstore",
+			"ramfs", "rpc_pipefs", "securityfs", "selinuxfs", "squashfs", "sysfs", "tracefs"
+		};
+		for (const char* t : types) {
+			if (type == t) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	/**
+	 * Next blank separated field of the line, advancing p past it.
+	 */
+	string field(const char*& p, const char* end) {
+		while (p < end && *p == ' ') {
+			++p;
+		}
+		const char* start = p;
+		while (p < end && *p != ' ') {
+			++p;
+		}
+		return string(start, p);
+	}
+
+	/**
+	 * Replaces the octal escapes the kernel writes for blanks and
+	 * backslashes in paths.
+	 */
+	string unescape(const string& path) {
+		string res;
+		res.reserve(path.size());
+		for (size_t i = 0; i < path.size(); ++i) {
+			if (path[i] == '\\' && i + 3 < path.size() && path[i + 1] >= '0' && path[i + 1] <= '3' &&
+				path[i + 2] >= '0' && path[i + 2] <= '7' && path[i + 3] >= '0' && path[i + 3] <= '7') {
+				res += static_cast<char>((path[i + 1] - '0') * 64 + (path[i + 2] - '0') * 8 + (path[i + 3] - '0'));
+				i += 3;
+			} else {
+				res += path[i];
+			}
+		}
+		return res;
+	}
+
+} //namespace
+
+bool parse_stat(const string& text, counter_snapshot& snapshot) noexcept {
+	const char* p = find_line(text, "cpu ");
+	if (p == nullptr) {
+		return false;
+	}
+
+	// user nice system idle iowait irq softirq steal, guest time is part of user
+	uint64_t fields[8] = {};
+	for (auto& field : fields) {
+		field = number(p);
+	}
+
+	uint64_t total = 0;
+	for (auto field : fields) {
+		total += field;
+	}
+	snapshot.cpu_total = total;
+	snapshot.cpu_busy = total - fields[3] - fields[4];
+	return true;
+}
+
+void parse_stat_cpus(const string& text, vector<cpu_time>& out) {
+	out.clear();
+	for (size_t pos = 0; pos < text.size();) {
+		const char* p = text.c_str() + pos;
+		if (strncmp(p, "cpu", 3) == 0 && p[3] >= '0' && p[3] <= '9') {
+			p += 3;
+			cpu_time cpu;
+			cpu.cpu = static_cast<unsigned>(number(p));
+			// as parse_stat
+			uint64_t fields[8] = {};
+			for (auto& field : fields) {
+				field = number(p);
+			}
+			cpu.total = 0;
+			for (auto field : fields) {
+				cpu.total += field;
+			}
+			cpu.busy = cpu.total - fields[3] - fields[4];
+			out.push_back(cpu);
+		}
+		pos = text.find('\n', pos);
+		if (pos == string::npos) {
+			break;
+		}
+		++pos;
+	}
+}
+
+bool parse_meminfo(const string& text, counter_snapshot& snapshot) noexcept {
+	const char* total = find_line(text, "MemTotal:");
+	const char* available = find_line(text, "MemAvailable:");
+	if (total == nullptr || available == nullptr) {
+		return false;
+	}
+	snapshot.memory_total = number(total) * 1024;
+	snapshot.memory_available = number(available) * 1024;
+	return true;
+}
+
+void parse_diskstats(const string& text, counter_snapshot& snapshot) {
+	struct device {
+		string name;
+		uint64_t sectors_read;
+		uint64_t sectors_written;
+	};
+	vector<device> devices;
+
+	const char* p = text.c_str();
+	while (*p) {
+		const char* end = strchr(p, '\n');
+		if (end == nullptr) {
+			end = p + strlen(p);
+		}
+
+		// major minor name reads merged sectors_read ms writes merged sectors_written ...
+		number(p);
+		number(p);
+		while (p < end && (*p == ' ' || *p == '\t')) {
+			++p;
+		}
+		const char* name = p;
+		while (p < end && *p != ' ' && *p != '\t') {
+			++p;
+		}
+
+		device d;
+		d.name.assign(name, p);
+		number(p);
+		number(p);
+		d.sectors_read = number(p);
+		number(p);
+		number(p);
+		number(p);
+		d.sectors_written = number(p);
+		if (!d.name.empty() && p <= end && !skipped_device(d.name)) {
+			devices.push_back(d);
+		}
+
+		p = *end ? end + 1 : end;
+	}
+
+	snapshot.volumes.clear();
+	for (const auto& d : devices) {
+		bool partition = false;
+		for (const auto& other : devices) {
+			if (is_partition_of(d.name, other.name)) {
+				partition = true;
+				break;
+			}
+		}
+		if (partition || snapshot.volumes.size() == 26) {
+			continue;
+		}
+
+		volume_counters volume;
+		volume.name = static_cast<wchar_t>(L'a' + snapshot.volumes.size());
+		volume.device = d.name;
+		// diskstats counts 512 byte sectors whatever the device uses
+		volume.bytes_read = d.sectors_read * 512;
+		volume.bytes_written = d.sectors_written * 512;
+		snapshot.volumes.push_back(volume);
+	}
+}
+
+bool parse_node_meminfo(const string& text, uint64_t& memory_total, uint64_t& memory_available) noexcept {
+	const char* total = find_node_line(text, "MemTotal:");
+	const char* free = find_node_line(text, "MemFree:");
+	if (total == nullptr || free == nullptr) {
+		return false;
+	}
+	memory_total = number(total) * 1024;
+	uint64_t available = number(free);
+	for (const char* name : { "Active(file):", "Inactive(file):", "SReclaimable:" }) {
+		const char* p = find_node_line(text, name);
+		if (p != nullptr) {
+			available += number(p);
+		}
+	}
+	memory_available = min(available * 1024, memory_total);
+	return true;
+}
+
+bool parse_numastat(const string& text, uint64_t& numa_miss, uint64_t& numa_foreign) noexcept {
+	const char* miss = find_line(text, "numa_miss ");
+	const char* foreign = find_line(text, "numa_foreign ");
+	if (miss == nullptr || foreign == nullptr) {
+		return false;
+	}
+	numa_miss = number(miss);
+	numa_foreign = number(foreign);
+	return true;
+}
+
+bool parse_schedstat(const char* text, size_t length, run_queue_counters& out) {
+	const char* const end = text + length;
+	if (length < 8 || memcmp(text, "version ", 8) != 0) {
+		return false;
+	}
+	const char* p = text + 8;
+	uint64_t version;
+	if (!number(p, end, version) || version < 15) {
+		return false;
+	}
+
+	size_t count = 0;
+	for (p = next_line(p, end); p < end; p = next_line(p, end)) {
+		if (end - p < 4 || memcmp(p, "cpu", 3) != 0 || p[3] < '0' || p[3] > '9') {
+			continue;
+		}
+		p += 3;
+		// yld_count, an unused 0, sched_count, sched_goidle, ttwu_count,
+		// ttwu_local, rq_cpu_time, run_delay, pcount
+		uint64_t fields[10];
+		size_t read = 0;
+		while (read < 10 && number(p, end, fields[read])) {
+			++read;
+		}
+		if (read < 10) {
+			continue;
+		}
+		if (count == out.size()) {
+			out.resize(count + 1);
+		}
+		out.cpus[count] = static_cast<unsigned>(fields[0]);
+		out.run_ns[count] = fields[7];
+		out.wait_ns[count] = fields[8];
+		out.timeslices[count] = fields[9];
+		++count;
+	}
+	out.resize(count);
+	return true;
+}
+
+bool parse_process_schedstat(const char* text, size_t length, uint64_t& run_ns, uint64_t& wait_ns,
+							 uint64_t& timeslices) noexcept {
+	const char* p = text;
+	const char* const end = text + length;
+	return number(p, end, run_ns) && number(p, end, wait_ns) && number(p, end, timeslices);
+}
+
+net_table_columns::net_table_columns(const vector<string>& fields)
+	: fields_(fields)
+	, lookups_(0) {
+	for (const auto& field : fields_) {
+		const size_t colon = field.find(':');
+		if (colon == string::npos || colon == 0 || colon + 1 == field.size()) {
+			throw invalid_argument("net table field is not <Table>:<name>: " + field);
+		}
+	}
+}
+
+size_t net_table_columns::parse(const char* text, size_t length, uint64_t* values) {
+	fill(values, values + fields_.size(), 0);
+	if (lookups_ == 0 || !same_names(text, length)) {
+		look_up(text, length);
+	}
+
+	const char* const end = text + length;
+	const char* p = text;
+	auto column = columns_.begin();
+	size_t found = 0;
+	for (size_t table = 0; p < end && column != columns_.end(); ++table) {
+		const char* const values_line = next_line(p, end);
+		const char* const values_end = line_end(values_line, end);
+		p = next_line(values_line, end);
+		if (column->table != table) {
+			continue;
+		}
+
+		// the "<Table>:" label, then the values in name order
+		const char* v = values_line;
+		skip_field(v, values_end);
+		size_t index = 0;
+		for (; column != columns_.end() && column->table == table; ++column) {
+			for (; index < column->index; ++index) {
+				skip_field(v, values_end);
+			}
+			// negative values, as MaxConn -1, are not counters
+			if (number(v, values_end, values[column->field])) {
+				++found;
+				++index;
+			}
+		}
+	}
+	return found;
+}
+
+bool net_table_columns::same_names(const char* text, size_t length) const noexcept {
+	const char* const end = text + length;
+	const char* p = text;
+	for (const auto& names : names_) {
+		const char* const names_end = line_end(p, end);
+		if (static_cast<size_t>(names_end - p) != names.size() || memcmp(p, names.data(), names.size()) != 0) {
+			return false;
+		}
+		p = next_line(next_line(p, end), end);
+	}
+	return p == end;
+}
+
+void net_table_columns::look_up(const char* text, size_t length) {
+	++lookups_;
+	names_.clear();
+	columns_.clear();
+
+	const char* const end = text + length;
+	for (const char* p = text; p < end; p = next_line(next_line(p, end), end)) {
+		const char* const names_end = line_end(p, end);
+		const size_t table = names_.size();
+		names_.emplace_back(p, names_end);
+
+		const char* n = p;
+		skip_field(n, names_end);
+		const string label(p, n);
+		for (size_t index = 0; n < names_end; ++index) {
+			while (n < names_end && *n == ' ') {
+				++n;
+			}
+			const char* const name = n;
+			skip_field(n, names_end);
+			if (name == n) {
+				break;
+			}
+			for (size_t field = 0; field < fields_.size(); ++field) {
+				const string& wanted = fields_[field];
+				const size_t colon = wanted.find(':');
+				if (label.size() == colon + 1 && wanted.compare(0, colon + 1, label) == 0 &&
+					wanted.compare(colon + 1, string::npos, name, static_cast<size_t>(n - name)) == 0) {
+					columns_.push_back({ table, index, field });
+				}
+			}
+		}
+	}
+	sort(columns_.begin(), columns_.end(), [](const column& a, const column& b) {
+		return a.table != b.table ? a.table < b.table : a.index < b.index;
+	});
+}
+
+bool parse_sockstat(const char* text, size_t length, uint64_t page_size, net_stats& net) noexcept {
+	const char* const end = text + length;
+	bool tcp = false;
+	net.sockets = 0;
+	net.tcp_sockets = 0;
+	net.tcp_orphans = 0;
+	net.tcp_time_wait = 0;
+	net.udp_sockets = 0;
+	net.tcp_memory_bytes = 0;
+	net.udp_memory_bytes = 0;
+	for (const char* p = text; p < end; p = next_line(p, end)) {
+		const char* const eol = line_end(p, end);
+		uint64_t value;
+		if (eol - p > 8 && memcmp(p, "sockets:", 8) == 0) {
+			if (find_value(p, eol, "used", value)) {
+				net.sockets = narrow(value);
+			}
+		} else if (eol - p > 4 && memcmp(p, "TCP:", 4) == 0) {
+			tcp = true;
+			if (find_value(p, eol, "inuse", value)) {
+				net.tcp_sockets = narrow(value);
+			}
+			if (find_value(p, eol, "orphan", value)) {
+				net.tcp_orphans = narrow(value);
+			}
+			if (find_value(p, eol, "tw", value)) {
+				net.tcp_time_wait = narrow(value);
+			}
+			if (find_value(p, eol, "mem", value)) {
+				net.tcp_memory_bytes = value * page_size;
+			}
+		} else if (eol - p > 4 && memcmp(p, "UDP:", 4) == 0) {
+			if (find_value(p, eol, "inuse", value)) {
+				net.udp_sockets = narrow(value);
+			}
+			if (find_value(p, eol, "mem", value)) {
+				net.udp_memory_bytes = value * page_size;
+			}
+		}
+	}
+	return tcp;
+}
+
+void parse_cpulist(const string& text, vector<unsigned>& out) {
+	out.clear();
+	const char* p = text.c_str();
+	while (*p >= '0' && *p <= '9') {
+		const uint64_t first = number(p);
+		uint64_t last = first;
+		if (*p == '-') {
+			++p;
+			last = number(p);
+		}
+		for (uint64_t cpu = first; cpu <= last && cpu - first < 65536; ++cpu) {
+			out.push_back(static_cast<unsigned>(cpu));
+		}
+		if (*p != ',') {
+			break;
+		}
+		++p;
+	}
+}
+
+bool topology_uevent(const char* message, size_t length) noexcept {
+	static const char* const actions[] = { "online@", "offline@", "add@", "remove@" };
+	static const char* const devpaths[] = {
+		"/devices/system/cpu/cpu", "/devices/system/memory/memory", "/devices/system/node/node"
+	};
+
+	// only the "<action>@<devpath>" header, up to the first NUL
+	const char* const end = static_cast<const char*>(memchr(message, '\0', length));
+	const size_t header = end != nullptr ? static_cast<size_t>(end - message) : length;
+	for (const char* action : actions) {
+		const size_t action_length = strlen(action);
+		if (header < action_length || memcmp(message, action, action_length) != 0) {
+			continue;
+		}
+		for (const char* devpath : devpaths) {
+			const size_t devpath_length = strlen(devpath);
+			// cpu<n>, not cpufreq or cpuidle
+			const char* const digit = message + action_length + devpath_length;
+			if (header - action_length > devpath_length &&
+				memcmp(message + action_length, devpath, devpath_length) == 0 &&
+				*digit >= '0' && *digit <= '9') {
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+void parse_mountinfo(const string& text, vector<mount_entry>& out) {
+	out.clear();
+	const char* p = text.c_str();
+	while (*p) {
+		const char* end = strchr(p, '\n');
+		if (end == nullptr) {
+			end = p + strlen(p);
+		}
+
+		// id parent major:minor root mount_point options [optional...] - type source super_options
+		for (int i = 0; i < 4; ++i) {
+			field(p, end);
+		}
+		mount_entry entry;
+		entry.mount_point = unescape(field(p, end));
+		string separator;
+		do {
+			separator = field(p, end);
+		} while (!separator.empty() && separator != "-");
+		entry.fs_type = field(p, end);
+		entry.source = unescape(field(p, end));
+
+		if (!entry.mount_point.empty() && !entry.fs_type.empty() && !pseudo_filesystem(entry.fs_type)) {
+			// a later mount on the same point hides the earlier one
+			const auto hidden = find_if(out.begin(), out.end(),
+				[&](const mount_entry& m) { return m.mount_point == entry.mount_point; });
+			if (hidden != out.end()) {
+				*hidden = entry;
+			} else {
+				out.push_back(entry);
+			}
+		}
+
+		p = *end ? end + 1 : end;
+	}
+}
+
+capture_reader::capture_reader(istream& in)
+	: in_(in) {
+}
+
+bool capture_reader::next(counter_snapshot& snapshot) {
+	while (header_.empty()) {
+		if (!getline(in_, line_)) {
+			return false;
+		}
+		if (starts_with(line_, snapshot_marker)) {
+			header_ = line_;
+		}
+	}
+
+	snapshot.time_ms = strtoll(header_.c_str() + strlen(snapshot_marker), nullptr, 10);
+	header_.clear();
+	stat_.clear();
+	meminfo_.clear();
+	diskstats_.clear();
+	processes_.clear();
+
+	string* section = nullptr;
+	while (getline(in_, line_)) {
+		if (starts_with(line_, snapshot_marker)) {
+			header_ = line_;
+			break;
+		}
+		if (starts_with(line_, section_marker)) {
+			section_.assign(line_, strlen(section_marker), string::npos);
+			section = section_ == "stat" ? &stat_ :
+				section_ == "meminfo" ? &meminfo_ :
+				section_ == "diskstats" ? &diskstats_ :
+				section_ == "processes" ? &processes_ : nullptr;
+			continue;
+		}
+		if (section != nullptr) {
+			*section += line_;
+			*section += '\n';
+		}
+	}
+
+	return parse(snapshot);
+}
+
+bool capture_reader::parse(counter_snapshot& snapshot) {
+	if (!parse_stat(stat_, snapshot) || !parse_meminfo(meminfo_, snapshot)) {
+		throw runtime_error("procfs capture: stat or meminfo missing at " + to_string(snapshot.time_ms));
+	}
+	parse_diskstats(diskstats_, snapshot);
+	snapshot.process_count = static_cast<unsigned>(strtoul(processes_.c_str(), nullptr, 10));
+	return true;
+}
+
+} //namespace procfs
+} //namespace monitor
+} //namespace crossover
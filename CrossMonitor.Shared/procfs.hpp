@@ -0,0 +1,209 @@
+#pragma once
+
+#include "snapshot.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <string>
+#include <vector>
+
+/**
+ * Linux procfs and sysfs counters, parsed from text so that both live
+ * files and recorded captures go through the same code.
+ */
+
+namespace crossover {
+namespace monitor {
+namespace procfs {
+
+	/**
+	 * Reads the aggregate "cpu" line of /proc/stat.
+	 * @return false if it is missing.
+	 */
+	bool parse_stat(const std::string& text, counter_snapshot& snapshot) noexcept;
+
+	/**
+	 * CPU time of one CPU since boot, as counter_snapshot::cpu_total and
+	 * cpu_busy.
+	 */
+	struct cpu_time {
+		unsigned cpu;
+		std::uint64_t total;
+		std::uint64_t busy;
+	};
+
+	/**
+	 * Reads the "cpu<n>" lines of /proc/stat, one per online CPU.
+	 */
+	void parse_stat_cpus(const std::string& text, std::vector<cpu_time>& out);
+
+	/**
+	 * Reads MemTotal and MemAvailable of /proc/meminfo.
+	 * @return false if either is missing.
+	 */
+	bool parse_meminfo(const std::string& text, counter_snapshot& snapshot) noexcept;
+
+	/**
+	 * Reads the whole disks of /proc/diskstats; partitions, loop, ram,
+	 * optical and device mapper devices are skipped. data names volumes with
+	 * one character, so the disks are named L'a', L'b', ... in the order
+	 * listed, up to 26.
+	 */
+	void parse_diskstats(const std::string& text, counter_snapshot& snapshot);
+
+	/**
+	 * Reads the memory of /sys/devices/system/node/node<n>/meminfo into
+	 * memory_total and memory_available. Nodes have no MemAvailable,
+	 * it is taken as MemFree plus the file pages and the reclaimable slab,
+	 * which the kernel can free for allocations.
+	 * @return false if MemTotal or MemFree is missing.
+	 */
+	bool parse_node_meminfo(const std::string& text, std::uint64_t& memory_total,
+							std::uint64_t& memory_available) noexcept;
+
+	/**
+	 * Reads numa_miss and numa_foreign of /sys/devices/system/node/node<n>/numastat.
+	 * @return false if either is missing.
+	 */
+	bool parse_numastat(const std::string& text, std::uint64_t& numa_miss, std::uint64_t& numa_foreign) noexcept;
+
+	/**
+	 * Reads the run queue of every CPU of /proc/schedstat, version 15 and
+	 * later, into out in the order listed. Does not allocate once out
+	 * holds every CPU, the text is not copied.
+	 * @return false for an unsupported version.
+	 */
+	bool parse_schedstat(const char* text, std::size_t length, run_queue_counters& out);
+
+	/**
+	 * Reads the run and wait nanoseconds and timeslices of /proc/<pid>/schedstat.
+	 * @return false if the text has fewer fields.
+	 */
+	bool parse_process_schedstat(const char* text, std::size_t length, std::uint64_t& run_ns,
+								 std::uint64_t& wait_ns, std::uint64_t& timeslices) noexcept;
+
+	/**
+	 * Reads named fields of the tables of /proc/net/snmp and
+	 * /proc/net/netstat, each a "<Table>: <names>" line followed by a
+	 * "<Table>: <values>" line. Where every field is, which line and which
+	 * column, is looked up from the first text parsed and kept; later texts
+	 * are only checked to have the same name lines, and the columns are
+	 * looked up again if they do not, as after a kernel upgrade.
+	 */
+	class net_table_columns final {
+	public:
+		/**
+		 * @param fields "<Table>:<name>" of every field, as "Tcp:RetransSegs",
+		 * in the order of the values parse() writes.
+		 */
+		explicit net_table_columns(const std::vector<std::string>& fields);
+
+		/**
+		 * Writes the value of every field to values, 0 for the fields the
+		 * text does not have or that are negative. Does not allocate unless
+		 * the name lines changed.
+		 * @return number of fields found.
+		 */
+		std::size_t parse(const char* text, std::size_t length, std::uint64_t* values);
+
+		/**
+		 * Times the columns were looked up.
+		 */
+		std::uint64_t lookups() const noexcept {
+			return lookups_;
+		}
+
+	private:
+		struct column {
+			// of the line pair and of the value on its value line
+			std::size_t table;
+			std::size_t index;
+			std::size_t field;
+		};
+
+		bool same_names(const char* text, std::size_t length) const noexcept;
+		void look_up(const char* text, std::size_t length);
+
+		std::vector<std::string> fields_;
+		// name line of every table, as last looked up
+		std::vector<std::string> names_;
+		// ordered by table and index
+		std::vector<column> columns_;
+		std::uint64_t lookups_;
+	}; //class net_table_columns
+
+	/**
+	 * Reads the sockets in use and the memory of TCP and UDP of
+	 * /proc/net/sockstat into the socket fields of net.
+	 * @param page_size bytes of the pages the memory is counted in.
+	 * @return false if the TCP line is missing.
+	 */
+	bool parse_sockstat(const char* text, std::size_t length, std::uint64_t page_size, net_stats& net) noexcept;
+
+	/**
+	 * Reads a sysfs list of CPUs or nodes, such as "0-3,8-11", in order.
+	 */
+	void parse_cpulist(const std::string& text, std::vector<unsigned>& out);
+
+	/**
+	 * @return whether a kernel uevent, as read from a NETLINK_KOBJECT_UEVENT
+	 * socket ("<action>@<devpath>" and NUL separated KEY=value pairs),
+	 * reports a CPU, memory block or node going on or offline.
+	 */
+	bool topology_uevent(const char* message, std::size_t length) noexcept;
+
+	/**
+	 * A mount of /proc/<pid>/mountinfo.
+	 */
+	struct mount_entry {
+		std::string mount_point;
+		std::string fs_type;
+		std::string source;
+	};
+
+	/**
+	 * Reads the mounts of /proc/<pid>/mountinfo that hold files: pseudo
+	 * filesystems (proc, sysfs, cgroup, ...) are skipped, and of the mounts
+	 * stacked on one mount point only the last, visible one is kept, in its
+	 * place. Mount points are unescaped (\040 is a space).
+	 */
+	void parse_mountinfo(const std::string& text, std::vector<mount_entry>& out);
+
+	/**
+	 * Reads a capture of the procfs files, one snapshot after the other:
+	 *
+	 *   ==> <milliseconds since 1970-01-01>
+	 *   --> stat
+	 *   <contents of /proc/stat>
+	 *   --> meminfo
+	 *   <contents of /proc/meminfo>
+	 *   --> diskstats
+	 *   <contents of /proc/diskstats>
+	 *   --> processes
+	 *   <number of /proc/<pid> directories>
+	 *
+	 * See CrossMonitor.Replay/capture_procfs.sh.
+	 */
+	class capture_reader final : public snapshot_source, public boost::noncopyable {
+	public:
+		explicit capture_reader(std::istream& in);
+
+		bool next(counter_snapshot& snapshot) override;
+
+	private:
+		bool parse(counter_snapshot& snapshot);
+
+		std::istream& in_;
+		std::string line_;
+		std::string header_;
+		std::string section_;
+		std::string stat_;
+		std::string meminfo_;
+		std::string diskstats_;
+		std::string processes_;
+	}; //class capture_reader
+
+} //namespace procfs
+} //namespace monitor
+} //namespace crossover
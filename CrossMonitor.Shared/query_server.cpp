@@ -0,0 +1,372 @@
+#include "query_server.hpp"
+#include "openmetrics.hpp"
+#include "log.hpp"
+
+#include <boost/asio.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <istream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define LOG CROSSOVER_MONITOR_LOG
+
+using namespace std;
+
+namespace crossover {
+namespace monitor {
+
+namespace asio = boost::asio;
+using asio::ip::tcp;
+
+namespace {
+
+	const size_t max_request_size = 4096;
+	const unsigned default_history_minutes = 5;
+	const unsigned max_history_minutes = 24 * 60;
+	const boost::posix_time::seconds request_timeout(5);
+
+	// separators of the JSON arrays, gathered by reference
+	const char array_begin[] = "[";
+	const char array_separator[] = ",";
+	const char array_end[] = "]";
+
+	const char json_content_type[] = "application/json";
+
+	/**
+	 * @return value of the minutes parameter of a query string.
+	 */
+	unsigned history_minutes(const string& query) noexcept {
+		const string name = "minutes=";
+		size_t pos = 0;
+		while (pos < query.size()) {
+			const size_t end = min(query.find('&', pos), query.size());
+			if (query.compare(pos, name.size(), name) == 0) {
+				const unsigned long minutes = strtoul(query.c_str() + pos + name.size(), nullptr, 10);
+				return static_cast<unsigned>(min<unsigned long>(max(minutes, 1UL), max_history_minutes));
+			}
+			pos = end + 1;
+		}
+		return default_history_minutes;
+	}
+
+} //namespace
+
+class query_server::impl final {
+private:
+	class connection final : public enable_shared_from_this<connection> {
+	public:
+		connection(impl& server)
+			: server_(server)
+			, socket_(server.io_service_)
+			, request_(max_request_size)
+			, timer_(server.io_service_)
+			, ring_(nullptr)
+			, held_(nullptr)
+			, last_byte_(0) {
+		}
+
+		tcp::socket& socket() noexcept {
+			return socket_;
+		}
+
+		void start() {
+			auto self = shared_from_this();
+			timer_.expires_from_now(request_timeout);
+			timer_.async_wait([self](const boost::system::error_code& error) {
+				if (!error) {
+					boost::system::error_code ignored;
+					self->socket_.close(ignored);
+				}
+			});
+			asio::async_read_until(socket_, request_, "\r\n\r\n",
+				[self](const boost::system::error_code& error, size_t) {
+				self->timer_.cancel();
+				if (!error) {
+					self->respond();
+				}
+			});
+		}
+
+	private:
+		void respond() {
+			istream request(&request_);
+			string method, target;
+			request >> method >> target;
+
+			const size_t question = target.find('?');
+			const string path = target.substr(0, question);
+			const string query = question == string::npos ? string() : target.substr(question + 1);
+
+			if (method != "GET") {
+				reply("405 Method Not Allowed");
+			} else if (path == "/latest") {
+				latest();
+			} else if (path == "/history") {
+				history(history_minutes(query));
+			} else if (path == "/aggregates") {
+				aggregates();
+			} else if (path == "/metrics") {
+				metrics();
+			} else {
+				reply("404 Not Found");
+			}
+		}
+
+		void latest() {
+			const utils::sample_ring& ring = *(ring_ = &server_.samples_);
+			const uint64_t count = ring.count();
+			utils::sample_ring::view v;
+			if (count == 0 || !ring.read(count - 1, v)) {
+				reply("404 Not Found");
+				return;
+			}
+			views_.push_back(v);
+			reply_views(false, json_content_type);
+		}
+
+		void metrics() {
+			const utils::sample_ring& ring = *(ring_ = &server_.metrics_);
+			const uint64_t count = ring.count();
+			utils::sample_ring::view v;
+			if (count == 0 || !ring.read(count - 1, v)) {
+				reply("404 Not Found");
+				return;
+			}
+			views_.push_back(v);
+			reply_views(false, openmetrics_exporter::content_type);
+		}
+
+		void history(unsigned minutes) {
+			const utils::sample_ring& ring = *(ring_ = &server_.samples_);
+			const uint64_t count = ring.count();
+			const uint64_t oldest = ring.headroom(count);
+
+			int64_t since = 0;
+			utils::sample_ring::view v;
+			for (uint64_t index = count; index-- > oldest && ring.read(index, v);) {
+				if (views_.empty()) {
+					since = v.time_ms - static_cast<int64_t>(minutes) * 60 * 1000;
+				} else if (v.time_ms <= since) {
+					break;
+				}
+				views_.push_back(v);
+			}
+			reverse(views_.begin(), views_.end());
+			reply_views(true, json_content_type);
+		}
+
+		void aggregates() {
+			const utils::sample_ring& ring = *(ring_ = &server_.aggregates_);
+			const uint64_t count = ring.count();
+			const uint64_t oldest = ring.headroom(count);
+
+			utils::sample_ring::view v;
+			for (uint64_t index = count; index-- > oldest && ring.read(index, v);) {
+				const bool seen = any_of(views_.begin(), views_.end(),
+					[&](const utils::sample_ring::view& other) { return other.tag == v.tag; });
+				if (!seen) {
+					views_.push_back(v);
+				}
+			}
+			sort(views_.begin(), views_.end(),
+				[](const utils::sample_ring::view& a, const utils::sample_ring::view& b) { return a.tag < b.tag; });
+			reply_views(true, json_content_type);
+		}
+
+		void reply_views(bool array, const char* content_type) {
+			size_t length = 0;
+			if (array) {
+				buffers_.push_back(asio::buffer(array_begin, 1));
+				length += 2;
+			}
+			for (size_t i = 0; i < views_.size(); ++i) {
+				if (array && i > 0) {
+					buffers_.push_back(asio::buffer(array_separator, 1));
+					++length;
+				}
+				buffers_.push_back(asio::buffer(views_[i].first, views_[i].first_size));
+				if (views_[i].second_size > 0) {
+					buffers_.push_back(asio::buffer(views_[i].second, views_[i].second_size));
+				}
+				length += views_[i].size();
+			}
+			if (array) {
+				buffers_.push_back(asio::buffer(array_end, 1));
+			}
+
+			header_ = "HTTP/1.0 200 OK\r\n"
+				"Content-Type: " + string(content_type) + "\r\n"
+				"Content-Length: " + to_string(length) + "\r\n"
+				"Connection: close\r\n\r\n";
+			buffers_.insert(buffers_.begin(), asio::buffer(header_));
+
+			// the last byte is sent once the others are checked, so that the
+			// client of a torn response never gets all of its Content-Length
+			const asio::const_buffer last = buffers_.back();
+			const size_t last_size = asio::buffer_size(last);
+			held_ = asio::buffer_cast<const char*>(last) + last_size - 1;
+			buffers_.back() = asio::buffer(asio::buffer_cast<const char*>(last), last_size - 1);
+			write();
+		}
+
+		void reply(const string& status) {
+			header_ = "HTTP/1.0 " + status + "\r\n"
+				"Content-Length: 0\r\n"
+				"Connection: close\r\n\r\n";
+			buffers_.push_back(asio::buffer(header_));
+			write();
+		}
+
+		void write() {
+			auto self = shared_from_this();
+			asio::async_write(socket_, buffers_, [self](const boost::system::error_code& error, size_t) {
+				self->written(error);
+			});
+		}
+
+		void written(const boost::system::error_code& error) {
+			if (error) {
+				LOG(debug) << "Query response not sent: " << error.message();
+				return;
+			}
+			if (held_ != nullptr) {
+				// all the other bytes are in the socket now
+				last_byte_ = *held_;
+				held_ = nullptr;
+				const bool torn = any_of(views_.begin(), views_.end(), [this](const utils::sample_ring::view& v) {
+					return !ring_->valid(v);
+				});
+				if (torn) {
+					++server_.torn_;
+					LOG(warning) << "Query response overwritten by the collector while it was sent, connection reset";
+					reset();
+					return;
+				}
+				buffers_.assign(1, asio::buffer(&last_byte_, 1));
+				write();
+				return;
+			}
+			++server_.served_;
+
+			boost::system::error_code ignored;
+			socket_.shutdown(tcp::socket::shutdown_both, ignored);
+		}
+
+		/**
+		 * Closes the connection with a reset, the client sees an error
+		 * rather than the end of the response.
+		 */
+		void reset() {
+			boost::system::error_code ignored;
+			socket_.set_option(tcp::socket::linger(true, 0), ignored);
+			socket_.close(ignored);
+		}
+
+		impl& server_;
+		tcp::socket socket_;
+		asio::streambuf request_;
+		asio::deadline_timer timer_;
+		// ring the views point into
+		const utils::sample_ring* ring_;
+		vector<utils::sample_ring::view> views_;
+		string header_;
+		vector<asio::const_buffer> buffers_;
+		// last byte of a response of views, sent after they are checked
+		const char* held_;
+		char last_byte_;
+	}; //class connection
+
+public:
+	impl(const query_options& options, const utils::sample_ring& samples, const utils::sample_ring& aggregates,
+		 const utils::sample_ring& metrics)
+		: samples_(samples)
+		, aggregates_(aggregates)
+		, metrics_(metrics)
+		, acceptor_(io_service_, tcp::endpoint(asio::ip::address_v4::loopback(), options.port))
+		, served_(0)
+		, torn_(0) {
+		accept();
+		thread_ = thread([this]() {
+			try {
+				io_service_.run();
+			}
+			catch (const std::exception& e) {
+				LOG(error) << "Query endpoint stopped: " << e.what();
+			}
+		});
+
+		LOG(info) << "Query endpoint listening on 127.0.0.1:" << port();
+	}
+
+	~impl() {
+		io_service_.stop();
+		if (thread_.joinable()) {
+			thread_.join();
+		}
+	}
+
+	unsigned short port() const noexcept {
+		boost::system::error_code error;
+		return acceptor_.local_endpoint(error).port();
+	}
+
+	uint64_t served() const noexcept {
+		return served_;
+	}
+
+	uint64_t torn_responses() const noexcept {
+		return torn_;
+	}
+
+private:
+	void accept() {
+		auto next = make_shared<connection>(*this);
+		acceptor_.async_accept(next->socket(), [this, next](const boost::system::error_code& error) {
+			if (!error) {
+				next->start();
+			} else if (error == asio::error::operation_aborted) {
+				return;
+			} else {
+				LOG(warning) << "Query endpoint accept failed: " << error.message();
+			}
+			accept();
+		});
+	}
+
+	const utils::sample_ring& samples_;
+	const utils::sample_ring& aggregates_;
+	const utils::sample_ring& metrics_;
+	asio::io_service io_service_;
+	tcp::acceptor acceptor_;
+	thread thread_;
+	atomic<uint64_t> served_;
+	atomic<uint64_t> torn_;
+}; //class query_server::impl
+
+query_server::query_server(const query_options& options, const utils::sample_ring& samples,
+						   const utils::sample_ring& aggregates, const utils::sample_ring& metrics)
+	: impl_(new impl(options, samples, aggregates, metrics)) {
+}
+
+query_server::~query_server() {
+}
+
+unsigned short query_server::port() const noexcept {
+	return impl_->port();
+}
+
+uint64_t query_server::served() const noexcept {
+	return impl_->served();
+}
+
+uint64_t query_server::torn_responses() const noexcept {
+	return impl_->torn_responses();
+}
+
+} //namespace monitor
+} //namespace crossover
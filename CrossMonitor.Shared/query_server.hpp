@@ -0,0 +1,78 @@
+#pragma once
+
+#include "sample_ring.hpp"
+
+#include <boost/noncopyable.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace crossover {
+namespace monitor {
+
+/**
+ * Local query endpoint setup.
+ */
+struct query_options {
+	bool enabled = false;
+	/**
+	 * Loopback TCP port, 0 picks a free one (see query_server::port()).
+	 */
+	unsigned short port = 8089;
+	/**
+	 * Size of the sample history ring. With the defaults about an hour
+	 * of one second samples of a machine with a few volumes fit.
+	 */
+	std::size_t history_bytes = 4 * 1024 * 1024;
+	std::size_t history_records = 16 * 1024;
+};
+
+/**
+ * HTTP/1.0 endpoint on 127.0.0.1 serving records published into
+ * sample_rings by the collector:
+ *
+ *   GET /latest               the newest sample record
+ *   GET /history?minutes=N    [record, ...] of the last N minutes (default 5)
+ *                             before the newest sample, oldest first
+ *   GET /aggregates           [rollup, ...] the last closed rollup of each
+ *                             width, the ring tag is the width in seconds
+ *   GET /metrics              the newest openmetrics_exporter::text()
+ *
+ * Responses are gathered straight from the rings, nothing is copied and no
+ * lock is shared with the collector. Requests are served by a thread of
+ * its own. Records that the collector overwrote while they were being sent
+ * are counted as torn responses and their connection is reset before the
+ * last byte, so that the client sees an error instead of corrupted data;
+ * the rings are read with headroom so this should not happen unless the
+ * client stalls for a long time.
+ */
+class query_server final : public boost::noncopyable {
+public:
+	/**
+	 * Starts listening. Throws std::exception derived exceptions if the
+	 * port cannot be bound. The rings must outlive the server.
+	 */
+	query_server(const query_options& options, const utils::sample_ring& samples,
+				 const utils::sample_ring& aggregates, const utils::sample_ring& metrics);
+	/**
+	 * Closes the open connections and joins the server thread.
+	 */
+	~query_server();
+
+	/**
+	 * @return the port listened on.
+	 */
+	unsigned short port() const noexcept;
+
+	std::uint64_t served() const noexcept;
+	std::uint64_t torn_responses() const noexcept;
+
+private:
+	class impl;
+
+	std::unique_ptr<impl> impl_;
+}; //class query_server
+
+} //namespace monitor
+} //namespace crossover
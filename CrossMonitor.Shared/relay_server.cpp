@@ -0,0 +1,579 @@
+#include "relay_server.hpp"
+#include "bounded_queue.hpp"
+#include "log.hpp"
+#include "utils.hpp"
+
+#include <boost/asio.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <functional>
+#include <future>
+#include <limits>
+#include <map>
+#include <stdexcept>
+#include <thread>
+#include <tuple>
+#include <unordered_set>
+#include <utility>
+
+#define LOG CROSSOVER_MONITOR_LOG
+
+using namespace std;
+
+namespace crossover {
+namespace monitor {
+
+namespace asio = boost::asio;
+using asio::ip::tcp;
+using namespace web;
+
+namespace {
+
+	const size_t max_record_size = 64 * 1024;
+	const size_t inbox_capacity = 64 * 1024;
+	const boost::posix_time::milliseconds drain_period(10);
+
+	void put_varint(string& out, uint64_t value) {
+		while (value >= 0x80) {
+			out.push_back(static_cast<char>(value | 0x80));
+			value >>= 7;
+		}
+		out.push_back(static_cast<char>(value));
+	}
+
+	/**
+	 * @return false if the bytes up to end end inside the varint.
+	 */
+	bool try_varint(const char*& position, const char* end, uint64_t& value) {
+		value = 0;
+		for (unsigned shift = 0; shift < 64; shift += 7) {
+			if (position == end) {
+				return false;
+			}
+			const uint8_t byte = static_cast<uint8_t>(*position++);
+			value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+			if (!(byte & 0x80)) {
+				return true;
+			}
+		}
+		throw invalid_argument("malformed relay batch: varint too long");
+	}
+
+	uint64_t get_varint(const char*& position, const char* end) {
+		uint64_t value;
+		if (!try_varint(position, end, value)) {
+			throw invalid_argument("malformed relay batch: truncated");
+		}
+		return value;
+	}
+
+	const json::value& field(const json::value& value, const utility::string_t& name) {
+		if (!value.is_object() || !value.has_field(name)) {
+			throw invalid_argument("missing field: " + utility::conversions::to_utf8string(name));
+		}
+		return value.at(name);
+	}
+
+	int64_t to_ms(const rollup::clock::time_point& time) noexcept {
+		return chrono::duration_cast<chrono::milliseconds>(time.time_since_epoch()).count();
+	}
+
+	/**
+	 * A parsed record on its way to the shard of its rack.
+	 */
+	struct record {
+		string rack;
+		int64_t time_ms = 0;
+		data sample;
+		// set for rollup records, sample is unused then
+		unique_ptr<rollup> piece;
+	};
+
+} //namespace
+
+void relay_batch::add(const string& rack, const rollup& value) {
+	put_varint(body_, rack.size());
+	body_.append(rack);
+	value.encode(body_);
+	++count_;
+}
+
+void relay_batch::take(string& out) {
+	out.clear();
+	put_varint(out, body_.size());
+	out.append(body_);
+	body_.clear();
+	count_ = 0;
+}
+
+bool relay_batch::decode(const char*& position, const char* end, vector<rack_rollup>& out) {
+	const char* p = position;
+	uint64_t size;
+	if (!try_varint(p, end, size) || static_cast<uint64_t>(end - p) < size) {
+		return false;
+	}
+
+	const char* body_end = p + size;
+	vector<rack_rollup> rollups;
+	while (p < body_end) {
+		const uint64_t rack_size = get_varint(p, body_end);
+		if (static_cast<uint64_t>(body_end - p) < rack_size) {
+			throw invalid_argument("malformed relay batch: truncated");
+		}
+		string rack(p, static_cast<size_t>(rack_size));
+		p += rack_size;
+		rollups.push_back(rack_rollup{ move(rack), rollup::decode(p, body_end) });
+	}
+
+	out.insert(out.end(), make_move_iterator(rollups.begin()), make_move_iterator(rollups.end()));
+	position = body_end;
+	return true;
+}
+
+class relay_server::impl final {
+private:
+	class connection;
+
+	/**
+	 * Everything a shard works with, touched by its thread only.
+	 */
+	struct shard final {
+		explicit shard(unsigned index)
+			: index(index)
+			, work(new asio::io_service::work(io_service))
+			, timer(io_service)
+			, inbox(inbox_capacity)
+			, watermark_ms(numeric_limits<int64_t>::min())
+			, stopping(false)
+			, connections_accepted(0)
+			, ingested_bytes(0)
+			, records(0)
+			, rejected_records(0)
+			, routed_records(0)
+			, forwarded_bytes(0)
+			, forwarded_rollups(0) {
+		}
+
+		const unsigned index;
+		// before io_service, the connections it still holds remove themselves
+		unordered_set<connection*> connections;
+		asio::io_service io_service;
+		unique_ptr<asio::io_service::work> work;
+		asio::deadline_timer timer;
+		// records of the racks of this shard parsed by the others
+		utils::bounded_queue<record> inbox;
+		// (rack, width in seconds, start in seconds) -> open rack rollup
+		map<tuple<string, int64_t, int64_t>, rollup> open;
+		// newest record time seen
+		int64_t watermark_ms;
+		relay_batch batch;
+		string frame;
+		chrono::steady_clock::time_point forwarded_at;
+		bool stopping;
+		thread runner;
+
+		// written by the shard thread only, read by stats()
+		atomic<uint64_t> connections_accepted;
+		atomic<uint64_t> ingested_bytes;
+		atomic<uint64_t> records;
+		atomic<uint64_t> rejected_records;
+		atomic<uint64_t> routed_records;
+		atomic<uint64_t> forwarded_bytes;
+		atomic<uint64_t> forwarded_rollups;
+	}; //struct shard
+
+	class connection final : public enable_shared_from_this<connection> {
+	public:
+		connection(impl& server, shard& owner)
+			: server_(server)
+			, shard_(owner)
+			, socket_(owner.io_service)
+			, buffer_(max_record_size)
+			, used_(0)
+			, started_(false) {
+		}
+
+		~connection() {
+			if (started_) {
+				shard_.connections.erase(this);
+			}
+		}
+
+		tcp::socket& socket() noexcept {
+			return socket_;
+		}
+
+		/**
+		 * Runs on the thread of the shard.
+		 */
+		void start() {
+			if (server_.stopping_) {
+				return;
+			}
+			started_ = true;
+			shard_.connections.insert(this);
+			++shard_.connections_accepted;
+			read();
+		}
+
+		void close() noexcept {
+			boost::system::error_code ignored;
+			socket_.close(ignored);
+		}
+
+	private:
+		void read() {
+			auto self = shared_from_this();
+			socket_.async_read_some(asio::buffer(&buffer_[used_], buffer_.size() - used_),
+				[self](const boost::system::error_code& error, size_t size) {
+				self->received(error, size);
+			});
+		}
+
+		void received(const boost::system::error_code& error, size_t size) {
+			if (error) {
+				if (error != asio::error::eof && error != asio::error::operation_aborted) {
+					LOG(debug) << "Relay connection closed: " << error.message();
+				}
+				return;
+			}
+			shard_.ingested_bytes.fetch_add(size, memory_order_relaxed);
+
+			const char* begin = buffer_.data();
+			const char* end = begin + used_ + size;
+			for (const char* newline; (newline = static_cast<const char*>(memchr(begin, '\n', end - begin))) != nullptr;
+				 begin = newline + 1) {
+				server_.ingest(shard_, begin, newline);
+			}
+
+			used_ = end - begin;
+			if (used_ == buffer_.size()) {
+				LOG(warning) << "Relay record longer than " << max_record_size << " bytes, connection closed";
+				return;
+			}
+			memmove(buffer_.data(), begin, used_);
+			read();
+		}
+
+		impl& server_;
+		shard& shard_;
+		tcp::socket socket_;
+		vector<char> buffer_;
+		// bytes of an incomplete record at the start of buffer_
+		size_t used_;
+		bool started_;
+	}; //class connection
+
+public:
+	impl(const relay_options& options, OnForwardHandler onForward)
+		: options_(options)
+		, onForward_(onForward)
+		, next_shard_(0)
+		, stopping_(false) {
+		if (!onForward_) {
+			throw invalid_argument("relay_server needs a handler for forwarded batches");
+		}
+		if (options_.width.count() <= 0) {
+			throw invalid_argument("relay width must be positive");
+		}
+		if (options_.lateness.count() < 0) {
+			throw invalid_argument("relay lateness cannot be negative");
+		}
+
+		const unsigned count = options_.shards != 0 ? options_.shards : max(1u, thread::hardware_concurrency());
+		for (unsigned i = 0; i < count; ++i) {
+			shards_.push_back(utils::make_aligned<shard>(i));
+		}
+		acceptor_.reset(new tcp::acceptor(shards_[0]->io_service,
+			tcp::endpoint(asio::ip::address::from_string(options_.address), options_.port)));
+		accept();
+
+		for (auto& s : shards_) {
+			shard& owner = *s;
+			owner.forwarded_at = chrono::steady_clock::now();
+			tick(owner);
+			owner.runner = thread([this, &owner]() {
+				run(owner);
+			});
+		}
+
+		LOG(info) << "Relay listening on " << options_.address << ":" << port() << " with " << count << " shards";
+	}
+
+	~impl() {
+		stopping_ = true;
+		on_every_shard([this](shard& s) {
+			if (s.index == 0) {
+				boost::system::error_code ignored;
+				acceptor_->close(ignored);
+			}
+			for (auto c : s.connections) {
+				c->close();
+			}
+		});
+		// nothing is parsed anymore, so nothing is routed to a shard after it stopped
+		on_every_shard([this](shard& s) {
+			s.stopping = true;
+			s.timer.cancel();
+			forward_all(s);
+		});
+
+		for (auto& s : shards_) {
+			s->work.reset();
+		}
+		for (auto& s : shards_) {
+			if (s->runner.joinable()) {
+				s->runner.join();
+			}
+		}
+	}
+
+	unsigned short port() const noexcept {
+		boost::system::error_code error;
+		return acceptor_->local_endpoint(error).port();
+	}
+
+	unsigned shards() const noexcept {
+		return static_cast<unsigned>(shards_.size());
+	}
+
+	statistics stats() const noexcept {
+		statistics res;
+		for (const auto& s : shards_) {
+			res.connections += s->connections_accepted;
+			res.ingested_bytes += s->ingested_bytes;
+			res.records += s->records;
+			res.rejected_records += s->rejected_records;
+			res.routed_records += s->routed_records;
+			res.forwarded_bytes += s->forwarded_bytes;
+			res.forwarded_rollups += s->forwarded_rollups;
+		}
+		return res;
+	}
+
+	void flush() {
+		on_every_shard([this](shard& s) {
+			forward_all(s);
+		});
+	}
+
+private:
+	void run(shard& s) noexcept {
+		for (;;) {
+			try {
+				s.io_service.run();
+				return;
+			}
+			catch (const std::exception& e) {
+				LOG(error) << "Relay shard " << s.index << " failed: " << e.what();
+			}
+		}
+	}
+
+	/**
+	 * Runs task on the thread of every shard and waits for all of them.
+	 */
+	void on_every_shard(const function<void(shard&)>& task) {
+		vector<future<void>> done;
+		for (auto& s : shards_) {
+			shard& owner = *s;
+			auto finished = make_shared<promise<void>>();
+			done.push_back(finished->get_future());
+			owner.io_service.post([&task, &owner, finished]() {
+				task(owner);
+				finished->set_value();
+			});
+		}
+		for (auto& d : done) {
+			d.wait();
+		}
+	}
+
+	/**
+	 * Accepts on the thread of the first shard, into the shards in turn.
+	 */
+	void accept() {
+		shard& owner = *shards_[next_shard_++ % shards_.size()];
+		auto next = make_shared<connection>(*this, owner);
+		acceptor_->async_accept(next->socket(), [this, next, &owner](const boost::system::error_code& error) {
+			if (!error) {
+				owner.io_service.post([next]() {
+					next->start();
+				});
+			} else if (error == asio::error::operation_aborted) {
+				return;
+			} else {
+				LOG(warning) << "Relay accept failed: " << error.message();
+			}
+			accept();
+		});
+	}
+
+	void tick(shard& s) {
+		s.timer.expires_from_now(drain_period);
+		s.timer.async_wait([this, &s](const boost::system::error_code& error) {
+			if (error || s.stopping) {
+				return;
+			}
+			drain(s);
+			close_due(s);
+			if (!s.batch.empty() && chrono::steady_clock::now() - s.forwarded_at >= options_.flush_period) {
+				forward(s);
+			}
+			tick(s);
+		});
+	}
+
+	/**
+	 * Parses a record received by shard at and adds it to the rollups of
+	 * its rack, or passes it to the shard the rack belongs to.
+	 */
+	void ingest(shard& at, const char* begin, const char* end) {
+		if (begin != end && end[-1] == '\r') {
+			--end;
+		}
+		if (begin == end) {
+			return;
+		}
+
+		record r;
+		try {
+			const json::value value = json::value::parse(utility::conversions::to_string_t(string(begin, end)));
+			r.rack = utility::conversions::to_utf8string(field(value, U("rack")).as_string());
+			if (value.has_field(U("rollup"))) {
+				r.piece.reset(new rollup(rollup::from_json(value)));
+				r.time_ms = to_ms(r.piece->start());
+			} else {
+				r.time_ms = field(value, U("time_ms")).as_number().to_int64();
+				r.sample = data::from_json(field(value, U("data")));
+			}
+		} catch (const exception& e) {
+			++at.rejected_records;
+			LOG(debug) << "Relay record rejected: " << e.what();
+			return;
+		}
+
+		shard& owner = *shards_[hash<string>()(r.rack) % shards_.size()];
+		if (&owner == &at) {
+			apply(at, r);
+			return;
+		}
+		++at.routed_records;
+		while (!owner.inbox.try_push(move(r))) {
+			// the owner may be waiting for room in our inbox
+			drain(at);
+			this_thread::yield();
+		}
+	}
+
+	void apply(shard& s, record& r) {
+		const rollup::clock::time_point time{ chrono::milliseconds(r.time_ms) };
+		const chrono::seconds width = r.piece ? r.piece->width() : options_.width;
+		const rollup::clock::time_point start = r.piece ? r.piece->start() : rollup(width, time).start();
+
+		auto key = make_tuple(move(r.rack), static_cast<int64_t>(width.count()),
+			static_cast<int64_t>(chrono::duration_cast<chrono::seconds>(start.time_since_epoch()).count()));
+		auto it = s.open.find(key);
+		if (it == s.open.end()) {
+			it = s.open.emplace(move(key), rollup(width, start)).first;
+		}
+		if (r.piece) {
+			it->second.merge(*r.piece);
+		} else {
+			it->second.add(r.sample, time);
+		}
+
+		s.watermark_ms = max(s.watermark_ms, r.time_ms);
+		++s.records;
+	}
+
+	void drain(shard& s) {
+		record r;
+		while (s.inbox.try_pop(r)) {
+			apply(s, r);
+		}
+	}
+
+	/**
+	 * Batches the rack rollups the watermark is lateness past.
+	 */
+	void close_due(shard& s) {
+		const int64_t lateness_ms = chrono::duration_cast<chrono::milliseconds>(options_.lateness).count();
+		for (auto it = s.open.begin(); it != s.open.end();) {
+			if (to_ms(it->second.end()) + lateness_ms <= s.watermark_ms) {
+				add_to_batch(s, get<0>(it->first), it->second);
+				it = s.open.erase(it);
+			} else {
+				++it;
+			}
+		}
+	}
+
+	void add_to_batch(shard& s, const string& rack, const rollup& closed) {
+		s.batch.add(rack, closed);
+		if (s.batch.size() >= options_.batch_bytes) {
+			forward(s);
+		}
+	}
+
+	void forward(shard& s) {
+		const size_t rollups = s.batch.count();
+		s.batch.take(s.frame);
+		s.forwarded_at = chrono::steady_clock::now();
+		try {
+			onForward_(s.index, s.frame);
+			s.forwarded_bytes += s.frame.size();
+			s.forwarded_rollups += rollups;
+		} catch (const exception& e) {
+			LOG(error) << "Relay batch of shard " << s.index << " not forwarded: " << e.what();
+		}
+	}
+
+	void forward_all(shard& s) {
+		drain(s);
+		for (const auto& open : s.open) {
+			add_to_batch(s, get<0>(open.first), open.second);
+		}
+		s.open.clear();
+		if (!s.batch.empty()) {
+			forward(s);
+		}
+	}
+
+	const relay_options options_;
+	const OnForwardHandler onForward_;
+	// the inbox of a shard keeps its positions on their own cache lines
+	vector<utils::aligned_ptr<shard>> shards_;
+	unique_ptr<tcp::acceptor> acceptor_;
+	// used by the thread of the first shard only
+	size_t next_shard_;
+	atomic<bool> stopping_;
+}; //class relay_server::impl
+
+relay_server::relay_server(const relay_options& options, OnForwardHandler onForward)
+	: impl_(new impl(options, onForward)) {
+}
+
+relay_server::~relay_server() {
+}
+
+unsigned short relay_server::port() const noexcept {
+	return impl_->port();
+}
+
+unsigned relay_server::shards() const noexcept {
+	return impl_->shards();
+}
+
+relay_server::statistics relay_server::stats() const noexcept {
+	return impl_->stats();
+}
+
+void relay_server::flush() {
+	impl_->flush();
+}
+
+} //namespace monitor
+} //namespace crossover
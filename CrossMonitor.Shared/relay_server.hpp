@@ -0,0 +1,183 @@
+#pragma once
+
+#include "rollup.hpp"
+
+#include <boost/noncopyable.hpp>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace crossover {
+namespace monitor {
+
+/**
+ * Relay setup.
+ */
+struct relay_options {
+	std::string address = "0.0.0.0";
+	/**
+	 * TCP port the agents send to, 0 picks a free one (see relay_server::port()).
+	 */
+	unsigned short port = 8090;
+	/**
+	 * Number of shards, each a thread of its own. 0 is one per core.
+	 */
+	unsigned shards = 0;
+	/**
+	 * Width of the rack rollups built from samples.
+	 */
+	std::chrono::seconds width = std::chrono::seconds(10);
+	/**
+	 * How long a rack rollup waits for late records after its end,
+	 * in record time, before it is forwarded.
+	 */
+	std::chrono::seconds lateness = std::chrono::seconds(10);
+	/**
+	 * A batch is forwarded when it reaches this size, or flush_period
+	 * after the previous one.
+	 */
+	std::size_t batch_bytes = 64 * 1024;
+	std::chrono::milliseconds flush_period = std::chrono::seconds(1);
+};
+
+/**
+ * The rollup of one rack.
+ */
+struct rack_rollup {
+	std::string rack;
+	rollup value;
+};
+
+/**
+ * Rack rollups forwarded together.
+ * A batch is framed as its size in bytes followed by the rollups, each
+ * as the rack name and rollup::encode(); sizes are LEB128 varints, rack
+ * names UTF-8.
+ */
+class relay_batch final {
+public:
+	relay_batch() noexcept
+		: count_(0) {
+	}
+
+	void add(const std::string& rack, const rollup& value);
+
+	bool empty() const noexcept {
+		return count_ == 0;
+	}
+	std::size_t count() const noexcept {
+		return count_;
+	}
+	/**
+	 * Size of the rollups added, without the frame.
+	 */
+	std::size_t size() const noexcept {
+		return body_.size();
+	}
+
+	/**
+	 * Replaces out with the framed batch and empties the batch.
+	 */
+	void take(std::string& out);
+
+	/**
+	 * Reads the framed batch at position into out and moves position past it.
+	 * Throws std::invalid_argument if the batch is malformed.
+	 * @return false if the bytes up to end do not hold the whole batch yet,
+	 * position and out are left untouched then.
+	 */
+	static bool decode(const char*& position, const char* end, std::vector<rack_rollup>& out);
+
+private:
+	std::string body_;
+	std::size_t count_;
+}; //class relay_batch
+
+/**
+ * Receives the records of many agents and forwards rack rollups in
+ * batches.
+ *
+ * Agents connect over TCP and send records, one JSON object per line:
+ *
+ *   {"host": h, "rack": r, "time_ms": t, "data": data}   a sample
+ *   {"host": h, "rack": r, "rollup": {...}}              a rollup of the host
+ *
+ * data and rollup as written by data::to_json() and rollup::to_json().
+ * Samples are added to the rollup of their rack over the bucket of
+ * relay_options::width they fall in, rollups are merged into the rollup
+ * of their rack over the same bucket. Malformed records are counted and
+ * skipped.
+ *
+ * The relay is split into shards sharing nothing: each runs on a thread
+ * of its own, with its own connections, rollups and batch. Connections are
+ * dealt out to the shards in turn and every rack belongs to one shard,
+ * which holds the rollups of all its hosts. Records of racks of another
+ * shard are passed to it through a lock-free queue. A rack rollup is
+ * added to the batch of its shard once the newest record time the shard
+ * has seen is relay_options::lateness past its end; records arriving
+ * later start a new rollup of the bucket, which merges with the earlier
+ * one upstream.
+ */
+class relay_server final : public boost::noncopyable {
+public:
+	/**
+	 * Called with every framed batch (see relay_batch) on the thread of
+	 * the shard forwarding it, so the shards call it concurrently, each
+	 * with its own index. Exceptions it throws are logged and the batch
+	 * is dropped.
+	 */
+	typedef std::function<void(unsigned shard, const std::string& batch)> OnForwardHandler;
+
+	struct statistics {
+		std::uint64_t connections = 0;
+		std::uint64_t ingested_bytes = 0;
+		std::uint64_t records = 0;
+		std::uint64_t rejected_records = 0;
+		/**
+		 * Records passed to the shard of their rack.
+		 */
+		std::uint64_t routed_records = 0;
+		std::uint64_t forwarded_bytes = 0;
+		std::uint64_t forwarded_rollups = 0;
+	};
+
+	/**
+	 * Starts listening and the shard threads. Throws std::exception derived
+	 * exceptions if the address cannot be bound, std::invalid_argument if
+	 * options are out of range.
+	 */
+	relay_server(const relay_options& options, OnForwardHandler onForward);
+	/**
+	 * Closes the connections, forwards what every shard holds and joins
+	 * the shard threads. Records still arriving may be lost.
+	 */
+	~relay_server();
+
+	unsigned short port() const noexcept;
+	unsigned shards() const noexcept;
+
+	/**
+	 * Sums of the counters of the shards. A record is counted once it
+	 * was added to the rollups of its rack.
+	 */
+	statistics stats() const noexcept;
+
+	/**
+	 * Forwards every rollup and batch the shards hold, even if it is not
+	 * due yet, and waits for it.
+	 */
+	void flush();
+
+private:
+	class impl;
+
+	std::unique_ptr<impl> impl_;
+}; //class relay_server
+
+} //namespace monitor
+} //namespace crossover
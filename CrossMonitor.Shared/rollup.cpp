@@ -0,0 +1,567 @@
+#include "rollup.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+using namespace std;
+
+namespace crossover {
+namespace monitor {
+
+using namespace web;
+
+const double quantile_sketch::relative_accuracy = 0.02;
+const double quantile_sketch::min_value = 0.01;
+
+namespace {
+
+	// ratio between the bounds of a sketch bucket
+	const double bucket_ratio = (1 + quantile_sketch::relative_accuracy) / (1 - quantile_sketch::relative_accuracy);
+	const double log_bucket_ratio = log(bucket_ratio);
+
+	const json::value& field(const json::value& value, const utility::string_t& name) {
+		if (!value.is_object() || !value.has_field(name)) {
+			throw invalid_argument("missing field: " + utility::conversions::to_utf8string(name));
+		}
+		return value.at(name);
+	}
+
+	int64_t to_ms(const rollup::clock::time_point& time) noexcept {
+		return chrono::duration_cast<chrono::milliseconds>(time.time_since_epoch()).count();
+	}
+
+	/**
+	 * Start of the bucket of the given width that holds time.
+	 */
+	rollup::clock::time_point align(const chrono::seconds& width, const rollup::clock::time_point& time) {
+		const auto since_epoch = chrono::duration_cast<chrono::seconds>(time.time_since_epoch());
+		auto buckets = since_epoch.count() / width.count();
+		if (since_epoch.count() < 0 && since_epoch.count() % width.count() != 0) {
+			--buckets;
+		}
+		return rollup::clock::time_point(chrono::seconds(buckets * width.count()));
+	}
+
+	// binary form, LEB128 varints like the binary log
+
+	void put_varint(string& out, uint64_t value) {
+		while (value >= 0x80) {
+			out.push_back(static_cast<char>(value | 0x80));
+			value >>= 7;
+		}
+		out.push_back(static_cast<char>(value));
+	}
+
+	void put_signed(string& out, int64_t value) {
+		put_varint(out, (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63));
+	}
+
+	void put_double(string& out, double value) {
+		uint64_t bits;
+		memcpy(&bits, &value, sizeof(bits));
+		for (size_t i = 0; i < sizeof(bits); ++i) {
+			out.push_back(static_cast<char>(bits >> (8 * i)));
+		}
+	}
+
+	void need(const char* position, const char* end, size_t size) {
+		if (static_cast<size_t>(end - position) < size) {
+			throw invalid_argument("malformed rollup: truncated");
+		}
+	}
+
+	uint64_t get_varint(const char*& position, const char* end) {
+		uint64_t value = 0;
+		for (unsigned shift = 0; shift < 64; shift += 7) {
+			need(position, end, 1);
+			const uint8_t byte = static_cast<uint8_t>(*position++);
+			value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+			if (!(byte & 0x80)) {
+				return value;
+			}
+		}
+		throw invalid_argument("malformed rollup: varint too long");
+	}
+
+	int64_t get_signed(const char*& position, const char* end) {
+		const uint64_t value = get_varint(position, end);
+		return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+	}
+
+	double get_double(const char*& position, const char* end) {
+		uint64_t bits = 0;
+		need(position, end, sizeof(bits));
+		for (size_t i = 0; i < sizeof(bits); ++i) {
+			bits |= static_cast<uint64_t>(static_cast<uint8_t>(*position++)) << (8 * i);
+		}
+		double value;
+		memcpy(&value, &bits, sizeof(value));
+		return value;
+	}
+
+} //namespace
+
+quantile_sketch::quantile_sketch() noexcept
+	: count_(0)
+	, zero_count_(0) {
+	counts_.fill(0);
+}
+
+void quantile_sketch::add(double value) noexcept {
+	++count_;
+	// NaN lands here too
+	if (!(value > min_value)) {
+		++zero_count_;
+		return;
+	}
+
+	const double index = ceil(log(value / min_value) / log_bucket_ratio) - 1;
+	++counts_[index < 0 ? 0 : min(static_cast<size_t>(index), bucket_count - 1)];
+}
+
+void quantile_sketch::merge(const quantile_sketch& other) noexcept {
+	count_ += other.count_;
+	zero_count_ += other.zero_count_;
+	for (size_t i = 0; i < bucket_count; ++i) {
+		counts_[i] += other.counts_[i];
+	}
+}
+
+double quantile_sketch::quantile(double fraction) const noexcept {
+	if (count_ == 0) {
+		return 0;
+	}
+
+	const double rank = max(0.0, min(fraction, 1.0)) * (count_ - 1);
+	uint64_t seen = zero_count_;
+	if (rank < seen) {
+		return 0;
+	}
+	for (size_t i = 0; i < bucket_count; ++i) {
+		seen += counts_[i];
+		if (rank < seen) {
+			// the value with the same relative error to both bucket bounds
+			return min_value * pow(bucket_ratio, static_cast<double>(i)) * 2 * bucket_ratio / (bucket_ratio + 1);
+		}
+	}
+	return min_value * pow(bucket_ratio, static_cast<double>(bucket_count));
+}
+
+bool quantile_sketch::operator==(const quantile_sketch& rhs) const noexcept {
+	return count_ == rhs.count_ && zero_count_ == rhs.zero_count_ && counts_ == rhs.counts_;
+}
+
+json::value quantile_sketch::to_json() const {
+	vector<json::value> buckets;
+	for (size_t i = 0; i < bucket_count; ++i) {
+		if (counts_[i] != 0) {
+			vector<json::value> bucket;
+			bucket.push_back(json::value(static_cast<uint32_t>(i)));
+			bucket.push_back(json::value(counts_[i]));
+			buckets.push_back(json::value::array(bucket));
+		}
+	}
+
+	json::value out;
+	out[U("zero")] = json::value(zero_count_);
+	out[U("buckets")] = json::value::array(buckets);
+	return out;
+}
+
+quantile_sketch quantile_sketch::from_json(const json::value& value) {
+	quantile_sketch res;
+	res.zero_count_ = field(value, U("zero")).as_number().to_uint32();
+	res.count_ = res.zero_count_;
+
+	for (const auto& bucket : field(value, U("buckets")).as_array()) {
+		if (!bucket.is_array() || bucket.size() != 2) {
+			throw invalid_argument("sketch bucket must be an [index, count] pair");
+		}
+		const uint32_t index = bucket.at(0).as_number().to_uint32();
+		if (index >= bucket_count) {
+			throw invalid_argument("sketch bucket index out of range: " + to_string(index));
+		}
+		const uint32_t count = bucket.at(1).as_number().to_uint32();
+		res.counts_[index] += count;
+		res.count_ += count;
+	}
+	return res;
+}
+
+void quantile_sketch::encode(string& out) const {
+	put_varint(out, zero_count_);
+	put_varint(out, bucket_count - std::count(counts_.begin(), counts_.end(), 0u));
+	size_t next = 0;
+	for (size_t i = 0; i < bucket_count; ++i) {
+		if (counts_[i] != 0) {
+			put_varint(out, i - next);
+			put_varint(out, counts_[i]);
+			next = i + 1;
+		}
+	}
+}
+
+quantile_sketch quantile_sketch::decode(const char*& position, const char* end) {
+	quantile_sketch res;
+	res.zero_count_ = static_cast<uint32_t>(get_varint(position, end));
+	res.count_ = res.zero_count_;
+
+	const uint64_t buckets = get_varint(position, end);
+	uint64_t next = 0;
+	for (uint64_t i = 0; i < buckets; ++i) {
+		const uint64_t gap = get_varint(position, end);
+		if (gap >= bucket_count - next) {
+			throw invalid_argument("malformed rollup: sketch bucket index out of range");
+		}
+		const uint64_t index = next + gap;
+		const uint32_t count = static_cast<uint32_t>(get_varint(position, end));
+		res.counts_[index] = count;
+		res.count_ += count;
+		next = index + 1;
+	}
+	return res;
+}
+
+aggregate::aggregate() noexcept
+	: count(0)
+	, sum(0)
+	, min(numeric_limits<double>::max())
+	, max(numeric_limits<double>::lowest())
+	, last(0)
+	, last_time_ms(numeric_limits<int64_t>::min()) {
+}
+
+void aggregate::add(double value, int64_t time_ms) noexcept {
+	++count;
+	sum += value;
+	min = std::min(min, value);
+	max = std::max(max, value);
+	if (time_ms > last_time_ms || (time_ms == last_time_ms && value > last)) {
+		last = value;
+		last_time_ms = time_ms;
+	}
+	sketch.add(value);
+}
+
+void aggregate::merge(const aggregate& other) noexcept {
+	if (other.count == 0) {
+		return;
+	}
+	count += other.count;
+	sum += other.sum;
+	min = std::min(min, other.min);
+	max = std::max(max, other.max);
+	if (other.last_time_ms > last_time_ms || (other.last_time_ms == last_time_ms && other.last > last)) {
+		last = other.last;
+		last_time_ms = other.last_time_ms;
+	}
+	sketch.merge(other.sketch);
+}
+
+json::value aggregate::to_json() const {
+	json::value out;
+	out[U("count")] = json::value(count);
+	out[U("sum")] = json::value(sum);
+	out[U("min")] = json::value(min);
+	out[U("max")] = json::value(max);
+	out[U("last")] = json::value(last);
+	out[U("last_time_ms")] = json::value(last_time_ms);
+	out[U("sketch")] = sketch.to_json();
+	return out;
+}
+
+aggregate aggregate::from_json(const json::value& value) {
+	aggregate res;
+	res.count = field(value, U("count")).as_number().to_uint64();
+	res.sum = field(value, U("sum")).as_double();
+	res.min = field(value, U("min")).as_double();
+	res.max = field(value, U("max")).as_double();
+	res.last = field(value, U("last")).as_double();
+	res.last_time_ms = field(value, U("last_time_ms")).as_number().to_int64();
+	res.sketch = quantile_sketch::from_json(field(value, U("sketch")));
+
+	if (res.sketch.count() != res.count) {
+		throw invalid_argument("aggregate count does not match its sketch");
+	}
+	return res;
+}
+
+void aggregate::encode(string& out) const {
+	put_varint(out, count);
+	put_double(out, sum);
+	put_double(out, min);
+	put_double(out, max);
+	put_double(out, last);
+	put_signed(out, last_time_ms);
+	sketch.encode(out);
+}
+
+aggregate aggregate::decode(const char*& position, const char* end) {
+	aggregate res;
+	res.count = get_varint(position, end);
+	res.sum = get_double(position, end);
+	res.min = get_double(position, end);
+	res.max = get_double(position, end);
+	res.last = get_double(position, end);
+	res.last_time_ms = get_signed(position, end);
+	res.sketch = quantile_sketch::decode(position, end);
+
+	if (res.sketch.count() != res.count) {
+		throw invalid_argument("aggregate count does not match its sketch");
+	}
+	return res;
+}
+
+rollup::rollup(const chrono::seconds& width, const clock::time_point& time)
+	: width_(width) {
+	if (width.count() <= 0) {
+		throw invalid_argument("rollup width must be positive");
+	}
+	start_ = align(width, time);
+}
+
+void rollup::add(const data& sample, const clock::time_point& time) {
+	// the parts carried over from an earlier sample are counted there
+	const unsigned fresh = sample.get_fresh();
+	if (fresh & cpu_part) {
+		add(U("cpu_percent"), sample.get_cpu_percent(), time);
+		add_cores(sample.get_cpu_cores(), time);
+		if (!sample.get_run_queues().empty()) {
+			add(U("run_queue_delay_us"), sample.get_run_queue_delay_us(), time);
+			add(U("run_queue_wait_ratio"), sample.get_run_queue_wait_ratio(), time);
+		}
+	}
+	if (fresh & memory_part) {
+		add(U("memory_percent"), sample.get_memory_percent(), time);
+	}
+	if (fresh & process_part) {
+		add(U("process_count"), sample.get_process_count(), time);
+	}
+	if (fresh & io_part) {
+		for (const auto& io_stat : sample.get_io_stats()) {
+			const utility::string_t partition(1, static_cast<utility::char_t>(io_stat.partition_name));
+			add(U("bytes_read:") + partition, io_stat.bytes_read, time);
+			add(U("bytes_written:") + partition, io_stat.bytes_written, time);
+		}
+	}
+	if (fresh & fs_part) {
+		for (const auto& fs : sample.get_fs_stats()) {
+			const utility::string_t mount_point = utility::conversions::to_string_t(fs.mount_point);
+			// of the space users can have, like df
+			const uint64_t usable = fs.used_bytes + fs.available_bytes;
+			if (usable > 0) {
+				add(U("fs_used_percent:") + mount_point, 100.0 * fs.used_bytes / usable, time);
+			}
+			if (fs.inodes > 0) {
+				add(U("fs_inodes_used_percent:") + mount_point, 100.0 * fs.inodes_used / fs.inodes, time);
+			}
+		}
+	}
+	if (fresh & numa_part) {
+		for (const auto& stat : sample.get_numa_stats()) {
+			const utility::string_t node = utility::conversions::to_string_t(to_string(stat.node));
+			add(U("numa_cpu_percent:") + node, stat.cpu_percent, time);
+			add(U("numa_memory_percent:") + node, stat.memory_percent, time);
+			add(U("numa_miss:") + node, static_cast<double>(stat.numa_miss), time);
+			add(U("numa_foreign:") + node, static_cast<double>(stat.numa_foreign), time);
+		}
+	}
+	if ((fresh & net_part) && sample.has_net_stats()) {
+		const net_stats& net = sample.get_net_stats();
+		add(U("tcp_retransmits"), static_cast<double>(net.tcp_retransmits), time);
+		add(U("tcp_resets_sent"), static_cast<double>(net.tcp_resets_sent), time);
+		add(U("tcp_established_resets"), static_cast<double>(net.tcp_established_resets), time);
+		add(U("listen_overflows"), static_cast<double>(net.listen_overflows), time);
+		add(U("listen_drops"), static_cast<double>(net.listen_drops), time);
+		add(U("udp_receive_buffer_errors"), static_cast<double>(net.udp_receive_buffer_errors), time);
+		add(U("sockets"), net.sockets, time);
+		add(U("tcp_sockets"), net.tcp_sockets, time);
+		add(U("tcp_memory_bytes"), static_cast<double>(net.tcp_memory_bytes), time);
+		add(U("udp_memory_bytes"), static_cast<double>(net.udp_memory_bytes), time);
+	}
+}
+
+void rollup::add_cores(const cpu_core_stats& cores, const clock::time_point& time) {
+	if (cores.empty()) {
+		return;
+	}
+	// the averages of the CPUs that report a clock
+	double frequency = 0.0;
+	double effective = 0.0;
+	size_t frequencies = 0;
+	size_t effectives = 0;
+	uint64_t core_throttles = 0;
+	uint64_t package_throttles = 0;
+	for (size_t i = 0; i < cores.size(); ++i) {
+		if (cores.frequency_khz[i] > 0) {
+			frequency += cores.frequency_khz[i];
+			++frequencies;
+		}
+		if (cores.effective_frequency_khz[i] > 0) {
+			effective += cores.effective_frequency_khz[i];
+			++effectives;
+		}
+		core_throttles += cores.core_throttles[i];
+		// every CPU of a package reports its throttles
+		package_throttles = max(package_throttles, cores.package_throttles[i]);
+	}
+	if (frequencies > 0) {
+		add(U("cpu_frequency_khz"), frequency / frequencies, time);
+	}
+	if (effectives > 0) {
+		add(U("cpu_effective_frequency_khz"), effective / effectives, time);
+	}
+	add(U("cpu_core_throttles"), static_cast<double>(core_throttles), time);
+	add(U("cpu_package_throttles"), static_cast<double>(package_throttles), time);
+}
+
+void rollup::add(const utility::string_t& metric, double value, const clock::time_point& time) {
+	metrics_[metric].add(value, to_ms(time));
+}
+
+void rollup::merge(const rollup& other) {
+	if (other.start_ < start_ || other.end() > end()) {
+		throw invalid_argument("merged rollup is outside of the bucket");
+	}
+	for (const auto& metric : other.metrics_) {
+		metrics_[metric.first].merge(metric.second);
+	}
+}
+
+json::value rollup::to_json() const {
+	json::value metrics = json::value::object();
+	for (const auto& metric : metrics_) {
+		metrics[metric.first] = metric.second.to_json();
+	}
+
+	json::value body;
+	body[U("width_s")] = json::value(static_cast<int64_t>(width_.count()));
+	body[U("start_s")] = json::value(
+		static_cast<int64_t>(chrono::duration_cast<chrono::seconds>(start_.time_since_epoch()).count()));
+	body[U("metrics")] = metrics;
+
+	json::value out;
+	out[U("rollup")] = body;
+	return out;
+}
+
+rollup rollup::from_json(const json::value& value) {
+	try {
+		const json::value& body = field(value, U("rollup"));
+		const chrono::seconds width(field(body, U("width_s")).as_number().to_int64());
+		const clock::time_point start{ chrono::seconds(field(body, U("start_s")).as_number().to_int64()) };
+
+		rollup res(width, start);
+		if (res.start_ != start) {
+			throw invalid_argument("rollup start is not aligned to its width");
+		}
+
+		for (const auto& metric : field(body, U("metrics")).as_object()) {
+			res.metrics_[metric.first] = aggregate::from_json(metric.second);
+		}
+		return res;
+	} catch (const json::json_exception& e) {
+		throw invalid_argument(string("malformed rollup: ") + e.what());
+	}
+}
+
+void rollup::encode(string& out) const {
+	put_varint(out, static_cast<uint64_t>(width_.count()));
+	put_signed(out, chrono::duration_cast<chrono::seconds>(start_.time_since_epoch()).count());
+	put_varint(out, metrics_.size());
+	for (const auto& metric : metrics_) {
+		const string name = utility::conversions::to_utf8string(metric.first);
+		put_varint(out, name.size());
+		out.append(name);
+		metric.second.encode(out);
+	}
+}
+
+rollup rollup::decode(const char*& position, const char* end) {
+	const uint64_t width = get_varint(position, end);
+	if (width == 0 || width > static_cast<uint64_t>(numeric_limits<int64_t>::max())) {
+		throw invalid_argument("malformed rollup: width out of range");
+	}
+	const clock::time_point start{ chrono::seconds(get_signed(position, end)) };
+
+	rollup res(chrono::seconds(static_cast<int64_t>(width)), start);
+	if (res.start_ != start) {
+		throw invalid_argument("rollup start is not aligned to its width");
+	}
+
+	const uint64_t metrics = get_varint(position, end);
+	for (uint64_t i = 0; i < metrics; ++i) {
+		const uint64_t size = get_varint(position, end);
+		need(position, end, size);
+		const string name(position, static_cast<size_t>(size));
+		position += size;
+		res.metrics_[utility::conversions::to_string_t(name)] = aggregate::decode(position, end);
+	}
+	return res;
+}
+
+const array<chrono::seconds, rollup_builder::level_count> rollup_builder::widths = { {
+	chrono::seconds(10),
+	chrono::minutes(1),
+	chrono::hours(1)
+} };
+
+rollup_builder::rollup_builder(OnClosedHandler onClosed)
+	: m_onClosed(onClosed) {
+	if (!m_onClosed) {
+		throw invalid_argument("rollup_builder needs a handler for closed rollups");
+	}
+	for (const auto& width : widths) {
+		m_open.emplace_back(width, rollup::clock::time_point());
+	}
+}
+
+void rollup_builder::add(const data& sample, const rollup::clock::time_point& time) {
+	for (size_t level = 0; level < level_count; ++level) {
+		if (!m_open[level].empty() && time >= m_open[level].end()) {
+			close(level);
+		}
+	}
+
+	if (m_open[0].empty()) {
+		m_open[0] = rollup(widths[0], time);
+	}
+	// a sample from before the open bucket (the clock went back) is counted in it
+	m_open[0].add(sample, time);
+}
+
+void rollup_builder::flush() {
+	for (size_t level = 0; level < level_count; ++level) {
+		if (!m_open[level].empty()) {
+			close(level);
+		}
+	}
+}
+
+void rollup_builder::close(size_t level) {
+	rollup closed(widths[level], m_open[level].start());
+	swap(closed, m_open[level]);
+
+	if (level + 1 < level_count) {
+		merge_into(level + 1, closed);
+	}
+	m_onClosed(closed);
+}
+
+void rollup_builder::merge_into(size_t level, const rollup& closed) {
+	if (!m_open[level].empty() && m_open[level].start() != align(widths[level], closed.start())) {
+		close(level);
+	}
+	if (m_open[level].empty()) {
+		m_open[level] = rollup(widths[level], closed.start());
+	}
+	m_open[level].merge(closed);
+}
+
+} //namespace monitor
+} //namespace crossover
@@ -0,0 +1,238 @@
+#pragma once
+
+#include "data.hpp"
+
+#include <cpprest/json.h>
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace crossover {
+namespace monitor {
+
+/**
+ * Mergeable quantile sketch with fixed memory.
+ * Values are counted in logarithmic buckets, so any quantile is returned
+ * within relative_accuracy of the true value for values above min_value;
+ * values at or below min_value (including zero and negative values) are
+ * counted together and reported as zero. Values above the largest bucket
+ * are counted in it.
+ * Merging adds bucket counts, so it is exact, commutative and associative:
+ * a sketch merged from parts equals the sketch of the whole stream.
+ */
+class quantile_sketch final {
+public:
+	static const double relative_accuracy;
+	static const double min_value;
+	/**
+	 * Number of buckets above min_value, covers values up to about 4.5e9
+	 * (the range of IO_stat<unsigned>).
+	 */
+	static const std::size_t bucket_count = 672;
+
+	quantile_sketch() noexcept;
+
+	void add(double value) noexcept;
+	void merge(const quantile_sketch& other) noexcept;
+
+	std::uint64_t count() const noexcept {
+		return count_;
+	}
+
+	/**
+	 * Gets the estimated value below which the given fraction of values fell.
+	 * @param fraction 0 to 1, e.g. 0.99 for p99. Returns 0 for an empty sketch.
+	 */
+	double quantile(double fraction) const noexcept;
+
+	bool operator==(const quantile_sketch& rhs) const noexcept;
+	bool operator!=(const quantile_sketch& rhs) const noexcept {
+		return !(*this == rhs);
+	}
+
+	/**
+	 * Only the non-empty buckets are written: {"zero": n, "buckets": [[index, n], ...]}
+	 */
+	web::json::value to_json() const;
+	/**
+	 * Throws std::invalid_argument if the value is not a sketch written by to_json().
+	 */
+	static quantile_sketch from_json(const web::json::value& value);
+
+	/**
+	 * Appends the binary form: the zero count and the non-empty buckets,
+	 * each as the gap to the previous one and its count, all varints.
+	 */
+	void encode(std::string& out) const;
+	/**
+	 * Reads a sketch written by encode() and moves position past it.
+	 * Throws std::invalid_argument if the bytes up to end are not one.
+	 */
+	static quantile_sketch decode(const char*& position, const char* end);
+
+private:
+	std::uint64_t count_;
+	std::uint32_t zero_count_;
+	std::array<std::uint32_t, bucket_count> counts_;
+}; //class quantile_sketch
+
+/**
+ * Summary of one metric over a time bucket.
+ */
+struct aggregate final {
+	std::uint64_t count;
+	double sum;
+	double min;
+	double max;
+	/**
+	 * Latest value and its time in milliseconds since 1970-01-01.
+	 */
+	double last;
+	std::int64_t last_time_ms;
+	quantile_sketch sketch;
+
+	aggregate() noexcept;
+
+	void add(double value, std::int64_t time_ms) noexcept;
+	/**
+	 * Commutative and associative, except for the rounding of sum.
+	 * The later of the two last values wins, the larger one on a tie.
+	 */
+	void merge(const aggregate& other) noexcept;
+
+	web::json::value to_json() const;
+	static aggregate from_json(const web::json::value& value);
+
+	void encode(std::string& out) const;
+	static aggregate decode(const char*& position, const char* end);
+}; //struct aggregate
+
+/**
+ * Aggregates of every data metric over one time bucket.
+ * Buckets are aligned to multiples of their width since 1970-01-01,
+ * so rollups built on different hosts (or on the agent and on the server)
+ * over the same bucket can be merged.
+ */
+class rollup final {
+public:
+	typedef std::chrono::system_clock clock;
+	typedef std::map<utility::string_t, aggregate> metrics_type;
+
+	/**
+	 * Throws std::invalid_argument if width is not positive.
+	 * @param width bucket width.
+	 * @param time any time inside the bucket.
+	 */
+	rollup(const std::chrono::seconds& width, const clock::time_point& time);
+
+	const std::chrono::seconds& width() const noexcept {
+		return width_;
+	}
+	const clock::time_point& start() const noexcept {
+		return start_;
+	}
+	clock::time_point end() const noexcept {
+		return start_ + width_;
+	}
+	bool empty() const noexcept {
+		return metrics_.empty();
+	}
+	const metrics_type& metrics() const noexcept {
+		return metrics_;
+	}
+
+	/**
+	 * Adds every fresh metric of a collected sample, see data::get_fresh().
+	 * The metrics, by family, the optional ones only where they are read:
+	 * - CPU: cpu_percent.
+	 * - CPU clocks: cpu_frequency_khz, cpu_effective_frequency_khz, averages of the CPUs reporting one.
+	 * - CPU throttling: cpu_core_throttles, the sum, cpu_package_throttles, the most of any CPU.
+	 * - run queues: run_queue_delay_us, run_queue_wait_ratio.
+	 * - memory: memory_percent.
+	 * - processes: process_count.
+	 * - volumes: bytes_read:<partition>, bytes_written:<partition>.
+	 * - filesystems: fs_used_percent:<mount point>, fs_inodes_used_percent:<mount point> if it has inodes.
+	 * - NUMA nodes: numa_cpu_percent:<node>, numa_memory_percent:<node>, numa_miss:<node>, numa_foreign:<node>.
+	 * - TCP/IP stack: the six event counters of net_stats, sockets, tcp_sockets, tcp_memory_bytes, udp_memory_bytes.
+	 */
+	void add(const data& sample, const clock::time_point& time);
+	void add(const utility::string_t& metric, double value, const clock::time_point& time);
+
+	/**
+	 * Throws std::invalid_argument if other covers a different bucket.
+	 */
+	void merge(const rollup& other);
+
+	/**
+	 * {"rollup": {"width_s": w, "start_s": s, "metrics": {"name": aggregate, ...}}}
+	 */
+	web::json::value to_json() const;
+	/**
+	 * Throws std::invalid_argument if the value is not a rollup written by to_json().
+	 */
+	static rollup from_json(const web::json::value& value);
+
+	/**
+	 * Appends the binary form for forwarding in bulk, a fraction of the
+	 * size of to_json(): counts, times and indexes as varints, the other
+	 * values as 8 byte doubles, metric names as UTF-8.
+	 */
+	void encode(std::string& out) const;
+	/**
+	 * Reads a rollup written by encode() and moves position past it.
+	 * Throws std::invalid_argument if the bytes up to end are not one.
+	 */
+	static rollup decode(const char*& position, const char* end);
+
+private:
+	void add_cores(const cpu_core_stats& cores, const clock::time_point& time);
+
+	std::chrono::seconds width_;
+	clock::time_point start_;
+	metrics_type metrics_;
+}; //class rollup
+
+/**
+ * Builds the 10 second, 1 minute and 1 hour rollups incrementally.
+ * Samples are added to the open 10 second bucket; a closed bucket is
+ * reported and merged into the open bucket of the next wider level,
+ * so memory stays fixed at one open bucket per level.
+ */
+class rollup_builder final {
+public:
+	typedef std::function<void(const rollup& closed)> OnClosedHandler;
+
+	static const std::size_t level_count = 3;
+	static const std::array<std::chrono::seconds, level_count> widths;
+
+	explicit rollup_builder(OnClosedHandler onClosed);
+
+	/**
+	 * Closes the buckets that ended before time, then adds the sample.
+	 * Samples must come in time order.
+	 */
+	void add(const data& sample, const rollup::clock::time_point& time);
+
+	/**
+	 * Closes and reports the open buckets, even if they have not ended yet.
+	 * Partial buckets merge with the rest of the same bucket later on.
+	 */
+	void flush();
+
+private:
+	void close(std::size_t level);
+	void merge_into(std::size_t level, const rollup& closed);
+
+	OnClosedHandler m_onClosed;
+	// one per level, a level with an empty rollup has no open bucket
+	std::vector<rollup> m_open;
+}; //class rollup_builder
+
+} //namespace monitor
+} //namespace crossover
@@ -0,0 +1,189 @@
+#pragma once
+
+#include <boost/noncopyable.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+namespace crossover {
+namespace monitor {
+namespace utils {
+
+	/**
+	 * Single-producer byte ring of pre-rendered records for lock-free readers.
+	 * The producer copies every record into a circular byte buffer once;
+	 * readers get pointers straight into the buffer (no copy) and check
+	 * afterwards, with valid(), that the producer has not overwritten the
+	 * bytes meanwhile. Neither side ever waits for the other.
+	 *
+	 * Writes are ordered like a seqlock: the producer announces the bytes and
+	 * index slot it is about to reuse, then writes them, then publishes the
+	 * record. A reader that saw any of the new bytes is guaranteed to see the
+	 * announcement when it validates.
+	 *
+	 * To keep records alive while they are being sent, readers should stay
+	 * away from the oldest part of the ring, see headroom.
+	 */
+	class sample_ring final : public boost::noncopyable {
+	public:
+		/**
+		 * A record seen by a reader. A record that wraps around the end of
+		 * the buffer comes in two parts, second_size is 0 otherwise.
+		 */
+		struct view {
+			std::uint64_t index;
+			std::uint64_t offset;
+			std::int64_t time_ms;
+			std::uint32_t tag;
+			const char* first;
+			std::size_t first_size;
+			const char* second;
+			std::size_t second_size;
+
+			std::size_t size() const noexcept {
+				return first_size + second_size;
+			}
+			std::string to_string() const {
+				return std::string(first, first_size) + std::string(second, second_size);
+			}
+		};
+
+		/**
+		 * Constructor. Throws std::invalid_argument if a capacity is zero.
+		 * @param bytes size of the byte buffer.
+		 * @param records maximum number of records held.
+		 */
+		sample_ring(std::size_t bytes, std::size_t records)
+			: bytes_(bytes)
+			, records_(records)
+			, buffer_(new char[bytes])
+			, index_(new entry[records])
+			, reserved_bytes_(0)
+			, reserved_records_(0)
+			, published_(0) {
+			if (bytes == 0 || records == 0) {
+				throw std::invalid_argument("sample_ring capacity cannot be zero");
+			}
+		}
+
+		std::size_t capacity_bytes() const noexcept {
+			return bytes_;
+		}
+		std::size_t capacity_records() const noexcept {
+			return records_;
+		}
+
+		/**
+		 * Producer only. Copies a record into the ring, overwriting the oldest
+		 * ones as needed.
+		 * @param tag any value for readers to tell records apart.
+		 * @return false if the record is larger than half of the buffer,
+		 * it is not stored then.
+		 */
+		bool publish(std::int64_t time_ms, std::uint32_t tag, const char* data, std::size_t size) noexcept {
+			if (size > bytes_ / 2) {
+				return false;
+			}
+
+			const std::uint64_t record = published_.load(std::memory_order_relaxed);
+			const std::uint64_t offset = reserved_bytes_.load(std::memory_order_relaxed);
+
+			reserved_records_.store(record + 1, std::memory_order_relaxed);
+			reserved_bytes_.store(offset + size, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_release);
+
+			const std::size_t start = static_cast<std::size_t>(offset % bytes_);
+			const std::size_t first_size = std::min(size, bytes_ - start);
+			std::memcpy(buffer_.get() + start, data, first_size);
+			std::memcpy(buffer_.get(), data + first_size, size - first_size);
+
+			entry& e = index_[record % records_];
+			e.offset.store(offset, std::memory_order_relaxed);
+			e.size.store(size, std::memory_order_relaxed);
+			e.time_ms.store(time_ms, std::memory_order_relaxed);
+			e.tag.store(tag, std::memory_order_relaxed);
+
+			published_.store(record + 1, std::memory_order_release);
+			return true;
+		}
+		bool publish(std::int64_t time_ms, std::uint32_t tag, const std::string& data) noexcept {
+			return publish(time_ms, tag, data.data(), data.size());
+		}
+
+		/**
+		 * Number of records published so far, the newest one has index count() - 1.
+		 */
+		std::uint64_t count() const noexcept {
+			return published_.load(std::memory_order_acquire);
+		}
+
+		/**
+		 * Index of the oldest record a reader should use if it needs the record
+		 * to stay valid while the producer publishes up to a quarter of the
+		 * ring more. Records older than that may be overwritten soon.
+		 */
+		std::uint64_t headroom(std::uint64_t count) const noexcept {
+			const std::uint64_t keep = records_ - records_ / 4;
+			return count > keep ? count - keep : 0;
+		}
+
+		/**
+		 * Reads the index entry of a published record. Check the result
+		 * with valid() after using the bytes.
+		 * @return false if the record was already overwritten.
+		 */
+		bool read(std::uint64_t index, view& v) const noexcept {
+			const entry& e = index_[index % records_];
+			v.index = index;
+			v.offset = e.offset.load(std::memory_order_relaxed);
+			const std::size_t size = e.size.load(std::memory_order_relaxed);
+			v.time_ms = e.time_ms.load(std::memory_order_relaxed);
+			v.tag = e.tag.load(std::memory_order_relaxed);
+
+			const std::size_t start = static_cast<std::size_t>(v.offset % bytes_);
+			v.first = buffer_.get() + start;
+			v.first_size = std::min(size, bytes_ - start);
+			v.second = buffer_.get();
+			v.second_size = size - v.first_size;
+
+			// bytes still wrong when the index entry was overwritten meanwhile
+			return valid(v) && v.offset + size <= reserved_bytes_.load(std::memory_order_relaxed);
+		}
+
+		/**
+		 * @return true if neither the index entry nor the bytes of the record
+		 * have been reused since they were read.
+		 */
+		bool valid(const view& v) const noexcept {
+			std::atomic_thread_fence(std::memory_order_acquire);
+			return reserved_records_.load(std::memory_order_relaxed) <= v.index + records_ &&
+				reserved_bytes_.load(std::memory_order_relaxed) <= v.offset + bytes_;
+		}
+
+	private:
+		struct entry {
+			std::atomic<std::uint64_t> offset;
+			std::atomic<std::size_t> size;
+			std::atomic<std::int64_t> time_ms;
+			std::atomic<std::uint32_t> tag;
+		};
+
+		const std::size_t bytes_;
+		const std::size_t records_;
+		std::unique_ptr<char[]> buffer_;
+		std::unique_ptr<entry[]> index_;
+
+		alignas(64) std::atomic<std::uint64_t> reserved_bytes_;
+		std::atomic<std::uint64_t> reserved_records_;
+		alignas(64) std::atomic<std::uint64_t> published_;
+	}; //class sample_ring
+
+} //namespace utils
+} //namespace monitor
+} //namespace crossover
@@ -0,0 +1,725 @@
+#include "snapshot.hpp"
+#include "counter_kernels.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <limits>
+#include <stdexcept>
+
+using namespace std;
+
+namespace crossover {
+namespace monitor {
+
+namespace {
+
+	const char file_magic[4] = { 'C', 'M', 'S', 'J' };
+	const size_t max_record_size = 16 * 1024 * 1024;
+
+	void put_fixed(string& out, uint64_t value, size_t bytes) {
+		for (size_t i = 0; i < bytes; ++i) {
+			out.push_back(static_cast<char>(value >> (8 * i)));
+		}
+	}
+
+	void put_varint(string& out, uint64_t value) {
+		while (value >= 0x80) {
+			out.push_back(static_cast<char>(value | 0x80));
+			value >>= 7;
+		}
+		out.push_back(static_cast<char>(value));
+	}
+
+	void put_signed(string& out, int64_t value) {
+		put_varint(out, (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63));
+	}
+
+	/**
+	 * Reads the fields of one record, throws std::runtime_error past its end.
+	 */
+	class cursor final {
+	public:
+		cursor(const string& data)
+			: data_(data)
+			, position_(0) {
+		}
+
+		uint64_t fixed(size_t bytes) {
+			need(bytes);
+			uint64_t value = 0;
+			for (size_t i = 0; i < bytes; ++i) {
+				value |= static_cast<uint64_t>(static_cast<uint8_t>(data_[position_++])) << (8 * i);
+			}
+			return value;
+		}
+
+		uint64_t varint() {
+			uint64_t value = 0;
+			for (unsigned shift = 0; shift < 64; shift += 7) {
+				need(1);
+				const uint8_t byte = static_cast<uint8_t>(data_[position_++]);
+				value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+				if (!(byte & 0x80)) {
+					return value;
+				}
+			}
+			throw runtime_error("corrupted snapshot journal: varint too long");
+		}
+
+		int64_t signed_varint() {
+			const uint64_t value = varint();
+			return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+		}
+
+		void bytes(string& out) {
+			const uint64_t size = varint();
+			need(size);
+			out.assign(data_, position_, static_cast<size_t>(size));
+			position_ += static_cast<size_t>(size);
+		}
+
+	private:
+		void need(uint64_t bytes) const {
+			if (bytes > data_.size() - position_) {
+				throw runtime_error("corrupted snapshot journal: record out of bounds");
+			}
+		}
+
+		const string& data_;
+		size_t position_;
+	}; //class cursor
+
+	uint32_t float_bits(float value) noexcept {
+		uint32_t bits;
+		memcpy(&bits, &value, sizeof(bits));
+		return bits;
+	}
+
+	float bits_float(uint64_t bits) noexcept {
+		const uint32_t narrow = static_cast<uint32_t>(bits);
+		float value;
+		memcpy(&value, &narrow, sizeof(value));
+		return value;
+	}
+
+	unsigned clamp_unsigned(uint64_t value) noexcept {
+		return static_cast<unsigned>(min<uint64_t>(value, numeric_limits<unsigned>::max()));
+	}
+
+	/**
+	 * Index of match_ids() for an entry that appeared during the interval.
+	 */
+	const size_t unmatched = numeric_limits<size_t>::max();
+
+	/**
+	 * Matches the entries of after to those of before by id: match gets
+	 * the index in before of every id of after, or unmatched.
+	 * @return true if the ids are the same in the same order, as they
+	 * usually are, match is left alone then.
+	 */
+	bool match_ids(const vector<unsigned>& before, const vector<unsigned>& after, vector<size_t>& match) {
+		if (before == after) {
+			return true;
+		}
+		match.resize(after.size());
+		for (size_t i = 0; i < after.size(); ++i) {
+			// entries usually keep their order, so try the same index first
+			size_t index = i;
+			if (index >= before.size() || before[index] != after[i]) {
+				index = static_cast<size_t>(find(before.begin(), before.end(), after[i]) - before.begin());
+			}
+			match[i] = index == before.size() ? unmatched : index;
+		}
+		return false;
+	}
+
+	/**
+	 * One field of before in the order of after: before itself if the ids
+	 * are the same, else gathered into out. An entry that appeared during
+	 * the interval takes its value in after, so it moved nothing.
+	 */
+	const uint64_t* gather(const vector<uint64_t>& before, const vector<uint64_t>& after, bool same_ids,
+						   const vector<size_t>& match, uint64_t* out) noexcept {
+		if (same_ids) {
+			return before.data();
+		}
+		for (size_t i = 0; i < after.size(); ++i) {
+			out[i] = match[i] == unmatched ? after[i] : before[match[i]];
+		}
+		return out;
+	}
+
+} //namespace
+
+bool counter_snapshot::operator==(const counter_snapshot& rhs) const noexcept {
+	if (time_ms != rhs.time_ms || cpu_total != rhs.cpu_total || cpu_busy != rhs.cpu_busy ||
+		memory_total != rhs.memory_total || memory_available != rhs.memory_available ||
+		process_count != rhs.process_count || volumes.size() != rhs.volumes.size() ||
+		cores != rhs.cores || run_queues != rhs.run_queues || waiting_processes != rhs.waiting_processes ||
+		filesystems != rhs.filesystems || numa_nodes != rhs.numa_nodes || has_net != rhs.has_net ||
+		(has_net && net != rhs.net)) {
+		return false;
+	}
+	for (size_t i = 0; i < volumes.size(); ++i) {
+		const volume_counters& a = volumes[i];
+		const volume_counters& b = rhs.volumes[i];
+		if (a.name != b.name || a.device != b.device ||
+			a.bytes_read != b.bytes_read || a.bytes_written != b.bytes_written) {
+			return false;
+		}
+	}
+	return true;
+}
+
+snapshot_decoder::snapshot_decoder()
+	: primed_(false) {
+}
+
+bool snapshot_decoder::decode(const counter_snapshot& snapshot, data& out) {
+	if (!primed_) {
+		previous_ = snapshot;
+		primed_ = true;
+		return false;
+	}
+
+	try {
+		sample(previous_, snapshot, out, buffers_);
+	} catch (const invalid_argument&) {
+		// the next interval starts here even if this snapshot is rejected
+		previous_ = snapshot;
+		throw;
+	}
+	previous_ = snapshot;
+	return true;
+}
+
+void snapshot_decoder::sample(const counter_snapshot& before, const counter_snapshot& after, data& out,
+							  delta_buffers& buffers, unsigned parts) {
+	if (parts & io_part) {
+		io_deltas(before.volumes, after.volumes, out.get_io_stats_for_edit(), buffers);
+	}
+
+	if (parts & cpu_part) {
+		out.set_cpu_percent(cpu_percent(before, after));
+		core_deltas(before.cores, after.cores, buffers.cores, buffers);
+		out.set_cpu_cores(buffers.cores);
+		float delay_us;
+		float wait_ratio;
+		run_queue_deltas(before.run_queues, after.run_queues, buffers.run_queues, delay_us, wait_ratio, buffers);
+		out.set_run_queues(buffers.run_queues, delay_us, wait_ratio);
+		out.set_process_run_queues(after.waiting_processes);
+	}
+	if (parts & memory_part) {
+		out.set_memory_percent(memory_percent(after));
+	}
+	if (parts & process_part) {
+		out.set_process_count(after.process_count);
+	}
+	if (parts & fs_part) {
+		out.set_fs_stats(after.filesystems);
+	}
+	if (parts & numa_part) {
+		numa_deltas(before.numa_nodes, after.numa_nodes, buffers.nodes, buffers);
+		out.set_numa_stats(buffers.nodes);
+	}
+	if ((parts & net_part) && after.has_net) {
+		net_stats net;
+		// the first reading of the network is the base of its deltas
+		net_deltas(before.has_net ? before.net : after.net, after.net, net);
+		out.set_net_stats(net);
+	}
+	out.set_fresh(parts);
+}
+
+void snapshot_decoder::carry(const counter_snapshot& before, counter_snapshot& after, unsigned parts) {
+	if (!(parts & cpu_part)) {
+		after.cpu_total = before.cpu_total;
+		after.cpu_busy = before.cpu_busy;
+		after.cores = before.cores;
+		after.run_queues = before.run_queues;
+		after.waiting_processes = before.waiting_processes;
+	}
+	if (!(parts & memory_part)) {
+		after.memory_total = before.memory_total;
+		after.memory_available = before.memory_available;
+	}
+	if (!(parts & process_part)) {
+		after.process_count = before.process_count;
+	}
+	if (!(parts & io_part)) {
+		after.volumes = before.volumes;
+	}
+	if (!(parts & fs_part)) {
+		after.filesystems = before.filesystems;
+	}
+	if (!(parts & numa_part)) {
+		after.numa_nodes = before.numa_nodes;
+	}
+	if (!(parts & net_part)) {
+		after.has_net = before.has_net;
+		after.net = before.net;
+	}
+}
+
+float snapshot_decoder::cpu_percent(const counter_snapshot& before, const counter_snapshot& after) noexcept {
+	const uint64_t previous[2] = { before.cpu_total, before.cpu_busy };
+	const uint64_t current[2] = { after.cpu_total, after.cpu_busy };
+	uint64_t moved[2];
+	kernels::deltas(previous, current, moved, 2);
+
+	float res;
+	kernels::percentages(moved + 1, moved, &res, 1);
+	return res;
+}
+
+float snapshot_decoder::memory_percent(const counter_snapshot& snapshot) noexcept {
+	if (snapshot.memory_total == 0) {
+		return 0.f;
+	}
+	const uint64_t used = snapshot.memory_total - min(snapshot.memory_available, snapshot.memory_total);
+	return static_cast<float>(100.0 * static_cast<double>(used) / static_cast<double>(snapshot.memory_total));
+}
+
+void snapshot_decoder::io_deltas(const vector<volume_counters>& before,
+								 const vector<volume_counters>& after, IO_stats& out, delta_buffers& buffers) {
+	const size_t count = after.size();
+
+	// bytes read of every volume, then bytes written
+	buffers.counters.resize(4 * count);
+	buffers.narrow.resize(2 * count);
+	uint64_t* const previous = buffers.counters.data();
+	uint64_t* const current = previous + 2 * count;
+
+	for (size_t i = 0; i < count; ++i) {
+		const volume_counters& volume = after[i];
+		current[i] = volume.bytes_read;
+		current[count + i] = volume.bytes_written;
+
+		// volumes usually keep their order, so try the same index first
+		auto match = before.begin() + min(i, before.size());
+		if (match == before.end() || match->name != volume.name) {
+			match = find_if(before.begin(), before.end(),
+				[&](const volume_counters& v) { return v.name == volume.name; });
+		}
+		// one that appeared during the interval moved nothing
+		const volume_counters& base = match == before.end() ? volume : *match;
+		previous[i] = base.bytes_read;
+		previous[count + i] = base.bytes_written;
+	}
+
+	kernels::deltas(previous, current, current, 2 * count);
+	kernels::saturate(current, buffers.narrow.data(), 2 * count);
+
+	out.resize(count);
+	for (size_t i = 0; i < count; ++i) {
+		out[i].partition_name = after[i].name;
+		out[i].bytes_read = buffers.narrow[i];
+		out[i].bytes_written = buffers.narrow[count + i];
+	}
+}
+
+void snapshot_decoder::run_queue_deltas(const run_queue_counters& before, const run_queue_counters& after,
+										run_queue_stats& out, float& delay_us, float& wait_ratio,
+										delta_buffers& buffers) {
+	const size_t count = after.size();
+	// a CPU brought online during the interval has no deltas yet
+	const bool same_ids = match_ids(before.cpus, after.cpus, buffers.match);
+
+	// run_ns, wait_ns and timeslices of before, then their deltas
+	buffers.counters.resize(6 * count);
+	uint64_t* const previous = buffers.counters.data();
+	const uint64_t* const run_before = gather(before.run_ns, after.run_ns, same_ids, buffers.match, previous);
+	const uint64_t* const wait_before = gather(before.wait_ns, after.wait_ns, same_ids, buffers.match,
+		previous + count);
+	const uint64_t* const timeslices_before = gather(before.timeslices, after.timeslices, same_ids, buffers.match,
+		previous + 2 * count);
+	uint64_t* const run = previous + 3 * count;
+	uint64_t* const wait = run + count;
+	uint64_t* const timeslices = wait + count;
+	kernels::deltas(run_before, after.run_ns.data(), run, count);
+	kernels::deltas(wait_before, after.wait_ns.data(), wait, count);
+	kernels::deltas(timeslices_before, after.timeslices.data(), timeslices, count);
+
+	uint64_t total[3] = {};
+	out.resize(count);
+	copy(after.cpus.begin(), after.cpus.end(), out.cpus.begin());
+	for (size_t i = 0; i < count; ++i) {
+		// the counters of a CPU reset together, any of them going back
+		// leaves the others meaningless
+		if (after.run_ns[i] < run_before[i] || after.wait_ns[i] < wait_before[i] ||
+			after.timeslices[i] < timeslices_before[i]) {
+			run[i] = wait[i] = timeslices[i] = 0;
+		}
+
+		out.delay_us[i] = timeslices[i] == 0 ? 0.f : static_cast<float>(wait[i] / 1000.0 / timeslices[i]);
+		const uint64_t runnable = run[i] + wait[i];
+		out.wait_ratio[i] = runnable == 0 ? 0.f : static_cast<float>(static_cast<double>(wait[i]) / runnable);
+		total[0] += run[i];
+		total[1] += wait[i];
+		total[2] += timeslices[i];
+	}
+	delay_us = total[2] == 0 ? 0.f : static_cast<float>(total[1] / 1000.0 / total[2]);
+	const uint64_t runnable = total[0] + total[1];
+	wait_ratio = runnable == 0 ? 0.f : static_cast<float>(static_cast<double>(total[1]) / runnable);
+}
+
+void snapshot_decoder::core_deltas(const cpu_core_counters& before, const cpu_core_counters& after,
+								   cpu_core_stats& out, delta_buffers& buffers) {
+	const size_t count = after.size();
+	// a CPU brought online during the interval has no deltas yet
+	const bool same_ids = match_ids(before.cpus, after.cpus, buffers.match);
+
+	// a field of before, then the deltas of aperf and mperf
+	buffers.counters.resize(3 * count);
+	uint64_t* const previous = buffers.counters.data();
+	uint64_t* const aperf = previous + count;
+	uint64_t* const mperf = aperf + count;
+	out.resize(count);
+	kernels::deltas(gather(before.aperf, after.aperf, same_ids, buffers.match, previous),
+		after.aperf.data(), aperf, count);
+	kernels::deltas(gather(before.mperf, after.mperf, same_ids, buffers.match, previous),
+		after.mperf.data(), mperf, count);
+	kernels::deltas(gather(before.core_throttles, after.core_throttles, same_ids, buffers.match, previous),
+		after.core_throttles.data(), out.core_throttles.data(), count);
+	kernels::deltas(gather(before.package_throttles, after.package_throttles, same_ids, buffers.match, previous),
+		after.package_throttles.data(), out.package_throttles.data(), count);
+
+	copy(after.cpus.begin(), after.cpus.end(), out.cpus.begin());
+	copy(after.frequency_khz.begin(), after.frequency_khz.end(), out.frequency_khz.begin());
+	for (size_t i = 0; i < count; ++i) {
+		// APERF counts at the actual clock, MPERF at the base one, both
+		// only while the CPU runs
+		out.effective_frequency_khz[i] = mperf[i] == 0 ? 0 : static_cast<uint32_t>(min<double>(
+			static_cast<double>(after.base_frequency_khz[i]) * aperf[i] / mperf[i], numeric_limits<uint32_t>::max()));
+	}
+}
+
+void snapshot_decoder::net_deltas(const net_stats& before, const net_stats& after, net_stats& out) noexcept {
+	const uint64_t previous[6] = { before.tcp_retransmits, before.tcp_resets_sent, before.tcp_established_resets,
+		before.listen_overflows, before.listen_drops, before.udp_receive_buffer_errors };
+	const uint64_t current[6] = { after.tcp_retransmits, after.tcp_resets_sent, after.tcp_established_resets,
+		after.listen_overflows, after.listen_drops, after.udp_receive_buffer_errors };
+	uint64_t moved[6];
+	kernels::deltas(previous, current, moved, 6);
+
+	out = after;
+	out.tcp_retransmits = moved[0];
+	out.tcp_resets_sent = moved[1];
+	out.tcp_established_resets = moved[2];
+	out.listen_overflows = moved[3];
+	out.listen_drops = moved[4];
+	out.udp_receive_buffer_errors = moved[5];
+}
+
+void snapshot_decoder::numa_deltas(const numa_counters& before, const numa_counters& after, numa_stats& out,
+								   delta_buffers& buffers) {
+	const size_t count = after.size();
+	const bool same_ids = match_ids(before.nodes, after.nodes, buffers.match);
+
+	// a field of before, then the deltas of cpu_total, cpu_busy, numa_miss
+	// and numa_foreign and the memory used
+	buffers.counters.resize(6 * count);
+	uint64_t* const previous = buffers.counters.data();
+	uint64_t* const total = previous + count;
+	uint64_t* const busy = total + count;
+	uint64_t* const miss = busy + count;
+	uint64_t* const foreign = miss + count;
+	uint64_t* const used = foreign + count;
+	kernels::deltas(gather(before.cpu_total, after.cpu_total, same_ids, buffers.match, previous),
+		after.cpu_total.data(), total, count);
+	kernels::deltas(gather(before.cpu_busy, after.cpu_busy, same_ids, buffers.match, previous),
+		after.cpu_busy.data(), busy, count);
+	kernels::deltas(gather(before.numa_miss, after.numa_miss, same_ids, buffers.match, previous),
+		after.numa_miss.data(), miss, count);
+	kernels::deltas(gather(before.numa_foreign, after.numa_foreign, same_ids, buffers.match, previous),
+		after.numa_foreign.data(), foreign, count);
+	for (size_t i = 0; i < count; ++i) {
+		used[i] = after.memory_total[i] - min(after.memory_available[i], after.memory_total[i]);
+	}
+
+	buffers.percent.resize(2 * count);
+	float* const cpu = buffers.percent.data();
+	float* const memory = cpu + count;
+	kernels::percentages(busy, total, cpu, count);
+	kernels::percentages(used, after.memory_total.data(), memory, count);
+
+	out.resize(count);
+	for (size_t i = 0; i < count; ++i) {
+		numa_node_stat& stat = out[i];
+		stat.node = after.nodes[i];
+		stat.cpu_percent = cpu[i];
+		stat.memory_percent = memory[i];
+		stat.numa_miss = miss[i];
+		stat.numa_foreign = foreign[i];
+	}
+}
+
+namespace journal {
+
+	void encode(const counter_snapshot& snapshot, string& record) {
+		record.clear();
+		put_signed(record, snapshot.time_ms);
+		put_varint(record, snapshot.cpu_total);
+		put_varint(record, snapshot.cpu_busy);
+		put_varint(record, snapshot.memory_total);
+		put_varint(record, snapshot.memory_available);
+		put_varint(record, snapshot.process_count);
+		put_varint(record, snapshot.volumes.size());
+		for (const auto& volume : snapshot.volumes) {
+			put_varint(record, static_cast<uint64_t>(volume.name));
+			put_varint(record, volume.device.size());
+			record += volume.device;
+			put_varint(record, volume.bytes_read);
+			put_varint(record, volume.bytes_written);
+		}
+		put_varint(record, snapshot.filesystems.size());
+		for (const auto& fs : snapshot.filesystems) {
+			put_varint(record, fs.mount_point.size());
+			record += fs.mount_point;
+			put_varint(record, fs.size_bytes);
+			put_varint(record, fs.used_bytes);
+			put_varint(record, fs.available_bytes);
+			put_varint(record, fs.inodes);
+			put_varint(record, fs.inodes_used);
+		}
+		const numa_counters& nodes = snapshot.numa_nodes;
+		put_varint(record, nodes.size());
+		for (size_t i = 0; i < nodes.size(); ++i) {
+			put_varint(record, nodes.nodes[i]);
+			put_varint(record, nodes.cpu_total[i]);
+			put_varint(record, nodes.cpu_busy[i]);
+			put_varint(record, nodes.memory_total[i]);
+			put_varint(record, nodes.memory_available[i]);
+			put_varint(record, nodes.numa_miss[i]);
+			put_varint(record, nodes.numa_foreign[i]);
+		}
+		const cpu_core_counters& cores = snapshot.cores;
+		put_varint(record, cores.size());
+		for (size_t i = 0; i < cores.size(); ++i) {
+			put_varint(record, cores.cpus[i]);
+			put_varint(record, cores.frequency_khz[i]);
+			put_varint(record, cores.base_frequency_khz[i]);
+			put_varint(record, cores.aperf[i]);
+			put_varint(record, cores.mperf[i]);
+			put_varint(record, cores.core_throttles[i]);
+			put_varint(record, cores.package_throttles[i]);
+		}
+		const run_queue_counters& queues = snapshot.run_queues;
+		put_varint(record, queues.size());
+		for (size_t i = 0; i < queues.size(); ++i) {
+			put_varint(record, queues.cpus[i]);
+			put_varint(record, queues.run_ns[i]);
+			put_varint(record, queues.wait_ns[i]);
+			put_varint(record, queues.timeslices[i]);
+		}
+		put_varint(record, snapshot.waiting_processes.size());
+		for (const auto& process : snapshot.waiting_processes) {
+			put_varint(record, process.pid);
+			put_fixed(record, float_bits(process.delay_us), 4);
+			put_fixed(record, float_bits(process.wait_ratio), 4);
+		}
+		record.push_back(snapshot.has_net ? 1 : 0);
+		if (snapshot.has_net) {
+			const net_stats& net = snapshot.net;
+			put_varint(record, net.tcp_retransmits);
+			put_varint(record, net.tcp_resets_sent);
+			put_varint(record, net.tcp_established_resets);
+			put_varint(record, net.listen_overflows);
+			put_varint(record, net.listen_drops);
+			put_varint(record, net.udp_receive_buffer_errors);
+			put_varint(record, net.sockets);
+			put_varint(record, net.tcp_sockets);
+			put_varint(record, net.tcp_orphans);
+			put_varint(record, net.tcp_time_wait);
+			put_varint(record, net.udp_sockets);
+			put_varint(record, net.tcp_memory_bytes);
+			put_varint(record, net.udp_memory_bytes);
+		}
+	}
+
+	void decode(const string& record, uint16_t record_version, counter_snapshot& snapshot) {
+		if (record_version == 0 || record_version > version) {
+			throw runtime_error("unsupported snapshot journal version");
+		}
+
+		cursor c(record);
+		snapshot.time_ms = c.signed_varint();
+		snapshot.cpu_total = c.varint();
+		snapshot.cpu_busy = c.varint();
+		snapshot.memory_total = c.varint();
+		snapshot.memory_available = c.varint();
+		snapshot.process_count = clamp_unsigned(c.varint());
+		const uint64_t volumes = c.varint();
+		if (volumes > record.size()) {
+			throw runtime_error("corrupted snapshot journal: too many volumes");
+		}
+		snapshot.volumes.resize(static_cast<size_t>(volumes));
+		for (auto& volume : snapshot.volumes) {
+			volume.name = static_cast<wchar_t>(c.varint());
+			c.bytes(volume.device);
+			volume.bytes_read = c.varint();
+			volume.bytes_written = c.varint();
+		}
+
+		snapshot.filesystems.clear();
+		if (record_version >= 2) {
+			const uint64_t filesystems = c.varint();
+			if (filesystems > record.size()) {
+				throw runtime_error("corrupted snapshot journal: too many filesystems");
+			}
+			snapshot.filesystems.resize(static_cast<size_t>(filesystems));
+			for (auto& fs : snapshot.filesystems) {
+				c.bytes(fs.mount_point);
+				fs.size_bytes = c.varint();
+				fs.used_bytes = c.varint();
+				fs.available_bytes = c.varint();
+				fs.inodes = c.varint();
+				fs.inodes_used = c.varint();
+			}
+		}
+
+		snapshot.numa_nodes.clear();
+		if (record_version >= 3) {
+			const uint64_t nodes = c.varint();
+			if (nodes > record.size()) {
+				throw runtime_error("corrupted snapshot journal: too many NUMA nodes");
+			}
+			numa_counters& out = snapshot.numa_nodes;
+			out.resize(static_cast<size_t>(nodes));
+			for (size_t i = 0; i < out.size(); ++i) {
+				out.nodes[i] = clamp_unsigned(c.varint());
+				out.cpu_total[i] = c.varint();
+				out.cpu_busy[i] = c.varint();
+				out.memory_total[i] = c.varint();
+				out.memory_available[i] = c.varint();
+				out.numa_miss[i] = c.varint();
+				out.numa_foreign[i] = c.varint();
+			}
+		}
+
+		snapshot.cores.clear();
+		if (record_version >= 4) {
+			const uint64_t cores = c.varint();
+			if (cores > record.size()) {
+				throw runtime_error("corrupted snapshot journal: too many CPUs");
+			}
+			cpu_core_counters& out = snapshot.cores;
+			out.resize(static_cast<size_t>(cores));
+			for (size_t i = 0; i < out.size(); ++i) {
+				out.cpus[i] = clamp_unsigned(c.varint());
+				out.frequency_khz[i] = static_cast<uint32_t>(clamp_unsigned(c.varint()));
+				out.base_frequency_khz[i] = static_cast<uint32_t>(clamp_unsigned(c.varint()));
+				out.aperf[i] = c.varint();
+				out.mperf[i] = c.varint();
+				out.core_throttles[i] = c.varint();
+				out.package_throttles[i] = c.varint();
+			}
+		}
+
+		snapshot.run_queues.clear();
+		snapshot.waiting_processes.clear();
+		if (record_version >= 5) {
+			const uint64_t queues = c.varint();
+			if (queues > record.size()) {
+				throw runtime_error("corrupted snapshot journal: too many run queues");
+			}
+			run_queue_counters& out = snapshot.run_queues;
+			out.resize(static_cast<size_t>(queues));
+			for (size_t i = 0; i < out.size(); ++i) {
+				out.cpus[i] = clamp_unsigned(c.varint());
+				out.run_ns[i] = c.varint();
+				out.wait_ns[i] = c.varint();
+				out.timeslices[i] = c.varint();
+			}
+			const uint64_t processes = c.varint();
+			if (processes > record.size()) {
+				throw runtime_error("corrupted snapshot journal: too many waiting processes");
+			}
+			snapshot.waiting_processes.resize(static_cast<size_t>(processes));
+			for (auto& process : snapshot.waiting_processes) {
+				process.pid = clamp_unsigned(c.varint());
+				process.delay_us = bits_float(c.fixed(4));
+				process.wait_ratio = bits_float(c.fixed(4));
+			}
+		}
+
+		snapshot.has_net = record_version >= 6 && c.fixed(1) != 0;
+		snapshot.net = net_stats();
+		if (snapshot.has_net) {
+			net_stats& net = snapshot.net;
+			net.tcp_retransmits = c.varint();
+			net.tcp_resets_sent = c.varint();
+			net.tcp_established_resets = c.varint();
+			net.listen_overflows = c.varint();
+			net.listen_drops = c.varint();
+			net.udp_receive_buffer_errors = c.varint();
+			net.sockets = static_cast<uint32_t>(clamp_unsigned(c.varint()));
+			net.tcp_sockets = static_cast<uint32_t>(clamp_unsigned(c.varint()));
+			net.tcp_orphans = static_cast<uint32_t>(clamp_unsigned(c.varint()));
+			net.tcp_time_wait = static_cast<uint32_t>(clamp_unsigned(c.varint()));
+			net.udp_sockets = static_cast<uint32_t>(clamp_unsigned(c.varint()));
+			net.tcp_memory_bytes = c.varint();
+			net.udp_memory_bytes = c.varint();
+		}
+	}
+
+	writer::writer(ostream& out)
+		: out_(out) {
+		string header(file_magic, sizeof(file_magic));
+		put_fixed(header, version, 2);
+		out_.write(header.data(), header.size());
+	}
+
+	void writer::append(const counter_snapshot& snapshot) {
+		encode(snapshot, record_);
+
+		string size;
+		put_fixed(size, record_.size(), 4);
+		out_.write(size.data(), size.size());
+		out_.write(record_.data(), record_.size());
+	}
+
+	reader::reader(istream& in)
+		: in_(in)
+		, version_(0) {
+		char header[sizeof(file_magic) + 2];
+		if (!in_.read(header, sizeof(header)) || memcmp(header, file_magic, sizeof(file_magic)) != 0) {
+			throw runtime_error("not a snapshot journal");
+		}
+		version_ = static_cast<uint16_t>(static_cast<uint8_t>(header[4]) |
+			static_cast<uint8_t>(header[5]) << 8);
+		if (version_ == 0 || version_ > version) {
+			throw runtime_error("unsupported snapshot journal version");
+		}
+	}
+
+	bool reader::next(counter_snapshot& snapshot) {
+		char size_bytes[4];
+		if (!in_.read(size_bytes, sizeof(size_bytes))) {
+			if (in_.gcount() == 0) {
+				return false;
+			}
+			throw runtime_error("corrupted snapshot journal: truncated record size");
+		}
+		size_t size = 0;
+		for (size_t i = 0; i < sizeof(size_bytes); ++i) {
+			size |= static_cast<size_t>(static_cast<uint8_t>(size_bytes[i])) << (8 * i);
+		}
+		if (size > max_record_size) {
+			throw runtime_error("corrupted snapshot journal: record too large");
+		}
+
+		record_.resize(size);
+		if (size > 0 && !in_.read(&record_[0], size)) {
+			throw runtime_error("corrupted snapshot journal: truncated record");
+		}
+
+		decode(record_, version_, snapshot);
+		return true;
+	}
+
+} //namespace journal
+
+} //namespace monitor
+} //namespace crossover
@@ -0,0 +1,407 @@
+#pragma once
+
+#include "data.hpp"
+
+#include <boost/noncopyable.hpp>
+
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace crossover {
+namespace monitor {
+
+/**
+ * Raw cumulative counters of one volume.
+ */
+struct volume_counters {
+	/**
+	 * Name used in data::io_stats.
+	 */
+	wchar_t name;
+	/**
+	 * Device the counters were read from, empty if unknown.
+	 */
+	std::string device;
+	std::uint64_t bytes_read;
+	std::uint64_t bytes_written;
+};
+
+/**
+ * Raw clock and throttle counters of every CPU, as flat arrays of one
+ * value per CPU in the order of cpus, 0 where its source is missing.
+ */
+struct cpu_core_counters {
+	std::vector<unsigned> cpus;
+	std::vector<std::uint32_t> frequency_khz;
+	/**
+	 * Clock MPERF counts at, 0 if unknown.
+	 */
+	std::vector<std::uint32_t> base_frequency_khz;
+	/**
+	 * Cumulative APERF and MPERF counters.
+	 */
+	std::vector<std::uint64_t> aperf;
+	std::vector<std::uint64_t> mperf;
+	/**
+	 * Cumulative thermal throttle counts.
+	 */
+	std::vector<std::uint64_t> core_throttles;
+	std::vector<std::uint64_t> package_throttles;
+
+	std::size_t size() const noexcept {
+		return cpus.size();
+	}
+	bool empty() const noexcept {
+		return cpus.empty();
+	}
+	void resize(std::size_t count) {
+		cpus.resize(count);
+		frequency_khz.resize(count);
+		base_frequency_khz.resize(count);
+		aperf.resize(count);
+		mperf.resize(count);
+		core_throttles.resize(count);
+		package_throttles.resize(count);
+	}
+	void clear() noexcept {
+		resize(0);
+	}
+
+	bool operator==(const cpu_core_counters& rhs) const noexcept {
+		return cpus == rhs.cpus && frequency_khz == rhs.frequency_khz &&
+			base_frequency_khz == rhs.base_frequency_khz && aperf == rhs.aperf && mperf == rhs.mperf &&
+			core_throttles == rhs.core_throttles && package_throttles == rhs.package_throttles;
+	}
+	bool operator!=(const cpu_core_counters& rhs) const noexcept {
+		return !(*this == rhs);
+	}
+};
+
+/**
+ * Raw scheduler counters of every CPU, from /proc/schedstat, as flat
+ * arrays of one value per CPU in the order of cpus.
+ */
+struct run_queue_counters {
+	std::vector<unsigned> cpus;
+	/**
+	 * Cumulative nanoseconds tasks ran on the CPU and waited on its run
+	 * queue, and timeslices they ran.
+	 */
+	std::vector<std::uint64_t> run_ns;
+	std::vector<std::uint64_t> wait_ns;
+	std::vector<std::uint64_t> timeslices;
+
+	std::size_t size() const noexcept {
+		return cpus.size();
+	}
+	bool empty() const noexcept {
+		return cpus.empty();
+	}
+	void resize(std::size_t count) {
+		cpus.resize(count);
+		run_ns.resize(count);
+		wait_ns.resize(count);
+		timeslices.resize(count);
+	}
+	void clear() noexcept {
+		resize(0);
+	}
+
+	bool operator==(const run_queue_counters& rhs) const noexcept {
+		return cpus == rhs.cpus && run_ns == rhs.run_ns && wait_ns == rhs.wait_ns && timeslices == rhs.timeslices;
+	}
+	bool operator!=(const run_queue_counters& rhs) const noexcept {
+		return !(*this == rhs);
+	}
+};
+
+/**
+ * Raw counters of every NUMA node, as flat arrays of one value per node,
+ * in the order of nodes.
+ */
+struct numa_counters {
+	std::vector<unsigned> nodes;
+	/**
+	 * CPU time of the CPUs of the node since boot, as cpu_total and cpu_busy.
+	 */
+	std::vector<std::uint64_t> cpu_total;
+	std::vector<std::uint64_t> cpu_busy;
+	std::vector<std::uint64_t> memory_total;
+	std::vector<std::uint64_t> memory_available;
+	/**
+	 * Cumulative numa_miss and numa_foreign pages of the node.
+	 */
+	std::vector<std::uint64_t> numa_miss;
+	std::vector<std::uint64_t> numa_foreign;
+
+	std::size_t size() const noexcept {
+		return nodes.size();
+	}
+	bool empty() const noexcept {
+		return nodes.empty();
+	}
+	void resize(std::size_t count) {
+		nodes.resize(count);
+		cpu_total.resize(count);
+		cpu_busy.resize(count);
+		memory_total.resize(count);
+		memory_available.resize(count);
+		numa_miss.resize(count);
+		numa_foreign.resize(count);
+	}
+	void clear() noexcept {
+		resize(0);
+	}
+
+	bool operator==(const numa_counters& rhs) const noexcept {
+		return nodes == rhs.nodes && cpu_total == rhs.cpu_total && cpu_busy == rhs.cpu_busy &&
+			memory_total == rhs.memory_total && memory_available == rhs.memory_available &&
+			numa_miss == rhs.numa_miss && numa_foreign == rhs.numa_foreign;
+	}
+	bool operator!=(const numa_counters& rhs) const noexcept {
+		return !(*this == rhs);
+	}
+};
+
+/**
+ * Raw counters of the machine at one point in time, before any deltas
+ * are taken. Consecutive snapshots make one data sample, see snapshot_decoder.
+ */
+struct counter_snapshot {
+	/**
+	 * Milliseconds since 1970-01-01.
+	 */
+	std::int64_t time_ms = 0;
+	/**
+	 * CPU time since boot in any unit: all of it and the busy part.
+	 */
+	std::uint64_t cpu_total = 0;
+	std::uint64_t cpu_busy = 0;
+	/**
+	 * Every CPU in CPU order, none where they are not read. Part of the
+	 * CPU part of the samples.
+	 */
+	cpu_core_counters cores;
+	/**
+	 * Every CPU in CPU order, none where schedstat is not read. Part of
+	 * the CPU part of the samples.
+	 */
+	run_queue_counters run_queues;
+	/**
+	 * Processes that waited the longest since the previous reading,
+	 * taken as is into samples.
+	 */
+	process_run_queues waiting_processes;
+	std::uint64_t memory_total = 0;
+	std::uint64_t memory_available = 0;
+	unsigned process_count = 0;
+	std::vector<volume_counters> volumes;
+	/**
+	 * Capacity of the mounted filesystems, taken as is into samples.
+	 */
+	fs_stats filesystems;
+	/**
+	 * NUMA nodes in node order, none on a machine without NUMA.
+	 */
+	numa_counters numa_nodes;
+	/**
+	 * Events of the TCP/IP stack since boot and the sockets open now,
+	 * valid if has_net.
+	 */
+	bool has_net = false;
+	net_stats net = {};
+
+	bool operator==(const counter_snapshot& rhs) const noexcept;
+	bool operator!=(const counter_snapshot& rhs) const noexcept {
+		return !(*this == rhs);
+	}
+};
+
+/**
+ * Buffers the deltas of a sample are taken in, kept by whoever samples,
+ * a collector or a snapshot_decoder, so that sampling allocates only for
+ * more counters than it saw before.
+ */
+struct delta_buffers {
+	/**
+	 * Index in before of every entry of after matched by id.
+	 */
+	std::vector<std::size_t> match;
+	/**
+	 * Counters of before in the order of after and their deltas.
+	 */
+	std::vector<std::uint64_t> counters;
+	/**
+	 * Deltas narrowed to the unsigned of data.
+	 */
+	std::vector<unsigned> narrow;
+	/**
+	 * Percentages of the deltas, one array per field.
+	 */
+	std::vector<float> percent;
+	/**
+	 * Stats of the last sample, which data copies into the arrays it holds.
+	 */
+	cpu_core_stats cores;
+	run_queue_stats run_queues;
+	numa_stats nodes;
+};
+
+/**
+ * Turns consecutive snapshots into data samples: CPU use, run-queue delay
+ * and the clock and throttling of every CPU over the interval,
+ * memory use, filesystem capacity and open sockets at its end, the bytes
+ * moved per volume, the use of every NUMA node and the events of the
+ * TCP/IP stack during it.
+ * A counter that went backwards (reboot, volume replaced) counts as zero.
+ */
+class snapshot_decoder final {
+public:
+	snapshot_decoder();
+
+	/**
+	 * Throws std::invalid_argument if the snapshot holds values data rejects.
+	 * @return false for the first snapshot, which only sets the base
+	 * of the deltas, out is left alone then.
+	 */
+	bool decode(const counter_snapshot& snapshot, data& out);
+
+	/**
+	 * The sample between two snapshots, a pure function of them.
+	 * Throws std::invalid_argument if after holds values data rejects,
+	 * out may be partly updated then.
+	 * @param buffers scratch of the caller, see delta_buffers.
+	 * @param parts data_part bits of the parts to set, out keeps the others
+	 * and is marked fresh in these only.
+	 */
+	static void sample(const counter_snapshot& before, const counter_snapshot& after, data& out,
+					   delta_buffers& buffers, unsigned parts = all_parts);
+	/**
+	 * Copies the counters of the parts not in parts (data_part bits) from
+	 * before to after, for a snapshot that read only some of them: the next
+	 * sample of a part then takes its deltas from the last reading of it.
+	 */
+	static void carry(const counter_snapshot& before, counter_snapshot& after, unsigned parts);
+	/**
+	 * CPU use between two snapshots, 0 to 100.
+	 */
+	static float cpu_percent(const counter_snapshot& before, const counter_snapshot& after) noexcept;
+	/**
+	 * Memory use at the time of the snapshot, 0 to 100.
+	 */
+	static float memory_percent(const counter_snapshot& snapshot) noexcept;
+	/**
+	 * Bytes moved per volume of after since before, in the order of after.
+	 */
+	static void io_deltas(const std::vector<volume_counters>& before,
+						  const std::vector<volume_counters>& after, IO_stats& out, delta_buffers& buffers);
+	/**
+	 * Run-queue delay of every CPU of after since before, in the order of
+	 * after, and over all of them. A CPU whose counters went backwards, as
+	 * they may when it comes back online, moved nothing.
+	 * @param delay_us mean delay of a timeslice on any CPU.
+	 * @param wait_ratio share of the runnable time of all CPUs spent waiting.
+	 */
+	static void run_queue_deltas(const run_queue_counters& before, const run_queue_counters& after,
+								 run_queue_stats& out, float& delay_us, float& wait_ratio, delta_buffers& buffers);
+	/**
+	 * Clock and throttling of every CPU of after since before, in the
+	 * order of after.
+	 */
+	static void core_deltas(const cpu_core_counters& before, const cpu_core_counters& after, cpu_core_stats& out,
+							delta_buffers& buffers);
+	/**
+	 * Use of every NUMA node of after since before, in the order of after.
+	 */
+	static void numa_deltas(const numa_counters& before, const numa_counters& after, numa_stats& out,
+							delta_buffers& buffers);
+	/**
+	 * Events of the TCP/IP stack since before, with the sockets of after.
+	 */
+	static void net_deltas(const net_stats& before, const net_stats& after, net_stats& out) noexcept;
+
+private:
+	counter_snapshot previous_;
+	bool primed_;
+	delta_buffers buffers_;
+}; //class snapshot_decoder
+
+/**
+ * Source of recorded snapshots, oldest first.
+ */
+class snapshot_source {
+public:
+	virtual ~snapshot_source() {
+	}
+
+	/**
+	 * Throws std::runtime_error on a corrupted or truncated recording.
+	 * @return false at the end of the recording.
+	 */
+	virtual bool next(counter_snapshot& snapshot) = 0;
+}; //class snapshot_source
+
+/**
+ * Snapshot journal: "CMSJ", a format version and length prefixed records
+ * of LEB128 varints (zigzag for the time). Version 2 appends the
+ * filesystems to every record, version 3 the NUMA nodes after them,
+ * version 4 the CPUs after those, version 5 the run queues and the
+ * waiting processes and version 6 the TCP/IP stack last; older journals
+ * read without them.
+ */
+namespace journal {
+
+	/**
+	 * Format version of the records written.
+	 */
+	const std::uint16_t version = 6;
+
+	/**
+	 * Encodes snapshot into record, without the length prefix, for a
+	 * journal or any other store of snapshots.
+	 */
+	void encode(const counter_snapshot& snapshot, std::string& record);
+
+	/**
+	 * Decodes a record of encode() written at the given format version.
+	 * Throws std::runtime_error if the version is unknown or the record
+	 * corrupted.
+	 */
+	void decode(const std::string& record, std::uint16_t record_version, counter_snapshot& snapshot);
+
+	class writer final : public boost::noncopyable {
+	public:
+		/**
+		 * Writes the file header to out.
+		 */
+		explicit writer(std::ostream& out);
+
+		void append(const counter_snapshot& snapshot);
+
+	private:
+		std::ostream& out_;
+		std::string record_;
+	}; //class writer
+
+	class reader final : public snapshot_source, public boost::noncopyable {
+	public:
+		/**
+		 * Throws std::runtime_error if the stream is not a snapshot journal.
+		 */
+		explicit reader(std::istream& in);
+
+		bool next(counter_snapshot& snapshot) override;
+
+	private:
+		std::istream& in_;
+		std::string record_;
+		std::uint16_t version_;
+	}; //class reader
+
+} //namespace journal
+
+} //namespace monitor
+} //namespace crossover
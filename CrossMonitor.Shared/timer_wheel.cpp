@@ -0,0 +1,231 @@
+#include "timer_wheel.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+#if defined(_MSC_VER) && defined(_M_X64)
+#include <intrin.h>
+#endif
+
+using namespace std;
+
+namespace crossover {
+namespace monitor {
+
+namespace {
+
+	unsigned lowest_bit(uint64_t value) noexcept {
+#if defined(_MSC_VER) && defined(_M_X64)
+		unsigned long res;
+		_BitScanForward64(&res, value);
+		return res;
+#elif defined(__GNUC__)
+		return __builtin_ctzll(value);
+#else
+		unsigned res = 0;
+		while ((value & 1) == 0) {
+			value >>= 1;
+			++res;
+		}
+		return res;
+#endif
+	}
+
+	unsigned highest_bit(uint64_t value) noexcept {
+#if defined(_MSC_VER) && defined(_M_X64)
+		unsigned long res;
+		_BitScanReverse64(&res, value);
+		return res;
+#elif defined(__GNUC__)
+		return 63 - __builtin_clzll(value);
+#else
+		unsigned res = 0;
+		while (value >>= 1) {
+			++res;
+		}
+		return res;
+#endif
+	}
+
+	/**
+	 * value without its lowest shift bits, 0 if shift covers all of them.
+	 */
+	uint64_t above(uint64_t value, unsigned shift) noexcept {
+		return shift >= 64 ? 0 : value >> shift << shift;
+	}
+
+} //namespace
+
+const timer_wheel::timer_id timer_wheel::none;
+
+timer_wheel::timer_wheel(const duration& now)
+	: now_(0)
+	, size_(0)
+	, missed_(0) {
+	if (now.count() < 0) {
+		throw invalid_argument("timer wheel time cannot be negative");
+	}
+	now_ = static_cast<uint64_t>(now.count());
+	fill(begin(heads_), end(heads_), none);
+	fill(begin(occupied_), end(occupied_), 0);
+}
+
+timer_wheel::timer_id timer_wheel::add(const duration& period, const duration& phase) {
+	if (period.count() <= 0) {
+		throw invalid_argument("timer period must be positive");
+	}
+	timer_id id;
+	if (free_.empty()) {
+		id = timers_.size();
+		timers_.push_back(timer{ 0, 0, 0, none, none, none });
+	} else {
+		id = free_.back();
+		free_.pop_back();
+	}
+	schedule(id, period, phase);
+	++size_;
+	return id;
+}
+
+void timer_wheel::reschedule(timer_id id, const duration& period, const duration& phase) {
+	get(id);
+	if (period.count() <= 0) {
+		throw invalid_argument("timer period must be positive");
+	}
+	unlink(id);
+	schedule(id, period, phase);
+}
+
+void timer_wheel::remove(timer_id id) {
+	get(id);
+	unlink(id);
+	timers_[id].slot = none;
+	free_.push_back(id);
+	--size_;
+}
+
+timer_wheel::duration timer_wheel::next_due() const noexcept {
+	uint64_t start;
+	unsigned level;
+	if (!next_slot(start, level)) {
+		return duration::max();
+	}
+	if (level == 0) {
+		return duration(static_cast<duration::rep>(start));
+	}
+	// only the slot is known, not which of its timers comes first
+	uint64_t res = ~static_cast<uint64_t>(0);
+	for (timer_id id = heads_[level * slots + ((start >> (level * bits)) & (slots - 1))]; id != none;
+		id = timers_[id].next) {
+		res = min(res, timers_[id].due);
+	}
+	return duration(static_cast<duration::rep>(res));
+}
+
+size_t timer_wheel::advance(const duration& now, vector<timer_id>& due) {
+	if (now.count() < 0 || static_cast<uint64_t>(now.count()) < now_) {
+		throw invalid_argument("timer wheel cannot go back in time");
+	}
+	const uint64_t to = static_cast<uint64_t>(now.count());
+	const size_t before = due.size();
+
+	uint64_t start;
+	unsigned level;
+	while (next_slot(start, level) && start <= to) {
+		now_ = start;
+		const size_t slot = level * slots + ((start >> (level * bits)) & (slots - 1));
+		timer_id id = heads_[slot];
+		heads_[slot] = none;
+		occupied_[level] &= ~(static_cast<uint64_t>(1) << (slot & (slots - 1)));
+
+		while (id != none) {
+			timer& t = timers_[id];
+			const timer_id next = t.next;
+			if (level == 0) {
+				due.push_back(id);
+				// the due times up to to are gone, the next one is after it
+				const uint64_t skipped = (to - t.due) / t.period;
+				missed_ += skipped;
+				t.due += (skipped + 1) * t.period;
+			}
+			// moves down the levels until it falls due
+			insert(id);
+			id = next;
+		}
+	}
+	now_ = to;
+	return due.size() - before;
+}
+
+timer_wheel::timer& timer_wheel::get(timer_id id) {
+	if (id >= timers_.size() || timers_[id].slot == none) {
+		throw invalid_argument("unknown timer " + to_string(id));
+	}
+	return timers_[id];
+}
+
+void timer_wheel::schedule(timer_id id, const duration& period, const duration& phase) noexcept {
+	timer& t = timers_[id];
+	t.period = static_cast<uint64_t>(period.count());
+	const duration::rep shifted = phase.count() % period.count();
+	t.phase = static_cast<uint64_t>(shifted < 0 ? shifted + period.count() : shifted);
+	t.due = now_ < t.phase ? t.phase : t.phase + ((now_ - t.phase) / t.period + 1) * t.period;
+	insert(id);
+}
+
+void timer_wheel::insert(timer_id id) noexcept {
+	timer& t = timers_[id];
+	// a due time agreeing with now on every digit above a level and not
+	// on that one goes to that level; in the slot of now on level 0 it is
+	// due now
+	const uint64_t due = max(t.due, now_);
+	const unsigned level = due == now_ ? 0 : highest_bit(due ^ now_) / bits;
+	const unsigned index = static_cast<unsigned>((due >> (level * bits)) & (slots - 1));
+	const size_t slot = level * slots + index;
+
+	t.slot = slot;
+	t.previous = none;
+	t.next = heads_[slot];
+	if (t.next != none) {
+		timers_[t.next].previous = id;
+	}
+	heads_[slot] = id;
+	occupied_[level] |= static_cast<uint64_t>(1) << index;
+}
+
+void timer_wheel::unlink(timer_id id) noexcept {
+	timer& t = timers_[id];
+	if (t.previous != none) {
+		timers_[t.previous].next = t.next;
+	} else {
+		heads_[t.slot] = t.next;
+		if (t.next == none) {
+			occupied_[t.slot / slots] &= ~(static_cast<uint64_t>(1) << (t.slot % slots));
+		}
+	}
+	if (t.next != none) {
+		timers_[t.next].previous = t.previous;
+	}
+}
+
+bool timer_wheel::next_slot(uint64_t& start, unsigned& level) const noexcept {
+	// every timer of a level comes after those of the levels below,
+	// and on levels above 0 after the slot of now
+	for (unsigned l = 0; l < levels; ++l) {
+		const unsigned digit = static_cast<unsigned>((now_ >> (l * bits)) & (slots - 1));
+		const unsigned first = l == 0 ? digit : digit + 1;
+		if (first >= slots) {
+			continue;
+		}
+		const uint64_t ahead = occupied_[l] & (~static_cast<uint64_t>(0) << first);
+		if (ahead != 0) {
+			level = l;
+			start = above(now_, (l + 1) * bits) + (static_cast<uint64_t>(lowest_bit(ahead)) << (l * bits));
+			return true;
+		}
+	}
+	return false;
+}
+
+} //namespace monitor
+} //namespace crossover
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <boost/noncopyable.hpp>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace crossover {
+namespace monitor {
+
+/**
+ * Periodic timers on a hierarchical timing wheel, driven by whoever owns
+ * the clock: the wheel only moves when advance() is called, so it runs as
+ * well on virtual time as on the real one.
+ *
+ * Times are milliseconds on the clock of the owner. A timer falls due at
+ * every phase + k * period, so it does not drift however late advance()
+ * is called; if advance() skips several of its due times, it falls due
+ * once and the skipped ones are counted in missed().
+ *
+ * The wheel has levels of 64 slots, a slot of level n spanning 64^n
+ * milliseconds, so that adding, removing and firing a timer take constant
+ * time and advance() jumps straight to the next occupied slot however
+ * far away it is. A timer is moved down a level at most once per level
+ * before it falls due.
+ */
+class timer_wheel final : public boost::noncopyable {
+public:
+	typedef std::chrono::milliseconds duration;
+	typedef std::size_t timer_id;
+
+	/**
+	 * Throws std::invalid_argument if now is negative.
+	 * @param now time of the clock to start at.
+	 */
+	explicit timer_wheel(const duration& now = duration::zero());
+
+	/**
+	 * Adds a timer falling due at every phase + k * period, from the
+	 * first of them after now() on: the timers due at now() were handed
+	 * out by the advance() that got there.
+	 * Throws std::invalid_argument if period is not positive.
+	 */
+	timer_id add(const duration& period, const duration& phase = duration::zero());
+	/**
+	 * Moves a timer onto a new schedule, as if added again with the same id.
+	 * Throws std::invalid_argument like add() or if the timer is unknown.
+	 */
+	void reschedule(timer_id id, const duration& period, const duration& phase = duration::zero());
+	/**
+	 * The id may be given to a later timer.
+	 * Throws std::invalid_argument if the timer is unknown.
+	 */
+	void remove(timer_id id);
+
+	std::size_t size() const noexcept {
+		return size_;
+	}
+	duration now() const noexcept {
+		return duration(static_cast<duration::rep>(now_));
+	}
+	/**
+	 * When the next timer falls due, duration::max() without timers.
+	 */
+	duration next_due() const noexcept;
+	/**
+	 * Due times skipped by advance() calls coming too late, over all timers.
+	 */
+	std::uint64_t missed() const noexcept {
+		return missed_;
+	}
+
+	/**
+	 * Moves the wheel on to now and appends every timer that fell due on
+	 * the way to due, in the order of their due times. Timers falling due
+	 * at the same time are appended together.
+	 * Throws std::invalid_argument if now is before now().
+	 * @return number of timers appended.
+	 */
+	std::size_t advance(const duration& now, std::vector<timer_id>& due);
+
+private:
+	static const unsigned bits = 6;
+	static const unsigned slots = 1 << bits;
+	// enough for any 64 bit time
+	static const unsigned levels = (64 + bits - 1) / bits;
+	static const timer_id none = ~static_cast<timer_id>(0);
+
+	struct timer {
+		std::uint64_t due;
+		std::uint64_t period;
+		std::uint64_t phase;
+		// neighbours in the slot, none at the ends
+		timer_id previous;
+		timer_id next;
+		// level * slots + index, none if the id is free
+		std::size_t slot;
+	};
+
+	timer& get(timer_id id);
+	void schedule(timer_id id, const duration& period, const duration& phase) noexcept;
+	void insert(timer_id id) noexcept;
+	void unlink(timer_id id) noexcept;
+	/**
+	 * Start of the first occupied slot and its level, false without timers.
+	 */
+	bool next_slot(std::uint64_t& start, unsigned& level) const noexcept;
+
+	std::uint64_t now_;
+	std::vector<timer> timers_;
+	std::vector<timer_id> free_;
+	timer_id heads_[levels * slots];
+	std::uint64_t occupied_[levels];
+	std::size_t size_;
+	std::uint64_t missed_;
+}; //class timer_wheel
+
+} //namespace monitor
+} //namespace crossover
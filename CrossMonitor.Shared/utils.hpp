@@ -2,10 +2,20 @@
 
 #include <boost/noncopyable.hpp>
 
+#include <algorithm>
 #include <atomic>
 #include <chrono>
+#include <cstddef>
+#include <cstdlib>
 #include <functional>
 #include <ctime>
+#include <memory>
+#include <new>
+#include <utility>
+
+#if defined(_MSC_VER)
+#include <malloc.h>
+#endif
 
 namespace crossover {
 namespace monitor {
@@ -61,6 +71,69 @@ namespace utils {
 		std::function<void(void)> f_;
 	};
 
+	/**
+	 * Allocates size bytes aligned to alignment, a power of two.
+	 * Throws std::bad_alloc if out of memory.
+	 */
+	inline void* aligned_allocate(std::size_t alignment, std::size_t size) {
+		// posix_memalign takes no less than the alignment of a pointer
+		alignment = std::max(alignment, sizeof(void*));
+#if defined(_MSC_VER)
+		void* const p = _aligned_malloc(size, alignment);
+		if (p == nullptr) {
+			throw std::bad_alloc();
+		}
+		return p;
+#else
+		void* p;
+		if (posix_memalign(&p, alignment, size) != 0) {
+			throw std::bad_alloc();
+		}
+		return p;
+#endif
+	}
+
+	/**
+	 * Frees memory of aligned_allocate(), nullptr is ignored.
+	 */
+	inline void aligned_free(void* p) noexcept {
+#if defined(_MSC_VER)
+		_aligned_free(p);
+#else
+		std::free(p);
+#endif
+	}
+
+	/**
+	 * Deleter of the objects of make_aligned().
+	 */
+	template <typename T>
+	struct aligned_delete {
+		void operator()(T* p) const noexcept {
+			p->~T();
+			aligned_free(p);
+		}
+	};
+
+	template <typename T>
+	using aligned_ptr = std::unique_ptr<T, aligned_delete<T>>;
+
+	/**
+	 * new for types aligned beyond what operator new guarantees before
+	 * C++17, such as those that keep members on their own cache lines.
+	 * Throws std::bad_alloc if out of memory, or what the constructor throws.
+	 */
+	template <typename T, typename... Args>
+	aligned_ptr<T> make_aligned(Args&&... args) {
+		void* const p = aligned_allocate(alignof(T), sizeof(T));
+		try {
+			return aligned_ptr<T>(new (p) T(std::forward<Args>(args)...));
+		} catch (...) {
+			aligned_free(p);
+			throw;
+		}
+	}
+
 } //namespace utils
 } //namespace monitor
 } //namespace crossover